@@ -0,0 +1,2 @@
+﻿#define ALLOC_TRACKER_IMPLEMENTATION
+#include "AllocTracker.h"
@@ -0,0 +1,264 @@
+#pragma once
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+#include <Trace.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Heap allocation counts per frame, per thread and per site. With ALLOC_TRACKING=1 the global operator new and
+// delete are replaced (in alloc_tracker.cpp, which defines ALLOC_TRACKER_IMPLEMENTATION) by versions that count
+// allocations, frees and requested bytes before going to malloc. A site is the innermost TRACE_ZONE or
+// PROFILE_ZONE open on the allocating thread. Counters live in a per-thread record with one writer, so the hook
+// takes no lock and does not allocate; records come from malloc and are never freed. end_frame() turns the
+// running totals into the last frame's deltas without allocating itself, so a steady-state frame can be
+// checked to be exactly zero. Set ALLOC_TRACKING the same way for every file of the build.
+
+#ifndef ALLOC_TRACKING
+#define ALLOC_TRACKING 0
+#endif
+
+constexpr size_t alloc_max_sites = 64;// per thread; allocations past a full table count in the totals only
+
+struct AllocCount {
+  uint64_t allocations;
+  uint64_t frees;
+  uint64_t bytes;// requested by the allocations
+};
+
+struct AllocSiteStats {
+  const char *site;// zone name, "(no zone)" outside any
+  AllocCount count;
+};
+
+struct AllocThreadStats {
+  const char *name;// from TRACE_THREAD_NAME, nullptr if never named
+  uint32_t id;
+  AllocCount count;
+};
+
+struct AllocThreadRecord {
+  std::atomic<const char *> name{nullptr};
+  uint32_t id = 0;
+  std::atomic<uint64_t> allocations{0}, frees{0}, bytes{0};
+  std::atomic<const char *> sites[alloc_max_sites]{};
+  std::atomic<uint64_t> site_allocations[alloc_max_sites]{}, site_bytes[alloc_max_sites]{};
+  AllocThreadRecord *next = nullptr;
+  // totals at the last end_frame; only the frame-ending thread touches these
+  AllocCount seen{0, 0, 0};
+  uint64_t seen_site_allocations[alloc_max_sites]{}, seen_site_bytes[alloc_max_sites]{};
+};
+
+namespace alloc_detail {
+inline std::atomic<AllocThreadRecord *> &records() {
+  static std::atomic<AllocThreadRecord *> head{nullptr};
+  return head;
+}
+// the calling thread's record, from malloc on first use so the hook never re-enters itself
+inline AllocThreadRecord *this_thread_record() {
+  thread_local AllocThreadRecord *record = nullptr;
+  if (!record) {
+    static std::atomic<uint32_t> next_id{1};
+    void *memory = std::malloc(sizeof(AllocThreadRecord));
+    if (!memory) return nullptr;
+    record = new (memory) AllocThreadRecord();
+    record->id = next_id.fetch_add(1, std::memory_order_relaxed);
+    record->next = records().load(std::memory_order_relaxed);
+    while (!records().compare_exchange_weak(record->next, record, std::memory_order_release, std::memory_order_relaxed)) {}
+  }
+  return record;
+}
+// single writer: a relaxed load and store is enough and cheaper than fetch_add
+inline void bump(std::atomic<uint64_t> &counter, const uint64_t by) { counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed); }
+
+inline void on_alloc(const size_t size) {
+  AllocThreadRecord *record = this_thread_record();
+  if (!record) return;
+  record->name.store(trace_detail::thread_label(), std::memory_order_relaxed);
+  bump(record->allocations, 1);
+  bump(record->bytes, size);
+  const char *site = trace_detail::current_zone() ? trace_detail::current_zone() : "(no zone)";
+  // open addressing on the name pointer; names are literals, so one pointer per site
+  const size_t start = (reinterpret_cast<uintptr_t>(site) >> 3) % alloc_max_sites;
+  for (size_t i = 0; i < alloc_max_sites; ++i) {
+    const size_t slot = (start + i) % alloc_max_sites;
+    const char *held = record->sites[slot].load(std::memory_order_relaxed);
+    if (!held) record->sites[slot].store(held = site, std::memory_order_release);
+    if (held != site) continue;
+    bump(record->site_allocations[slot], 1);
+    bump(record->site_bytes[slot], size);
+    return;
+  }
+}
+inline void on_free() {
+  if (AllocThreadRecord *record = this_thread_record()) bump(record->frees, 1);
+}
+}// namespace alloc_detail
+
+class AllocTracker {
+ public:
+  static constexpr size_t max_threads = 64;// threads listed per frame; all of them count in the frame total
+
+  AllocTracker() {
+    threads.reserve(max_threads);
+    sites.reserve(alloc_max_sites);
+  }
+
+  // closes a frame: the last frame's counts are everything since the previous call, on every thread
+  void end_frame() {
+    frame = {0, 0, 0};
+    threads.clear();
+    sites.clear();
+    for (AllocThreadRecord *r = alloc_detail::records().load(std::memory_order_acquire); r; r = r->next) {
+      const AllocCount now{r->allocations.load(std::memory_order_relaxed), r->frees.load(std::memory_order_relaxed), r->bytes.load(std::memory_order_relaxed)};
+      const AllocCount delta{now.allocations - r->seen.allocations, now.frees - r->seen.frees, now.bytes - r->seen.bytes};
+      r->seen = now;
+      frame.allocations += delta.allocations;
+      frame.frees += delta.frees;
+      frame.bytes += delta.bytes;
+      if ((delta.allocations || delta.frees) && threads.size() < max_threads) threads.push_back({r->name.load(std::memory_order_relaxed), r->id, delta});
+      for (size_t slot = 0; slot < alloc_max_sites; ++slot) {
+        const char *site = r->sites[slot].load(std::memory_order_acquire);
+        if (!site) continue;
+        const uint64_t allocations = r->site_allocations[slot].load(std::memory_order_relaxed), bytes = r->site_bytes[slot].load(std::memory_order_relaxed);
+        const AllocCount site_delta{allocations - r->seen_site_allocations[slot], 0, bytes - r->seen_site_bytes[slot]};
+        r->seen_site_allocations[slot] = allocations;
+        r->seen_site_bytes[slot] = bytes;
+        if (!site_delta.allocations) continue;
+        // the same zone on several threads is one site
+        auto it = std::find_if(sites.begin(), sites.end(), [site](const AllocSiteStats &s) { return s.site == site; });
+        if (it != sites.end()) {
+          it->count.allocations += site_delta.allocations;
+          it->count.bytes += site_delta.bytes;
+        } else if (sites.size() < alloc_max_sites) {
+          sites.push_back({site, site_delta});
+        }
+      }
+    }
+    std::sort(sites.begin(), sites.end(), [](const AllocSiteStats &a, const AllocSiteStats &b) { return a.count.allocations > b.count.allocations; });
+    ++frames;
+    peak_allocations = std::max(peak_allocations, frame.allocations);
+    if (frame.allocations) ++allocating;
+  }
+
+  const AllocCount &last_frame() const { return frame; }
+  const std::vector<AllocThreadStats> &last_frame_threads() const { return threads; }
+  const std::vector<AllocSiteStats> &last_frame_sites() const { return sites; }// most allocations first
+  size_t frame_count() const { return frames; }
+  size_t allocating_frames() const { return allocating; }
+  uint64_t peak_frame_allocations() const { return peak_allocations; }
+
+ private:
+  AllocCount frame{0, 0, 0};
+  std::vector<AllocThreadStats> threads;
+  std::vector<AllocSiteStats> sites;
+  size_t frames = 0, allocating = 0;
+  uint64_t peak_allocations = 0;
+};
+
+inline AllocTracker &alloc_tracker() {
+  static AllocTracker instance;
+  return instance;
+}
+
+// the calling thread's running totals
+inline AllocCount this_thread_allocations() {
+  const AllocThreadRecord *r = alloc_detail::this_thread_record();
+  if (!r) return {0, 0, 0};
+  return {r->allocations.load(std::memory_order_relaxed), r->frees.load(std::memory_order_relaxed), r->bytes.load(std::memory_order_relaxed)};
+}
+
+// reports when the enclosing scope allocated on this thread; for code that must stay allocation free once warm
+class AllocFreeScope {
+ public:
+  explicit AllocFreeScope(const char *label) : label(label), start(this_thread_allocations()) {}
+  ~AllocFreeScope() {
+    const uint64_t allocations = this_thread_allocations().allocations - start.allocations;
+    if (ALLOC_TRACKING && allocations) std::printf("ERROR::ALLOC::UNEXPECTED %s made %llu allocations\n", label, static_cast<unsigned long long>(allocations));
+  }
+  AllocFreeScope(const AllocFreeScope &) = delete;
+  AllocFreeScope &operator=(const AllocFreeScope &) = delete;
+
+ private:
+  const char *label;
+  AllocCount start;
+};
+
+#endif
+
+#if defined(ALLOC_TRACKER_IMPLEMENTATION) && ALLOC_TRACKING && !defined(ALLOC_TRACKER_IMPLEMENTED)
+#define ALLOC_TRACKER_IMPLEMENTED
+#pragma region counting operator new and delete
+namespace alloc_detail {
+inline void *aligned_malloc(const size_t size, const std::align_val_t alignment) {
+  const size_t align = static_cast<size_t>(alignment);
+#ifdef _WIN32
+  return _aligned_malloc(size ? size : 1, align);
+#else
+  return std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align);
+#endif
+}
+inline void aligned_free(void *p) {
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  std::free(p);
+#endif
+}
+}// namespace alloc_detail
+
+void *operator new(const std::size_t size) {
+  void *p = std::malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  alloc_detail::on_alloc(size);
+  return p;
+}
+void *operator new[](const std::size_t size) { return operator new(size); }
+void *operator new(const std::size_t size, const std::nothrow_t &) noexcept {
+  void *p = std::malloc(size ? size : 1);
+  if (p) alloc_detail::on_alloc(size);
+  return p;
+}
+void *operator new[](const std::size_t size, const std::nothrow_t &tag) noexcept { return operator new(size, tag); }
+void operator delete(void *p) noexcept {
+  if (!p) return;
+  alloc_detail::on_free();
+  std::free(p);
+}
+void operator delete[](void *p) noexcept { operator delete(p); }
+void operator delete(void *p, std::size_t) noexcept { operator delete(p); }
+void operator delete[](void *p, std::size_t) noexcept { operator delete(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { operator delete(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { operator delete(p); }
+
+void *operator new(const std::size_t size, const std::align_val_t alignment) {
+  void *p = alloc_detail::aligned_malloc(size, alignment);
+  if (!p) throw std::bad_alloc();
+  alloc_detail::on_alloc(size);
+  return p;
+}
+void *operator new[](const std::size_t size, const std::align_val_t alignment) { return operator new(size, alignment); }
+void *operator new(const std::size_t size, const std::align_val_t alignment, const std::nothrow_t &) noexcept {
+  void *p = alloc_detail::aligned_malloc(size, alignment);
+  if (p) alloc_detail::on_alloc(size);
+  return p;
+}
+void *operator new[](const std::size_t size, const std::align_val_t alignment, const std::nothrow_t &tag) noexcept { return operator new(size, alignment, tag); }
+void operator delete(void *p, std::align_val_t) noexcept {
+  if (!p) return;
+  alloc_detail::on_free();
+  alloc_detail::aligned_free(p);
+}
+void operator delete[](void *p, const std::align_val_t alignment) noexcept { operator delete(p, alignment); }
+void operator delete(void *p, std::size_t, const std::align_val_t alignment) noexcept { operator delete(p, alignment); }
+void operator delete[](void *p, std::size_t, const std::align_val_t alignment) noexcept { operator delete(p, alignment); }
+void operator delete(void *p, const std::align_val_t alignment, const std::nothrow_t &) noexcept { operator delete(p, alignment); }
+void operator delete[](void *p, const std::align_val_t alignment, const std::nothrow_t &) noexcept { operator delete(p, alignment); }
+#pragma endregion
+#endif
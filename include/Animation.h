@@ -0,0 +1,404 @@
+#pragma once
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <LockFreeCell.h>
+#include <Trace.h>
+
+#include <assimp/scene.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ANIMATION_SSE2 1
+#else
+#define ANIMATION_SSE2 0
+#endif
+
+// Skeletal and morph animation, CPU side: skeleton and clips imported from assimp, keyframe sampling, the bone
+// palette, and CPU skinning for when the GPU path (shader/skinned.vs, Skinning.h) is not available.
+// Sampling runs on an AnimationPlayer thread; the frame loop only picks up the latest AnimationPose.
+
+constexpr int max_bones = 100;// must match MAX_BONES in shader/skinned.vs
+constexpr int max_morph_targets = 8;
+
+struct BoneInfo {
+  int id;           // index into the palette
+  glm::mat4 offset; // mesh space -> bone space
+};
+
+inline glm::mat4 to_glm(const aiMatrix4x4 &m) {
+  // assimp is row major
+  return glm::mat4(m.a1, m.b1, m.c1, m.d1, m.a2, m.b2, m.c2, m.d2, m.a3, m.b3, m.c3, m.d3, m.a4, m.b4, m.c4, m.d4);
+}
+
+#pragma region skeleton and clips
+// node hierarchy flattened so parents come before their children
+struct SkeletonNode {
+  std::string name;
+  glm::mat4 transform;// bind pose, relative to the parent
+  int parent;         // -1 for the root
+  int bone;           // palette index, -1 for nodes that only carry transforms
+};
+
+struct Skeleton {
+  std::vector<SkeletonNode> nodes;
+  std::vector<glm::mat4> bone_offsets;
+  glm::mat4 global_inverse{1.0f};
+
+  int bone_count() const { return static_cast<int>(bone_offsets.size()); }
+  int find(const std::string &name) const {
+    for (size_t i = 0; i < nodes.size(); ++i)
+      if (nodes[i].name == name) return static_cast<int>(i);
+    return -1;
+  }
+};
+
+inline Skeleton build_skeleton(const aiNode *root, const std::map<std::string, BoneInfo> &bones) {
+  Skeleton skeleton;
+  skeleton.global_inverse = glm::inverse(to_glm(root->mTransformation));
+  skeleton.bone_offsets.assign(bones.size(), glm::mat4(1.0f));
+  for (const auto &bone : bones) skeleton.bone_offsets[bone.second.id] = bone.second.offset;
+  std::vector<std::pair<const aiNode *, int>> stack{{root, -1}};
+  while (!stack.empty()) {
+    const aiNode *node = stack.back().first;
+    const int parent = stack.back().second;
+    stack.pop_back();
+    const auto bone = bones.find(node->mName.C_Str());
+    skeleton.nodes.push_back({node->mName.C_Str(), to_glm(node->mTransformation), parent, bone != bones.end() ? bone->second.id : -1});
+    const int index = static_cast<int>(skeleton.nodes.size()) - 1;
+    for (unsigned int i = node->mNumChildren; i-- > 0;) stack.emplace_back(node->mChildren[i], index);
+  }
+  return skeleton;
+}
+
+template <typename T>
+struct AnimationKey {
+  double time;// ticks
+  T value;
+};
+
+struct NodeChannel {
+  int node;
+  std::vector<AnimationKey<glm::vec3>> positions;
+  std::vector<AnimationKey<glm::quat>> rotations;
+  std::vector<AnimationKey<glm::vec3>> scales;
+};
+
+struct MorphKey {
+  double time;
+  float weights[max_morph_targets];
+};
+
+struct AnimationClip {
+  std::string name;
+  double duration = 0.0;// ticks
+  double ticks_per_second = 25.0;
+  std::vector<NodeChannel> channels;
+  std::vector<MorphKey> morph_keys;// first morph channel of the clip
+  int morph_targets = 0;
+
+  double seconds() const { return duration / ticks_per_second; }
+};
+
+inline AnimationClip load_animation_clip(const aiAnimation *animation, const Skeleton &skeleton) {
+  AnimationClip clip;
+  clip.name = animation->mName.C_Str();
+  clip.duration = animation->mDuration;
+  clip.ticks_per_second = animation->mTicksPerSecond > 0.0 ? animation->mTicksPerSecond : 25.0;
+  for (unsigned int c = 0; c < animation->mNumChannels; ++c) {
+    const aiNodeAnim *source = animation->mChannels[c];
+    NodeChannel channel;
+    channel.node = skeleton.find(source->mNodeName.C_Str());
+    if (channel.node < 0) {
+      std::cout << "ERROR::ANIMATION::UNKNOWN_NODE " << source->mNodeName.C_Str() << std::endl;
+      continue;
+    }
+    for (unsigned int k = 0; k < source->mNumPositionKeys; ++k) {
+      const aiVectorKey &key = source->mPositionKeys[k];
+      channel.positions.push_back({key.mTime, glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z)});
+    }
+    for (unsigned int k = 0; k < source->mNumRotationKeys; ++k) {
+      const aiQuatKey &key = source->mRotationKeys[k];
+      channel.rotations.push_back({key.mTime, glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z)});
+    }
+    for (unsigned int k = 0; k < source->mNumScalingKeys; ++k) {
+      const aiVectorKey &key = source->mScalingKeys[k];
+      channel.scales.push_back({key.mTime, glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z)});
+    }
+    clip.channels.push_back(std::move(channel));
+  }
+  if (animation->mNumMorphMeshChannels > 0) {
+    const aiMeshMorphAnim *morph = animation->mMorphMeshChannels[0];
+    for (unsigned int k = 0; k < morph->mNumKeys; ++k) {
+      const aiMeshMorphKey &source = morph->mKeys[k];
+      MorphKey key{source.mTime, {}};
+      for (unsigned int v = 0; v < source.mNumValuesAndWeights; ++v)
+        if (source.mValues[v] < static_cast<unsigned int>(max_morph_targets)) {
+          key.weights[source.mValues[v]] = static_cast<float>(source.mWeights[v]);
+          clip.morph_targets = std::max(clip.morph_targets, static_cast<int>(source.mValues[v]) + 1);
+        }
+      clip.morph_keys.push_back(key);
+    }
+  }
+  return clip;
+}
+#pragma endregion
+
+#pragma region sampling
+// what the renderer needs from one sampled instant; trivially copyable so it fits a LockFreeCell
+struct AnimationPose {
+  int clip;
+  double time;// seconds into the clip
+  int bone_count;
+  glm::mat4 bones[max_bones];// palette: mesh space -> posed mesh space
+  int morph_count;
+  float morph_weights[max_morph_targets];
+};
+
+// Samples clips into poses. Every channel keeps the key it used last, so playing forward finds the next key
+// in O(1) instead of searching the whole track; jumping back (loop, scrub) falls back to a binary search.
+class AnimationSampler {
+ public:
+  explicit AnimationSampler(const Skeleton &skeleton) : skeleton(skeleton), locals(skeleton.nodes.size()), globals(skeleton.nodes.size()) {}
+
+  void sample(const AnimationClip &clip, const int clip_index, const double seconds, AnimationPose &pose) {
+    if (clip_index != cursor_clip) {
+      cursors.assign(clip.channels.size(), Cursor{});
+      morph_cursor = 0;
+      cursor_clip = clip_index;
+    }
+    const double ticks = clip.duration > 0.0 ? std::fmod(std::max(seconds, 0.0) * clip.ticks_per_second, clip.duration) : 0.0;
+    for (size_t n = 0; n < skeleton.nodes.size(); ++n) locals[n] = skeleton.nodes[n].transform;
+    for (size_t c = 0; c < clip.channels.size(); ++c) {
+      const NodeChannel &channel = clip.channels[c];
+      Cursor &cursor = cursors[c];
+      const glm::vec3 t = interpolate(channel.positions, ticks, cursor.position, glm::vec3(0.0f));
+      const glm::quat r = interpolate(channel.rotations, ticks, cursor.rotation, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+      const glm::vec3 s = interpolate(channel.scales, ticks, cursor.scale, glm::vec3(1.0f));
+      locals[channel.node] = glm::translate(glm::mat4(1.0f), t) * glm::mat4_cast(r) * glm::scale(glm::mat4(1.0f), s);
+    }
+    pose.clip = clip_index;
+    pose.time = seconds;
+    pose.bone_count = std::min(skeleton.bone_count(), max_bones);
+    for (size_t n = 0; n < skeleton.nodes.size(); ++n) {
+      const SkeletonNode &node = skeleton.nodes[n];
+      globals[n] = node.parent >= 0 ? globals[node.parent] * locals[n] : locals[n];
+      if (node.bone >= 0 && node.bone < max_bones) pose.bones[node.bone] = skeleton.global_inverse * globals[n] * skeleton.bone_offsets[node.bone];
+    }
+    pose.morph_count = clip.morph_targets;
+    std::fill(std::begin(pose.morph_weights), std::end(pose.morph_weights), 0.0f);
+    if (!clip.morph_keys.empty()) {
+      const size_t k = seek(clip.morph_keys, ticks, morph_cursor);
+      const MorphKey &a = clip.morph_keys[k], &b = clip.morph_keys[std::min(k + 1, clip.morph_keys.size() - 1)];
+      const float f = b.time > a.time ? static_cast<float>((ticks - a.time) / (b.time - a.time)) : 0.0f;
+      for (int m = 0; m < clip.morph_targets; ++m) pose.morph_weights[m] = a.weights[m] + (b.weights[m] - a.weights[m]) * f;
+    }
+  }
+
+  // the bind pose, for meshes that have bones but no clip playing
+  void bind_pose(AnimationPose &pose) {
+    pose.clip = -1;
+    pose.time = 0.0;
+    pose.bone_count = std::min(skeleton.bone_count(), max_bones);
+    for (size_t n = 0; n < skeleton.nodes.size(); ++n) {
+      const SkeletonNode &node = skeleton.nodes[n];
+      globals[n] = node.parent >= 0 ? globals[node.parent] * node.transform : node.transform;
+      if (node.bone >= 0 && node.bone < max_bones) pose.bones[node.bone] = skeleton.global_inverse * globals[n] * skeleton.bone_offsets[node.bone];
+    }
+    pose.morph_count = 0;
+  }
+
+ private:
+  struct Cursor {
+    size_t position = 0, rotation = 0, scale = 0;
+  };
+
+  const Skeleton &skeleton;
+  std::vector<glm::mat4> locals, globals;
+  std::vector<Cursor> cursors;
+  size_t morph_cursor = 0;
+  int cursor_clip = -1;
+
+  // index of the last key at or before `ticks`, starting from the cached cursor
+  template <typename Key>
+  static size_t seek(const std::vector<Key> &keys, const double ticks, size_t &cursor) {
+    if (cursor >= keys.size() || keys[cursor].time > ticks) {
+      const auto after = std::upper_bound(keys.begin(), keys.end(), ticks, [](const double t, const Key &k) { return t < k.time; });
+      cursor = after == keys.begin() ? 0 : static_cast<size_t>(after - keys.begin()) - 1;
+    }
+    while (cursor + 1 < keys.size() && keys[cursor + 1].time <= ticks) ++cursor;
+    return cursor;
+  }
+
+  static glm::vec3 mix_value(const glm::vec3 &a, const glm::vec3 &b, const float f) { return glm::mix(a, b, f); }
+  static glm::quat mix_value(const glm::quat &a, const glm::quat &b, const float f) { return glm::normalize(glm::slerp(a, b, f)); }
+
+  template <typename T>
+  static T interpolate(const std::vector<AnimationKey<T>> &keys, const double ticks, size_t &cursor, const T &fallback) {
+    if (keys.empty()) return fallback;
+    const size_t k = seek(keys, ticks, cursor);
+    if (k + 1 >= keys.size()) return keys[k].value;
+    const double span = keys[k + 1].time - keys[k].time;
+    const float f = span > 0.0 ? static_cast<float>(glm::clamp((ticks - keys[k].time) / span, 0.0, 1.0)) : 0.0f;
+    return mix_value(keys[k].value, keys[k + 1].value, f);
+  }
+};
+#pragma endregion
+
+#pragma region cpu skinning
+// positions/normals of vertices [first, end): morph targets blended in first, then up to four bones.
+// The bone matrices are blended with SSE, one column per register, and renormalized when a vertex lost
+// influences on import; vertices without weights stay put.
+inline void skin_vertices(const glm::vec3 *rest_positions, const glm::vec3 *rest_normals, const glm::ivec4 *bone_ids, const glm::vec4 *bone_weights, const std::vector<std::vector<glm::vec3>> &morph_deltas,
+                          const AnimationPose &pose, const size_t first, const size_t end, glm::vec3 *out_positions, glm::vec3 *out_normals) {
+  const int morphs = std::min(pose.morph_count, static_cast<int>(morph_deltas.size()));
+  for (size_t v = first; v < end; ++v) {
+    glm::vec3 p = rest_positions[v];
+    for (int m = 0; m < morphs; ++m)
+      if (pose.morph_weights[m] != 0.0f) p += pose.morph_weights[m] * morph_deltas[m][v];
+    const glm::vec3 &n = rest_normals[v];
+    const glm::ivec4 &ids = bone_ids[v];
+    const glm::vec4 &w = bone_weights[v];
+#if ANIMATION_SSE2
+    __m128 c0 = _mm_setzero_ps(), c1 = c0, c2 = c0, c3 = c0;
+    float total = 0.0f;
+    for (int i = 0; i < 4; ++i) {
+      if (ids[i] < 0 || ids[i] >= pose.bone_count || w[i] == 0.0f) continue;
+      const float *m = &pose.bones[ids[i]][0][0];
+      const __m128 weight = _mm_set1_ps(w[i]);
+      c0 = _mm_add_ps(c0, _mm_mul_ps(weight, _mm_loadu_ps(m)));
+      c1 = _mm_add_ps(c1, _mm_mul_ps(weight, _mm_loadu_ps(m + 4)));
+      c2 = _mm_add_ps(c2, _mm_mul_ps(weight, _mm_loadu_ps(m + 8)));
+      c3 = _mm_add_ps(c3, _mm_mul_ps(weight, _mm_loadu_ps(m + 12)));
+      total += w[i];
+    }
+    if (total == 0.0f) {
+      out_positions[v] = p;
+      out_normals[v] = n;
+      continue;
+    }
+    const __m128 inv_total = _mm_set1_ps(1.0f / total);
+    c0 = _mm_mul_ps(c0, inv_total);
+    c1 = _mm_mul_ps(c1, inv_total);
+    c2 = _mm_mul_ps(c2, inv_total);
+    c3 = _mm_mul_ps(c3, inv_total);
+    alignas(16) float r[4];
+    _mm_store_ps(r, _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(p.x)), _mm_mul_ps(c1, _mm_set1_ps(p.y))), _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(p.z)), c3)));
+    out_positions[v] = glm::vec3(r[0], r[1], r[2]);
+    _mm_store_ps(r, _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(n.x)), _mm_mul_ps(c1, _mm_set1_ps(n.y))), _mm_mul_ps(c2, _mm_set1_ps(n.z))));
+    out_normals[v] = glm::normalize(glm::vec3(r[0], r[1], r[2]));
+#else
+    glm::mat4 m(0.0f);
+    float total = 0.0f;
+    for (int i = 0; i < 4; ++i) {
+      if (ids[i] < 0 || ids[i] >= pose.bone_count || w[i] == 0.0f) continue;
+      m += w[i] * pose.bones[ids[i]];
+      total += w[i];
+    }
+    if (total == 0.0f) {
+      out_positions[v] = p;
+      out_normals[v] = n;
+      continue;
+    }
+    m /= total;
+    out_positions[v] = glm::vec3(m * glm::vec4(p, 1.0f));
+    out_normals[v] = glm::normalize(glm::vec3(m * glm::vec4(n, 0.0f)));
+#endif
+  }
+}
+#pragma endregion
+
+#pragma region player thread
+// what the frame loop wants played; phase >= 0 scrubs to that share of the clip instead of playing in real time
+struct AnimationControl {
+  int clip;
+  float speed;
+  float phase;
+};
+
+// Samples the current clip at a fixed rate on its own thread and publishes the latest pose. Sampling, the node
+// hierarchy walk and the palette are then off the frame loop, which only copies the pose out.
+class AnimationPlayer {
+ public:
+  AnimationPlayer(const Skeleton &skeleton, const std::vector<AnimationClip> &clips, const double rate = 120.0) : clips(clips), rate(rate), sampler(skeleton) {
+    control.store({clips.empty() ? -1 : 0, 1.0f, -1.0f});
+    sampler.bind_pose(scratch);
+    pose.store(scratch);
+  }
+  ~AnimationPlayer() { stop(); }
+  AnimationPlayer(const AnimationPlayer &) = delete;
+  AnimationPlayer &operator=(const AnimationPlayer &) = delete;
+
+  LockFreeCell<AnimationControl> control;
+  LockFreeCell<AnimationPose> pose;
+
+  void start() {
+    if (running.exchange(true)) return;
+    worker = std::thread([this] { run(); });
+  }
+  void stop() {
+    running = false;
+    if (worker.joinable()) worker.join();
+  }
+
+  // one sampling step, also usable without the thread
+  void advance(const double dt) {
+    AnimationControl c;
+    control.load(c);
+    if (c.clip < 0 || c.clip >= static_cast<int>(clips.size())) {
+      sampler.bind_pose(scratch);
+    } else {
+      const AnimationClip &clip = clips[c.clip];
+      if (c.clip != playing) {
+        playing = c.clip;
+        seconds = 0.0;
+      }
+      seconds = c.phase >= 0.0f ? static_cast<double>(c.phase) * clip.seconds() : seconds + dt * c.speed;
+      if (clip.seconds() > 0.0) seconds = std::fmod(seconds, clip.seconds());
+      sampler.sample(clip, c.clip, seconds, scratch);
+    }
+    pose.store(scratch);
+  }
+
+ private:
+  const std::vector<AnimationClip> &clips;
+  const double rate;
+  AnimationSampler sampler;
+  AnimationPose scratch{};
+  int playing = -1;
+  double seconds = 0.0;
+  std::atomic<bool> running{false};
+  std::thread worker;
+
+  void run() {
+    using clock = std::chrono::steady_clock;
+    const auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / rate));
+    auto next = clock::now();
+    TRACE_THREAD_NAME("animation");
+    while (running.load(std::memory_order_relaxed)) {
+      next += period;
+      {
+        TRACE_ZONE("animate");
+        advance(1.0 / rate);
+      }
+      std::this_thread::sleep_until(next);
+    }
+  }
+};
+#pragma endregion
+
+#endif
@@ -0,0 +1,778 @@
+#pragma once
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COLLISION_SSE2 1
+#else
+#define COLLISION_SSE2 0
+#endif
+
+// CPU collision queries against triangle meshes (the vertebra models) for haptics and contact states.
+//
+// TriangleBvh is a 4-wide BVH: every node stores the bounds of its four children as SoA float[4] rows so one
+// SSE compare tests all four boxes. It is built with binned SAH over a binary tree which is then collapsed.
+// Triangles are copied in leaf order, so a leaf is one contiguous run. refit() recomputes bounds for deformed
+// vertices without rebuilding; rigidly moving geometry (instruments) is handled by transforming the query into
+// the mesh's local space instead, which costs nothing per frame.
+
+#pragma region geometry helpers
+struct Aabb {
+  glm::vec3 min{FLT_MAX};
+  glm::vec3 max{-FLT_MAX};
+
+  void grow(const glm::vec3 &p) {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  }
+  void grow(const Aabb &b) {
+    min = glm::min(min, b.min);
+    max = glm::max(max, b.max);
+  }
+  bool valid() const { return min.x <= max.x; }
+  float area() const {
+    if (!valid()) return 0.0f;
+    const glm::vec3 e = max - min;
+    return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+  }
+  glm::vec3 center() const { return 0.5f * (min + max); }
+};
+
+// closest point on triangle abc to p (Ericson, Real-Time Collision Detection 5.1.5)
+inline glm::vec3 closest_point_triangle(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+  const glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+  const float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+  if (d1 <= 0.0f && d2 <= 0.0f) return a;
+  const glm::vec3 bp = p - b;
+  const float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+  if (d3 >= 0.0f && d4 <= d3) return b;
+  const float vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+  const glm::vec3 cp = p - c;
+  const float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+  if (d6 >= 0.0f && d5 <= d6) return c;
+  const float vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+  const float va = d3 * d6 - d5 * d4;
+  if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+  const float denom = 1.0f / (va + vb + vc);
+  return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// closest points between segments p1q1 and p2q2 (Ericson 5.1.9); returns squared distance
+inline float closest_segment_segment(const glm::vec3 &p1, const glm::vec3 &q1, const glm::vec3 &p2, const glm::vec3 &q2, glm::vec3 &c1, glm::vec3 &c2) {
+  const glm::vec3 d1 = q1 - p1, d2 = q2 - p2, r = p1 - p2;
+  const float a = glm::dot(d1, d1), e = glm::dot(d2, d2), f = glm::dot(d2, r);
+  float s, t;
+  if (a <= FLT_EPSILON && e <= FLT_EPSILON) {
+    c1 = p1;
+    c2 = p2;
+    return glm::dot(c1 - c2, c1 - c2);
+  }
+  if (a <= FLT_EPSILON) {
+    s = 0.0f;
+    t = glm::clamp(f / e, 0.0f, 1.0f);
+  } else {
+    const float c = glm::dot(d1, r);
+    if (e <= FLT_EPSILON) {
+      t = 0.0f;
+      s = glm::clamp(-c / a, 0.0f, 1.0f);
+    } else {
+      const float b = glm::dot(d1, d2);
+      const float denom = a * e - b * b;
+      s = denom != 0.0f ? glm::clamp((b * f - c * e) / denom, 0.0f, 1.0f) : 0.0f;
+      t = (b * s + f) / e;
+      if (t < 0.0f) {
+        t = 0.0f;
+        s = glm::clamp(-c / a, 0.0f, 1.0f);
+      } else if (t > 1.0f) {
+        t = 1.0f;
+        s = glm::clamp((b - c) / a, 0.0f, 1.0f);
+      }
+    }
+  }
+  c1 = p1 + d1 * s;
+  c2 = p2 + d2 * t;
+  return glm::dot(c1 - c2, c1 - c2);
+}
+
+// segment pq against triangle abc (Moller-Trumbore); returns the parameter along pq or -1
+inline float segment_triangle_intersection(const glm::vec3 &p, const glm::vec3 &q, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+  const glm::vec3 dir = q - p;
+  const glm::vec3 e1 = b - a, e2 = c - a;
+  const glm::vec3 h = glm::cross(dir, e2);
+  const float det = glm::dot(e1, h);
+  if (std::fabs(det) < 1e-12f) return -1.0f;
+  const float inv = 1.0f / det;
+  const glm::vec3 s = p - a;
+  const float u = glm::dot(s, h) * inv;
+  if (u < 0.0f || u > 1.0f) return -1.0f;
+  const glm::vec3 qv = glm::cross(s, e1);
+  const float v = glm::dot(dir, qv) * inv;
+  if (v < 0.0f || u + v > 1.0f) return -1.0f;
+  const float t = glm::dot(e2, qv) * inv;
+  return t >= 0.0f && t <= 1.0f ? t : -1.0f;
+}
+
+// squared distance between segment pq and triangle abc, with the closest points
+inline float closest_segment_triangle(const glm::vec3 &p, const glm::vec3 &q, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c, glm::vec3 &on_segment, glm::vec3 &on_triangle) {
+  const float t = segment_triangle_intersection(p, q, a, b, c);
+  if (t >= 0.0f) {
+    on_segment = on_triangle = p + (q - p) * t;
+    return 0.0f;
+  }
+  on_segment = p;
+  on_triangle = closest_point_triangle(p, a, b, c);
+  float best = glm::dot(on_segment - on_triangle, on_segment - on_triangle);
+  const auto consider = [&](const glm::vec3 &s, const glm::vec3 &tri) {
+    const float d = glm::dot(s - tri, s - tri);
+    if (d < best) {
+      best = d;
+      on_segment = s;
+      on_triangle = tri;
+    }
+  };
+  consider(q, closest_point_triangle(q, a, b, c));
+  const glm::vec3 edges[3][2] = {{a, b}, {b, c}, {c, a}};
+  for (const auto &edge : edges) {
+    glm::vec3 cs, ct;
+    closest_segment_segment(p, q, edge[0], edge[1], cs, ct);
+    consider(cs, ct);
+  }
+  return best;
+}
+#pragma endregion
+
+#pragma region queries
+struct Capsule {
+  glm::vec3 a;
+  glm::vec3 b;
+  float radius;
+};
+
+struct ContactResult {
+  bool hit = false;
+  float distance = FLT_MAX;// surface distance for closest-point queries, axis distance for capsules
+  float depth = 0.0f;      // capsule radius minus distance, > 0 when penetrating
+  float time = 1.0f;       // sweeps: fraction of the motion before first contact
+  glm::vec3 point_on_mesh{0.0f};
+  glm::vec3 point_on_query{0.0f};
+  glm::vec3 normal{0.0f};// unit, from the mesh towards the query
+  int triangle = -1;     // index into the source index buffer / 3
+};
+#pragma endregion
+
+#pragma region bvh
+class TriangleBvh {
+ public:
+  struct alignas(16) Node {
+    float min_x[4], min_y[4], min_z[4];
+    float max_x[4], max_y[4], max_z[4];
+    int32_t child[4];  // >= 0: inner node index, < 0: leaf starting at triangle ~child
+    uint32_t count[4]; // triangles in a leaf slot; an empty slot is a leaf with count 0 and inverted bounds
+  };
+
+  TriangleBvh() = default;
+  TriangleBvh(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices) { build(positions, indices); }
+
+  void build(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices) {
+    const size_t triangle_count = indices.size() / 3;
+    nodes.clear();
+    tri_a.clear();
+    tri_b.clear();
+    tri_c.clear();
+    tri_source.clear();
+    source_indices = indices;
+    if (triangle_count == 0) return;
+
+    std::vector<Aabb> bounds(triangle_count);
+    std::vector<glm::vec3> centroids(triangle_count);
+    std::vector<uint32_t> order(triangle_count);
+    for (size_t i = 0; i < triangle_count; ++i) {
+      const glm::vec3 &a = positions[indices[3 * i]], &b = positions[indices[3 * i + 1]], &c = positions[indices[3 * i + 2]];
+      bounds[i].grow(a);
+      bounds[i].grow(b);
+      bounds[i].grow(c);
+      centroids[i] = (a + b + c) * (1.0f / 3.0f);
+      order[i] = static_cast<uint32_t>(i);
+    }
+
+    std::vector<BuildNode> binary;
+    binary.reserve(2 * triangle_count / leaf_size + 1);
+    build_binary(binary, bounds, centroids, order, 0, static_cast<uint32_t>(triangle_count), 0);
+
+    tri_source = order;
+    tri_a.resize(triangle_count);
+    tri_b.resize(triangle_count);
+    tri_c.resize(triangle_count);
+    for (size_t i = 0; i < triangle_count; ++i) {
+      tri_a[i] = positions[indices[3 * order[i]]];
+      tri_b[i] = positions[indices[3 * order[i] + 1]];
+      tri_c[i] = positions[indices[3 * order[i] + 2]];
+    }
+
+    nodes.reserve(binary.size() / 2 + 1);
+    if (binary[0].count > 0) {
+      // the whole mesh fits into one leaf: wrap it so traversal always starts at an inner node
+      nodes.emplace_back();
+      clear_node(nodes[0]);
+      set_slot(nodes[0], 0, binary[0].bounds, ~static_cast<int32_t>(binary[0].first), binary[0].count);
+    } else {
+      collapse(binary, 0);
+    }
+  }
+
+  // recomputes triangle copies and node bounds after the source vertices moved (same topology)
+  void refit(const std::vector<glm::vec3> &positions) {
+    for (size_t i = 0; i < tri_source.size(); ++i) {
+      tri_a[i] = positions[source_indices[3 * tri_source[i]]];
+      tri_b[i] = positions[source_indices[3 * tri_source[i] + 1]];
+      tri_c[i] = positions[source_indices[3 * tri_source[i] + 2]];
+    }
+    // children always come after their parent, so a reverse sweep sees every child before its parent
+    for (size_t n = nodes.size(); n-- > 0;) {
+      Node &node = nodes[n];
+      for (int s = 0; s < 4; ++s) {
+        Aabb b;
+        if (node.child[s] >= 0) {
+          const Node &child = nodes[node.child[s]];
+          for (int cs = 0; cs < 4; ++cs) b.grow(slot_bounds(child, cs));
+        } else {
+          const uint32_t first = ~static_cast<uint32_t>(node.child[s]);
+          for (uint32_t t = first; t < first + node.count[s]; ++t) {
+            b.grow(tri_a[t]);
+            b.grow(tri_b[t]);
+            b.grow(tri_c[t]);
+          }
+        }
+        set_bounds(node, s, b);
+      }
+    }
+  }
+
+  bool empty() const { return nodes.empty(); }
+  size_t triangle_count() const { return tri_source.size(); }
+  size_t node_count() const { return nodes.size(); }
+  size_t memory_bytes() const { return nodes.size() * sizeof(Node) + tri_a.size() * 3 * sizeof(glm::vec3) + tri_source.size() * sizeof(uint32_t) + source_indices.size() * sizeof(unsigned int); }
+
+  Aabb bounds() const {
+    Aabb b;
+    if (!nodes.empty())
+      for (int s = 0; s < 4; ++s) b.grow(slot_bounds(nodes[0], s));
+    return b;
+  }
+
+  // closest surface point to p within max_distance
+  ContactResult closest_point(const glm::vec3 &p, const float max_distance = FLT_MAX) const {
+    ContactResult result;
+    if (nodes.empty()) return result;
+    float best = max_distance == FLT_MAX ? FLT_MAX : max_distance * max_distance;
+    uint32_t stack[stack_size];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+      const Node &node = nodes[stack[--top]];
+      float dist[4];
+      box_distance2(node, p, dist);
+      // push far children first so the nearest is popped next and tightens `best` early
+      int slots[4];
+      order_far_first(dist, slots);
+      for (const int s : slots) {
+        if (dist[s] >= best) continue;
+        if (node.child[s] >= 0) {
+          stack[top++] = static_cast<uint32_t>(node.child[s]);
+          prefetch(&nodes[node.child[s]]);
+          continue;
+        }
+        const uint32_t first = ~static_cast<uint32_t>(node.child[s]);
+        for (uint32_t t = first; t < first + node.count[s]; ++t) {
+          const glm::vec3 c = closest_point_triangle(p, tri_a[t], tri_b[t], tri_c[t]);
+          const float d = glm::dot(p - c, p - c);
+          if (d < best) {
+            best = d;
+            result.hit = true;
+            result.point_on_mesh = c;
+            result.triangle = static_cast<int>(tri_source[t]);
+            result.normal = face_normal(t);
+          }
+        }
+      }
+    }
+    if (result.hit) {
+      result.distance = std::sqrt(best);
+      result.point_on_query = p;
+      if (result.distance > 1e-6f) result.normal = (p - result.point_on_mesh) / result.distance;
+    }
+    return result;
+  }
+
+  // deepest contact of a capsule with the mesh; hit is set only when the capsule touches the surface
+  ContactResult capsule(const Capsule &capsule) const {
+    ContactResult result = closest_segment(capsule.a, capsule.b, capsule.radius);
+    if (result.hit) result.depth = capsule.radius - result.distance;
+    return result;
+  }
+
+  // translates the capsule by `motion` and reports the first time of contact (conservative advancement:
+  // each step moves by the current clearance, which can never tunnel through the surface). Each step only
+  // searches one radius ahead; if that is empty the capsule may safely move that far, and small searches are
+  // far cheaper than one search over the whole path.
+  ContactResult sweep(const Capsule &capsule, const glm::vec3 &motion, const float tolerance = 1e-4f, const int max_iterations = 64) const {
+    ContactResult result;
+    const float length = glm::length(motion);
+    const float lookahead = std::max(capsule.radius, length / 16.0f);
+    float t = 0.0f;
+    for (int i = 0; i < max_iterations; ++i) {
+      const glm::vec3 offset = motion * t;
+      const float remaining = length * (1.0f - t);
+      const float reach = std::min(remaining, lookahead);
+      const ContactResult step = closest_segment(capsule.a + offset, capsule.b + offset, capsule.radius + reach + tolerance);
+      if (!step.hit) {
+        if (reach >= remaining) return result;// nothing along the rest of the path
+        t += reach / length;
+        continue;
+      }
+      const float gap = step.distance - capsule.radius;
+      if (gap <= tolerance) {
+        result = step;
+        result.time = t;
+        result.depth = std::max(-gap, 0.0f);
+        return result;
+      }
+      if (length <= 0.0f) return result;
+      t += gap / length;
+      if (t > 1.0f) return result;
+    }
+    return result;
+  }
+
+  // closest mesh point to segment ab within max_distance (measured from the axis)
+  ContactResult closest_segment(const glm::vec3 &a, const glm::vec3 &b, const float max_distance) const {
+    ContactResult result;
+    if (nodes.empty()) return result;
+    float best = max_distance;
+    const glm::vec3 seg_min = glm::min(a, b), seg_max = glm::max(a, b);
+    const glm::vec3 axis = b - a;
+    const float inv_length2 = glm::dot(axis, axis) > 0.0f ? 1.0f / glm::dot(axis, axis) : 0.0f;
+    // a zero component would make the slab test divide 0 by 0; a tiny one keeps it finite with the same answer
+    const auto safe_inverse = [](const float v) { return 1.0f / (std::fabs(v) > 1e-12f ? v : std::copysign(1e-12f, v)); };
+    const glm::vec3 inv_axis(safe_inverse(axis.x), safe_inverse(axis.y), safe_inverse(axis.z));
+    uint32_t stack[stack_size];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0 && !(result.hit && best == 0.0f)) {// an intersection cannot be beaten
+      const Node &node = nodes[stack[--top]];
+      // the segment has to pass through the box grown by `best` (slab test, conservative: the grown box holds
+      // everything within `best` of the box). Children are searched by the distance from the box to the
+      // segment point nearest its center, so the closest one goes first and `best` tightens early.
+      float dist[4];
+      const int mask = segment_box_overlap(node, a, inv_axis, best) & bounds_within(node, seg_min, seg_max, best);
+      segment_box_distance2(node, a, axis, inv_length2, dist);
+      int slots[4];
+      order_far_first(dist, slots);
+      for (const int s : slots) {
+        if (!(mask & (1 << s))) continue;
+        if (node.child[s] >= 0) {
+          stack[top++] = static_cast<uint32_t>(node.child[s]);
+          prefetch(&nodes[node.child[s]]);
+          continue;
+        }
+        const uint32_t first = ~static_cast<uint32_t>(node.child[s]);
+        for (uint32_t t = first; t < first + node.count[s]; ++t) {
+          const glm::vec3 &ta = tri_a[t], &tb = tri_b[t], &tc = tri_c[t];
+          // the gap between the triangle's and the segment's bounds, per axis; as a vector it bounds the distance
+          const glm::vec3 lo = glm::min(glm::min(ta, tb), tc), hi = glm::max(glm::max(ta, tb), tc);
+          const glm::vec3 gap = glm::max(glm::max(lo - seg_max, seg_min - hi), glm::vec3(0.0f));
+          if (glm::dot(gap, gap) > best * best) continue;
+          // bounding sphere of the triangle against the segment, much tighter than boxes for slanted segments
+          const glm::vec3 centroid = (ta + tb + tc) * (1.0f / 3.0f);
+          const float tri_radius = std::sqrt(std::max(std::max(glm::dot(ta - centroid, ta - centroid), glm::dot(tb - centroid, tb - centroid)), glm::dot(tc - centroid, tc - centroid)));
+          const float along = glm::clamp(glm::dot(centroid - a, axis) * inv_length2, 0.0f, 1.0f);
+          const glm::vec3 off = centroid - (a + axis * along);
+          const float sphere_reach = best + tri_radius;
+          if (glm::dot(off, off) > sphere_reach * sphere_reach) continue;
+          // the sphere split along the triangle's normal: the segment's distance from the plane, and in the plane
+          // the projected segment's distance from the centroid less the radius. Much tighter than the sphere for
+          // a shaft end hovering over the surface, as in the sweep's last steps
+          const glm::vec3 n = glm::cross(tb - ta, tc - ta);
+          const float n2 = glm::dot(n, n);
+          if (n2 > 0.0f) {
+            const glm::vec3 unit = n / std::sqrt(n2);
+            const float da = glm::dot(a - centroid, unit), db = glm::dot(b - centroid, unit);
+            const float plane = (da > 0.0f) == (db > 0.0f) ? std::min(std::fabs(da), std::fabs(db)) : 0.0f;
+            if (plane > 0.0f) {// a segment through the plane is what the sphere test already handles well
+              const glm::vec3 pa = a - unit * da, pb = b - unit * db;
+              const glm::vec3 projected = pb - pa;
+              const float projected2 = glm::dot(projected, projected);
+              const float s = projected2 > 0.0f ? glm::clamp(glm::dot(centroid - pa, projected) / projected2, 0.0f, 1.0f) : 0.0f;
+              const float lateral = std::max(glm::length(centroid - (pa + projected * s)) - tri_radius, 0.0f);
+              if (plane * plane + lateral * lateral > best * best) continue;
+            }
+          }
+          glm::vec3 on_segment, on_triangle;
+          const float d2 = closest_segment_triangle(a, b, ta, tb, tc, on_segment, on_triangle);
+          if (d2 < best * best || (!result.hit && d2 <= best * best)) {
+            best = std::sqrt(d2);
+            result.hit = true;
+            result.distance = best;
+            result.point_on_mesh = on_triangle;
+            result.point_on_query = on_segment;
+            result.triangle = static_cast<int>(tri_source[t]);
+            result.normal = best > 1e-6f ? (on_segment - on_triangle) / best : face_normal(t);
+          }
+        }
+      }
+    }
+    return result;
+  }
+
+ private:
+  static constexpr uint32_t leaf_size = 4;
+  static constexpr int bin_count = 12;
+  // the binary build stops splitting at max_depth, and collapsing never makes the wide tree deeper. a pop
+  // removes one entry and pushes at most four, so a depth-first stack never holds more than 3 * depth + 1
+  static constexpr int max_depth = 64;
+  static constexpr int stack_size = 3 * max_depth + 1;
+
+  struct BuildNode {
+    Aabb bounds;
+    uint32_t left = 0, right = 0;// children (inner)
+    uint32_t first = 0, count = 0;// triangle range (leaf)
+  };
+
+  std::vector<Node> nodes;
+  std::vector<glm::vec3> tri_a, tri_b, tri_c;// leaf order
+  std::vector<uint32_t> tri_source;          // leaf order -> source triangle
+  std::vector<unsigned int> source_indices;
+
+  glm::vec3 face_normal(const uint32_t t) const {
+    const glm::vec3 n = glm::cross(tri_b[t] - tri_a[t], tri_c[t] - tri_a[t]);
+    const float l = glm::length(n);
+    return l > 0.0f ? n / l : glm::vec3(0.0f, 1.0f, 0.0f);
+  }
+
+  uint32_t build_binary(std::vector<BuildNode> &out, const std::vector<Aabb> &bounds, const std::vector<glm::vec3> &centroids, std::vector<uint32_t> &order, const uint32_t first, const uint32_t count, const int depth) {
+    const auto index = static_cast<uint32_t>(out.size());
+    out.emplace_back();
+    Aabb node_bounds, centroid_bounds;
+    for (uint32_t i = first; i < first + count; ++i) {
+      node_bounds.grow(bounds[order[i]]);
+      centroid_bounds.grow(centroids[order[i]]);
+    }
+    out[index].bounds = node_bounds;
+
+    const auto make_leaf = [&]() {
+      out[index].first = first;
+      out[index].count = count;
+      return index;
+    };
+    // a degenerate split chain ends in one oversized leaf rather than overflowing the traversal stack
+    if (count <= leaf_size || depth >= max_depth) return make_leaf();
+
+    // binned SAH along the widest centroid axis
+    const glm::vec3 extent = centroid_bounds.max - centroid_bounds.min;
+    const int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    if (extent[axis] <= 0.0f) return make_leaf();
+    const float scale = bin_count / extent[axis];
+    const auto bin_of = [&](const uint32_t tri) { return std::min(bin_count - 1, static_cast<int>((centroids[tri][axis] - centroid_bounds.min[axis]) * scale)); };
+
+    Aabb bin_bounds[bin_count];
+    uint32_t bin_counts[bin_count] = {};
+    for (uint32_t i = first; i < first + count; ++i) {
+      const int b = bin_of(order[i]);
+      bin_bounds[b].grow(bounds[order[i]]);
+      ++bin_counts[b];
+    }
+    float right_area[bin_count];
+    uint32_t right_count[bin_count];
+    Aabb acc;
+    uint32_t n = 0;
+    for (int b = bin_count - 1; b > 0; --b) {
+      acc.grow(bin_bounds[b]);
+      n += bin_counts[b];
+      right_area[b] = acc.area();
+      right_count[b] = n;
+    }
+    float best_cost = FLT_MAX;
+    int best_split = -1;
+    acc = Aabb();
+    n = 0;
+    for (int b = 0; b < bin_count - 1; ++b) {
+      acc.grow(bin_bounds[b]);
+      n += bin_counts[b];
+      if (n == 0 || right_count[b + 1] == 0) continue;
+      const float cost = acc.area() * static_cast<float>(n) + right_area[b + 1] * static_cast<float>(right_count[b + 1]);
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_split = b;
+      }
+    }
+
+    uint32_t mid;
+    if (best_split < 0) {
+      mid = first + count / 2;
+      std::nth_element(order.begin() + first, order.begin() + mid, order.begin() + first + count, [&](const uint32_t l, const uint32_t r) { return centroids[l][axis] < centroids[r][axis]; });
+    } else {
+      mid = static_cast<uint32_t>(std::partition(order.begin() + first, order.begin() + first + count, [&](const uint32_t tri) { return bin_of(tri) <= best_split; }) - order.begin());
+    }
+
+    const uint32_t left = build_binary(out, bounds, centroids, order, first, mid - first, depth + 1);
+    const uint32_t right = build_binary(out, bounds, centroids, order, mid, first + count - mid, depth + 1);
+    out[index].left = left;
+    out[index].right = right;
+    return index;
+  }
+
+  // turns binary inner node `b` into a 4-wide node by pulling up grandchildren; returns the wide node index
+  int32_t collapse(const std::vector<BuildNode> &binary, const uint32_t b) {
+    const auto index = static_cast<int32_t>(nodes.size());
+    nodes.emplace_back();
+    uint32_t slots[4] = {binary[b].left, binary[b].right};
+    int used = 2;
+    while (used < 4) {
+      // open the inner child with the largest surface area
+      int open = -1;
+      float open_area = -1.0f;
+      for (int s = 0; s < used; ++s) {
+        const BuildNode &child = binary[slots[s]];
+        if (child.count == 0 && child.bounds.area() > open_area) {
+          open = s;
+          open_area = child.bounds.area();
+        }
+      }
+      if (open < 0) break;
+      const BuildNode &opened = binary[slots[open]];
+      slots[open] = opened.left;
+      slots[used++] = opened.right;
+    }
+    clear_node(nodes[index]);
+    for (int s = 0; s < used; ++s) {
+      const BuildNode &child = binary[slots[s]];
+      if (child.count > 0) {
+        set_slot(nodes[index], s, child.bounds, ~static_cast<int32_t>(child.first), child.count);
+      } else {
+        const int32_t wide = collapse(binary, slots[s]);
+        set_slot(nodes[index], s, child.bounds, wide, 0);
+      }
+    }
+    return index;
+  }
+
+  static void clear_node(Node &node) {
+    for (int s = 0; s < 4; ++s) {
+      set_bounds(node, s, Aabb());
+      node.child[s] = ~0;
+      node.count[s] = 0;
+    }
+  }
+
+  static void set_slot(Node &node, const int s, const Aabb &b, const int32_t child, const uint32_t count) {
+    set_bounds(node, s, b);
+    node.child[s] = child;
+    node.count[s] = count;
+  }
+
+  static void set_bounds(Node &node, const int s, const Aabb &b) {
+    node.min_x[s] = b.min.x;
+    node.min_y[s] = b.min.y;
+    node.min_z[s] = b.min.z;
+    node.max_x[s] = b.max.x;
+    node.max_y[s] = b.max.y;
+    node.max_z[s] = b.max.z;
+  }
+
+  static Aabb slot_bounds(const Node &node, const int s) {
+    Aabb b;
+    b.min = glm::vec3(node.min_x[s], node.min_y[s], node.min_z[s]);
+    b.max = glm::vec3(node.max_x[s], node.max_y[s], node.max_z[s]);
+    return b;
+  }
+
+  // the BVH is far bigger than the caches; a pushed child is fetched while its siblings are tested
+  static void prefetch(const Node *node) {
+#if COLLISION_SSE2
+    _mm_prefetch(reinterpret_cast<const char *>(node), _MM_HINT_T0);
+    _mm_prefetch(reinterpret_cast<const char *>(node) + 64, _MM_HINT_T0);
+#else
+    (void) node;
+#endif
+  }
+
+  // slot indices by descending dist, a five-comparator sorting network instead of a sort call per node
+  static void order_far_first(const float dist[4], int slots[4]) {
+    slots[0] = 0, slots[1] = 1, slots[2] = 2, slots[3] = 3;
+    const auto exchange = [&](const int i, const int j) {
+      if (dist[slots[i]] < dist[slots[j]]) std::swap(slots[i], slots[j]);
+    };
+    exchange(0, 1);
+    exchange(2, 3);
+    exchange(0, 2);
+    exchange(1, 3);
+    exchange(1, 2);
+  }
+
+  // child boxes grown by `grow` that segment a + t * axis, t in [0, 1], passes through (bit per slot)
+  static int segment_box_overlap(const Node &node, const glm::vec3 &a, const glm::vec3 &inv_axis, const float grow) {
+#if COLLISION_SSE2
+    __m128 enter = _mm_setzero_ps(), leave = _mm_set1_ps(1.0f);
+    const __m128 g = _mm_set1_ps(grow);
+    const auto slab = [&](const float *mn, const float *mx, const float origin, const float inv) {
+      const __m128 o = _mm_set1_ps(origin), i = _mm_set1_ps(inv);
+      const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_load_ps(mn), g), o), i);
+      const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_load_ps(mx), g), o), i);
+      enter = _mm_max_ps(enter, _mm_min_ps(t0, t1));
+      leave = _mm_min_ps(leave, _mm_max_ps(t0, t1));
+    };
+    slab(node.min_x, node.max_x, a.x, inv_axis.x);
+    slab(node.min_y, node.max_y, a.y, inv_axis.y);
+    slab(node.min_z, node.max_z, a.z, inv_axis.z);
+    // empty slots have inverted bounds, which the slabs alone would not reject
+    const __m128 used = _mm_cmple_ps(_mm_load_ps(node.min_x), _mm_load_ps(node.max_x));
+    return _mm_movemask_ps(_mm_and_ps(used, _mm_cmple_ps(enter, leave)));
+#else
+    int mask = 0;
+    for (int s = 0; s < 4; ++s) {
+      if (node.min_x[s] > node.max_x[s]) continue;
+      float enter = 0.0f, leave = 1.0f;
+      const float mn[3] = {node.min_x[s], node.min_y[s], node.min_z[s]}, mx[3] = {node.max_x[s], node.max_y[s], node.max_z[s]};
+      for (int k = 0; k < 3; ++k) {
+        const float t0 = (mn[k] - grow - a[k]) * inv_axis[k], t1 = (mx[k] + grow - a[k]) * inv_axis[k];
+        enter = std::max(enter, std::min(t0, t1));
+        leave = std::min(leave, std::max(t0, t1));
+      }
+      if (enter <= leave) mask |= 1 << s;
+    }
+    return mask;
+#endif
+  }
+
+  // child boxes whose gap to the box [mn, mx] (per axis, taken as a vector) is at most `distance`
+  static int bounds_within(const Node &node, const glm::vec3 &mn, const glm::vec3 &mx, const float distance) {
+#if COLLISION_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const auto axis_gap = [&zero](const float *lo, const float *hi, const float box_lo, const float box_hi) {
+      const __m128 g = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(lo), _mm_set1_ps(box_hi)), _mm_sub_ps(_mm_set1_ps(box_lo), _mm_load_ps(hi))), zero);
+      return _mm_mul_ps(g, g);
+    };
+    const __m128 gap = _mm_add_ps(_mm_add_ps(axis_gap(node.min_x, node.max_x, mn.x, mx.x), axis_gap(node.min_y, node.max_y, mn.y, mx.y)), axis_gap(node.min_z, node.max_z, mn.z, mx.z));
+    return _mm_movemask_ps(_mm_cmple_ps(gap, _mm_set1_ps(distance * distance)));
+#else
+    int mask = 0;
+    for (int s = 0; s < 4; ++s) {
+      const glm::vec3 lo(node.min_x[s], node.min_y[s], node.min_z[s]), hi(node.max_x[s], node.max_y[s], node.max_z[s]);
+      const glm::vec3 gap = glm::max(glm::max(lo - mx, mn - hi), glm::vec3(0.0f));
+      if (glm::dot(gap, gap) <= distance * distance) mask |= 1 << s;
+    }
+    return mask;
+#endif
+  }
+
+  // squared distance from each child box to the segment point nearest its center: an upper bound of the
+  // box/segment distance, only good for ordering; empty slots come out as +inf
+  static void segment_box_distance2(const Node &node, const glm::vec3 &a, const glm::vec3 &axis, const float inv_length2, float out[4]) {
+#if COLLISION_SSE2
+    const __m128 zero = _mm_setzero_ps(), half = _mm_set1_ps(0.5f);
+    const __m128 cx = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_load_ps(node.min_x), _mm_load_ps(node.max_x)), half), _mm_set1_ps(a.x));
+    const __m128 cy = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_load_ps(node.min_y), _mm_load_ps(node.max_y)), half), _mm_set1_ps(a.y));
+    const __m128 cz = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_load_ps(node.min_z), _mm_load_ps(node.max_z)), half), _mm_set1_ps(a.z));
+    __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(axis.x)), _mm_mul_ps(cy, _mm_set1_ps(axis.y))), _mm_mul_ps(cz, _mm_set1_ps(axis.z)));
+    t = _mm_min_ps(_mm_max_ps(_mm_mul_ps(t, _mm_set1_ps(inv_length2)), zero), _mm_set1_ps(1.0f));
+    const auto axis_distance = [&](const float *mn, const float *mx, const float origin, const float direction) {
+      const __m128 q = _mm_add_ps(_mm_set1_ps(origin), _mm_mul_ps(t, _mm_set1_ps(direction)));
+      const __m128 d = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(mn), q), _mm_sub_ps(q, _mm_load_ps(mx))), zero);
+      return _mm_mul_ps(d, d);
+    };
+    const __m128 d = _mm_add_ps(_mm_add_ps(axis_distance(node.min_x, node.max_x, a.x, axis.x), axis_distance(node.min_y, node.max_y, a.y, axis.y)), axis_distance(node.min_z, node.max_z, a.z, axis.z));
+    _mm_storeu_ps(out, d);
+#else
+    for (int s = 0; s < 4; ++s) {
+      const glm::vec3 mn(node.min_x[s], node.min_y[s], node.min_z[s]), mx(node.max_x[s], node.max_y[s], node.max_z[s]);
+      const float t = glm::clamp(glm::dot(0.5f * (mn + mx) - a, axis) * inv_length2, 0.0f, 1.0f);
+      const glm::vec3 q = a + axis * t;
+      const glm::vec3 d = glm::max(glm::max(mn - q, q - mx), glm::vec3(0.0f));
+      out[s] = glm::dot(d, d);
+    }
+#endif
+    for (int s = 0; s < 4; ++s)
+      if (node.min_x[s] > node.max_x[s]) out[s] = FLT_MAX;
+  }
+
+  // squared distance from p to each of the four child boxes; empty slots come out as +inf
+  static void box_distance2(const Node &node, const glm::vec3 &p, float out[4]) {
+#if COLLISION_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const auto axis = [&zero](const float *mn, const float *mx, const float v) {
+      const __m128 pv = _mm_set1_ps(v);
+      const __m128 d = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(mn), pv), _mm_sub_ps(pv, _mm_load_ps(mx))), zero);
+      return _mm_mul_ps(d, d);
+    };
+    const __m128 d = _mm_add_ps(_mm_add_ps(axis(node.min_x, node.max_x, p.x), axis(node.min_y, node.max_y, p.y)), axis(node.min_z, node.max_z, p.z));
+    _mm_storeu_ps(out, d);
+#else
+    for (int s = 0; s < 4; ++s) {
+      const float dx = std::max(std::max(node.min_x[s] - p.x, p.x - node.max_x[s]), 0.0f);
+      const float dy = std::max(std::max(node.min_y[s] - p.y, p.y - node.max_y[s]), 0.0f);
+      const float dz = std::max(std::max(node.min_z[s] - p.z, p.z - node.max_z[s]), 0.0f);
+      out[s] = dx * dx + dy * dy + dz * dz;
+    }
+#endif
+    for (int s = 0; s < 4; ++s)
+      if (node.min_x[s] > node.max_x[s]) out[s] = FLT_MAX;
+  }
+};
+#pragma endregion
+
+#pragma region rigid instances
+// A BVH placed in the world by a rigid transform (rotation + translation). Queries are moved into the mesh's
+// local frame, so moving the instance is just a matrix update, no refit.
+struct BvhInstance {
+  const TriangleBvh *bvh = nullptr;
+  glm::mat4 world{1.0f};
+  glm::mat4 inverse{1.0f};
+
+  void set_transform(const glm::mat4 &m) {
+    world = m;
+    inverse = glm::inverse(m);
+  }
+
+  ContactResult closest_point(const glm::vec3 &p, const float max_distance = FLT_MAX) const { return to_world(bvh->closest_point(local(p), max_distance)); }
+
+  ContactResult capsule(const Capsule &c) const { return to_world(bvh->capsule({local(c.a), local(c.b), c.radius})); }
+
+  ContactResult sweep(const Capsule &c, const glm::vec3 &motion) const { return to_world(bvh->sweep({local(c.a), local(c.b), c.radius}, glm::vec3(inverse * glm::vec4(motion, 0.0f)))); }
+
+ private:
+  glm::vec3 local(const glm::vec3 &p) const { return glm::vec3(inverse * glm::vec4(p, 1.0f)); }
+
+  ContactResult to_world(ContactResult r) const {
+    if (!r.hit) return r;
+    r.point_on_mesh = glm::vec3(world * glm::vec4(r.point_on_mesh, 1.0f));
+    r.point_on_query = glm::vec3(world * glm::vec4(r.point_on_query, 1.0f));
+    r.normal = glm::normalize(glm::vec3(world * glm::vec4(r.normal, 0.0f)));
+    return r;
+  }
+};
+
+// capsule around the longest axis of a bounding box, e.g. an instrument shaft
+inline Capsule capsule_from_bounds(const Aabb &b) {
+  const glm::vec3 e = b.max - b.min;
+  const int axis = e.x > e.y ? (e.x > e.z ? 0 : 2) : (e.y > e.z ? 1 : 2);
+  const float radius = 0.25f * (e[(axis + 1) % 3] + e[(axis + 2) % 3]);
+  glm::vec3 a = b.center(), c = b.center();
+  a[axis] = b.min[axis] + radius;
+  c[axis] = b.max[axis] - radius;
+  if (a[axis] > c[axis]) a[axis] = c[axis] = b.center()[axis];
+  return {a, c, radius};
+}
+#pragma endregion
+
+#endif
@@ -0,0 +1,140 @@
+#pragma once
+#ifndef COLLISION_BENCH_H
+#define COLLISION_BENCH_H
+
+#include <Animation.h>
+#include <Collision.h>
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Headless benchmark for Collision.h (run with --bench-collision). Loads the anatomy meshes through assimp only,
+// no GL context needed, so it also runs on the servers; falls back to a dense synthetic mesh when a file is missing.
+
+// triangle soup of every mesh the node tree references, in model space: node transforms are baked in except for
+// skinned meshes (same as Model's collision positions)
+inline bool load_collision_mesh(const std::string &path, std::vector<glm::vec3> &positions, std::vector<unsigned int> &indices) {
+  Assimp::Importer importer;
+  const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices);
+  if (!scene || !scene->mRootNode) return false;
+  const auto add_node = [&](const auto &self, const aiNode *node, const glm::mat4 &parent_transform) -> void {
+    const glm::mat4 transform = parent_transform * to_glm(node->mTransformation);
+    for (unsigned int i = 0; i < node->mNumMeshes; ++i) {
+      const aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
+      const glm::mat4 mesh_transform = mesh->HasBones() ? glm::mat4(1.0f) : transform;
+      const auto base = static_cast<unsigned int>(positions.size());
+      for (unsigned int v = 0; v < mesh->mNumVertices; ++v) positions.emplace_back(mesh_transform * glm::vec4(mesh->mVertices[v].x, mesh->mVertices[v].y, mesh->mVertices[v].z, 1.0f));
+      for (unsigned int f = 0; f < mesh->mNumFaces; ++f)
+        if (mesh->mFaces[f].mNumIndices == 3)
+          for (unsigned int k = 0; k < 3; ++k) indices.push_back(base + mesh->mFaces[f].mIndices[k]);
+    }
+    for (unsigned int i = 0; i < node->mNumChildren; ++i) self(self, node->mChildren[i], transform);
+  };
+  add_node(add_node, scene->mRootNode, glm::mat4(1.0f));
+  return !indices.empty();
+}
+
+// bumpy sphere, roughly the triangle density of a scanned vertebra
+inline void make_benchmark_mesh(const int rings, std::vector<glm::vec3> &positions, std::vector<unsigned int> &indices) {
+  const int segments = rings;
+  for (int i = 0; i <= rings; ++i)
+    for (int j = 0; j <= segments; ++j) {
+      const float theta = 3.14159265f * static_cast<float>(i) / static_cast<float>(rings);
+      const float phi = 6.28318531f * static_cast<float>(j) / static_cast<float>(segments);
+      const float r = 5.0f + 0.3f * std::sin(7.0f * theta) * std::cos(5.0f * phi);
+      positions.push_back(r * glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)));
+    }
+  for (int i = 0; i < rings; ++i)
+    for (int j = 0; j < segments; ++j) {
+      const auto a = static_cast<unsigned int>(i * (segments + 1) + j), b = a + 1, c = a + segments + 1, d = c + 1;
+      indices.insert(indices.end(), {a, c, b, b, c, d});
+    }
+}
+
+inline int run_collision_benchmark(const std::vector<std::string> &paths, const int queries = 10000) {
+  using clock = std::chrono::steady_clock;
+  const auto micros = [](const clock::time_point a, const clock::time_point b) { return std::chrono::duration<double, std::micro>(b - a).count(); };
+  const auto percentile = [](std::vector<double> v, const double q) {
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    return v[static_cast<size_t>(q * static_cast<double>(v.size() - 1))];
+  };
+
+  std::vector<std::string> names = paths;
+  if (names.empty()) names.emplace_back("<synthetic>");
+  std::printf("%-40s %9s %9s %9s %9s | %-22s %-22s %-22s\n", "mesh", "tris", "build ms", "refit ms", "MB", "closest p50/p99 us", "capsule p50/p99 us", "sweep p50/p99 us");
+
+  for (const std::string &name : names) {
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+    if (name == "<synthetic>" || !load_collision_mesh(name, positions, indices)) {
+      if (name != "<synthetic>") std::printf("%s: not loadable, using synthetic mesh\n", name.c_str());
+      positions.clear();
+      indices.clear();
+      make_benchmark_mesh(300, positions, indices);
+    }
+
+    auto t0 = clock::now();
+    TriangleBvh bvh(positions, indices);
+    auto t1 = clock::now();
+    const double build_ms = micros(t0, t1) / 1000.0;
+    t0 = clock::now();
+    bvh.refit(positions);
+    t1 = clock::now();
+    const double refit_ms = micros(t0, t1) / 1000.0;
+
+    // queries around the surface: points and instrument-sized capsules within ~5% of the mesh size
+    const Aabb box = bvh.bounds();
+    const float size = glm::length(box.max - box.min);
+    uint32_t state = 12345u;
+    const auto rnd = [&state]() {
+      state = state * 1664525u + 1013904223u;
+      return static_cast<float>(state >> 8) * (1.0f / 16777216.0f);
+    };
+    const auto random_point = [&]() { return box.min + (box.max - box.min) * glm::vec3(rnd(), rnd(), rnd()); };
+    const auto random_dir = [&]() { return glm::normalize(glm::vec3(rnd() - 0.5f, rnd() - 0.5f, rnd() - 0.5f) + glm::vec3(1e-4f)); };
+
+    std::vector<double> closest, capsule, sweep;
+    closest.reserve(queries);
+    capsule.reserve(queries);
+    sweep.reserve(queries);
+    int hits = 0;
+    for (int q = 0; q < queries; ++q) {
+      // snap a random point to the surface and jitter it, so queries sit where instruments actually are
+      const ContactResult anchor = bvh.closest_point(random_point());
+      const glm::vec3 p = anchor.point_on_mesh + random_dir() * (0.02f * size * rnd());
+
+      t0 = clock::now();
+      const ContactResult c = bvh.closest_point(p, 0.05f * size);
+      t1 = clock::now();
+      closest.push_back(micros(t0, t1));
+
+      const Capsule shaft{p, p + random_dir() * (0.1f * size), 0.01f * size};
+      t0 = clock::now();
+      const ContactResult k = bvh.capsule(shaft);
+      t1 = clock::now();
+      capsule.push_back(micros(t0, t1));
+
+      const Capsule start{p + anchor.normal * (0.05f * size), p + anchor.normal * (0.15f * size), 0.01f * size};
+      t0 = clock::now();
+      const ContactResult s = bvh.sweep(start, -anchor.normal * (0.1f * size));
+      t1 = clock::now();
+      sweep.push_back(micros(t0, t1));
+      hits += c.hit + k.hit + s.hit;
+    }
+
+    std::printf("%-40s %9zu %9.2f %9.2f %9.2f | %9.2f / %-10.2f %9.2f / %-10.2f %9.2f / %-10.2f (hits %d)\n", name.c_str(), bvh.triangle_count(), build_ms, refit_ms, static_cast<double>(bvh.memory_bytes()) / (1024.0 * 1024.0),
+                percentile(closest, 0.5), percentile(closest, 0.99), percentile(capsule, 0.5), percentile(capsule, 0.99), percentile(sweep, 0.5), percentile(sweep, 0.99), hits);
+  }
+  return 0;
+}
+
+#endif
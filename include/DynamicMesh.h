@@ -0,0 +1,424 @@
+#pragma once
+#ifndef DYNAMIC_MESH_H
+#define DYNAMIC_MESH_H
+
+#include <JobSystem.h>
+#include <Mesh.h>
+#include <ResourceRegistry.h>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DYNAMIC_MESH_SSE2 1
+#else
+#define DYNAMIC_MESH_SSE2 0
+#endif
+
+// Mesh variant for geometry that deforms every frame (soft tissue, skinned meshes).
+//
+// Vertex data is split in two streams: what never changes (texture coords, tangents, bone ids/weights, the same
+// attribute locations 2-6 as Mesh) is uploaded once, positions and normals (locations 0 and 1) are streamed.
+// Writers mark the vertex spans they changed; only those spans are re-uploaded and only their normals recomputed.
+//  - k_stream_ring: `ring` copies of the dynamic stream, each guarded by a fence from the frame that drew it.
+//    A copy is written with an unsynchronized map once its fence passed, so the CPU never waits on a draw
+//    still in flight; every copy gets the spans changed since it was last written.
+//  - k_stream_orphan: one buffer, orphaned and rewritten whole whenever anything changed. For meshes that change
+//    almost entirely every frame, where tracking spans buys nothing.
+enum dynamic_stream_mode { k_stream_ring, k_stream_orphan };
+
+struct DynamicMeshStats {
+  size_t dirty_vertices;// uploaded by the last upload(), normals included
+  size_t uploaded_bytes;
+  size_t stream_bytes;// one full copy of the dynamic stream
+  int spans;
+  int fence_waits;// uploads that found their copy still in use by the GPU
+  double normals_ms;
+  double upload_ms;
+};
+
+class DynamicMesh {
+ public:
+  DynamicMesh(const vector<Vertex> &vertices, const vector<unsigned int> &indices, vector<Texture> textures = {}, const GLenum primitive = GL_TRIANGLES, const dynamic_stream_mode mode = k_stream_ring, const int ring = 3, string owner = "dynamic mesh")
+      : textures(std::move(textures)), primitive(primitive), mode(mode), ring(mode == k_stream_ring ? std::max(ring, 1) : 1), owner(std::move(owner)) {
+    positions.reserve(vertices.size());
+    normals.reserve(vertices.size());
+    std::vector<StaticVertex> statics;
+    statics.reserve(vertices.size());
+    for (const Vertex &v : vertices) {
+      positions.push_back(v.Position);
+      normals.push_back(v.Normal);
+      StaticVertex s{v.TexCoords, v.Tangent, v.Bitangent, {}, {}};
+      std::copy(std::begin(v.m_BoneIDs), std::end(v.m_BoneIDs), s.bone_ids);
+      std::copy(std::begin(v.m_Weights), std::end(v.m_Weights), s.weights);
+      statics.push_back(s);
+    }
+
+    glGenBuffers(1, &static_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, static_vbo);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(statics.size() * sizeof(StaticVertex)), statics.data(), GL_STATIC_DRAW);
+    static_record = resources().add(k_resource_buffer, static_vbo, statics.size() * sizeof(StaticVertex), std::to_string(statics.size()) + " static vertices", this->owner);
+    glGenBuffers(1, &ebo);
+    slots.resize(this->ring);
+    std::vector<StreamVertex> initial(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) initial[i] = {positions[i], normals[i]};
+    for (Slot &slot : slots) {
+      glGenBuffers(1, &slot.vbo);
+      glBindBuffer(GL_ARRAY_BUFFER, slot.vbo);
+      glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(initial.size() * sizeof(StreamVertex)), initial.data(), GL_DYNAMIC_DRAW);
+      slot.record = resources().add(k_resource_buffer, slot.vbo, initial.size() * sizeof(StreamVertex), std::to_string(initial.size()) + " streamed vertices", this->owner);
+      glGenVertexArrays(1, &slot.vao);
+      setup_vao(slot);
+    }
+    set_indices(indices);
+  }
+  ~DynamicMesh() {
+    for (Slot &slot : slots) {
+      if (slot.fence) glDeleteSync(slot.fence);
+      glDeleteVertexArrays(1, &slot.vao);
+      glDeleteBuffers(1, &slot.vbo);
+      resources().remove(slot.record);
+    }
+    resources().remove(static_record);
+    resources().remove(index_record);
+    glDeleteBuffers(1, &ebo);
+    glDeleteBuffers(1, &static_vbo);
+  }
+  DynamicMesh(const DynamicMesh &) = delete;
+  DynamicMesh &operator=(const DynamicMesh &) = delete;
+
+  vector<Texture> textures;
+
+  size_t vertex_count() const { return positions.size(); }
+  const std::vector<glm::vec3> &vertex_positions() const { return positions; }
+  const std::vector<glm::vec3> &vertex_normals() const { return normals; }
+
+  // replaces the topology (e.g. after tearing); all normals are recomputed on the next recompute_normals
+  void set_indices(const vector<unsigned int> &new_indices) {
+    indices = new_indices;
+    // the element buffer binding is VAO state
+    for (Slot &slot : slots) {
+      glBindVertexArray(slot.vao);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    }
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indices.size() * sizeof(unsigned int)), indices.data(), GL_DYNAMIC_DRAW);
+    glBindVertexArray(0);
+    if (index_record == 0) index_record = resources().add(k_resource_buffer, ebo, indices.size() * sizeof(unsigned int), std::to_string(indices.size()) + " indices", owner);
+    else resources().update(index_record, indices.size() * sizeof(unsigned int), std::to_string(indices.size()) + " indices");
+    if (primitive != GL_TRIANGLES) return;
+    // vertex -> triangles, compressed rows
+    const size_t triangles = indices.size() / 3;
+    triangle_start.assign(positions.size() + 1, 0);
+    for (size_t i = 0; i < 3 * triangles; ++i) ++triangle_start[indices[i] + 1];
+    for (size_t v = 0; v < positions.size(); ++v) triangle_start[v + 1] += triangle_start[v];
+    vertex_triangles.resize(3 * triangles);
+    std::vector<uint32_t> fill(triangle_start.begin(), triangle_start.end() - 1);
+    for (size_t i = 0; i < 3 * triangles; ++i) vertex_triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    face_normals.assign(triangles, glm::vec3(0.0f));
+    triangle_seen.assign(triangles, 0);
+    vertex_seen.assign(positions.size(), 0);
+    full_normals = true;
+    mark_dirty(0, positions.size());
+  }
+
+  // write access to positions [first, first + count), which are marked dirty
+  glm::vec3 *edit_positions(const size_t first, const size_t count) {
+    mark_dirty(first, count);
+    return positions.data() + first;
+  }
+
+  // write access to normals [first, first + count), for writers that compute them themselves (skinning); the
+  // span is uploaded as is, call it after recompute_normals or instead of it
+  glm::vec3 *edit_normals(const size_t first, const size_t count) {
+    const Span span{static_cast<uint32_t>(first), static_cast<uint32_t>(std::min(first + count, positions.size()))};
+    if (count > 0)
+      for (Slot &slot : slots) slot.pending.push_back(span);
+    return normals.data() + first;
+  }
+
+  // copies in new positions and marks the vertices that moved more than `epsilon`, so resting parts cost nothing
+  void update_positions(const std::vector<glm::vec3> &moved, const float epsilon = 0.0f) {
+    const size_t n = std::min(moved.size(), positions.size());
+    const float epsilon2 = epsilon * epsilon;
+    size_t run = n;// first vertex of the current run of moved ones, n when not in a run
+    for (size_t i = 0; i < n; ++i) {
+      const glm::vec3 d = moved[i] - positions[i];
+      if (glm::dot(d, d) > epsilon2) {
+        positions[i] = moved[i];
+        if (run == n) run = i;
+      } else if (run != n) {
+        mark_dirty(run, i - run);
+        run = n;
+      }
+    }
+    if (run != n) mark_dirty(run, n - run);
+  }
+
+  void mark_dirty(const size_t first, const size_t count) {
+    if (count == 0) return;
+    const Span span{static_cast<uint32_t>(first), static_cast<uint32_t>(std::min(first + count, positions.size()))};
+    dirty.push_back(span);
+    for (Slot &slot : slots) slot.pending.push_back(span);
+  }
+
+  // recomputes the normals of every vertex sharing a triangle with a dirty vertex; the affected vertices join
+  // the spans to upload. Face normals are cached, so only triangles around dirty vertices are touched.
+  void recompute_normals(JobSystem &jobs) {
+    if (primitive != GL_TRIANGLES || dirty.empty()) {
+      dirty.clear();
+      return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    ++stamp;
+    affected_triangles.clear();
+    affected_vertices.clear();
+    if (full_normals) {
+      for (uint32_t t = 0; t < face_normals.size(); ++t) affected_triangles.push_back(t);
+      for (uint32_t v = 0; v < positions.size(); ++v) affected_vertices.push_back(v);
+      full_normals = false;
+    } else {
+      coalesce(dirty, 0);
+      for (const Span &span : dirty)
+        for (uint32_t v = span.first; v < span.end; ++v)
+          for (uint32_t k = triangle_start[v]; k < triangle_start[v + 1]; ++k) {
+            const uint32_t t = vertex_triangles[k];
+            if (triangle_seen[t] == stamp) continue;
+            triangle_seen[t] = stamp;
+            affected_triangles.push_back(t);
+            for (int c = 0; c < 3; ++c) {
+              const uint32_t w = indices[3 * t + c];
+              if (vertex_seen[w] != stamp) {
+                vertex_seen[w] = stamp;
+                affected_vertices.push_back(w);
+              }
+            }
+          }
+    }
+    dirty.clear();
+
+    jobs.parallel_for(0, affected_triangles.size(), 1024, [&](size_t b, size_t e) {
+      for (size_t i = b; i < e; ++i) {
+        const uint32_t t = affected_triangles[i];
+        face_normals[t] = face_normal(positions[indices[3 * t]], positions[indices[3 * t + 1]], positions[indices[3 * t + 2]]);
+      }
+    });
+    // area weighted: the face normals are unnormalized cross products
+    jobs.parallel_for(0, affected_vertices.size(), 1024, [&](size_t b, size_t e) {
+      for (size_t i = b; i < e; ++i) {
+        const uint32_t v = affected_vertices[i];
+        normals[v] = vertex_normal(v);
+      }
+    });
+    // the vertices around the dirty ones changed too
+    std::sort(affected_vertices.begin(), affected_vertices.end());
+    for (size_t i = 0; i < affected_vertices.size();) {
+      size_t j = i + 1;
+      while (j < affected_vertices.size() && affected_vertices[j] == affected_vertices[j - 1] + 1) ++j;
+      for (Slot &slot : slots) slot.pending.push_back({affected_vertices[i], affected_vertices[j - 1] + 1});
+      i = j;
+    }
+    stats_.normals_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  // streams the pending spans into the copy drawn next; call once per frame before draw()
+  void upload() {
+    const auto start = std::chrono::steady_clock::now();
+    dirty.clear();// whatever recompute_normals did not handle keeps the normals it has
+    current = (current + 1) % ring;
+    Slot &slot = slots[current];
+    stats_.uploaded_bytes = 0;
+    stats_.dirty_vertices = 0;
+    stats_.spans = 0;
+    stats_.stream_bytes = positions.size() * sizeof(StreamVertex);
+    if (slot.pending.empty()) {
+      stats_.upload_ms = 0.0;
+      return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, slot.vbo);
+    if (mode == k_stream_orphan) {
+      // fresh storage, the old one stays with the draws still using it
+      glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(stats_.stream_bytes), nullptr, GL_DYNAMIC_DRAW);
+      write(static_cast<StreamVertex *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(stats_.stream_bytes), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT)), 0, static_cast<uint32_t>(positions.size()));
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+      stats_.dirty_vertices = positions.size();
+      stats_.spans = 1;
+    } else {
+      if (slot.fence) {
+        if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+          ++stats_.fence_waits;
+          while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+        }
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+      }
+      // nearby spans are merged, a few clean vertices cost less than another flush
+      coalesce(slot.pending, 16);
+      const std::vector<Span> &spans = slot.pending;
+      const uint32_t lo = spans.front().first, hi = spans.back().end;
+      auto *mapped = static_cast<StreamVertex *>(glMapBufferRange(GL_ARRAY_BUFFER, static_cast<GLintptr>(lo * sizeof(StreamVertex)), static_cast<GLsizeiptr>((hi - lo) * sizeof(StreamVertex)),
+                                                                  GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_FLUSH_EXPLICIT_BIT));
+      if (mapped) {
+        for (const Span &span : spans) {
+          write(mapped + (span.first - lo), span.first, span.end);
+          glFlushMappedBufferRange(GL_ARRAY_BUFFER, static_cast<GLintptr>((span.first - lo) * sizeof(StreamVertex)), static_cast<GLsizeiptr>((span.end - span.first) * sizeof(StreamVertex)));
+          stats_.dirty_vertices += span.end - span.first;
+        }
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+      } else {
+        std::cout << "ERROR::DYNAMIC_MESH::MAP_FAILED" << std::endl;
+      }
+      stats_.spans = static_cast<int>(spans.size());
+    }
+    slot.pending.clear();
+    stats_.uploaded_bytes = stats_.dirty_vertices * sizeof(StreamVertex);
+    stats_.upload_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  void Draw(Shader &shader) {
+    unsigned int diffuse_nr = 1, specular_nr = 1, normal_nr = 1, height_nr = 1;
+    for (unsigned int i = 0; i < textures.size(); i++) {
+      glActiveTexture(GL_TEXTURE0 + i);
+      const string &name = textures[i].type;
+      unsigned int number = 0;
+      if (name == "texture_diffuse") number = diffuse_nr++;
+      else if (name == "texture_specular") number = specular_nr++;
+      else if (name == "texture_normal") number = normal_nr++;
+      else if (name == "texture_height") number = height_nr++;
+      glUniform1i(glGetUniformLocation(shader.ID, number ? frame_format("%s%u", name.c_str(), number) : name.c_str()), i);
+      glBindTexture(GL_TEXTURE_2D, textures[i].bind_id());
+    }
+    Slot &slot = slots[current];
+    glBindVertexArray(slot.vao);
+    glDrawElements(primitive, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, nullptr);
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+    if (mode == k_stream_ring) {
+      if (slot.fence) glDeleteSync(slot.fence);
+      slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+  }
+
+  const DynamicMeshStats &stats() const { return stats_; }
+
+ private:
+  struct StreamVertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+  };
+  struct StaticVertex {
+    glm::vec2 tex_coords;
+    glm::vec3 tangent;
+    glm::vec3 bitangent;
+    int bone_ids[MAX_BONE_INFLUENCE];
+    float weights[MAX_BONE_INFLUENCE];
+  };
+  struct Span {
+    uint32_t first, end;
+  };
+  struct Slot {
+    unsigned int vbo = 0, vao = 0;
+    GLsync fence = nullptr;
+    std::vector<Span> pending;// changed since this copy was last written
+    ResourceRegistry::Handle record = 0;
+  };
+
+  const GLenum primitive;
+  const dynamic_stream_mode mode;
+  const int ring;
+  const string owner;// of the registry records
+  std::vector<glm::vec3> positions, normals;
+  vector<unsigned int> indices;
+  unsigned int static_vbo = 0, ebo = 0;
+  ResourceRegistry::Handle static_record = 0, index_record = 0;
+  std::vector<Slot> slots;
+  int current = 0;
+  std::vector<Span> dirty;// since the last recompute_normals
+
+  std::vector<uint32_t> triangle_start, vertex_triangles;
+  std::vector<glm::vec3> face_normals;
+  std::vector<uint32_t> triangle_seen, vertex_seen;
+  uint32_t stamp = 0;
+  std::vector<uint32_t> affected_triangles, affected_vertices;
+  bool full_normals = true;
+  DynamicMeshStats stats_{};
+
+  // sorts in place and merges overlapping spans and spans closer than `gap`; keeps the capacity
+  static void coalesce(std::vector<Span> &spans, const uint32_t gap) {
+    std::sort(spans.begin(), spans.end(), [](const Span &a, const Span &b) { return a.first < b.first; });
+    size_t merged = 0;
+    for (size_t i = 0; i < spans.size(); ++i) {
+      if (merged > 0 && spans[i].first <= spans[merged - 1].end + gap) spans[merged - 1].end = std::max(spans[merged - 1].end, spans[i].end);
+      else spans[merged++] = spans[i];
+    }
+    spans.resize(merged);
+  }
+
+  void write(StreamVertex *out, const uint32_t first, const uint32_t end) const {
+    for (uint32_t v = first; v < end; ++v) *out++ = {positions[v], normals[v]};
+  }
+
+#if DYNAMIC_MESH_SSE2
+  static __m128 load3(const glm::vec3 &v) { return _mm_setr_ps(v.x, v.y, v.z, 0.0f); }
+  static glm::vec3 store3(const __m128 v) {
+    alignas(16) float f[4];
+    _mm_store_ps(f, v);
+    return {f[0], f[1], f[2]};
+  }
+  static glm::vec3 face_normal(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+    const __m128 pa = load3(a), e0 = _mm_sub_ps(load3(b), pa), e1 = _mm_sub_ps(load3(c), pa);
+    // cross(e0, e1) = e0.yzx * e1.zxy - e0.zxy * e1.yzx
+    const __m128 e0_yzx = _mm_shuffle_ps(e0, e0, _MM_SHUFFLE(3, 0, 2, 1)), e1_yzx = _mm_shuffle_ps(e1, e1, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 cross = _mm_sub_ps(_mm_mul_ps(e0, e1_yzx), _mm_mul_ps(e0_yzx, e1));
+    return store3(_mm_shuffle_ps(cross, cross, _MM_SHUFFLE(3, 0, 2, 1)));
+  }
+  glm::vec3 vertex_normal(const uint32_t v) const {
+    __m128 sum = _mm_setzero_ps();
+    for (uint32_t k = triangle_start[v]; k < triangle_start[v + 1]; ++k) sum = _mm_add_ps(sum, load3(face_normals[vertex_triangles[k]]));
+    const __m128 squares = _mm_mul_ps(sum, sum);
+    const __m128 len2 = _mm_add_ps(_mm_add_ps(squares, _mm_shuffle_ps(squares, squares, _MM_SHUFFLE(3, 3, 3, 1))), _mm_shuffle_ps(squares, squares, _MM_SHUFFLE(3, 3, 3, 2)));
+    if (_mm_cvtss_f32(len2) <= 1e-30f) return normals[v];
+    return store3(_mm_div_ps(sum, _mm_sqrt_ps(_mm_shuffle_ps(len2, len2, _MM_SHUFFLE(0, 0, 0, 0)))));
+  }
+#else
+  static glm::vec3 face_normal(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) { return glm::cross(b - a, c - a); }
+  glm::vec3 vertex_normal(const uint32_t v) const {
+    glm::vec3 sum(0.0f);
+    for (uint32_t k = triangle_start[v]; k < triangle_start[v + 1]; ++k) sum += face_normals[vertex_triangles[k]];
+    const float len2 = glm::dot(sum, sum);
+    return len2 > 1e-30f ? sum / std::sqrt(len2) : normals[v];
+  }
+#endif
+
+  void setup_vao(const Slot &slot) const {
+    glBindVertexArray(slot.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, slot.vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(StreamVertex), (void *) offsetof(StreamVertex, position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(StreamVertex), (void *) offsetof(StreamVertex, normal));
+    glBindBuffer(GL_ARRAY_BUFFER, static_vbo);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(StaticVertex), (void *) offsetof(StaticVertex, tex_coords));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(StaticVertex), (void *) offsetof(StaticVertex, tangent));
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(StaticVertex), (void *) offsetof(StaticVertex, bitangent));
+    glEnableVertexAttribArray(5);
+    glVertexAttribIPointer(5, 4, GL_INT, sizeof(StaticVertex), (void *) offsetof(StaticVertex, bone_ids));
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(StaticVertex), (void *) offsetof(StaticVertex, weights));
+    glBindVertexArray(0);
+  }
+};
+
+#endif
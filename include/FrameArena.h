@@ -0,0 +1,189 @@
+#pragma once
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for data that lives one loop iteration: cull views, the draw queue, render graph pass lists,
+// uniform staging, formatted labels. Each thread bumps through its own sub-arena, so allocation is a pointer
+// increment without locks; frees do nothing and reset() at the end of the iteration takes everything back at
+// once. A sub-arena that ran out this frame chains an overflow block and, at reset, is replaced by one block
+// covering the whole frame, so after the first frames at a given load nothing reaches the heap. reset() runs on
+// the loop thread and recycles every thread's sub-arena, so only threads whose work finishes inside the
+// iteration (the loop thread, job workers) may use the arena; destructors of objects in it never run.
+
+struct FrameArenaStats {
+  size_t threads;
+  size_t last_frame_bytes;// used in the iteration before the last reset, all threads
+  size_t high_water_bytes;// most one thread used in any iteration
+  size_t capacity_bytes;
+  size_t overflows;       // blocks chained since start; the first frames at a new load add some
+};
+
+class FrameArena {
+ public:
+  static constexpr size_t initial_block_bytes = size_t(64) << 10;
+
+  FrameArena() = default;
+  FrameArena(const FrameArena &) = delete;
+  FrameArena &operator=(const FrameArena &) = delete;
+
+  void *allocate(const size_t bytes, const size_t alignment) { return this_thread_arena().allocate(bytes, alignment); }
+  template <typename T>
+  T *allocate_array(const size_t count) { return static_cast<T *>(allocate(count * sizeof(T), alignof(T))); }
+
+  // ends the iteration: everything allocated from the arena is gone
+  void reset() {
+    size_t frame_bytes = 0;
+    for (ThreadArena *arena = arenas.load(std::memory_order_acquire); arena; arena = arena->next) {
+      frame_bytes += arena->frame_bytes;
+      arena->reset();
+    }
+    last_frame_bytes = frame_bytes;
+  }
+
+  FrameArenaStats stats() const {
+    FrameArenaStats stats{0, last_frame_bytes, 0, 0, 0};
+    for (const ThreadArena *arena = arenas.load(std::memory_order_acquire); arena; arena = arena->next) {
+      ++stats.threads;
+      stats.high_water_bytes = std::max(stats.high_water_bytes, arena->high_water);
+      for (const Block &block : arena->blocks) stats.capacity_bytes += block.size;
+      stats.overflows += arena->overflows;
+    }
+    return stats;
+  }
+
+ private:
+  struct Block {
+    std::unique_ptr<uint8_t[]> data;
+    size_t size;
+  };
+  struct ThreadArena {
+    std::vector<Block> blocks;// the frame block, then overflow blocks chained this iteration
+    size_t used = 0;          // in the last block
+    size_t frame_bytes = 0;   // this iteration, padding included
+    size_t high_water = 0;
+    size_t overflows = 0;
+    ThreadArena *next = nullptr;
+
+    void *allocate(const size_t bytes, const size_t alignment) {
+      if (blocks.empty()) blocks.push_back({std::make_unique<uint8_t[]>(initial_block_bytes), initial_block_bytes});
+      Block *block = &blocks.back();
+      size_t start = align(*block, used, alignment);
+      if (start + bytes > block->size) {
+        frame_bytes += block->size - used;// the unused tail of the full block counts as used
+        const size_t size = std::max(block->size * 2, bytes + alignment);
+        blocks.push_back({std::make_unique<uint8_t[]>(size), size});
+        ++overflows;
+        block = &blocks.back();
+        used = 0;
+        start = align(*block, 0, alignment);
+      }
+      frame_bytes += start + bytes - used;
+      used = start + bytes;
+      return block->data.get() + start;
+    }
+    void reset() {
+      high_water = std::max(high_water, frame_bytes);
+      if (blocks.size() > 1) {
+        // one block for what the whole iteration needed, so the next one does not chain
+        size_t size = initial_block_bytes;
+        while (size < frame_bytes) size *= 2;
+        blocks.clear();
+        blocks.push_back({std::make_unique<uint8_t[]>(size), size});
+      }
+      used = 0;
+      frame_bytes = 0;
+    }
+    static size_t align(const Block &block, const size_t offset, const size_t alignment) {
+      const auto base = reinterpret_cast<uintptr_t>(block.data.get());
+      return static_cast<size_t>((base + offset + alignment - 1) / alignment * alignment - base);
+    }
+  };
+
+  std::atomic<ThreadArena *> arenas{nullptr};
+  size_t last_frame_bytes = 0;
+
+  // the calling thread's sub-arena, registered on first use; kept for the arena's lifetime
+  ThreadArena &this_thread_arena() {
+    thread_local ThreadArena *mine = nullptr;
+    if (!mine) {
+      mine = new ThreadArena();
+      mine->next = arenas.load(std::memory_order_relaxed);
+      while (!arenas.compare_exchange_weak(mine->next, mine, std::memory_order_release, std::memory_order_relaxed)) {}
+    }
+    return *mine;
+  }
+};
+
+// the loop's arena; one per process, as the sub-arenas are found through a thread_local
+inline FrameArena &frame_arena() {
+  static FrameArena instance;
+  return instance;
+}
+
+// STL allocator on the frame arena; deallocate does nothing, so containers using it must not outlive the
+// iteration (reserve when the size is known, growth leaves the old storage behind until reset)
+template <typename T>
+struct FrameAllocator {
+  using value_type = T;
+  FrameAllocator() = default;
+  template <typename U>
+  FrameAllocator(const FrameAllocator<U> &) noexcept {}
+  T *allocate(const size_t n) { return frame_arena().allocate_array<T>(n); }
+  void deallocate(T *, size_t) noexcept {}
+  template <typename U>
+  bool operator==(const FrameAllocator<U> &) const noexcept { return true; }
+  template <typename U>
+  bool operator!=(const FrameAllocator<U> &) const noexcept { return false; }
+};
+
+template <typename T>
+using frame_vector = std::vector<T, FrameAllocator<T>>;
+
+// printf into the arena; the string lives until the iteration's end (ImGui labels, debug text)
+inline const char *frame_format(const char *format, ...) {
+  va_list args, measure;
+  va_start(args, format);
+  va_copy(measure, args);
+  const int length = std::max(std::vsnprintf(nullptr, 0, format, measure), 0);
+  va_end(measure);
+  char *text = frame_arena().allocate_array<char>(static_cast<size_t>(length) + 1);
+  std::vsnprintf(text, static_cast<size_t>(length) + 1, format, args);
+  va_end(args);
+  return text;
+}
+
+// a void() callable copied into the frame arena, for callbacks run within the iteration (render graph passes).
+// Its destructor never runs, so it only takes trivially destructible callables: lambdas capturing references
+// and plain values.
+class FrameFunction {
+ public:
+  FrameFunction() = default;
+  template <typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, FrameFunction>::value>>
+  FrameFunction(F &&f) {// NOLINT(google-explicit-constructor)
+    using Callable = std::decay_t<F>;
+    static_assert(std::is_trivially_destructible<Callable>::value, "FrameFunction callables must be trivially destructible");
+    object = new (frame_arena().allocate(sizeof(Callable), alignof(Callable))) Callable(std::forward<F>(f));
+    call = [](void *callable) { (*static_cast<Callable *>(callable))(); };
+  }
+
+  void operator()() const { call(object); }
+  explicit operator bool() const { return call != nullptr; }
+
+ private:
+  void *object = nullptr;
+  void (*call)(void *) = nullptr;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#pragma once
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+
+// Demand-driven frames: the loop keeps stepping the simulation and publishing on schedule, but the 3D pass only
+// runs when what it shows changed (camera, panel size, moved nodes, cut bone, deformed tissue, animation) and the
+// Scene panel is visible, otherwise the last image is reused. The ImGui frame (and the swap) only runs on input,
+// after a new scene image, and at a slow refresh for the stats windows; between those the loop sleeps in
+// glfwWaitEventsTimeout until the next publish is due or an event arrives.
+
+struct FrameSchedulerConfig {
+  double publish_hz = 60.0;      // simulation step and FusionData publish rate while idle
+  double ui_refresh_hz = 4.0;    // idle redraws of the UI, for the stats windows
+  double ui_settle_seconds = 0.5;// UI keeps drawing this long after input (hover delays, drags, text cursor)
+};
+
+struct FrameSchedulerStats {
+  size_t iterations;
+  size_t scene_passes;
+  size_t ui_frames;
+  size_t idle_waits;
+};
+
+class FrameScheduler {
+ public:
+  explicit FrameScheduler(const FrameSchedulerConfig config = FrameSchedulerConfig()) : config(config) {}
+
+  // something drawn moved, was cut or deformed since the last 3D pass
+  void mark_scene_changed() { scene_changed = true; }
+  // window input or damage (resize, expose) at `now`
+  void mark_input(const double now) { ui_active_until = std::max(ui_active_until, now + config.ui_settle_seconds); }
+
+  // whether this iteration runs the 3D pass; false reuses the last image. While nobody wants the image (panel
+  // hidden, no stream subscriber) a change stays pending, so the first frame looked at again is current.
+  bool need_scene_pass(const glm::mat4 &view, const glm::mat4 &projection, const int width, const int height, const bool image_wanted) {
+    ++counts.iterations;
+    if (!image_wanted) return false;
+    const bool view_changed = !drawn_once || view != last_view || projection != last_projection || width != last_width || height != last_height;
+    if (!view_changed && !scene_changed) return false;
+    last_view = view;
+    last_projection = projection;
+    last_width = width;
+    last_height = height;
+    drawn_once = true;
+    scene_changed = false;
+    ++counts.scene_passes;
+    return true;
+  }
+
+  // whether this iteration builds and presents an ImGui frame
+  bool need_ui_frame(const double now, const bool scene_drawn) {
+    const bool due = scene_drawn || now < ui_active_until || now >= next_ui_refresh;
+    if (!due) return false;
+    next_ui_refresh = now + 1.0 / config.ui_refresh_hz;
+    ++counts.ui_frames;
+    return true;
+  }
+
+  // the simulation stepped and published at `now`
+  void published(const double now) {
+    // keep the cadence, but do not try to catch up after a stall
+    next_publish = std::max(next_publish + 1.0 / config.publish_hz, now);
+  }
+
+  // how long the loop may block for events after an iteration that presented nothing: until the next publish or
+  // UI refresh, whichever is first
+  double idle_timeout(const double now) {
+    ++counts.idle_waits;
+    return std::max(0.0, std::min(next_publish, next_ui_refresh) - now);
+  }
+
+  const FrameSchedulerStats &stats() const { return counts; }
+
+ private:
+  FrameSchedulerConfig config;
+  bool scene_changed = true;
+  bool drawn_once = false;
+  glm::mat4 last_view{1.0f}, last_projection{1.0f};
+  int last_width = 0, last_height = 0;
+  double ui_active_until = 0.0, next_ui_refresh = 0.0, next_publish = 0.0;
+  FrameSchedulerStats counts{};
+};
+
+#endif
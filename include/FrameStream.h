@@ -0,0 +1,472 @@
+#pragma once
+#ifndef FRAME_STREAM_H
+#define FRAME_STREAM_H
+
+#include <ResourceRegistry.h>
+#include <Trace.h>
+
+#include <ecal/ecal.h>
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Streams the scene image to remote stations. The render thread only issues glReadPixels into a pixel buffer
+// object of a small ring and fences it; a later frame maps the buffer once its fence has passed and hands the
+// mapped memory to a worker, which compresses it and publishes it on an eCAL topic. Nothing on the render thread
+// waits for the GPU or copies pixels: a readback that is not done yet is looked at again next frame, and when
+// the ring is full the frame is simply not captured.
+//
+// Wire format of one message: FrameHeader followed by payload_bytes of payload. Rows are bottom-up, as GL reads
+// them. k_codec_raw is RGB8. k_codec_lossless (decode_frame_lossless) is a JPEG-LS-like coder: the planes G,
+// R-G, B-G are predicted by the median edge detector, runs of perfectly predicted pixels are run-length coded
+// and the other residuals Rice coded with per-plane adaptive parameters.
+
+enum frame_codec : uint8_t { k_codec_raw = 0, k_codec_lossless = 1 };
+
+#pragma pack(push, 1)
+struct FrameHeader {
+  uint32_t magic;// frame_magic
+  uint32_t frame;// capture counter, gaps are frames that were not captured or not sent
+  int64_t capture_us;// eCAL time of the capture, for latency measurements on the receiving side
+  uint16_t width, height;
+  uint8_t codec;
+  uint8_t reserved[3];
+  uint32_t payload_bytes;
+};
+#pragma pack(pop)
+constexpr uint32_t frame_magic = 0x314d5246;// "FRM1"
+
+#pragma region codec
+namespace frame_codec_detail {
+class BitWriter {
+ public:
+  explicit BitWriter(std::vector<uint8_t> &out) : out(out) {}
+  // n <= 32
+  void put(const uint32_t value, const int n) {
+    acc |= static_cast<uint64_t>(value & (n == 32 ? 0xffffffffu : (1u << n) - 1u)) << count;
+    count += n;
+    while (count >= 8) {
+      out.push_back(static_cast<uint8_t>(acc));
+      acc >>= 8;
+      count -= 8;
+    }
+  }
+  void flush() {
+    if (count > 0) out.push_back(static_cast<uint8_t>(acc));
+    acc = 0;
+    count = 0;
+  }
+
+ private:
+  std::vector<uint8_t> &out;
+  uint64_t acc = 0;
+  int count = 0;
+};
+
+class BitReader {
+ public:
+  BitReader(const uint8_t *data, const size_t size) : data(data), size(size) {}
+  uint32_t get(const int n) {
+    while (count < n) {
+      acc |= static_cast<uint64_t>(position < size ? data[position] : 0) << count;
+      ++position;
+      count += 8;
+    }
+    const uint32_t value = static_cast<uint32_t>(acc & (n == 32 ? 0xffffffffull : (1ull << n) - 1ull));
+    acc >>= n;
+    count -= n;
+    return value;
+  }
+  bool overrun() const { return position > size + 8; }
+
+ private:
+  const uint8_t *data;
+  size_t size, position = 0;
+  uint64_t acc = 0;
+  int count = 0;
+};
+
+// running mean of the coded values, picks the Rice parameter (LOCO-I style)
+struct RiceContext {
+  uint32_t sum = 4, n = 1;
+  int k() const {
+    int k = 0;
+    while ((n << k) < sum && k < 24) ++k;
+    return k;
+  }
+  void update(const uint32_t value) {
+    sum += value;
+    if (++n == 64) {
+      sum >>= 1;
+      n >>= 1;
+    }
+  }
+};
+
+constexpr uint32_t rice_escape = 24;// quotients from here on are sent as raw_bits of the value instead
+
+inline void put_rice(BitWriter &bits, RiceContext &context, const uint32_t value, const int raw_bits) {
+  const int k = context.k();
+  const uint32_t q = value >> k;
+  if (q < rice_escape) {
+    bits.put((1u << q) - 1u, static_cast<int>(q) + 1);// q ones and a zero
+    if (k > 0) bits.put(value, k);
+  } else {
+    bits.put((1u << rice_escape) - 1u, static_cast<int>(rice_escape));
+    bits.put(value, raw_bits);
+  }
+  context.update(value);
+}
+
+inline uint32_t get_rice(BitReader &bits, RiceContext &context, const int raw_bits) {
+  const int k = context.k();
+  uint32_t q = 0;
+  while (q < rice_escape && bits.get(1)) ++q;
+  const uint32_t value = q < rice_escape ? (q << k) | (k > 0 ? bits.get(k) : 0u) : bits.get(raw_bits);
+  context.update(value);
+  return value;
+}
+
+// median edge detector on left a, up b, up-left c
+inline int med(const int a, const int b, const int c) {
+  if (c >= std::max(a, b)) return std::min(a, b);
+  if (c <= std::min(a, b)) return std::max(a, b);
+  return a + b - c;
+}
+// residual mod 256 as 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+inline uint32_t zigzag(const int residual) {
+  const auto r = static_cast<int8_t>(residual);
+  return static_cast<uint32_t>(static_cast<uint8_t>((r << 1) ^ (r >> 7)));
+}
+inline int unzigzag(const uint32_t value) { return static_cast<int>(value >> 1) ^ -static_cast<int>(value & 1u); }
+
+// neighbours of pixel x in the planes of the previous and current row, with the edge rules shared by both sides
+inline void neighbours(const uint8_t *up, const uint8_t *row, const int x, const int plane, const bool first_row, int &a, int &b, int &c) {
+  if (first_row) {
+    a = x > 0 ? row[3 * (x - 1) + plane] : 0;
+    b = c = a;
+  } else if (x == 0) {
+    b = up[plane];
+    a = c = b;
+  } else {
+    a = row[3 * (x - 1) + plane];
+    b = up[3 * x + plane];
+    c = up[3 * (x - 1) + plane];
+  }
+}
+}// namespace frame_codec_detail
+
+// appends the lossless coding of a width x height RGBA8 image (rows `stride` bytes apart) to out
+inline void encode_frame_lossless(const uint8_t *rgba, const int width, const int height, const size_t stride, std::vector<uint8_t> &out) {
+  using namespace frame_codec_detail;
+  out.reserve(out.size() + static_cast<size_t>(width) * height);
+  BitWriter bits(out);
+  RiceContext run_context, plane_context[3];
+  std::vector<uint8_t> rows(static_cast<size_t>(width) * 6);// previous and current row of the transformed planes
+  uint8_t *up = rows.data(), *row = rows.data() + static_cast<size_t>(width) * 3;
+  uint32_t run = 0;
+  for (int y = 0; y < height; ++y) {
+    const uint8_t *src = rgba + static_cast<size_t>(y) * stride;
+    for (int x = 0; x < width; ++x) {
+      const uint8_t g = src[4 * x + 1];
+      row[3 * x] = g;
+      row[3 * x + 1] = static_cast<uint8_t>(src[4 * x] - g);
+      row[3 * x + 2] = static_cast<uint8_t>(src[4 * x + 2] - g);
+    }
+    for (int x = 0; x < width; ++x) {
+      const uint8_t *value = row + 3 * x;
+      // flat neighbourhood (most of a rendered frame): every prediction is exact
+      if (y > 0 && x > 0 && std::memcmp(value, value - 3, 3) == 0 && std::memcmp(value, up + 3 * x, 3) == 0 && std::memcmp(value, up + 3 * x - 3, 3) == 0) {
+        ++run;
+        continue;
+      }
+      uint32_t residual[3];
+      for (int p = 0; p < 3; ++p) {
+        int a, b, c;
+        neighbours(up, row, x, p, y == 0, a, b, c);
+        residual[p] = zigzag(value[p] - med(a, b, c));
+      }
+      if ((residual[0] | residual[1] | residual[2]) == 0) {
+        ++run;
+        continue;
+      }
+      put_rice(bits, run_context, run, 32);
+      run = 0;
+      for (int p = 0; p < 3; ++p) put_rice(bits, plane_context[p], residual[p], 8);
+    }
+    std::swap(up, row);
+  }
+  put_rice(bits, run_context, run, 32);
+  bits.flush();
+}
+
+// inverse of encode_frame_lossless into RGB8; false on a truncated or corrupt payload
+inline bool decode_frame_lossless(const uint8_t *data, const size_t size, const int width, const int height, std::vector<uint8_t> &rgb) {
+  using namespace frame_codec_detail;
+  BitReader bits(data, size);
+  RiceContext run_context, plane_context[3];
+  rgb.resize(static_cast<size_t>(width) * height * 3);
+  std::vector<uint8_t> rows(static_cast<size_t>(width) * 6);
+  uint8_t *up = rows.data(), *row = rows.data() + static_cast<size_t>(width) * 3;
+  uint32_t run = get_rice(bits, run_context, 32);
+  for (int y = 0; y < height; ++y) {
+    uint8_t *dst = rgb.data() + static_cast<size_t>(y) * width * 3;
+    for (int x = 0; x < width; ++x) {
+      const bool predicted = run > 0;
+      if (predicted) --run;
+      for (int p = 0; p < 3; ++p) {
+        int a, b, c;
+        neighbours(up, row, x, p, y == 0, a, b, c);
+        const int residual = predicted ? 0 : unzigzag(get_rice(bits, plane_context[p], 8));
+        row[3 * x + p] = static_cast<uint8_t>(med(a, b, c) + residual);
+      }
+      if (!predicted) run = get_rice(bits, run_context, 32);
+      dst[3 * x + 1] = row[3 * x];
+      dst[3 * x] = static_cast<uint8_t>(row[3 * x + 1] + row[3 * x]);
+      dst[3 * x + 2] = static_cast<uint8_t>(row[3 * x + 2] + row[3 * x]);
+    }
+    std::swap(up, row);
+  }
+  return !bits.overrun();
+}
+
+// header plus payload of one RGBA8 frame
+inline void encode_frame(const uint8_t *rgba, const int width, const int height, const frame_codec codec, const uint32_t frame, const int64_t capture_us, std::vector<uint8_t> &out) {
+  out.resize(sizeof(FrameHeader));
+  if (codec == k_codec_lossless) {
+    encode_frame_lossless(rgba, width, height, static_cast<size_t>(width) * 4, out);
+  } else {
+    out.reserve(sizeof(FrameHeader) + static_cast<size_t>(width) * height * 3);
+    for (size_t i = 0; i < static_cast<size_t>(width) * height; ++i) out.insert(out.end(), rgba + 4 * i, rgba + 4 * i + 3);
+  }
+  const FrameHeader header{frame_magic, frame, capture_us, static_cast<uint16_t>(width), static_cast<uint16_t>(height), static_cast<uint8_t>(codec), {0, 0, 0}, static_cast<uint32_t>(out.size() - sizeof(FrameHeader))};
+  std::memcpy(out.data(), &header, sizeof(header));
+}
+#pragma endregion
+
+struct FrameStreamConfig {
+  std::string topic = "scene_frames";
+  frame_codec codec = k_codec_lossless;
+  double max_fps = 30.0;
+  double min_fps = 2.0;
+  double keyframe_interval = 1.0;// an unchanged image is re-sent this often, for late joiners
+  int ring = 3;                  // pixel buffers in flight
+  int workers = 1;
+};
+
+struct FrameStreamStats {
+  uint64_t captured;
+  uint64_t sent;
+  uint64_t ring_full;// captures skipped because every buffer was still in use
+  uint64_t send_failures;
+  double fps;            // current capture rate
+  double encode_ms;      // last compress + send on a worker
+  double compression;    // raw RGB bytes over sent bytes, last frame
+  double render_thread_ms;// capture() + poll() on the render thread, last frame
+};
+
+class FrameStreamer {
+ public:
+  explicit FrameStreamer(FrameStreamConfig config = FrameStreamConfig()) : config(std::move(config)), publisher(this->config.topic), slots(static_cast<size_t>(std::max(this->config.ring, 2))) {
+    current_fps = this->config.max_fps;
+    for (Slot &slot : slots) glGenBuffers(1, &slot.pbo);
+    running = true;
+    for (int i = 0; i < std::max(this->config.workers, 1); ++i) workers.emplace_back([this] { run(); });
+  }
+  ~FrameStreamer() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      running = false;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers) worker.join();
+    for (Slot &slot : slots) {
+      if (slot.state.load() != k_slot_free && slot.state.load() != k_slot_reading) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      }
+      if (slot.fence) glDeleteSync(slot.fence);
+      glDeleteBuffers(1, &slot.pbo);
+      resources().remove(slot.record);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+  FrameStreamer(const FrameStreamer &) = delete;
+  FrameStreamer &operator=(const FrameStreamer &) = delete;
+
+  // render thread, once the frame's image in `framebuffer` (width x height, lower left corner) is final.
+  // new_image is false when the image is the same as last frame's.
+  void capture(const GLuint framebuffer, const int width, const int height, const bool new_image, const double now) {
+    const auto t0 = std::chrono::steady_clock::now();
+    adapt_rate();
+    const bool due = now >= next_capture && (new_image || now - last_capture >= config.keyframe_interval);
+    if (due && publisher.IsSubscribed()) start_readback(framebuffer, width, height, now);
+    render_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  }
+
+  // render thread, every loop iteration: maps readbacks whose fence passed and takes back buffers the workers
+  // are done with
+  void poll() {
+    const auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < slots.size(); ++i) {
+      Slot &slot = slots[i];
+      const int state = slot.state.load(std::memory_order_acquire);
+      if (state == k_slot_reading) {
+        const GLenum status = glClientWaitSync(slot.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        slot.pixels = static_cast<const uint8_t *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(slot.bytes()), GL_MAP_READ_BIT));
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if (!slot.pixels) {
+          std::cout << "ERROR::FRAME_STREAM:: could not map the readback buffer" << std::endl;
+          slot.state.store(k_slot_free);
+          continue;
+        }
+        slot.state.store(k_slot_mapped);
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          queue.push_back(i);
+        }
+        wake.notify_one();
+      } else if (state == k_slot_encoded) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.pixels = nullptr;
+        slot.state.store(k_slot_free);
+      }
+    }
+    render_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  }
+
+  // someone listens on the topic, so the image is needed even when nobody looks at it locally
+  bool subscribed() const { return publisher.IsSubscribed(); }
+
+  FrameStreamStats stats() const {
+    return {captured, sent.load(), ring_full, send_failures.load(), current_fps, encode_ms.load(), compression.load(), render_seconds * 1e3};
+  }
+
+ private:
+  enum slot_state { k_slot_free, k_slot_reading, k_slot_mapped, k_slot_encoded };
+  struct Slot {
+    GLuint pbo = 0;
+    size_t capacity = 0;
+    GLsync fence = nullptr;
+    ResourceRegistry::Handle record = 0;// render thread only
+    std::atomic<int> state{k_slot_free};
+    // set by the render thread before the slot is queued
+    int width = 0, height = 0;
+    uint32_t frame = 0;
+    int64_t capture_us = 0;
+    const uint8_t *pixels = nullptr;
+    size_t bytes() const { return static_cast<size_t>(width) * height * 4; }
+  };
+
+  FrameStreamConfig config;
+  eCAL::CPublisher publisher;
+  std::vector<Slot> slots;
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<size_t> queue;
+  bool running = false;
+
+  // render thread only
+  double current_fps = 0.0, next_capture = 0.0, last_capture = -1e9, render_seconds = 0.0;
+  uint64_t captured = 0, ring_full = 0;
+  // written by the workers
+  std::atomic<uint64_t> sent{0}, send_failures{0};
+  std::atomic<double> encode_ms{0.0}, compression{0.0};
+
+  void start_readback(const GLuint framebuffer, const int width, const int height, const double now) {
+    Slot *slot = nullptr;
+    for (Slot &s : slots)
+      if (s.state.load(std::memory_order_acquire) == k_slot_free) {
+        slot = &s;
+        break;
+      }
+    if (!slot) {
+      // the workers are behind: back off
+      ++ring_full;
+      current_fps = std::max(config.min_fps, current_fps * 0.8);
+      next_capture = now + 1.0 / current_fps;
+      return;
+    }
+    slot->width = width;
+    slot->height = height;
+    slot->frame = static_cast<uint32_t>(captured++);
+    slot->capture_us = eCAL::Time::GetMicroSeconds();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+    if (slot->bytes() > slot->capacity) {
+      slot->capacity = slot->bytes();
+      glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(slot->capacity), nullptr, GL_STREAM_READ);
+      std::string format = "RGBA8 readback " + std::to_string(width) + "x" + std::to_string(height);
+      if (slot->record == 0) slot->record = resources().add(k_resource_buffer, slot->pbo, slot->capacity, std::move(format), "frame streamer");
+      else resources().update(slot->record, slot->capacity, std::move(format));
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot->state.store(k_slot_reading, std::memory_order_release);
+    last_capture = now;
+    next_capture = now + 1.0 / current_fps;
+  }
+
+  // keep the workers' duty cycle between 50% and 80%
+  void adapt_rate() {
+    const double busy = encode_ms.load() * 1e-3 * current_fps / std::max(config.workers, 1);
+    if (busy > 0.8) current_fps = std::max(config.min_fps, current_fps * 0.9);
+    else if (busy < 0.5) current_fps = std::min(config.max_fps, current_fps * 1.05);
+  }
+
+  void run() {
+    TRACE_THREAD_NAME("frame stream encoder");
+    std::vector<uint8_t> message;
+    while (true) {
+      size_t index;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this] { return !running || !queue.empty(); });
+        if (!running) return;
+        index = queue.front();
+        queue.pop_front();
+      }
+      Slot &slot = slots[index];
+      // the render thread may refill the slot once it is released, so whatever is used after that is copied
+      const int64_t capture_us = slot.capture_us;
+      const double raw_bytes = static_cast<double>(slot.width) * slot.height * 3;
+      const auto t0 = std::chrono::steady_clock::now();
+      {
+        TRACE_ZONE("encode");
+        encode_frame(slot.pixels, slot.width, slot.height, config.codec, slot.frame, capture_us, message);
+      }
+      slot.state.store(k_slot_encoded, std::memory_order_release);// the slot is no longer needed
+      {
+        TRACE_ZONE("send");
+        if (publisher.Send(message.data(), message.size(), capture_us) == message.size()) ++sent;
+        else ++send_failures;
+      }
+      encode_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+      compression = raw_bytes / static_cast<double>(message.size());
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <Collision.h>
+#include <FrameArena.h>
+
+#include <glm/glm.hpp>
+
+// View frustum as six inward facing planes (a, b, c, d with a*x + b*y + c*z + d >= 0 inside), taken from the
+// combined projection * view matrix. Tests are conservative: something reported visible may still be outside
+// near a corner, never the other way round.
+struct Frustum {
+  glm::vec4 planes[6];
+
+  static Frustum from_matrix(const glm::mat4 &view_projection) {
+    const glm::mat4 m = glm::transpose(view_projection);// rows of view_projection
+    Frustum f;
+    f.planes[0] = m[3] + m[0];// left
+    f.planes[1] = m[3] - m[0];// right
+    f.planes[2] = m[3] + m[1];// bottom
+    f.planes[3] = m[3] - m[1];// top
+    f.planes[4] = m[3] + m[2];// near
+    f.planes[5] = m[3] - m[2];// far
+    for (glm::vec4 &p : f.planes) p /= glm::length(glm::vec3(p));
+    return f;
+  }
+
+  bool intersects_sphere(const glm::vec3 &center, const float radius) const {
+    for (const glm::vec4 &p : planes)
+      if (glm::dot(glm::vec3(p), center) + p.w < -radius) return false;
+    return true;
+  }
+
+  bool intersects_box(const Aabb &box) const {
+    for (const glm::vec4 &p : planes) {
+      // the corner furthest along the plane normal
+      const glm::vec3 corner(p.x >= 0.0f ? box.max.x : box.min.x, p.y >= 0.0f ? box.max.y : box.min.y, p.z >= 0.0f ? box.max.z : box.min.z);
+      if (glm::dot(glm::vec3(p), corner) + p.w < 0.0f) return false;
+    }
+    return true;
+  }
+
+  // box in the space `world` maps to the frustum's; tests the world box around it
+  bool intersects_box(const Aabb &box, const glm::mat4 &world) const {
+    const glm::vec3 center(world * glm::vec4(box.center(), 1.0f)), half = 0.5f * (box.max - box.min);
+    const glm::vec3 extent = glm::abs(glm::vec3(world[0])) * half.x + glm::abs(glm::vec3(world[1])) * half.y + glm::abs(glm::vec3(world[2])) * half.z;
+    return intersects_box(Aabb{center - extent, center + extent});
+  }
+};
+
+// what view dependent culling needs of one view; with several views something is kept when any of them keeps it
+struct CullView {
+  Frustum frustum;
+  glm::vec3 eye;
+};
+// the frame's views, in the frame arena
+using CullViews = frame_vector<CullView>;
+
+#endif
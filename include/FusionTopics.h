@@ -0,0 +1,230 @@
+#pragma once
+#ifndef FUSION_TOPICS_H
+#define FUSION_TOPICS_H
+
+#include <FrameArena.h>
+#include <Profiler.h>
+#include <ecal/ecal.h>
+#include <fusion.pb.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Rate-partitioned layout of the FusionData stream.
+//
+// pose topic  : per-sample fields (instrument poses, haptic, animation_value), sent on every publish,
+//               best effort / keep last 1 so a slow reader only ever sees the newest pose.
+// state topic : slowly changing configuration (offset, rot_coord, pivot_pos, tissue, counters), sent only when
+//               it changes, re-sent when a subscriber connects and on a heartbeat, so late joiners get the
+//               last value ("latched"); reliable delivery.
+// Both topics carry FusionData with only their own fields set, so no new message types are needed and proto3
+// leaves the other fields off the wire. FusionReassembler turns the pair back into full FusionData.
+
+struct FusionTopicConfig {
+  bool split = false; // publish pose/state topics
+  bool legacy = true; // keep publishing the full message on legacy_topic
+  std::string legacy_topic = "fusion";
+  std::string pose_topic = "fusion_pose";
+  std::string state_topic = "fusion_state";
+  double state_heartbeat = 1.0;// seconds between unconditional state re-sends
+};
+
+#pragma region field partition
+// copies the high-rate fields of `from` into `to`. Sub-messages are assigned whole and scalars set explicitly
+// (not MergeFrom) so that a field going back to zero overwrites the old value.
+inline void copy_pose_fields(const pb::FusionData::FusionData &from, pb::FusionData::FusionData &to) {
+  *to.mutable_endoscope_pos() = from.endoscope_pos();
+  *to.mutable_endoscope_euler() = from.endoscope_euler();
+  *to.mutable_tube_pos() = from.tube_pos();
+  *to.mutable_tube_euler() = from.tube_euler();
+  *to.mutable_rongeur_pos() = from.rongeur_pos();
+  *to.mutable_rongeur_rot() = from.rongeur_rot();
+  *to.mutable_haptic() = from.haptic();
+  to.mutable_offset()->set_animation_value(from.offset().animation_value());
+}
+
+// copies the low-rate fields; offset.animation_value belongs to the pose and is left alone
+inline void copy_state_fields(const pb::FusionData::FusionData &from, pb::FusionData::FusionData &to) {
+  pb::Offset::Offset *offset = to.mutable_offset();
+  offset->set_endoscope_offset(from.offset().endoscope_offset());
+  offset->set_tube_offset(from.offset().tube_offset());
+  offset->set_instrument_switch(from.offset().instrument_switch());
+  offset->set_pivot_offset(from.offset().pivot_offset());
+  *to.mutable_rot_coord() = from.rot_coord();
+  *to.mutable_pivot_pos() = from.pivot_pos();
+  *to.mutable_soft_tissue() = from.soft_tissue();
+  to.set_ablation_count(from.ablation_count());
+  to.set_hemostasis_count(from.hemostasis_count());
+  to.set_hemostasis_index(from.hemostasis_index());
+  to.set_nerve_root_dance(from.nerve_root_dance());
+}
+#pragma endregion
+
+#pragma region publisher
+// Server side. Owns the topics selected by the config and serializes into the frame arena, so a publish does
+// not allocate; call it from the loop thread, within the iteration.
+class FusionPublisher {
+ public:
+  explicit FusionPublisher(FusionTopicConfig config = FusionTopicConfig()) : config(std::move(config)) {
+    if (!this->config.split || this->config.legacy) legacy = std::make_unique<eCAL::CPublisher>(this->config.legacy_topic);
+    if (this->config.split) {
+      eCAL::QOS::SWriterQOS pose_qos;
+      pose_qos.history_kind = eCAL::QOS::keep_last_history_qos;
+      pose_qos.history_kind_depth = 1;
+      pose_qos.reliability = eCAL::QOS::best_effort_reliability_qos;
+      pose = std::make_unique<eCAL::CPublisher>(this->config.pose_topic);
+      pose->SetQOS(pose_qos);
+
+      eCAL::QOS::SWriterQOS state_qos;
+      state_qos.history_kind = eCAL::QOS::keep_last_history_qos;
+      state_qos.history_kind_depth = 1;
+      state_qos.reliability = eCAL::QOS::reliable_reliability_qos;
+      state = std::make_unique<eCAL::CPublisher>(this->config.state_topic);
+      state->SetQOS(state_qos);
+      // runs on an eCAL thread; the next publish() picks the flag up
+      state->AddEventCallback(pub_event_connected, [this](const char *, const eCAL::SPubEventCallbackData *) { state_resend = true; });
+    }
+  }
+  ~FusionPublisher() {
+    if (state) state->RemEventCallback(pub_event_connected);
+  }
+  FusionPublisher(const FusionPublisher &) = delete;
+  FusionPublisher &operator=(const FusionPublisher &) = delete;
+
+  // publishes one sample according to the layout; returns false if any send came up short
+  bool publish(const pb::FusionData::FusionData &fusion, const long long time = -1) {
+    bool ok = true;
+    if (legacy) ok &= send(*legacy, fusion, time, legacy_bytes);
+    if (!config.split) return ok;
+
+    pose_message.Clear();
+    copy_pose_fields(fusion, pose_message);
+    ok &= send(*pose, pose_message, time, pose_bytes);
+
+    state_message.Clear();
+    copy_state_fields(fusion, state_message);
+    size_t size;
+    uint8_t *buffer;
+    {
+      PROFILE_ZONE("serialize");
+      size = state_message.ByteSizeLong();
+      buffer = frame_arena().allocate_array<uint8_t>(size);
+      state_message.SerializePartialToArray(buffer, static_cast<int>(size));
+    }
+    const auto now = std::chrono::steady_clock::now();
+    const bool changed = size != last_state.size() || std::memcmp(buffer, last_state.data(), size) != 0;
+    const bool heartbeat = std::chrono::duration<double>(now - last_state_send).count() >= config.state_heartbeat;
+    if (changed || heartbeat || state_resend.exchange(false)) {
+      PROFILE_ZONE("send");
+      ok &= state->Send(buffer, size, time) == size;
+      last_state.assign(buffer, buffer + size);
+      last_state_send = now;
+      state_bytes += size;
+    }
+    return ok;
+  }
+
+  const FusionTopicConfig config;
+
+  // bytes handed to eCAL per topic since start, for comparing the layouts
+  uint64_t legacy_bytes = 0;
+  uint64_t pose_bytes = 0;
+  uint64_t state_bytes = 0;
+
+ private:
+  std::unique_ptr<eCAL::CPublisher> legacy, pose, state;
+  pb::FusionData::FusionData pose_message, state_message;
+  std::vector<uint8_t> last_state;
+  std::chrono::steady_clock::time_point last_state_send;
+  std::atomic<bool> state_resend{false};
+
+  bool send(const eCAL::CPublisher &publisher, const pb::FusionData::FusionData &message, const long long time, uint64_t &bytes) {
+    size_t size;
+    uint8_t *buffer;
+    {
+      PROFILE_ZONE("serialize");
+      size = message.ByteSizeLong();
+      buffer = frame_arena().allocate_array<uint8_t>(size);
+      message.SerializePartialToArray(buffer, static_cast<int>(size));
+    }
+    bytes += size;
+    PROFILE_ZONE("send");
+    return publisher.Send(buffer, size, time) == size;
+  }
+};
+#pragma endregion
+
+#pragma region reassembler
+// Consumer side compatibility shim: subscribes to the pose and state topics and rebuilds full FusionData.
+// Every pose update produces one full message, handed to `on_fusion` and, if `republish_topic` is given,
+// re-sent there so unmodified legacy consumers can keep listening on "fusion".
+class FusionReassembler {
+ public:
+  using callback = std::function<void(const pb::FusionData::FusionData &)>;
+
+  explicit FusionReassembler(const FusionTopicConfig &config, callback on_fusion = nullptr, const std::string &republish_topic = "")
+      : on_fusion(std::move(on_fusion)), pose(config.pose_topic), state(config.state_topic) {
+    if (!republish_topic.empty()) republisher = std::make_unique<eCAL::CPublisher>(republish_topic);
+    state.AddReceiveCallback([this](const char *, const eCAL::SReceiveCallbackData *data) { on_state(data); });
+    pose.AddReceiveCallback([this](const char *, const eCAL::SReceiveCallbackData *data) { on_pose(data); });
+  }
+  ~FusionReassembler() {
+    pose.RemReceiveCallback();
+    state.RemReceiveCallback();
+  }
+  FusionReassembler(const FusionReassembler &) = delete;
+  FusionReassembler &operator=(const FusionReassembler &) = delete;
+
+  // the newest full message; false until both a pose and a state have arrived
+  bool latest(pb::FusionData::FusionData &out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!have_pose || !have_state) return false;
+    out = assembled;
+    return true;
+  }
+
+ private:
+  callback on_fusion;
+  eCAL::CSubscriber pose, state;
+  std::unique_ptr<eCAL::CPublisher> republisher;
+
+  mutable std::mutex mutex;
+  pb::FusionData::FusionData incoming, assembled;
+  std::vector<uint8_t> buffer;
+  bool have_pose = false;
+  bool have_state = false;
+
+  void on_state(const eCAL::SReceiveCallbackData *data) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!incoming.ParseFromArray(data->buf, static_cast<int>(data->size))) return;
+    copy_state_fields(incoming, assembled);
+    have_state = true;
+  }
+
+  void on_pose(const eCAL::SReceiveCallbackData *data) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!incoming.ParseFromArray(data->buf, static_cast<int>(data->size))) return;
+    copy_pose_fields(incoming, assembled);
+    have_pose = true;
+    // until the latched state shows up there is nothing complete to hand out
+    if (!have_state) return;
+    if (on_fusion) on_fusion(assembled);
+    if (republisher) {
+      const size_t size = assembled.ByteSizeLong();
+      if (buffer.size() < size) buffer.resize(size * 2);
+      assembled.SerializePartialToArray(buffer.data(), static_cast<int>(size));
+      republisher->Send(buffer.data(), size, data->time);
+    }
+  }
+};
+#pragma endregion
+
+#endif
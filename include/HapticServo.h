@@ -0,0 +1,263 @@
+#pragma once
+#ifndef HAPTIC_SERVO_H
+#define HAPTIC_SERVO_H
+
+#include <LockFreeCell.h>
+#include <Trace.h>
+
+#include <ecal/ecal.h>
+#include <glm/glm.hpp>
+#include <haptic.pb.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Haptic servo loop. Force rendering needs ~1 kHz, the display loop runs at frame rate and can stall for
+// hundreds of milliseconds (model loads, window moves), so the servo runs on its own thread:
+//  - the contact comes through a LockFreeCell written by the contact producer (the frame loop),
+//  - step() is bounded and does not allocate,
+//  - output goes out on its own topic and into `output` for the frame loop to mirror into FusionData,
+//  - when the inputs go stale the force fades out instead of holding the last spring forever.
+
+// deepest instrument/anatomy contact, written by whoever computes contacts
+struct HapticContact {
+  float depth;     // penetration depth, <= 0 means free
+  glm::vec3 normal;// direction the force pushes the instrument
+  float stiffness; // tissue stiffness scale, 1 = nominal
+  double time;     // seconds, steady clock
+};
+
+struct HapticOutput {
+  float state; // 0 free, 1 contact, 2 force saturated, 3 inputs stale
+  float offset;// rendered penetration depth
+  float force; // force magnitude
+  glm::vec3 direction;
+  uint64_t tick;
+};
+
+struct HapticServoConfig {
+  double rate = 1000.0;       // Hz
+  int cpu = -1;               // pin to this cpu, -1 leaves placement to the OS
+  int fifo_priority = 0;      // SCHED_FIFO priority (1..99) on Linux, time critical on Windows; 0 keeps normal
+  std::string topic = "haptic";
+  int publish_divider = 1;    // publish every n-th tick
+  float stiffness = 400.0f;   // N per unit of depth
+  float damping = 2.0f;       // N per unit/s
+  float max_force = 8.0f;     // saturation
+  float max_force_rate = 400.0f;// N/s slew limit, keeps steps from input updates (frame rate) off the device
+  double stale_after = 0.1;   // seconds without a contact update before the force fades
+  double fade_time = 0.2;     // seconds to fade to zero once stale
+  double spin_window = 200e-6;// busy-wait this long before each deadline instead of trusting the OS timer
+};
+
+// lateness histogram bucket upper bounds in microseconds; the last bucket catches everything above
+constexpr int haptic_latency_buckets = 7;
+constexpr double haptic_latency_bounds[haptic_latency_buckets - 1] = {10, 50, 100, 250, 500, 1000};
+
+struct HapticServoStats {
+  uint64_t ticks;
+  uint64_t deadline_misses;// ticks that finished after the next tick's deadline
+  uint64_t skipped_ticks;  // periods dropped when resynchronizing after a long stall
+  double max_lateness_us;
+  double mean_lateness_us;
+  double max_step_us;
+  uint64_t latency_histogram[haptic_latency_buckets];
+  bool affinity_applied;
+  bool priority_applied;
+};
+
+class HapticServo {
+ public:
+  explicit HapticServo(HapticServoConfig config = HapticServoConfig()) : config(std::move(config)) {}
+  ~HapticServo() { stop(); }
+  HapticServo(const HapticServo &) = delete;
+  HapticServo &operator=(const HapticServo &) = delete;
+
+  const HapticServoConfig config;
+
+  LockFreeCell<HapticContact> contact;
+  LockFreeCell<HapticOutput> output;
+
+  void start() {
+    if (running.exchange(true)) return;
+    worker = std::thread([this] { run(); });
+  }
+
+  void stop() {
+    running = false;
+    if (worker.joinable()) worker.join();
+  }
+
+  HapticServoStats stats() const {
+    HapticServoStats s{};
+    s.ticks = ticks.load(std::memory_order_relaxed);
+    s.deadline_misses = deadline_misses.load(std::memory_order_relaxed);
+    s.skipped_ticks = skipped_ticks.load(std::memory_order_relaxed);
+    s.max_lateness_us = max_lateness_us.load(std::memory_order_relaxed);
+    s.mean_lateness_us = s.ticks ? lateness_sum_us.load(std::memory_order_relaxed) / static_cast<double>(s.ticks) : 0.0;
+    s.max_step_us = max_step_us.load(std::memory_order_relaxed);
+    for (int i = 0; i < haptic_latency_buckets; ++i) s.latency_histogram[i] = histogram[i].load(std::memory_order_relaxed);
+    s.affinity_applied = affinity_applied;
+    s.priority_applied = priority_applied;
+    return s;
+  }
+
+  static double now_seconds() { return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+  // One servo tick: contact -> virtual coupling force. Bounded work, no allocation, no locks.
+  HapticOutput step(const double now, const double dt) {
+    HapticContact c;
+    const bool have_contact = contact.load(c) != 0;
+    const double age = have_contact ? now - c.time : 1e9;
+
+    float depth = have_contact ? std::max(c.depth, 0.0f) : 0.0f;
+    // depth rate from consecutive ticks, low-passed: contact updates arrive at frame rate, not servo rate
+    const float raw_rate = static_cast<float>((depth - last_depth) / dt);
+    depth_rate += (raw_rate - depth_rate) * 0.1f;
+    last_depth = depth;
+
+    float target = 0.0f;
+    if (depth > 0.0f) target = std::max(0.0f, config.stiffness * c.stiffness * depth + config.damping * depth_rate);
+
+    float fade = 1.0f;
+    if (age > config.stale_after) fade = static_cast<float>(std::max(0.0, 1.0 - (age - config.stale_after) / config.fade_time));
+    target = std::min(target * fade, config.max_force);
+
+    const float max_delta = static_cast<float>(config.max_force_rate * dt);
+    force += std::min(std::max(target - force, -max_delta), max_delta);
+
+    HapticOutput out{};
+    out.force = force;
+    out.offset = depth * fade;
+    out.direction = have_contact ? c.normal : glm::vec3(0.0f);
+    if (age > config.stale_after) out.state = 3.0f;
+    else if (force >= config.max_force) out.state = 2.0f;
+    else if (depth > 0.0f) out.state = 1.0f;
+    else out.state = 0.0f;
+    out.tick = ++tick_count;
+    return out;
+  }
+
+ private:
+  std::atomic<bool> running{false};
+  std::thread worker;
+
+  // servo-thread state
+  float force = 0.0f;
+  float last_depth = 0.0f;
+  float depth_rate = 0.0f;
+  uint64_t tick_count = 0;
+  pb::Haptic::Haptic message;
+  uint8_t buffer[64];
+
+  // statistics, written by the servo thread only
+  std::atomic<uint64_t> ticks{0};
+  std::atomic<uint64_t> deadline_misses{0};
+  std::atomic<uint64_t> skipped_ticks{0};
+  std::atomic<double> max_lateness_us{0.0};
+  std::atomic<double> lateness_sum_us{0.0};
+  std::atomic<double> max_step_us{0.0};
+  std::atomic<uint64_t> histogram[haptic_latency_buckets] = {};
+  std::atomic<bool> affinity_applied{false};
+  std::atomic<bool> priority_applied{false};
+
+  void apply_thread_settings() {
+#if defined(_WIN32)
+    if (config.cpu >= 0) affinity_applied = SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << config.cpu) != 0;
+    if (config.fifo_priority > 0) priority_applied = SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#elif defined(__linux__)
+    if (config.cpu >= 0) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(config.cpu, &set);
+      affinity_applied = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+    if (config.fifo_priority > 0) {
+      sched_param param{};
+      param.sched_priority = std::min(std::max(config.fifo_priority, sched_get_priority_min(SCHED_FIFO)), sched_get_priority_max(SCHED_FIFO));
+      // needs CAP_SYS_NICE or an rtprio limit; without it we keep running at normal priority
+      priority_applied = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+    }
+#endif
+    if (config.cpu >= 0 && !affinity_applied) std::cout << "WARNING::HAPTIC:: could not pin servo thread to cpu " << config.cpu << std::endl;
+    if (config.fifo_priority > 0 && !priority_applied) std::cout << "WARNING::HAPTIC:: real-time priority not permitted, running at normal priority" << std::endl;
+  }
+
+  static void atomic_max(std::atomic<double> &target, const double value) {
+    double current = target.load(std::memory_order_relaxed);
+    while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+  }
+
+  void run() {
+    TRACE_THREAD_NAME("haptic servo");
+    apply_thread_settings();
+    eCAL::CPublisher publisher(config.topic);
+
+    using clock = std::chrono::steady_clock;
+    const auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / config.rate));
+    const auto spin = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(config.spin_window));
+    const double dt = 1.0 / config.rate;
+    auto deadline = clock::now() + period;
+
+    while (running.load(std::memory_order_relaxed)) {
+      // sleep most of the way, then spin: the OS timer alone is too coarse for a 1 ms period
+      if (deadline - clock::now() > spin) std::this_thread::sleep_until(deadline - spin);
+      while (clock::now() < deadline) std::this_thread::yield();
+
+      TRACE_ZONE("haptic tick");
+      const auto start = clock::now();
+      const double lateness_us = std::chrono::duration<double, std::micro>(start - deadline).count();
+
+      const HapticOutput out = step(std::chrono::duration<double>(start.time_since_epoch()).count(), dt);
+      output.store(out);
+      if (out.tick % static_cast<uint64_t>(std::max(config.publish_divider, 1)) == 0) {
+        message.set_haptic_state(out.state);
+        message.set_haptic_offset(out.offset);
+        message.set_haptic_force(out.force);
+        const size_t size = message.ByteSizeLong();
+        if (size <= sizeof(buffer) && message.SerializeToArray(buffer, static_cast<int>(size))) publisher.Send(buffer, size);
+      }
+
+      const double step_us = std::chrono::duration<double, std::micro>(clock::now() - start).count();
+      ticks.fetch_add(1, std::memory_order_relaxed);
+      lateness_sum_us.store(lateness_sum_us.load(std::memory_order_relaxed) + lateness_us, std::memory_order_relaxed);
+      atomic_max(max_lateness_us, lateness_us);
+      atomic_max(max_step_us, step_us);
+      int bucket = 0;
+      while (bucket < haptic_latency_buckets - 1 && lateness_us > haptic_latency_bounds[bucket]) ++bucket;
+      histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+
+      deadline += period;
+      const auto now = clock::now();
+      if (now > deadline) {
+        deadline_misses.fetch_add(1, std::memory_order_relaxed);
+        // more than a few periods behind (we were descheduled): drop the backlog instead of bursting ticks
+        if (now - deadline > 4 * period) {
+          const auto behind = (now - deadline) / period;
+          skipped_ticks.fetch_add(static_cast<uint64_t>(behind), std::memory_order_relaxed);
+          deadline += behind * period;
+        }
+      }
+    }
+  }
+};
+
+#endif
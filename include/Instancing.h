@@ -0,0 +1,173 @@
+#pragma once
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <Frustum.h>
+#include <Model.h>
+#include <ResourceRegistry.h>
+#include <Shader.h>
+#include <TransformHierarchy.h>
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Instanced drawing of repeated objects (screws, rods, clips): one Model, any number of placements, one
+// glDrawElementsInstanced per mesh. Placements are culled against the frustum on the CPU and only the visible
+// ones are packed into the instance buffer, which is re-uploaded only when that packed array changed.
+// Draw with shader/instanced.vs + instanced.fs.
+
+// per-instance vertex data: world matrix at locations 7-10 (one column each), tint at 11
+struct InstanceData {
+  glm::mat4 world;
+  glm::vec4 tint;
+};
+constexpr unsigned int instance_location = 7;
+
+struct InstanceStats {
+  size_t instances;
+  size_t visible;
+  size_t draw_calls;
+  size_t uploaded_bytes;
+};
+
+// Sets up the instance attributes on the model's mesh VAOs, so use one InstancedModel per Model.
+class InstancedModel {
+ public:
+  explicit InstancedModel(Model &model) : model(model) {
+    Aabb box;
+    for (const glm::vec3 &p : model.collision_positions) box.grow(p);
+    if (box.valid()) {
+      center = box.center();
+      for (const glm::vec3 &p : model.collision_positions) radius = std::max(radius, glm::length(p - center));
+    }
+    glGenBuffers(1, &vbo);
+    for (const Mesh &mesh : model.meshes) {
+      glBindVertexArray(mesh.VAO);
+      glBindBuffer(GL_ARRAY_BUFFER, vbo);
+      for (unsigned int c = 0; c < 4; ++c) {
+        glEnableVertexAttribArray(instance_location + c);
+        glVertexAttribPointer(instance_location + c, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *) (offsetof(InstanceData, world) + c * sizeof(glm::vec4)));
+        glVertexAttribDivisor(instance_location + c, 1);
+      }
+      glEnableVertexAttribArray(instance_location + 4);
+      glVertexAttribPointer(instance_location + 4, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *) offsetof(InstanceData, tint));
+      glVertexAttribDivisor(instance_location + 4, 1);
+    }
+    glBindVertexArray(0);
+  }
+  ~InstancedModel() {
+    resources().remove(record);
+    glDeleteBuffers(1, &vbo);
+  }
+  InstancedModel(const InstancedModel &) = delete;
+  InstancedModel &operator=(const InstancedModel &) = delete;
+
+  Model &model;
+  // placements relative to the parent handed to update()
+  std::vector<InstanceData> instances;
+
+  // culls the placements under `parent` against the views (kept when any view sees them) and uploads the visible ones
+  void update(const glm::mat4 &parent, const CullViews &views) {
+    visible.clear();
+    for (const InstanceData &instance : instances) {
+      const glm::mat4 world = parent * instance.world;
+      const float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+      const glm::vec3 world_center(world * glm::vec4(center, 1.0f));
+      if (std::none_of(views.begin(), views.end(), [&](const CullView &view) { return view.frustum.intersects_sphere(world_center, radius * scale); })) continue;
+      visible.push_back({world, instance.tint});
+    }
+    last_stats = {instances.size(), visible.size(), 0, 0};
+    if (visible.size() == uploaded && (visible.empty() || std::memcmp(visible.data(), shadow.data(), visible.size() * sizeof(InstanceData)) == 0)) return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    if (visible.size() > capacity) {
+      capacity = std::max<size_t>(64, visible.size() + visible.size() / 2);
+      glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(capacity * sizeof(InstanceData)), nullptr, GL_DYNAMIC_DRAW);
+      if (record == 0) record = resources().add(k_resource_buffer, vbo, capacity * sizeof(InstanceData), std::to_string(capacity) + " instances", model.name + " instances");
+      else resources().update(record, capacity * sizeof(InstanceData), std::to_string(capacity) + " instances");
+    }
+    if (!visible.empty()) glBufferSubData(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(visible.size() * sizeof(InstanceData)), visible.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    shadow = visible;
+    uploaded = visible.size();
+    last_stats.uploaded_bytes = visible.size() * sizeof(InstanceData);
+  }
+
+  // the view comes from the bound ViewUniforms block; sets the model matrix per mesh
+  void Draw(Shader &shader) {
+    if (uploaded == 0) return;
+    for (size_t i = 0; i < model.meshes.size(); ++i) {
+      shader.setMat4("model", model.mesh_transforms[i]);
+      model.meshes[i].DrawInstanced(shader, static_cast<unsigned int>(uploaded));
+      ++last_stats.draw_calls;
+    }
+  }
+
+  const InstanceStats &stats() const { return last_stats; }
+
+ private:
+  unsigned int vbo = 0;
+  size_t capacity = 0, uploaded = 0;
+  ResourceRegistry::Handle record = 0;
+  glm::vec3 center{0.0f};
+  float radius = 0.0f;// bounding sphere in model space
+  std::vector<InstanceData> visible, shadow;
+  InstanceStats last_stats{};
+};
+
+#pragma region plan file
+// one model and its placements
+struct InstancePlan {
+  std::string model_path;
+  std::vector<InstanceData> instances;
+};
+
+// `model = path` starts a group, each `instance = x y z ex ey ez [r g b a]` adds a placement to it
+// (euler in degrees, same order as the fused poses; tint defaults to white); '#' starts a comment
+inline bool load_instance_plan(const std::string &path, std::vector<InstancePlan> &plans) {
+  std::ifstream file(path);
+  if (!file.is_open()) return false;
+  const auto trim = [](std::string s) {
+    const size_t b = s.find_first_not_of(" \t\r");
+    const size_t e = s.find_last_not_of(" \t\r");
+    return b == std::string::npos ? std::string() : s.substr(b, e - b + 1);
+  };
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line)) {
+    ++line_number;
+    line = trim(line.substr(0, line.find('#')));
+    if (line.empty()) continue;
+    const size_t eq = line.find('=');
+    const std::string key = eq == std::string::npos ? line : trim(line.substr(0, eq));
+    const std::string value = eq == std::string::npos ? std::string() : trim(line.substr(eq + 1));
+    if (key == "model") {
+      plans.push_back({value, {}});
+    } else if (key == "instance" && !plans.empty()) {
+      std::istringstream in(value);
+      glm::vec3 position, euler;
+      glm::vec4 tint(1.0f);
+      in >> position.x >> position.y >> position.z >> euler.x >> euler.y >> euler.z;
+      if (!in) {
+        std::cout << "ERROR::INSTANCING:: " << path << ":" << line_number << " expected x y z ex ey ez [r g b a]" << std::endl;
+        continue;
+      }
+      in >> tint.r >> tint.g >> tint.b >> tint.a;
+      glm::mat4 world = glm::mat4_cast(quat_from_euler_yxz(euler));
+      world[3] = glm::vec4(position, 1.0f);
+      plans.back().instances.push_back({world, in ? tint : glm::vec4(1.0f)});
+    } else {
+      std::cout << "ERROR::INSTANCING:: " << path << ":" << line_number << " unknown key " << key << std::endl;
+    }
+  }
+  return true;
+}
+#pragma endregion
+
+#endif
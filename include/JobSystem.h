@@ -0,0 +1,155 @@
+#pragma once
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <Trace.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define JOB_SYSTEM_SSE2 1
+#else
+#define JOB_SYSTEM_SSE2 0
+#endif
+
+// Fork-join worker pool for data-parallel loops. A simulation step issues dozens of short parallel loops back to
+// back (one per constraint color), so dispatch has to cost microseconds, not a condition-variable round trip:
+//  - workers spin on a generation counter for a short while after each loop and only then go to sleep,
+//  - the calling thread works on the loop too and returns once every worker has checked in,
+//  - ranges are handed out in `grain` sized chunks from one atomic cursor, so uneven chunks balance themselves.
+// Loops are issued from one thread at a time; loops issued from inside a loop body run inline.
+class JobSystem {
+ public:
+  // threads = total threads including the caller; 0 picks the hardware concurrency
+  explicit JobSystem(int threads = 0, double spin_seconds = 200e-6) : spin_seconds(spin_seconds) {
+    if (threads <= 0) threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    active = threads - 1;
+    for (int i = 0; i < threads - 1; ++i) workers.emplace_back([this, i] { worker_loop(i); });
+  }
+  ~JobSystem() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+      generation.fetch_add(1);
+    }
+    wake.notify_all();
+    for (std::thread &t : workers) t.join();
+  }
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+
+  int thread_count() const { return static_cast<int>(workers.size()) + 1; }
+  int active_threads() const { return active.load() + 1; }
+  // use only the first n threads (including the caller) for following loops, e.g. for scaling measurements
+  void set_active_threads(const int n) { active = std::min(std::max(n, 1), thread_count()) - 1; }
+
+  // calls fn(chunk_begin, chunk_end) over [begin, end) in chunks of `grain`; returns when all chunks are done
+  template <typename F>
+  void parallel_for(const size_t begin, const size_t end, size_t grain, F &&fn) {
+    if (end <= begin) return;
+    grain = std::max<size_t>(grain, 1);
+    if (inside_job() || active.load(std::memory_order_relaxed) == 0 || end - begin <= grain) {
+      fn(begin, end);
+      return;
+    }
+    using body = typename std::remove_reference<F>::type;
+    job_fn = [](const void *context, const size_t b, const size_t e) { (*static_cast<body *>(const_cast<void *>(context)))(b, e); };
+    job_context = &fn;
+    job_end = end;
+    job_grain = grain;
+    cursor.store(begin, std::memory_order_relaxed);
+    finished.store(0, std::memory_order_relaxed);
+    generation.fetch_add(1);// seq_cst: pairs with the sleeper count in wait_for_job
+    if (sleepers.load() > 0) {
+      std::lock_guard<std::mutex> lock(mutex);
+      wake.notify_all();
+    }
+    inside_job() = true;
+    run_chunks();
+    inside_job() = false;
+    // every worker checks in, so the job fields above are never rewritten while a worker still reads them
+    const int expected = static_cast<int>(workers.size());
+    while (finished.load(std::memory_order_acquire) < expected) pause();
+  }
+
+ private:
+  const double spin_seconds;
+  std::vector<std::thread> workers;
+  std::atomic<int> active{0};
+
+  // current loop, written by the caller before bumping `generation`
+  void (*job_fn)(const void *, size_t, size_t) = nullptr;
+  const void *job_context = nullptr;
+  size_t job_end = 0;
+  size_t job_grain = 1;
+  alignas(64) std::atomic<size_t> cursor{0};
+  alignas(64) std::atomic<int> finished{0};
+  alignas(64) std::atomic<uint64_t> generation{0};
+  std::atomic<int> sleepers{0};
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::atomic<bool> stopping{false};
+
+  static bool &inside_job() {
+    static thread_local bool flag = false;
+    return flag;
+  }
+
+  static void pause() {
+#if JOB_SYSTEM_SSE2
+    _mm_pause();
+#endif
+    std::this_thread::yield();
+  }
+
+  void run_chunks() {
+    for (;;) {
+      const size_t b = cursor.fetch_add(job_grain, std::memory_order_relaxed);
+      if (b >= job_end) return;
+      job_fn(job_context, b, std::min(b + job_grain, job_end));
+    }
+  }
+
+  uint64_t wait_for_job(const uint64_t seen) {
+    const auto spin_until = std::chrono::steady_clock::now() + std::chrono::duration<double>(spin_seconds);
+    for (int i = 0;; ++i) {
+      const uint64_t g = generation.load(std::memory_order_acquire);
+      if (g != seen) return g;
+      if ((i & 63) == 63 && std::chrono::steady_clock::now() > spin_until) break;
+      pause();
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    sleepers.fetch_add(1);
+    wake.wait(lock, [this, seen] { return generation.load() != seen; });
+    sleepers.fetch_sub(1);
+    return generation.load(std::memory_order_acquire);
+  }
+
+  void worker_loop(const int index) {
+    TRACE_THREAD_NAME("job worker");
+    inside_job() = true;
+    uint64_t seen = 0;
+    for (;;) {
+      seen = wait_for_job(seen);
+      if (stopping.load(std::memory_order_acquire)) return;
+      if (index < active.load(std::memory_order_relaxed)) {
+        TRACE_ZONE("job");
+        run_chunks();
+      }
+      finished.fetch_add(1, std::memory_order_release);
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+#ifndef LOCK_FREE_CELL_H
+#define LOCK_FREE_CELL_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Single-writer, multi-reader "latest value" cell (a seqlock). The writer never waits; readers retry while a write
+// is in flight and never block the writer, which is what a real-time reader next to a stall-prone producer
+// (the GL thread) needs. T must be trivially copyable.
+template <typename T>
+class LockFreeCell {
+  static_assert(std::is_trivially_copyable<T>::value, "LockFreeCell needs a trivially copyable type");
+
+ public:
+  LockFreeCell() : value() {}
+
+  // writer side; only one thread may call store
+  void store(const T &v) {
+    const uint32_t s = sequence.load(std::memory_order_relaxed);
+    sequence.store(s + 1, std::memory_order_relaxed);// odd: write in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&value, &v, sizeof(T));
+    sequence.store(s + 2, std::memory_order_release);
+  }
+
+  // reader side; returns the version number of the copy (0 means never written)
+  uint32_t load(T &out) const {
+    for (;;) {
+      const uint32_t before = sequence.load(std::memory_order_acquire);
+      if (before & 1u) continue;
+      std::memcpy(&out, &value, sizeof(T));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence.load(std::memory_order_relaxed) == before) return before / 2;
+    }
+  }
+
+  uint32_t version() const { return sequence.load(std::memory_order_acquire) / 2; }
+
+ private:
+  alignas(64) std::atomic<uint32_t> sequence{0};
+  T value;
+};
+
+#endif
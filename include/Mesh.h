@@ -5,8 +5,13 @@
 #include <glad/glad.h>// holds all OpenGL type declarations
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <FrameArena.h>
+#include <Meshlets.h>
+#include <ResourceRegistry.h>
 #include <Shader.h>
+#include <TextureCache.h>
 #include <string>
+#include <utility>
 #include <vector>
 using namespace std;
 
@@ -30,31 +35,171 @@ struct Vertex {
 };
 
 struct Texture {
-  unsigned int id;
+  unsigned int id = 0;// textures that are not from the cache
   string type;
   string path;
+  TextureCache::Handle handle = 0;// the reference this Texture holds in textures()
+
+  // the GL name to bind; a cached texture is asked for every time, as it starts out as a placeholder
+  unsigned int bind_id() const { return handle ? textures().id(handle) : id; }
 };
 
-class Mesh {
+// the GL objects of a Mesh and their resource records; moves with the mesh and is deleted with it, so a Mesh is
+// move-only
+class MeshGlObjects {
+ public:
+  unsigned int VAO = 0;
+
+  MeshGlObjects() = default;
+  MeshGlObjects(MeshGlObjects &&other) noexcept { take(other); }
+  MeshGlObjects &operator=(MeshGlObjects &&other) noexcept {
+    if (this != &other) {
+      release();
+      take(other);
+    }
+    return *this;
+  }
+  MeshGlObjects(const MeshGlObjects &) = delete;
+  MeshGlObjects &operator=(const MeshGlObjects &) = delete;
+  ~MeshGlObjects() { release(); }
+
+ protected:
+  unsigned int VBO = 0, EBO = 0;
+  unsigned int edgeVAO = 0, edgeEBO = 0;
+  ResourceRegistry::Handle vertex_record = 0, index_record = 0, edge_record = 0, cpu_record = 0;
+
+ private:
+  void take(MeshGlObjects &other) {
+    VAO = std::exchange(other.VAO, 0);
+    VBO = std::exchange(other.VBO, 0);
+    EBO = std::exchange(other.EBO, 0);
+    edgeVAO = std::exchange(other.edgeVAO, 0);
+    edgeEBO = std::exchange(other.edgeEBO, 0);
+    vertex_record = std::exchange(other.vertex_record, 0);
+    index_record = std::exchange(other.index_record, 0);
+    edge_record = std::exchange(other.edge_record, 0);
+    cpu_record = std::exchange(other.cpu_record, 0);
+  }
+  void release() {
+    for (const ResourceRegistry::Handle record : {vertex_record, index_record, edge_record, cpu_record}) resources().remove(record);
+    for (const unsigned int vao : {VAO, edgeVAO})
+      if (vao != 0) glDeleteVertexArrays(1, &vao);
+    for (const unsigned int buffer : {VBO, EBO, edgeEBO})
+      if (buffer != 0) glDeleteBuffers(1, &buffer);
+    VAO = VBO = EBO = edgeVAO = edgeEBO = 0;
+    vertex_record = index_record = edge_record = cpu_record = 0;
+  }
+};
+
+class Mesh : public MeshGlObjects {
  public:
   // mesh Data
   vector<Vertex> vertices;
   vector<unsigned int> indices;
   vector<Texture> textures;
-  unsigned int VAO;
+  // per morph target, position offsets from the rest pose (CPU skinning only)
+  vector<vector<glm::vec3>> morph_deltas;
+  // triangle indices in the index buffer; still valid after release_cpu_geometry()
+  unsigned int index_count = 0;
+  // GL_LINES index count of the edge list, 0 until set_edges()
+  unsigned int edge_count = 0;
+  // triangle clusters over contiguous index ranges (empty for skinned meshes) and the ranges that survived culling
+  vector<Meshlet> meshlets;
+  MeshletDrawList draw_list;
+  // owner of the mesh's records in the resource registry
+  string owner;
 
   // constructor
-  Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures) {
-    this->vertices = vertices;
-    this->indices = indices;
-    this->textures = textures;
+  Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, string owner = "mesh") : owner(std::move(owner)) {
+    this->vertices = std::move(vertices);
+    this->indices = std::move(indices);
+    this->textures = std::move(textures);
 
     // now that we have all the required data, set the vertex buffers and its attribute pointers.
     setup_mesh();
+    const size_t vertex_bytes = this->vertices.size() * sizeof(Vertex), index_bytes = this->indices.size() * sizeof(unsigned int);
+    vertex_record = resources().add(k_resource_buffer, VBO, vertex_bytes, std::to_string(this->vertices.size()) + " vertices", this->owner);
+    index_record = resources().add(k_resource_buffer, EBO, index_bytes, std::to_string(index_count) + " indices", this->owner);
+    cpu_record = resources().add(k_resource_cpu, 0, vertex_bytes + index_bytes, "geometry copy", this->owner);
+  }
+
+  // frees the CPU copies of vertices and indices; the GL buffers keep drawing. Only once nothing reads them any
+  // more: collision, occluders, edges and meshlets are built from them at load, CPU skinning reads them per frame
+  void release_cpu_geometry() {
+    vector<Vertex>().swap(vertices);
+    vector<unsigned int>().swap(indices);
+    resources().remove(cpu_record);
+    cpu_record = 0;
   }
 
   // render the mesh
   void Draw(Shader &shader) {
+    bind_textures(shader);
+
+    // draw mesh
+    draw_triangles();
+
+    // always good practice to set everything back to defaults once configured.
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+  // line list over the same vertices (pairs of indices), drawn through its own VAO by DrawEdges
+  void set_edges(const vector<unsigned int> &edge_indices) {
+    if (edgeVAO == 0) {
+      glGenVertexArrays(1, &edgeVAO);
+      glGenBuffers(1, &edgeEBO);
+      glBindVertexArray(edgeVAO);
+      glBindBuffer(GL_ARRAY_BUFFER, VBO);
+      glEnableVertexAttribArray(0);
+      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) 0);
+      glEnableVertexAttribArray(1);
+      glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, Normal));
+      glEnableVertexAttribArray(2);
+      glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, TexCoords));
+    } else {
+      glBindVertexArray(edgeVAO);
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, edgeEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, edge_indices.size() * sizeof(unsigned int), edge_indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    edge_count = static_cast<unsigned int>(edge_indices.size());
+    if (edge_record == 0) edge_record = resources().add(k_resource_buffer, edgeEBO, edge_count * sizeof(unsigned int), std::to_string(edge_count) + " edge indices", owner);
+    else resources().update(edge_record, edge_count * sizeof(unsigned int), std::to_string(edge_count) + " edge indices");
+  }
+
+  void DrawEdges(Shader &shader) {
+    if (edge_count == 0) return;
+    bind_textures(shader);
+    glBindVertexArray(edgeVAO);
+    glDrawElements(GL_LINES, edge_count, GL_UNSIGNED_INT, 0);
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+  // triangles only, no textures (depth passes)
+  void DrawGeometry() { draw_triangles(); }
+
+  // render `instances` copies; the per-instance attributes have to be set up on VAO (see Instancing.h)
+  void DrawInstanced(Shader &shader, const unsigned int instances) {
+    bind_textures(shader);
+    glBindVertexArray(VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0, static_cast<GLsizei>(instances));
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+ private:
+  // the whole index buffer, or the meshlet ranges left by culling
+  void draw_triangles() {
+    glBindVertexArray(VAO);
+    if (!draw_list.active)
+      glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0);
+    else if (!draw_list.counts.empty())
+      glMultiDrawElements(GL_TRIANGLES, draw_list.counts.data(), GL_UNSIGNED_INT, draw_list.offsets.data(), static_cast<GLsizei>(draw_list.counts.size()));
+    glBindVertexArray(0);
+  }
+
+  void bind_textures(Shader &shader) {
     // bind appropriate textures
     unsigned int diffuseNr = 1;
     unsigned int specularNr = 1;
@@ -63,36 +208,24 @@ class Mesh {
     for (unsigned int i = 0; i < textures.size(); i++) {
       glActiveTexture(GL_TEXTURE0 + i);// active proper texture unit before binding
       // retrieve texture number (the N in diffuse_textureN)
-      string number;
-      string name = textures[i].type;
+      unsigned int number = 0;
+      const string &name = textures[i].type;
       if (name == "texture_diffuse")
-        number = std::to_string(diffuseNr++);
+        number = diffuseNr++;
       else if (name == "texture_specular")
-        number = std::to_string(specularNr++);// transfer unsigned int to string
+        number = specularNr++;
       else if (name == "texture_normal")
-        number = std::to_string(normalNr++);// transfer unsigned int to string
+        number = normalNr++;
       else if (name == "texture_height")
-        number = std::to_string(heightNr++);// transfer unsigned int to string
+        number = heightNr++;
 
-      // now set the sampler to the correct texture unit
-      glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+      // now set the sampler to the correct texture unit; the uniform name is formatted in the frame arena
+      glUniform1i(glGetUniformLocation(shader.ID, number ? frame_format("%s%u", name.c_str(), number) : name.c_str()), i);
       // and finally bind the texture
-      glBindTexture(GL_TEXTURE_2D, textures[i].id);
+      glBindTexture(GL_TEXTURE_2D, textures[i].bind_id());
     }
-
-    // draw mesh
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-
-    // always good practice to set everything back to defaults once configured.
-    glActiveTexture(GL_TEXTURE0);
   }
 
- private:
-  // render data
-  unsigned int VBO, EBO;
-
   // initializes all the buffer objects/arrays
   void setup_mesh() {
     // create buffers/arrays
@@ -110,6 +243,7 @@ class Mesh {
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    index_count = static_cast<unsigned int>(indices.size());
 
     // set the vertex attribute pointers
     // vertex Positions
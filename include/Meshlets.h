@@ -0,0 +1,175 @@
+#pragma once
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include <Frustum.h>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Meshlets: a mesh's triangles regrouped at import into small connected clusters, each a contiguous range of the
+// index buffer with a bounding sphere and a cone bounding its face normals. Per frame the CPU drops clusters
+// outside the frustum or facing away from the camera (of every view, when several share the frame) and draws
+// the rest with one glMultiDrawElements, adjacent surviving ranges merged.
+
+constexpr unsigned int meshlet_max_triangles = 124;
+constexpr unsigned int meshlet_max_vertices = 64;
+
+struct Meshlet {
+  unsigned int first_index;
+  unsigned int index_count;
+  glm::vec3 center;// bounding sphere, mesh space
+  float radius;
+  glm::vec3 cone_axis;// average face normal
+  float cone_cutoff;  // sine of the cone's half angle; > 1 when the normals spread too far to ever cull
+};
+
+// Reorders `indices` so every meshlet is contiguous and returns the meshlets. Clusters grow greedily over
+// triangles sharing a vertex with them until a triangle or vertex budget is hit. V needs a glm::vec3 Position.
+template <typename V>
+std::vector<Meshlet> build_meshlets(const std::vector<V> &vertices, std::vector<unsigned int> &indices) {
+  const size_t triangle_count = indices.size() / 3;
+  // vertex -> triangles
+  std::vector<unsigned int> start(vertices.size() + 1, 0), adjacency(triangle_count * 3);
+  for (size_t i = 0; i < triangle_count * 3; ++i) ++start[indices[i] + 1];
+  for (size_t v = 0; v < vertices.size(); ++v) start[v + 1] += start[v];
+  std::vector<unsigned int> fill(start.begin(), start.end() - 1);
+  for (size_t i = 0; i < triangle_count * 3; ++i) adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+
+  std::vector<glm::vec3> face_normals(triangle_count, glm::vec3(0.0f));
+  for (size_t t = 0; t < triangle_count; ++t) {
+    const glm::vec3 &a = vertices[indices[3 * t]].Position, &b = vertices[indices[3 * t + 1]].Position, &c = vertices[indices[3 * t + 2]].Position;
+    const glm::vec3 n = glm::cross(b - a, c - a);
+    const float length = glm::length(n);
+    if (length > 0.0f) face_normals[t] = n / length;
+  }
+
+  std::vector<Meshlet> meshlets;
+  std::vector<unsigned int> reordered;
+  reordered.reserve(triangle_count * 3);
+  std::vector<uint8_t> assigned(triangle_count, 0);
+  std::vector<unsigned int> vertex_stamp(vertices.size(), UINT32_MAX), candidates;
+  std::vector<unsigned int> triangles;
+  for (size_t seed = 0; seed < triangle_count; ++seed) {
+    if (assigned[seed]) continue;
+    const auto stamp = static_cast<unsigned int>(meshlets.size());
+    unsigned int unique_vertices = 0;
+    glm::vec3 normal_sum(0.0f);
+    triangles.clear();
+    candidates.assign(1, static_cast<unsigned int>(seed));
+    // next triangle: fewest new vertices, then closest to the cluster's average normal (keeps cones narrow)
+    while (triangles.size() < meshlet_max_triangles) {
+      size_t best = SIZE_MAX;
+      float best_score = FLT_MAX;
+      const glm::vec3 axis = glm::length(normal_sum) > 0.0f ? glm::normalize(normal_sum) : glm::vec3(0.0f);
+      for (size_t c = 0; c < candidates.size();) {
+        const unsigned int t = candidates[c];
+        unsigned int added = 0;
+        for (int k = 0; k < 3; ++k) added += vertex_stamp[indices[3 * t + k]] != stamp;
+        if (assigned[t] || unique_vertices + added > meshlet_max_vertices) {
+          candidates[c] = candidates.back();
+          candidates.pop_back();
+          continue;
+        }
+        const float score = static_cast<float>(added) + 2.0f * (1.0f - glm::dot(face_normals[t], axis));
+        if (score < best_score) {
+          best_score = score;
+          best = c;
+        }
+        ++c;
+      }
+      if (best == SIZE_MAX) break;
+      const unsigned int t = candidates[best];
+      candidates[best] = candidates.back();
+      candidates.pop_back();
+      for (int k = 0; k < 3; ++k) {
+        const unsigned int v = indices[3 * t + k];
+        if (vertex_stamp[v] == stamp) continue;
+        vertex_stamp[v] = stamp;
+        ++unique_vertices;
+        for (unsigned int a = start[v]; a < start[v + 1]; ++a)
+          if (!assigned[adjacency[a]]) candidates.push_back(adjacency[a]);
+      }
+      assigned[t] = 1;
+      normal_sum += face_normals[t];
+      triangles.push_back(t);
+    }
+
+    Meshlet meshlet{static_cast<unsigned int>(reordered.size()), static_cast<unsigned int>(triangles.size() * 3), glm::vec3(0.0f), 0.0f, glm::vec3(0.0f), 2.0f};
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for (const unsigned int t : triangles) {
+      for (int k = 0; k < 3; ++k) {
+        lo = glm::min(lo, vertices[indices[3 * t + k]].Position);
+        hi = glm::max(hi, vertices[indices[3 * t + k]].Position);
+        reordered.push_back(indices[3 * t + k]);
+      }
+      meshlet.cone_axis += face_normals[t];
+    }
+    meshlet.center = 0.5f * (lo + hi);
+    for (const unsigned int t : triangles)
+      for (int k = 0; k < 3; ++k) meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[3 * t + k]].Position - meshlet.center));
+    const float axis_length = glm::length(meshlet.cone_axis);
+    if (axis_length > 0.0f) {
+      meshlet.cone_axis /= axis_length;
+      float min_dot = 1.0f;
+      for (const unsigned int t : triangles)
+        if (face_normals[t] != glm::vec3(0.0f)) min_dot = std::min(min_dot, glm::dot(face_normals[t], meshlet.cone_axis));
+      if (min_dot > 0.0f) meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+    }
+    meshlets.push_back(meshlet);
+  }
+  indices.swap(reordered);
+  return meshlets;
+}
+
+// compacted ranges for glMultiDrawElements; inactive means draw the whole mesh
+struct MeshletDrawList {
+  bool active = false;
+  std::vector<GLsizei> counts;
+  std::vector<const void *> offsets;// byte offsets into the index buffer
+  size_t meshlets_drawn = 0;
+};
+
+// Keeps the meshlets inside some view's frustum and, with cull_backfaces, showing some face to that view's eye
+// (meshoptimizer's cone test). world is assumed free of non-uniform scale. Leave backfaces alone when the faces
+// are not filled (polygon-mode wireframe shows back faces).
+inline void cull_meshlets(const std::vector<Meshlet> &meshlets, const glm::mat4 &world, const CullViews &views, const bool cull_backfaces, MeshletDrawList &out) {
+  out.active = true;
+  out.counts.clear();
+  out.offsets.clear();
+  out.meshlets_drawn = 0;
+  const glm::mat3 rotation(world);
+  const float scale = std::max(glm::length(rotation[0]), std::max(glm::length(rotation[1]), glm::length(rotation[2])));
+  unsigned int run_first = 0, run_end = 0;// current merged range, in indices
+  for (const Meshlet &meshlet : meshlets) {
+    const glm::vec3 center = glm::vec3(world * glm::vec4(meshlet.center, 1.0f));
+    const float radius = meshlet.radius * scale;
+    const bool cone = cull_backfaces && meshlet.cone_cutoff <= 1.0f;
+    const glm::vec3 axis = cone ? glm::normalize(rotation * meshlet.cone_axis) : glm::vec3(0.0f);
+    bool seen = false;
+    for (size_t v = 0; v < views.size() && !seen; ++v) {
+      if (!views[v].frustum.intersects_sphere(center, radius)) continue;
+      const glm::vec3 to_center = center - views[v].eye;
+      seen = !cone || glm::dot(to_center, axis) < meshlet.cone_cutoff * glm::length(to_center) + radius;
+    }
+    if (!seen) continue;
+    ++out.meshlets_drawn;
+    if (!out.counts.empty() && run_end == meshlet.first_index) {
+      run_end += meshlet.index_count;
+      out.counts.back() = static_cast<GLsizei>(run_end - run_first);
+      continue;
+    }
+    run_first = meshlet.first_index;
+    run_end = run_first + meshlet.index_count;
+    out.counts.push_back(static_cast<GLsizei>(meshlet.index_count));
+    out.offsets.push_back(reinterpret_cast<const void *>(static_cast<uintptr_t>(run_first) * sizeof(unsigned int)));
+  }
+}
+
+#endif
@@ -9,10 +9,12 @@
 #include <assimp/scene.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include <stb_image.h>
 
+#include <Animation.h>
 #include <Mesh.h>
 #include <Shader.h>
+#include <TextureCache.h>
+#include <Trace.h>
 
 #include <fstream>
 #include <iostream>
@@ -22,30 +24,80 @@
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
-
 class Model {
  public:
   // model data
-  vector<Texture> textures_loaded;// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+  vector<Texture> textures_loaded;// every texture reference the model took from textures(), released with the model
   vector<Mesh> meshes;
+  // node transforms from the file, model space; identity for skinned meshes, their bones place them
+  vector<glm::mat4> mesh_transforms;
+  // per mesh, 0 skips it in Draw (occlusion culling); empty draws everything
+  vector<unsigned char> mesh_visible;
   string directory;
+  // file name, the owner of the model's resource records
+  string name;
   bool gammaCorrection;
+  // positions/indices of all meshes merged into one triangle soup, kept on the CPU for collision queries
+  vector<glm::vec3> collision_positions;
+  vector<unsigned int> collision_indices;
+  // skinning and animation, empty for static models
+  map<string, BoneInfo> bone_info_map;
+  Skeleton skeleton;
+  vector<AnimationClip> animations;
 
   // constructor, expects a filepath to a 3D model.
   Model(string const &path, bool gamma = false) : gammaCorrection(gamma) {
     loadModel(path);
   }
+  ~Model() {
+    for (const Texture &texture : textures_loaded) textures().release(texture.handle);
+    resources().remove(collision_record);
+  }
+  Model(const Model &) = delete;
+  Model &operator=(const Model &) = delete;
 
-  // draws the model, and thus all its meshes
-  void Draw(Shader &shader) {
-    for (unsigned int i = 0; i < meshes.size(); i++)
+  // frees the meshes' CPU vertex and index copies once everything built from them at load exists (edges,
+  // meshlets, bounds, skinning streams); skinned meshes keep theirs. The collision soup stays.
+  void release_cpu_geometry() {
+    if (skinned()) return;
+    for (Mesh &mesh : meshes) mesh.release_cpu_geometry();
+  }
+
+  // draws the model, and thus all its meshes, placed at `world`; sets the shader's model matrix per mesh
+  void Draw(Shader &shader, const glm::mat4 &world) {
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+      if (!mesh_visible.empty() && !mesh_visible[i]) continue;
+      shader.setMat4("model", world * mesh_transforms[i]);
       meshes[i].Draw(shader);
+    }
   }
 
+  // meshlet culling of every mesh placed at `world`, for all views of the frame at once
+  void cull_meshlets(const glm::mat4 &world, const CullViews &views, const bool cull_backfaces) {
+    for (unsigned int i = 0; i < meshes.size(); i++)
+      if (!meshes[i].meshlets.empty()) ::cull_meshlets(meshes[i].meshlets, world * mesh_transforms[i], views, cull_backfaces, meshes[i].draw_list);
+  }
+  // meshlets kept by the last cull_meshlets() out of the total
+  size_t meshlets_drawn() const {
+    size_t n = 0;
+    for (const Mesh &mesh : meshes) n += mesh.draw_list.active ? mesh.draw_list.meshlets_drawn : mesh.meshlets.size();
+    return n;
+  }
+  size_t meshlet_count() const {
+    size_t n = 0;
+    for (const Mesh &mesh : meshes) n += mesh.meshlets.size();
+    return n;
+  }
+
+  bool skinned() const { return !bone_info_map.empty(); }
+  bool animated() const { return !animations.empty(); }
+
  private:
+  ResourceRegistry::Handle collision_record = 0;
+
   // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
   void loadModel(string const &path) {
+    TRACE_ZONE("load model");
     // read file via ASSIMP
     Assimp::Importer importer;
     const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
@@ -57,27 +109,39 @@ class Model {
     }
     // retrieve the directory path of the filepath
     directory = path.substr(0, path.find_last_of('/'));
+    name = path.substr(path.find_last_of('/') + 1);
 
     // process ASSIMP's root node recursively
-    processNode(scene->mRootNode, scene);
+    processNode(scene->mRootNode, scene, glm::mat4(1.0f));
+
+    // skeleton and clips, once all bones are known
+    if (!bone_info_map.empty() || scene->mNumAnimations > 0) {
+      skeleton = build_skeleton(scene->mRootNode, bone_info_map);
+      for (unsigned int i = 0; i < scene->mNumAnimations; i++) animations.push_back(load_animation_clip(scene->mAnimations[i], skeleton));
+    }
+    const size_t collision_bytes = collision_positions.size() * sizeof(glm::vec3) + collision_indices.size() * sizeof(unsigned int);
+    collision_record = resources().add(k_resource_cpu, 0, collision_bytes, std::to_string(collision_indices.size() / 3) + " collision triangles", name);
   }
 
   // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-  void processNode(aiNode *node, const aiScene *scene) {
+  void processNode(aiNode *node, const aiScene *scene, const glm::mat4 &parent_transform) {
+    const glm::mat4 transform = parent_transform * to_glm(node->mTransformation);
     // process each mesh located at the current node
     for (unsigned int i = 0; i < node->mNumMeshes; i++) {
       // the node object only contains indices to index the actual objects in the scene.
       // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
       aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-      meshes.push_back(processMesh(mesh, scene));
+      const glm::mat4 mesh_transform = mesh->HasBones() ? glm::mat4(1.0f) : transform;
+      meshes.push_back(processMesh(mesh, scene, mesh_transform));
+      mesh_transforms.push_back(mesh_transform);
     }
     // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
     for (unsigned int i = 0; i < node->mNumChildren; i++) {
-      processNode(node->mChildren[i], scene);
+      processNode(node->mChildren[i], scene, transform);
     }
   }
 
-  Mesh processMesh(aiMesh *mesh, const aiScene *scene) {
+  Mesh processMesh(aiMesh *mesh, const aiScene *scene, const glm::mat4 &transform) {
     // data to fill
     vector<Vertex> vertices;
     vector<unsigned int> indices;
@@ -86,6 +150,10 @@ class Model {
     // walk through each of the mesh's vertices
     for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
       Vertex vertex;
+      for (int k = 0; k < MAX_BONE_INFLUENCE; k++) {
+        vertex.m_BoneIDs[k] = -1;
+        vertex.m_Weights[k] = 0.0f;
+      }
       glm::vec3 vector;// we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
       // positions
       vector.x = mesh->mVertices[i].x;
@@ -130,6 +198,12 @@ class Model {
       for (unsigned int j = 0; j < face.mNumIndices; j++)
         indices.push_back(face.mIndices[j]);
     }
+    extractBoneWeights(vertices, mesh);
+    // keep a CPU copy of the triangles for collision queries, in model space
+    const auto base = static_cast<unsigned int>(collision_positions.size());
+    for (const Vertex &v : vertices) collision_positions.emplace_back(transform * glm::vec4(v.Position, 1.0f));
+    for (const unsigned int index : indices) collision_indices.push_back(base + index);
+
     // process materials
     aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
     // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
@@ -152,72 +226,67 @@ class Model {
     std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
     textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
+    // cluster the triangles for meshlet culling; this reorders the indices. Skinned and morphing meshes are left
+    // whole since their bounds move with the pose
+    vector<Meshlet> meshlets;
+    if (!mesh->HasBones() && mesh->mNumAnimMeshes == 0) meshlets = build_meshlets(vertices, indices);
+
     // return a mesh object created from the extracted mesh data
-    return Mesh(vertices, indices, textures);
+    Mesh result(std::move(vertices), std::move(indices), std::move(textures), name + " mesh " + std::to_string(meshes.size()));
+    result.meshlets = std::move(meshlets);
+    // morph targets as offsets from the rest positions
+    for (unsigned int m = 0; m < mesh->mNumAnimMeshes && m < static_cast<unsigned int>(max_morph_targets); m++) {
+      const aiAnimMesh *target = mesh->mAnimMeshes[m];
+      if (!target->mVertices || target->mNumVertices != mesh->mNumVertices) continue;
+      vector<glm::vec3> deltas(mesh->mNumVertices);
+      for (unsigned int i = 0; i < mesh->mNumVertices; i++) deltas[i] = glm::vec3(target->mVertices[i].x, target->mVertices[i].y, target->mVertices[i].z) - result.vertices[i].Position;
+      result.morph_deltas.push_back(std::move(deltas));
+    }
+    return result;
   }
 
-  // checks all material textures of a given type and loads the textures if they're not loaded yet.
-  // the required info is returned as a Texture struct.
+  // bone ids and weights of every vertex; bones are numbered across the whole model in order of appearance
+  void extractBoneWeights(vector<Vertex> &vertices, const aiMesh *mesh) {
+    for (unsigned int b = 0; b < mesh->mNumBones; b++) {
+      const aiBone *bone = mesh->mBones[b];
+      const string name = bone->mName.C_Str();
+      auto it = bone_info_map.find(name);
+      if (it == bone_info_map.end()) it = bone_info_map.emplace(name, BoneInfo{static_cast<int>(bone_info_map.size()), to_glm(bone->mOffsetMatrix)}).first;
+      const int id = it->second.id;
+      if (id >= max_bones) {
+        cout << "ERROR::MODEL::TOO_MANY_BONES " << name << endl;
+        continue;
+      }
+      for (unsigned int w = 0; w < bone->mNumWeights; w++) {
+        Vertex &vertex = vertices[bone->mWeights[w].mVertexId];
+        // keep the strongest influences when a vertex has more than MAX_BONE_INFLUENCE
+        int slot = 0;
+        for (int k = 1; k < MAX_BONE_INFLUENCE; k++)
+          if (vertex.m_Weights[k] < vertex.m_Weights[slot]) slot = k;
+        if (bone->mWeights[w].mWeight > vertex.m_Weights[slot]) {
+          vertex.m_BoneIDs[slot] = id;
+          vertex.m_Weights[slot] = bone->mWeights[w].mWeight;
+        }
+      }
+    }
+  }
+
+  // the material textures of a given type, returned as Texture structs. The shared texture cache loads each image
+  // once however many meshes, models or file names refer to it; every use takes a reference
   vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName) {
     vector<Texture> textures;
     for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
       aiString str;
       mat->GetTexture(type, i, &str);
-      // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-      bool skip = false;
-      for (unsigned int j = 0; j < textures_loaded.size(); j++) {
-        if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0) {
-          textures.push_back(textures_loaded[j]);
-          skip = true;// a texture with the same filepath has already been loaded, continue to next one. (optimization)
-          break;
-        }
-      }
-      if (!skip) {// if texture hasn't been loaded already, load it
-        Texture texture;
-        texture.id = TextureFromFile(str.C_Str(), this->directory);
-        texture.type = typeName;
-        texture.path = str.C_Str();
-        textures.push_back(texture);
-        textures_loaded.push_back(texture);// store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
-      }
+      Texture texture;
+      texture.handle = ::textures().acquire(directory + '/' + str.C_Str());
+      texture.type = typeName;
+      texture.path = str.C_Str();
+      textures.push_back(texture);
+      textures_loaded.push_back(texture);
     }
     return textures;
   }
 };
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma) {
-  string filename = string(path);
-  filename = directory + '/' + filename;
-
-  unsigned int textureID;
-  glGenTextures(1, &textureID);
-
-  int width, height, nrComponents;
-  unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-  if (data) {
-    GLenum format;
-    if (nrComponents == 1)
-      format = GL_RED;
-    else if (nrComponents == 3)
-      format = GL_RGB;
-    else if (nrComponents == 4)
-      format = GL_RGBA;
-
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    stbi_image_free(data);
-  } else {
-    std::cout << "Texture failed to load at path: " << path << std::endl;
-    stbi_image_free(data);
-  }
-
-  return textureID;
-}
 #endif
\ No newline at end of file
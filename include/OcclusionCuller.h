@@ -0,0 +1,313 @@
+#pragma once
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <Collision.h>
+#include <JobSystem.h>
+#include <Model.h>
+#include <SparseSdf.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_SSE2 1
+#else
+#define OCCLUSION_SSE2 0
+#endif
+
+// CPU occlusion culling, no GPU queries: simplified occluder meshes are rasterized into a small depth buffer
+// (tiles in parallel, four pixels per SSE step), reduced into a max-depth pyramid, and bounding boxes are tested
+// against the pyramid level where they cover at most 2x2 texels. Each occluder triangle writes its farthest
+// vertex depth, so the buffer never claims more occlusion than the occluders have.
+
+struct OcclusionConfig {
+  int width = 256; // multiples of tile, powers of two keep the whole pyramid
+  int height = 128;
+  int tile = 32;   // multiple of 4
+};
+
+struct OcclusionStats {
+  size_t occluder_triangles;
+  size_t tested;
+  size_t culled;
+  double raster_ms;
+};
+
+struct Occluder {
+  std::vector<glm::vec3> positions;
+  std::vector<unsigned int> indices;
+};
+
+// vertex clustering: vertices in the same cell merge to their mean, triangles that collapse are dropped
+inline Occluder simplify_occluder(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices, const float cell) {
+  struct CellHash {
+    size_t operator()(const glm::ivec3 &c) const { return static_cast<size_t>(c.x * 73856093) ^ static_cast<size_t>(c.y * 19349663) ^ static_cast<size_t>(c.z * 83492791); }
+  };
+  Occluder result;
+  std::unordered_map<glm::ivec3, unsigned int, CellHash> cells;
+  std::vector<unsigned int> cluster(positions.size());
+  std::vector<float> weight;
+  for (size_t v = 0; v < positions.size(); ++v) {
+    const auto inserted = cells.emplace(glm::ivec3(glm::floor(positions[v] / cell)), static_cast<unsigned int>(result.positions.size()));
+    if (inserted.second) {
+      result.positions.emplace_back(0.0f);
+      weight.push_back(0.0f);
+    }
+    cluster[v] = inserted.first->second;
+    result.positions[cluster[v]] += positions[v];
+    weight[cluster[v]] += 1.0f;
+  }
+  for (size_t c = 0; c < result.positions.size(); ++c) result.positions[c] /= weight[c];
+  for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+    const unsigned int a = cluster[indices[t]], b = cluster[indices[t + 1]], c = cluster[indices[t + 2]];
+    if (a == b || b == c || a == c) continue;
+    result.indices.insert(result.indices.end(), {a, b, c});
+  }
+  return result;
+}
+
+// model space bounds of each mesh of a model, node transforms included
+inline std::vector<Aabb> model_mesh_bounds(const Model &model) {
+  std::vector<Aabb> bounds(model.meshes.size());
+  for (size_t i = 0; i < model.meshes.size(); ++i)
+    for (const Vertex &v : model.meshes[i].vertices) bounds[i].grow(glm::vec3(model.mesh_transforms[i] * glm::vec4(v.Position, 1.0f)));
+  return bounds;
+}
+
+class OcclusionCuller {
+ public:
+  explicit OcclusionCuller(JobSystem &jobs, const OcclusionConfig &config = {}) : jobs(jobs), config(config) {
+    tiles_x = config.width / config.tile;
+    tiles_y = config.height / config.tile;
+    bins.resize(static_cast<size_t>(tiles_x) * tiles_y);
+    for (int w = config.width, h = config.height; w > 0 && h > 0; w /= 2, h /= 2) {
+      levels.emplace_back(static_cast<size_t>(w) * h, 1.0f);
+      level_size.emplace_back(w, h);
+      if (w % 2 || h % 2) break;
+    }
+  }
+
+  // starts a frame: drops last frame's occluders
+  void begin(const glm::mat4 &view_projection) {
+    this->view_projection = view_projection;
+    triangles.clear();
+    for (auto &bin : bins) bin.clear();
+    last_stats = {0, 0, 0, 0.0};
+  }
+
+  void add_occluder(const Occluder &occluder, const glm::mat4 &world) {
+    const glm::mat4 m = view_projection * world;
+    screen.resize(occluder.positions.size());
+    for (size_t v = 0; v < occluder.positions.size(); ++v) screen[v] = project(m, occluder.positions[v]);
+    for (size_t t = 0; t + 2 < occluder.indices.size(); t += 3) {
+      const glm::vec4 &a = screen[occluder.indices[t]], &b = screen[occluder.indices[t + 1]], &c = screen[occluder.indices[t + 2]];
+      // crossing the near plane: leave it out, fewer occluders only means less culling
+      if (a.w <= 0.0f || b.w <= 0.0f || c.w <= 0.0f) continue;
+      const float z = std::max(a.z, std::max(b.z, c.z));
+      if (z > 1.0f) continue;
+      const float min_x = std::min(a.x, std::min(b.x, c.x)), max_x = std::max(a.x, std::max(b.x, c.x));
+      const float min_y = std::min(a.y, std::min(b.y, c.y)), max_y = std::max(a.y, std::max(b.y, c.y));
+      if (max_x < 0.0f || max_y < 0.0f || min_x >= static_cast<float>(config.width) || min_y >= static_cast<float>(config.height)) continue;
+      if ((b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x) == 0.0f) continue;
+      const auto index = static_cast<uint32_t>(triangles.size());
+      triangles.push_back({{a.x, b.x, c.x}, {a.y, b.y, c.y}, z});
+      const int tx0 = static_cast<int>(std::max(min_x, 0.0f)) / config.tile, tx1 = static_cast<int>(std::min(max_x, static_cast<float>(config.width - 1))) / config.tile;
+      const int ty0 = static_cast<int>(std::max(min_y, 0.0f)) / config.tile, ty1 = static_cast<int>(std::min(max_y, static_cast<float>(config.height - 1))) / config.tile;
+      for (int ty = ty0; ty <= ty1; ++ty)
+        for (int tx = tx0; tx <= tx1; ++tx) bins[static_cast<size_t>(ty) * tiles_x + tx].push_back(index);
+    }
+  }
+
+  // rasterizes the occluders added since begin() and rebuilds the pyramid
+  void rasterize() {
+    const auto t0 = std::chrono::steady_clock::now();
+    jobs.parallel_for(0, bins.size(), 1, [this](const size_t b, const size_t e) {
+      for (size_t tile = b; tile < e; ++tile) rasterize_tile(tile);
+    });
+    for (size_t l = 1; l < levels.size(); ++l) {
+      const int w = level_size[l].x, h = level_size[l].y, src_w = level_size[l - 1].x;
+      const std::vector<float> &src = levels[l - 1];
+      std::vector<float> &dst = levels[l];
+      for (int y = 0; y < h; ++y)
+        for (int x = 0; x < w; ++x) {
+          const size_t s = static_cast<size_t>(2 * y) * src_w + 2 * x;
+          dst[static_cast<size_t>(y) * w + x] = std::max(std::max(src[s], src[s + 1]), std::max(src[s + src_w], src[s + src_w + 1]));
+        }
+    }
+    last_stats.occluder_triangles = triangles.size();
+    last_stats.raster_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+  }
+
+  // false when the box is outside the view or entirely behind the occluders
+  bool visible(const Aabb &box, const glm::mat4 &world = glm::mat4(1.0f)) {
+    ++last_stats.tested;
+    const glm::mat4 m = view_projection * world;
+    glm::vec2 lo(FLT_MAX), hi(-FLT_MAX);
+    float z = FLT_MAX;
+    for (int k = 0; k < 8; ++k) {
+      const glm::vec4 p = project(m, glm::vec3(k & 1 ? box.max.x : box.min.x, k & 2 ? box.max.y : box.min.y, k & 4 ? box.max.z : box.min.z));
+      if (p.w <= 0.0f) return true;// reaches behind the camera
+      lo = glm::min(lo, glm::vec2(p));
+      hi = glm::max(hi, glm::vec2(p));
+      z = std::min(z, p.z);
+    }
+    if (hi.x < 0.0f || hi.y < 0.0f || lo.x >= static_cast<float>(config.width) || lo.y >= static_cast<float>(config.height) || z > 1.0f) {
+      ++last_stats.culled;
+      return false;
+    }
+    int x0 = static_cast<int>(std::max(lo.x, 0.0f)), x1 = static_cast<int>(std::min(hi.x, static_cast<float>(config.width - 1)));
+    int y0 = static_cast<int>(std::max(lo.y, 0.0f)), y1 = static_cast<int>(std::min(hi.y, static_cast<float>(config.height - 1)));
+    size_t l = 0;
+    while (l + 1 < levels.size() && ((x1 >> l) - (x0 >> l) > 1 || (y1 >> l) - (y0 >> l) > 1)) ++l;
+    x0 >>= l, x1 >>= l, y0 >>= l, y1 >>= l;
+    const int w = level_size[l].x;
+    for (int y = y0; y <= y1; ++y)
+      for (int x = x0; x <= x1; ++x)
+        if (levels[l][static_cast<size_t>(y) * w + x] >= z) return true;
+    ++last_stats.culled;
+    return false;
+  }
+
+  const OcclusionStats &stats() const { return last_stats; }
+  // full resolution depth, row 0 at the bottom
+  const std::vector<float> &depth() const { return levels[0]; }
+  int width() const { return config.width; }
+  int height() const { return config.height; }
+
+ private:
+  struct ScreenTriangle {
+    float x[3], y[3];
+    float z;// farthest vertex depth
+  };
+
+  JobSystem &jobs;
+  OcclusionConfig config;
+  int tiles_x = 0, tiles_y = 0;
+  glm::mat4 view_projection{1.0f};
+  std::vector<ScreenTriangle> triangles;
+  std::vector<std::vector<uint32_t>> bins;// triangles overlapping each tile
+  std::vector<std::vector<float>> levels; // max depth pyramid, [0] full resolution
+  std::vector<glm::ivec2> level_size;
+  std::vector<glm::vec4> screen;
+  OcclusionStats last_stats{};
+
+  // pixels x, y, depth in [0, 1], w (<= 0 behind the camera)
+  glm::vec4 project(const glm::mat4 &m, const glm::vec3 &p) const {
+    const glm::vec4 clip = m * glm::vec4(p, 1.0f);
+    if (clip.w <= 1e-6f) return glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+    const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    return {(ndc.x * 0.5f + 0.5f) * static_cast<float>(config.width), (ndc.y * 0.5f + 0.5f) * static_cast<float>(config.height), ndc.z * 0.5f + 0.5f, clip.w};
+  }
+
+  void rasterize_tile(const size_t tile) {
+    const int x0 = static_cast<int>(tile % tiles_x) * config.tile, y0 = static_cast<int>(tile / tiles_x) * config.tile;
+    const int x1 = x0 + config.tile, y1 = y0 + config.tile;
+    float *depth = levels[0].data();
+    for (int y = y0; y < y1; ++y) std::fill(depth + static_cast<size_t>(y) * config.width + x0, depth + static_cast<size_t>(y) * config.width + x1, 1.0f);
+
+    for (const uint32_t index : bins[tile]) {
+      const ScreenTriangle &t = triangles[index];
+      // edge functions a*x + b*y + c, positive inside whatever the winding
+      float a[3], b[3], c[3];
+      const float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.y[1] - t.y[0]) * (t.x[2] - t.x[0]);
+      const float sign = area > 0.0f ? 1.0f : -1.0f;
+      for (int e = 0; e < 3; ++e) {
+        const int n = (e + 1) % 3;
+        a[e] = sign * (t.y[e] - t.y[n]);
+        b[e] = sign * (t.x[n] - t.x[e]);
+        c[e] = -(a[e] * t.x[e] + b[e] * t.y[e]);
+      }
+      const float min_x = std::min(t.x[0], std::min(t.x[1], t.x[2])), max_x = std::max(t.x[0], std::max(t.x[1], t.x[2]));
+      const float min_y = std::min(t.y[0], std::min(t.y[1], t.y[2])), max_y = std::max(t.y[0], std::max(t.y[1], t.y[2]));
+      // x range in whole groups of four, which stay inside the tile since tiles are multiples of four wide
+      const int bx0 = std::max(x0, static_cast<int>(std::max(min_x, 0.0f)) & ~3);
+      const int bx1 = std::min(x1, (static_cast<int>(std::min(max_x, static_cast<float>(config.width))) + 4) & ~3);
+      const int by0 = std::max(y0, static_cast<int>(std::max(min_y, 0.0f))), by1 = std::min(y1, static_cast<int>(std::min(max_y, static_cast<float>(config.height))) + 1);
+#if OCCLUSION_SSE2
+      const __m128 z = _mm_set1_ps(t.z), zero = _mm_setzero_ps();
+      const __m128 a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]), a2 = _mm_set1_ps(a[2]);
+      for (int y = by0; y < by1; ++y) {
+        const float py = static_cast<float>(y) + 0.5f;
+        const __m128 r0 = _mm_set1_ps(b[0] * py + c[0]), r1 = _mm_set1_ps(b[1] * py + c[1]), r2 = _mm_set1_ps(b[2] * py + c[2]);
+        float *row = depth + static_cast<size_t>(y) * config.width;
+        for (int x = bx0; x < bx1; x += 4) {
+          const float px = static_cast<float>(x) + 0.5f;
+          const __m128 xs = _mm_add_ps(_mm_set1_ps(px), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+          const __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, xs), r0), e1 = _mm_add_ps(_mm_mul_ps(a1, xs), r1), e2 = _mm_add_ps(_mm_mul_ps(a2, xs), r2);
+          const __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+          const __m128 d = _mm_loadu_ps(row + x);
+          _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(d, z)), _mm_andnot_ps(inside, d)));
+        }
+      }
+#else
+      for (int y = by0; y < by1; ++y) {
+        const float py = static_cast<float>(y) + 0.5f;
+        float *row = depth + static_cast<size_t>(y) * config.width;
+        for (int x = bx0; x < bx1; ++x) {
+          const float px = static_cast<float>(x) + 0.5f;
+          if (a[0] * px + b[0] * py + c[0] >= 0.0f && a[1] * px + b[1] * py + c[1] >= 0.0f && a[2] * px + b[2] * py + c[2] >= 0.0f) row[x] = std::min(row[x], t.z);
+        }
+      }
+#endif
+    }
+  }
+};
+
+// Occluders for the cut bone: each SparseSdf brick's mesh simplified on its own, so a cut only re-simplifies
+// the bricks it re-meshed. The result lies within a cell of the true surface.
+class SdfOccluders {
+ public:
+  explicit SdfOccluders(const float cell) : cell(cell) {}
+
+  void rebuild(const SparseSdf &sdf) {
+    bricks.clear();
+    for (uint32_t linear = 0; linear < sdf.grid_size(); ++linear) simplify(sdf, linear);
+  }
+  // after SparseSdf::remesh()
+  void update(const SparseSdf &sdf) {
+    for (const uint32_t linear : sdf.changed_bricks()) simplify(sdf, linear);
+  }
+
+  void submit(OcclusionCuller &culler) const {
+    for (const auto &brick : bricks) culler.add_occluder(brick.second, glm::mat4(1.0f));
+  }
+
+  size_t triangle_count() const {
+    size_t n = 0;
+    for (const auto &brick : bricks) n += brick.second.indices.size() / 3;
+    return n;
+  }
+
+ private:
+  float cell;
+  std::unordered_map<uint32_t, Occluder> bricks;
+  std::vector<glm::vec3> positions;
+  std::vector<unsigned int> indices;
+
+  void simplify(const SparseSdf &sdf, const uint32_t linear) {
+    const std::vector<SdfVertex> &mesh = sdf.mesh(linear);
+    if (mesh.empty()) {
+      bricks.erase(linear);
+      return;
+    }
+    positions.clear();
+    indices.clear();
+    for (const SdfVertex &v : mesh) {
+      indices.push_back(static_cast<unsigned int>(positions.size()));
+      positions.push_back(v.position);
+    }
+    Occluder occluder = simplify_occluder(positions, indices, cell);
+    if (occluder.indices.empty()) bricks.erase(linear);
+    else bricks[linear] = std::move(occluder);
+  }
+};
+
+#endif
@@ -0,0 +1,289 @@
+#pragma once
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Trace.h>
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Frame profiler for the render thread: scoped CPU zones on the steady clock and GPU zones as GL_TIMESTAMP
+// query pairs (unlike GL_TIME_ELAPSED these nest, and they do not collide with DynamicResolution's query).
+// GPU results are collected gpu_latency frames later and only if the queries are done; a frame still pending
+// when its slot comes round again is dropped, so the profiler never waits on the GPU. Every zone keeps a
+// rolling window of its per frame total for percentiles, and the last frame's zones are kept for the timeline.
+// Zones opened on other threads than the one that first used the profiler are ignored. Every PROFILE_ZONE is
+// also a TRACE_ZONE, so it shows on the trace timeline of whichever thread opened it.
+// Building with PROFILE_ENABLED=0 compiles the PROFILE_ macros to nothing.
+
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED 1
+#endif
+
+struct ProfileZone {
+  const char *name;
+  int depth;
+  double begin_ms, end_ms;// from the start of the frame (CPU) or of its first GPU zone
+};
+
+struct ProfileSummary {
+  std::string name;
+  double last_ms, p50_ms, p95_ms, p99_ms, max_ms;
+};
+
+class Profiler {
+ public:
+  static constexpr size_t history_frames = 240;
+  static constexpr size_t gpu_latency = 4;
+
+  Profiler() : owner(std::this_thread::get_id()), frame_start(clock::now()) {}
+  Profiler(const Profiler &) = delete;
+  Profiler &operator=(const Profiler &) = delete;
+
+  bool on_owner_thread() const { return std::this_thread::get_id() == owner; }
+
+  void begin_cpu(const char *name) {
+    cpu_stack.push_back(cpu_zones.size());
+    cpu_zones.push_back({name, static_cast<int>(cpu_stack.size()) - 1, since_frame_start(), 0.0});
+  }
+  void end_cpu() {
+    if (cpu_stack.empty()) return;
+    cpu_zones[cpu_stack.back()].end_ms = since_frame_start();
+    cpu_stack.pop_back();
+  }
+
+  void begin_gpu(const char *name) {
+    GpuSlot &slot = gpu_slots[frame % gpu_latency];
+    const size_t first = slot.zones.size() * 2;
+    while (slot.queries.size() < first + 2) {
+      GLuint query = 0;
+      glGenQueries(1, &query);
+      slot.queries.push_back(query);
+    }
+    glQueryCounter(slot.queries[first], GL_TIMESTAMP);
+    gpu_stack.push_back(slot.zones.size());
+    slot.zones.push_back({name, static_cast<int>(gpu_stack.size()) - 1, 0.0, 0.0});
+  }
+  void end_gpu() {
+    if (gpu_stack.empty()) return;
+    GpuSlot &slot = gpu_slots[frame % gpu_latency];
+    glQueryCounter(slot.queries[gpu_stack.back() * 2 + 1], GL_TIMESTAMP);
+    gpu_stack.pop_back();
+  }
+
+  // closes the loop iteration: totals go into the rolling windows, and the oldest GPU slot is read if ready
+  void end_frame() {
+    const double frame_ms = since_frame_start();
+    frame_history.add(frame_ms);
+    for (ProfileZone &zone : cpu_zones)
+      if (zone.end_ms < zone.begin_ms) zone.end_ms = frame_ms;// left open over the frame's end
+    add_totals(cpu_zones, cpu_history);
+    last_cpu.swap(cpu_zones);
+    cpu_zones.clear();
+    cpu_stack.clear();
+    frame_start = clock::now();
+
+    gpu_stack.clear();
+    ++frame;
+    GpuSlot &oldest = gpu_slots[frame % gpu_latency];
+    if (!oldest.zones.empty()) {
+      GLint available = 0;
+      glGetQueryObjectiv(oldest.queries[oldest.zones.size() * 2 - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (available) {
+        GLuint64 origin = 0;
+        glGetQueryObjectui64v(oldest.queries[0], GL_QUERY_RESULT, &origin);
+        for (size_t i = 0; i < oldest.zones.size(); ++i) {
+          GLuint64 begin = 0, end = 0;
+          glGetQueryObjectui64v(oldest.queries[2 * i], GL_QUERY_RESULT, &begin);
+          glGetQueryObjectui64v(oldest.queries[2 * i + 1], GL_QUERY_RESULT, &end);
+          oldest.zones[i].begin_ms = static_cast<double>(begin - origin) * 1e-6;
+          oldest.zones[i].end_ms = static_cast<double>(end - origin) * 1e-6;
+        }
+        add_totals(oldest.zones, gpu_history);
+        last_gpu = oldest.zones;
+      } else {
+        ++gpu_dropped;
+      }
+      oldest.zones.clear();
+    }
+  }
+
+  // deletes the queries; call while the GL context is still current
+  void release_gpu() {
+    for (GpuSlot &slot : gpu_slots) {
+      if (!slot.queries.empty()) glDeleteQueries(static_cast<GLsizei>(slot.queries.size()), slot.queries.data());
+      slot.queries.clear();
+      slot.zones.clear();
+    }
+  }
+
+  const std::vector<ProfileZone> &last_cpu_frame() const { return last_cpu; }
+  const std::vector<ProfileZone> &last_gpu_frame() const { return last_gpu; }
+  // the summaries are rebuilt into buffers the profiler keeps, so the overlay does not allocate once every zone
+  // has shown up; valid until the next call
+  ProfileSummary frame_summary() const {
+    ProfileSummary out;
+    frame_history.summarize(out, sort_scratch);
+    out.name = "frame";
+    return out;
+  }
+  const std::vector<ProfileSummary> &cpu_summaries() const { return summaries(cpu_history.histories, cpu_summary_buffer); }
+  const std::vector<ProfileSummary> &gpu_summaries() const { return summaries(gpu_history.histories, gpu_summary_buffer); }
+  size_t gpu_frames_dropped() const { return gpu_dropped; }
+
+ private:
+  using clock = std::chrono::steady_clock;
+
+  // the last history_frames values of one zone's per frame total
+  struct History {
+    std::string name;
+    std::vector<float> values;
+    size_t next = 0;
+    double last = 0.0;
+
+    void add(const double ms) {
+      last = ms;
+      if (values.size() < history_frames) values.push_back(static_cast<float>(ms));
+      else values[next] = static_cast<float>(ms);
+      next = (next + 1) % history_frames;
+    }
+    // fills everything but the name; `sorted` is scratch
+    void summarize(ProfileSummary &out, std::vector<float> &sorted) const {
+      sorted.assign(values.begin(), values.end());
+      std::sort(sorted.begin(), sorted.end());
+      const auto at = [&sorted](const double q) { return sorted.empty() ? 0.0 : static_cast<double>(sorted[std::min(sorted.size() - 1, static_cast<size_t>(q * static_cast<double>(sorted.size())))]); };
+      out.last_ms = last;
+      out.p50_ms = at(0.5);
+      out.p95_ms = at(0.95);
+      out.p99_ms = at(0.99);
+      out.max_ms = sorted.empty() ? 0.0 : static_cast<double>(sorted.back());
+    }
+  };
+  // the windows of one zone kind, in order of first appearance, and what add_totals needs to find them
+  struct HistorySet {
+    std::vector<History> histories;
+    std::unordered_map<const char *, size_t> by_pointer;// name address -> history; equal names at other addresses share it
+    std::vector<double> totals;// this frame's, per history; < 0 when it has no zone yet
+    std::vector<size_t> touched;
+  };
+  struct GpuSlot {
+    std::vector<ProfileZone> zones;
+    std::vector<GLuint> queries;// begin, end per zone
+  };
+
+  std::thread::id owner;
+  clock::time_point frame_start;
+  size_t frame = 0;
+  std::vector<ProfileZone> cpu_zones, last_cpu, last_gpu;
+  std::vector<size_t> cpu_stack, gpu_stack;
+  GpuSlot gpu_slots[gpu_latency];
+  HistorySet cpu_history, gpu_history;
+  History frame_history;
+  mutable std::vector<ProfileSummary> cpu_summary_buffer, gpu_summary_buffer;
+  mutable std::vector<float> sort_scratch;
+  size_t gpu_dropped = 0;
+
+  double since_frame_start() const { return std::chrono::duration<double, std::milli>(clock::now() - frame_start).count(); }
+
+  // zones sharing a name add up; nested zones count for themselves and inside their parent
+  static void add_totals(const std::vector<ProfileZone> &zones, HistorySet &set) {
+    set.touched.clear();
+    for (const ProfileZone &zone : zones) {
+      const size_t h = history_index(set, zone.name);
+      if (set.totals[h] < 0.0) {
+        set.totals[h] = 0.0;
+        set.touched.push_back(h);
+      }
+      set.totals[h] += zone.end_ms - zone.begin_ms;
+    }
+    for (const size_t h : set.touched) {
+      set.histories[h].add(set.totals[h]);
+      set.totals[h] = -1.0;
+    }
+  }
+  // by address first; an address not seen before is matched by contents once and then remembered
+  static size_t history_index(HistorySet &set, const char *name) {
+    const auto found = set.by_pointer.find(name);
+    if (found != set.by_pointer.end()) return found->second;
+    size_t h = 0;
+    while (h < set.histories.size() && std::strcmp(set.histories[h].name.c_str(), name) != 0) ++h;
+    if (h == set.histories.size()) {
+      set.histories.push_back(History{name, {}, 0, 0.0});
+      set.totals.push_back(-1.0);
+    }
+    set.by_pointer.emplace(name, h);
+    return h;
+  }
+  const std::vector<ProfileSummary> &summaries(const std::vector<History> &histories, std::vector<ProfileSummary> &out) const {
+    out.resize(histories.size());
+    for (size_t i = 0; i < histories.size(); ++i) {
+      histories[i].summarize(out[i], sort_scratch);
+      if (out[i].name != histories[i].name) out[i].name = histories[i].name;
+    }
+    return out;
+  }
+};
+
+inline Profiler &profiler() {
+  static Profiler instance;
+  return instance;
+}
+
+// scoped zones, see the PROFILE_ macros
+class CpuZone {
+ public:
+  explicit CpuZone(const char *name) : active(profiler().on_owner_thread()) {
+    if (active) profiler().begin_cpu(name);
+  }
+  ~CpuZone() {
+    if (active) profiler().end_cpu();
+  }
+  CpuZone(const CpuZone &) = delete;
+  CpuZone &operator=(const CpuZone &) = delete;
+
+ private:
+  bool active;
+};
+
+class GpuZone {
+ public:
+  explicit GpuZone(const char *name) : active(profiler().on_owner_thread()) {
+    if (active) profiler().begin_gpu(name);
+  }
+  ~GpuZone() {
+    if (active) profiler().end_gpu();
+  }
+  GpuZone(const GpuZone &) = delete;
+  GpuZone &operator=(const GpuZone &) = delete;
+
+ private:
+  bool active;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#if PROFILE_ENABLED
+// CPU time of the enclosing scope
+#define PROFILE_ZONE(name) \
+  TRACE_ZONE(name);        \
+  const CpuZone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+// GPU time of the GL commands issued in the enclosing scope; needs the GL context
+#define PROFILE_GPU_ZONE(name) const GpuZone PROFILE_CONCAT(profile_gpu_zone_, __LINE__)(name)
+#define PROFILE_END_FRAME() profiler().end_frame()
+#define PROFILE_RELEASE_GPU() profiler().release_gpu()
+#else
+#define PROFILE_ZONE(name) TRACE_ZONE(name)
+#define PROFILE_GPU_ZONE(name) ((void) 0)
+#define PROFILE_END_FRAME() ((void) 0)
+#define PROFILE_RELEASE_GPU() ((void) 0)
+#endif
+
+#endif
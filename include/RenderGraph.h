@@ -0,0 +1,374 @@
+#pragma once
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <FrameArena.h>
+#include <RenderTarget.h>
+#include <ResourceRegistry.h>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <initializer_list>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Per frame render graph. Passes are declared with the images they read and write; images are transient
+// (declared and sized per frame) unless exported for use after the graph ran (UI panels, readback). execute()
+// drops passes no exported image or side effect depends on, gives each image a lifetime from its first to its
+// last pass, and places images on a pool of GL textures/renderbuffers where images whose lifetimes do not
+// overlap share an allocation. As with RenderTarget an allocation may be larger than the image, which uses its
+// lower left corner; allocations grow at once and shrink, or are freed, after staying too large or unused.
+// Pass lists, callbacks and compile's scratch live in the frame arena, so a declared frame does not allocate
+// once the pool and the graph's own vectors have grown; after the arena's reset only image(), framebuffer() and
+// produced() of the last frame are still valid.
+
+enum render_format {
+  k_format_color,// RGB8 texture, sampled by later passes and the UI
+  k_format_depth // DEPTH24_STENCIL8 renderbuffer, only for depth testing
+};
+
+struct RenderGraphStats {
+  size_t passes;
+  size_t culled_passes;
+  size_t images;
+  size_t physical_images;
+  size_t allocated_bytes;// the pool
+  size_t unaliased_bytes;// the frame's images, each in an allocation of its own
+  size_t allocations;    // GL (re)allocations since start
+};
+
+class RenderGraph {
+ public:
+  using Resource = int;
+
+  explicit RenderGraph(const RenderTargetConfig config = RenderTargetConfig()) : config(config) {}
+  ~RenderGraph() {
+    for (const auto &entry : framebuffers) glDeleteFramebuffers(1, &entry.second);
+    for (const Physical &physical : pool) destroy(physical);
+  }
+  RenderGraph(const RenderGraph &) = delete;
+  RenderGraph &operator=(const RenderGraph &) = delete;
+
+  // starts declaring a frame; the last frame's images are gone from here on
+  void begin_frame() {
+    passes.clear();
+    images.clear();
+  }
+
+  Resource create(std::string name, const render_format format, const int width, const int height) {
+    images.push_back({std::move(name), format, std::max(width, 1), std::max(height, 1)});
+    return static_cast<Resource>(images.size() - 1);
+  }
+  // keeps the image, and whatever produces it, after execute() until the next begin_frame()
+  void export_image(const Resource image) { images[image].exported = true; }
+
+  // writes: at most one color and one depth image of the same size, bound as the pass's framebuffer.
+  // side_effects: run even when nothing reads what the pass writes (readback, queries)
+  void add_pass(std::string name, const std::initializer_list<Resource> reads, const std::initializer_list<Resource> writes, FrameFunction run, const bool side_effects = false) {
+    passes.push_back({std::move(name), frame_vector<Resource>(reads), frame_vector<Resource>(writes), run, side_effects});
+  }
+
+  void execute() {
+    compile();
+    for (Pass &pass : passes) {
+      if (!pass.alive) continue;
+      if (!pass.writes.empty()) {
+        const Image &target = images[pass.writes.front()];
+        pass.framebuffer = framebuffer_for(pass);
+        glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer);
+        glViewport(0, 0, target.width, target.height);
+      }
+      pass.run();
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+
+  // a color image as a reading pass or the UI samples it; texture 0 when it was not produced
+  RenderImage image(const Resource image) const {
+    if (!produced(image)) return {0, 1, 1, glm::vec2(1.0f)};
+    const Image &i = images[image];
+    const Physical &p = pool[i.physical];
+    return {p.format == k_format_color ? p.name : 0, i.width, i.height, glm::vec2(static_cast<float>(i.width) / static_cast<float>(p.width), static_cast<float>(i.height) / static_cast<float>(p.height))};
+  }
+  // the framebuffer the image was written through, for readback
+  GLuint framebuffer(const Resource image) const { return produced(image) ? passes[images[image].writer].framebuffer : 0; }
+  bool produced(const Resource image) const { return image >= 0 && static_cast<size_t>(image) < images.size() && images[image].physical >= 0 && images[image].writer >= 0; }
+
+  const RenderGraphStats &stats() const { return last_stats; }
+  // the last execute() ran a different set of passes or changed the pool, so report() has news
+  bool layout_changed() const { return changed; }
+
+  // the last frame: passes against the images they read (R) and write (W), exported images starred, then the
+  // allocations with the images placed on them
+  std::string report() const {
+    std::string out;
+    char line[256];
+    std::snprintf(line, sizeof(line), "render graph: %zu of %zu passes, %zu images on %zu allocations\n", last_stats.passes - last_stats.culled_passes, last_stats.passes, last_stats.images, last_stats.physical_images);
+    out += line;
+    std::vector<std::string> headers;
+    size_t name_width = 4;
+    for (const Pass &pass : passes) name_width = std::max(name_width, pass.name.size() + 9);
+    out += "  " + std::string("pass") + std::string(name_width - 4, ' ');
+    for (const Image &image : images) {
+      headers.push_back(image.name + (image.exported ? "*" : ""));
+      out += headers.back() + "  ";
+    }
+    out += "\n";
+    for (size_t p = 0; p < passes.size(); ++p) {
+      const std::string name = passes[p].alive ? passes[p].name : passes[p].name + " (culled)";
+      out += "  " + name + std::string(name_width - name.size(), ' ');
+      for (size_t i = 0; i < images.size(); ++i) {
+        const bool reads = std::find(passes[p].reads.begin(), passes[p].reads.end(), static_cast<Resource>(i)) != passes[p].reads.end();
+        const bool writes = std::find(passes[p].writes.begin(), passes[p].writes.end(), static_cast<Resource>(i)) != passes[p].writes.end();
+        const char *mark = reads && writes ? "RW" : reads ? "R" : writes ? "W" : "";
+        out += mark + std::string(headers[i].size() + 2 - std::char_traits<char>::length(mark), ' ');
+      }
+      out += "\n";
+    }
+    for (size_t k = 0; k < pool.size(); ++k) {
+      std::snprintf(line, sizeof(line), "  #%zu %s %dx%d %.1f MB:", k, pool[k].format == k_format_color ? "color" : "depth", pool[k].width, pool[k].height, static_cast<double>(bytes(pool[k].format, pool[k].width, pool[k].height)) / 1e6);
+      out += line;
+      for (const Image &image : images)
+        if (image.physical == static_cast<int>(k)) out += " " + image.name;
+      out += "\n";
+    }
+    std::snprintf(line, sizeof(line), "  memory %.1f MB, %.1f MB without aliasing\n", static_cast<double>(last_stats.allocated_bytes) / 1e6, static_cast<double>(last_stats.unaliased_bytes) / 1e6);
+    out += line;
+    return out;
+  }
+
+ private:
+  struct Image {
+    std::string name;
+    render_format format;
+    int width, height;
+    bool exported = false;
+    int first = INT_MAX, last = -1;// lifetime in pass indices
+    int physical = -1;
+    int writer = -1;
+  };
+  struct Pass {
+    std::string name;
+    frame_vector<Resource> reads, writes;
+    FrameFunction run;
+    bool side_effects;
+    bool alive = false;
+    GLuint framebuffer = 0;
+  };
+  struct Physical {
+    render_format format;
+    GLuint name;
+    int width, height;// allocated
+    int busy_until;   // last pass of the image currently placed on it
+    int need_width, need_height;
+    int shrink_count;
+    int idle_count;
+    std::vector<std::string> owners;// images placed on it last frame, preferred again so allocations stay put
+    ResourceRegistry::Handle record;
+  };
+
+  RenderTargetConfig config;
+  std::vector<Image> images;
+  std::vector<Pass> passes;
+  std::vector<Physical> pool;
+  std::map<std::pair<GLuint, GLuint>, GLuint> framebuffers;// (color texture, depth renderbuffer)
+  RenderGraphStats last_stats{};
+  std::string layout, last_layout;
+  bool changed = true;
+
+  int round_up(const int size) const { return (size + config.granularity - 1) / config.granularity * config.granularity; }
+  static size_t bytes(const render_format format, const int width, const int height) { return static_cast<size_t>(width) * height * (format == k_format_color ? 3 : 4); }
+
+  void compile() {
+    // cull, walking back from the exported images
+    frame_vector<uint8_t> needed(images.size(), 0);
+    for (size_t i = 0; i < images.size(); ++i) needed[i] = images[i].exported;
+    for (size_t p = passes.size(); p-- > 0;) {
+      Pass &pass = passes[p];
+      pass.alive = pass.side_effects || std::any_of(pass.writes.begin(), pass.writes.end(), [&needed](const Resource r) { return needed[r] != 0; });
+      if (pass.alive)
+        for (const Resource r : pass.reads) needed[r] = 1;
+    }
+
+    // lifetimes
+    for (size_t p = 0; p < passes.size(); ++p) {
+      if (!passes[p].alive) continue;
+      for (const auto *list : {&passes[p].reads, &passes[p].writes})
+        for (const Resource r : *list) {
+          images[r].first = std::min(images[r].first, static_cast<int>(p));
+          images[r].last = std::max(images[r].last, static_cast<int>(p));
+        }
+      for (const Resource r : passes[p].writes)
+        if (images[r].writer < 0) images[r].writer = static_cast<int>(p);
+    }
+    for (Image &image : images)
+      if (image.exported && image.last >= 0) image.last = INT_MAX;
+
+    // drop allocations unused for a while, then place the images in order of first use
+    for (size_t k = pool.size(); k-- > 0;) {
+      if (pool[k].idle_count < config.shrink_frames) continue;
+      forget(pool[k]);
+      pool.erase(pool.begin() + static_cast<std::ptrdiff_t>(k));
+    }
+    for (Physical &physical : pool) {
+      physical.busy_until = -1;
+      physical.need_width = physical.need_height = 0;
+    }
+    frame_vector<frame_vector<const std::string *>> owners(pool.size());
+    for (size_t p = 0; p < passes.size(); ++p) {
+      if (!passes[p].alive) continue;
+      for (const auto *list : {&passes[p].writes, &passes[p].reads})
+        for (const Resource r : *list) {
+          Image &image = images[r];
+          if (image.physical >= 0 || image.first != static_cast<int>(p)) continue;
+          image.physical = place(image);
+          Physical &physical = pool[image.physical];
+          physical.busy_until = image.last;
+          physical.need_width = std::max(physical.need_width, image.width);
+          physical.need_height = std::max(physical.need_height, image.height);
+          owners.resize(pool.size());
+          owners[image.physical].push_back(&image.name);
+        }
+    }
+
+    // grow at once, shrink after a while, count idle allocations
+    last_stats = {passes.size(), 0, images.size(), 0, 0, 0, last_stats.allocations};
+    for (size_t k = 0; k < pool.size(); ++k) {
+      Physical &physical = pool[k];
+      physical.owners.clear();
+      for (const std::string *owner : owners[k]) physical.owners.push_back(*owner);
+      if (owners[k].empty()) {
+        ++physical.idle_count;
+      } else {
+        physical.idle_count = 0;
+        const bool grow = physical.need_width > physical.width || physical.need_height > physical.height;
+        const bool small = static_cast<float>(physical.need_width) * static_cast<float>(physical.need_height) < config.shrink_ratio * static_cast<float>(physical.width) * static_cast<float>(physical.height);
+        physical.shrink_count = small ? physical.shrink_count + 1 : 0;
+        if (grow || physical.shrink_count >= config.shrink_frames) {
+          allocate(physical, grow ? round_up(std::max(physical.need_width, physical.width)) : round_up(physical.need_width), grow ? round_up(std::max(physical.need_height, physical.height)) : round_up(physical.need_height));
+          physical.shrink_count = 0;
+        }
+      }
+      last_stats.allocated_bytes += bytes(physical.format, physical.width, physical.height);
+    }
+    last_stats.physical_images = pool.size();
+    for (const Pass &pass : passes) last_stats.culled_passes += !pass.alive;
+    for (const Image &image : images)
+      if (image.physical >= 0) last_stats.unaliased_bytes += bytes(image.format, round_up(image.width), round_up(image.height));
+
+    // both layout strings keep their capacity from frame to frame
+    layout.clear();
+    for (const Pass &pass : passes)
+      if (pass.alive) layout.append(pass.name).append(";");
+    for (const Physical &physical : pool) {
+      char size[32];
+      std::snprintf(size, sizeof(size), "%dx%d", physical.width, physical.height);
+      layout.append(size);
+      for (const std::string &owner : physical.owners) layout.append(",").append(owner);
+      layout.append(";");
+    }
+    changed = layout != last_layout;
+    last_layout.swap(layout);
+  }
+
+  // a free allocation of the image's format: the one the image had last frame, else the smallest that fits,
+  // else the largest (grown). An allocation is left alone when an image still to be placed had it last frame and
+  // would overlap this one, so placements stay put from frame to frame; a new allocation only when nothing is free.
+  int place(const Image &image) {
+    const auto claimed = [this, &image](const Physical &physical) {
+      for (const std::string &owner : physical.owners)
+        if (owner != image.name && std::any_of(images.begin(), images.end(), [&](const Image &other) { return other.name == owner && other.physical < 0 && other.last >= 0 && other.first <= image.last; })) return true;
+      return false;
+    };
+    int best = -1;
+    std::tuple<bool, bool, float> best_key{};
+    for (size_t k = 0; k < pool.size(); ++k) {
+      const Physical &physical = pool[k];
+      if (physical.format != image.format || physical.busy_until >= image.first || claimed(physical)) continue;
+      const bool fits = physical.width >= image.width && physical.height >= image.height;
+      const float area = static_cast<float>(physical.width) * static_cast<float>(physical.height);
+      const std::tuple<bool, bool, float> key{std::find(physical.owners.begin(), physical.owners.end(), image.name) == physical.owners.end(), !fits, fits ? area : -area};
+      if (best < 0 || key < best_key) {
+        best = static_cast<int>(k);
+        best_key = key;
+      }
+    }
+    if (best >= 0) return best;
+    Physical physical{image.format, 0, 0, 0, -1, 0, 0, 0, 0, {}, 0};
+    if (image.format == k_format_color) glGenTextures(1, &physical.name);
+    else glGenRenderbuffers(1, &physical.name);
+    pool.push_back(physical);
+    return static_cast<int>(pool.size() - 1);
+  }
+
+  void allocate(Physical &physical, const int width, const int height) {
+    physical.width = width;
+    physical.height = height;
+    ++last_stats.allocations;
+    if (physical.format == k_format_color) {
+      glBindTexture(GL_TEXTURE_2D, physical.name);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      glBindTexture(GL_TEXTURE_2D, 0);
+    } else {
+      glBindRenderbuffer(GL_RENDERBUFFER, physical.name);
+      glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+      glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    }
+    const bool color = physical.format == k_format_color;
+    const size_t bytes = static_cast<size_t>(width) * static_cast<size_t>(height) * (color ? 3 : 4);
+    std::string format = std::string(color ? "RGB8 " : "D24S8 ") + std::to_string(width) + "x" + std::to_string(height);
+    if (physical.record == 0) physical.record = resources().add(color ? k_resource_texture : k_resource_renderbuffer, physical.name, bytes, std::move(format), "render graph");
+    else resources().update(physical.record, bytes, std::move(format));
+  }
+
+  GLuint framebuffer_for(const Pass &pass) {
+    GLuint color = 0, depth = 0;
+    for (const Resource r : pass.writes) (images[r].format == k_format_color ? color : depth) = pool[images[r].physical].name;
+    GLuint &fbo = framebuffers[{color, depth}];
+    if (fbo != 0) return fbo;
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    if (color != 0) {
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+    } else {
+      glDrawBuffer(GL_NONE);
+      glReadBuffer(GL_NONE);
+    }
+    if (depth != 0) glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) std::cout << "ERROR::RENDER_GRAPH:: framebuffer of pass " << pass.name << " is not complete" << std::endl;
+    return fbo;
+  }
+
+  // deletes an allocation and the framebuffers it is attached to
+  void forget(const Physical &physical) {
+    for (auto it = framebuffers.begin(); it != framebuffers.end();) {
+      const bool attached = physical.format == k_format_color ? it->first.first == physical.name : it->first.second == physical.name;
+      if (!attached) {
+        ++it;
+        continue;
+      }
+      glDeleteFramebuffers(1, &it->second);
+      it = framebuffers.erase(it);
+    }
+    destroy(physical);
+  }
+  static void destroy(const Physical &physical) {
+    resources().remove(physical.record);
+    if (physical.format == k_format_color) glDeleteTextures(1, &physical.name);
+    else glDeleteRenderbuffers(1, &physical.name);
+  }
+};
+
+#endif
@@ -0,0 +1,125 @@
+#pragma once
+#ifndef RENDER_TARGET_H
+#define RENDER_TARGET_H
+
+#include <Shader.h>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// Offscreen images sized to what is actually shown. RenderGraph keeps allocations at least as large as the
+// images placed on them, each image using the lower left corner, so panel resizes and resolution changes rarely
+// touch the GPU allocation: it grows at once (rounded up) but only shrinks after the requests stayed well below
+// it for a while. DynamicResolution scales the 3D pass to hold a GPU time target and UpscalePass brings a reduced
+// render back to panel size with a light sharpen.
+
+struct RenderTargetConfig {
+  int granularity = 64;     // allocations are rounded up to this many pixels
+  float shrink_ratio = 0.6f;// shrink once the requested area is below this share of the allocation...
+  int shrink_frames = 60;   // ...for this many consecutive frames; unused allocations are freed after as many
+};
+
+// a color image as a pass or the UI samples it: the used corner of a possibly larger texture
+struct RenderImage {
+  GLuint texture;
+  int width, height;
+  glm::vec2 uv_extent;// texture coordinate of the used corner's far edges
+};
+
+#pragma region dynamic resolution
+// Times the 3D pass on the GPU (GL_TIME_ELAPSED, read a few frames late so nothing stalls) and steers the
+// render scale, a factor on both dimensions, toward target_ms. Pixel cost goes with the square of the scale.
+class DynamicResolution {
+ public:
+  DynamicResolution(const float target_ms, const float min_scale) : target_ms(target_ms), min_scale(min_scale) { glGenQueries(query_count, queries); }
+  ~DynamicResolution() { glDeleteQueries(query_count, queries); }
+  DynamicResolution(const DynamicResolution &) = delete;
+  DynamicResolution &operator=(const DynamicResolution &) = delete;
+
+  void begin_pass() {
+    // the query about to be reused is the oldest one; take its result if the GPU is done with it
+    const GLuint query = queries[frame % query_count];
+    if (frame >= query_count) {
+      GLint available = 0;
+      glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available) return;// skip timing this frame rather than wait
+      GLuint64 ns = 0;
+      glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+      adjust(static_cast<float>(static_cast<double>(ns) * 1e-6));
+    }
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    timing = true;
+  }
+  void end_pass() {
+    if (!timing) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    timing = false;
+    ++frame;
+  }
+
+  float scale() const { return current_scale; }
+  float gpu_ms() const { return last_ms; }
+
+ private:
+  static constexpr unsigned int query_count = 4;
+  GLuint queries[query_count] = {};
+  unsigned int frame = 0;
+  bool timing = false;
+  float target_ms, min_scale;
+  float current_scale = 1.0f;
+  float last_ms = 0.0f;
+
+  void adjust(const float ms) {
+    last_ms = ms;
+    if (ms <= 0.0f) return;
+    // dead band between 85% and 100% of the target so the scale settles instead of hunting
+    const float ratio = target_ms / ms;
+    if (ratio >= 1.0f && ratio <= 1.0f / 0.85f) return;
+    const float step = std::clamp(std::sqrt(ratio), 0.9f, 1.05f);// drop quickly, recover slowly
+    current_scale = std::clamp(current_scale * step, min_scale, 1.0f);
+  }
+};
+#pragma endregion
+
+#pragma region upscale
+// Bilinear upscale of a reduced render plus a contrast limited sharpen (the cross of neighbours around each
+// sample, clamped to their range so edges do not ring). Renders a full screen triangle into the bound framebuffer.
+class UpscalePass {
+ public:
+  // shader/upscale.vs + upscale.fs
+  UpscalePass() : shader("./Shader/upscale.vs", "./Shader/upscale.fs") {
+    glGenVertexArrays(1, &vao);// attribute-less, the vertex shader makes the triangle from gl_VertexID
+  }
+  ~UpscalePass() { glDeleteVertexArrays(1, &vao); }
+  UpscalePass(const UpscalePass &) = delete;
+  UpscalePass &operator=(const UpscalePass &) = delete;
+
+  void draw(const RenderImage &source, const float sharpness) {
+    GLint polygon_mode[2];
+    glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glDisable(GL_DEPTH_TEST);
+    shader.use();
+    shader.setInt("source", 0);
+    shader.setVec2("uv_extent", source.uv_extent);
+    shader.setVec2("texel", source.uv_extent / glm::vec2(static_cast<float>(source.width), static_cast<float>(source.height)));
+    shader.setFloat("sharpness", sharpness);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, source.texture);
+    glBindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    glPolygonMode(GL_FRONT_AND_BACK, polygon_mode[0]);
+  }
+
+ private:
+  Shader shader;
+  GLuint vao = 0;
+};
+#pragma endregion
+
+#endif
@@ -0,0 +1,143 @@
+#pragma once
+#ifndef RENDER_VIEWS_H
+#define RENDER_VIEWS_H
+
+#include <FrameArena.h>
+#include <Frustum.h>
+#include <Model.h>
+#include <ResourceRegistry.h>
+#include <Shader.h>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Several cameras on the same frame (the free overview and the endoscope tip). What does not depend on the
+// camera is done once per frame: culling keeps whatever any view sees, the draw queue is built and sorted once,
+// and all views' matrices go to one uniform buffer in a single upload. Each view then only binds its target,
+// points the ViewUniforms block at its slice and replays the queue, so an extra view costs about its pixels.
+
+constexpr unsigned int view_uniforms_binding = 1;
+
+// std140 block ViewUniforms in the vertex shaders
+struct ViewUniforms {
+  glm::mat4 projection;
+  glm::mat4 view;
+  glm::vec4 eye;
+};
+
+struct RenderView {
+  std::string name;
+  bool active = true;  // somebody looks at it this frame; inactive views are neither culled for nor drawn
+  int hidden_node = -1;// scene node left out of this view (the endoscope does not see itself)
+  glm::mat4 view{1.0f};
+  glm::mat4 projection{1.0f};
+  CullView cull{};
+  int width = 0, height = 0;
+  size_t draws = 0;// queue items drawn by the last replay
+
+  void set(const glm::mat4 &view_matrix, const glm::mat4 &projection_matrix) {
+    view = view_matrix;
+    projection = projection_matrix;
+    cull = {Frustum::from_matrix(projection * view), glm::vec3(glm::inverse(view)[3])};
+  }
+};
+
+// camera at a node's origin looking down its local -z, +y up; for the endoscope tip
+inline glm::mat4 node_view_matrix(const glm::mat4 &world) {
+  const glm::vec3 eye(world[3]);
+  return glm::lookAt(eye, eye - glm::normalize(glm::vec3(world[2])), glm::normalize(glm::vec3(world[1])));
+}
+
+// the cull views of the active views
+inline CullViews active_cull_views(const std::vector<RenderView> &views) {
+  CullViews cull;
+  cull.reserve(views.size());
+  for (const RenderView &view : views)
+    if (view.active) cull.push_back(view.cull);
+  return cull;
+}
+
+// points a program's ViewUniforms block at the binding; once per program
+inline void attach_view_uniforms(const Shader &shader) {
+  const unsigned int block = glGetUniformBlockIndex(shader.ID, "ViewUniforms");
+  if (block != GL_INVALID_INDEX) glUniformBlockBinding(shader.ID, block, view_uniforms_binding);
+}
+
+// every view's ViewUniforms in one buffer, each slice at the driver's offset alignment
+class ViewUniformBuffer {
+ public:
+  ViewUniformBuffer() {
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    alignment = std::max(alignment, 1);
+    stride = (sizeof(ViewUniforms) + alignment - 1) / alignment * alignment;
+    glGenBuffers(1, &ubo);
+  }
+  ~ViewUniformBuffer() {
+    resources().remove(record);
+    glDeleteBuffers(1, &ubo);
+  }
+  ViewUniformBuffer(const ViewUniformBuffer &) = delete;
+  ViewUniformBuffer &operator=(const ViewUniformBuffer &) = delete;
+
+  // one upload for the frame, inactive views included so slices keep their index; staged in the frame arena
+  void upload(const std::vector<RenderView> &views) {
+    const size_t size = views.size() * stride;
+    uint8_t *staging = frame_arena().allocate_array<uint8_t>(size);
+    std::memset(staging, 0, size);
+    for (size_t i = 0; i < views.size(); ++i) {
+      const ViewUniforms data{views[i].projection, views[i].view, glm::vec4(views[i].cull.eye, 1.0f)};
+      std::memcpy(staging + i * stride, &data, sizeof(data));
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    if (size > capacity) {
+      capacity = size;
+      glBufferData(GL_UNIFORM_BUFFER, static_cast<GLsizeiptr>(capacity), staging, GL_DYNAMIC_DRAW);
+      if (record == 0) record = resources().add(k_resource_buffer, ubo, capacity, std::to_string(views.size()) + " views", "view uniforms");
+      else resources().update(record, capacity, std::to_string(views.size()) + " views");
+    } else {
+      glBufferSubData(GL_UNIFORM_BUFFER, 0, static_cast<GLsizeiptr>(size), staging);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+
+  // the block now reads view `index`
+  void use(const size_t index) const { glBindBufferRange(GL_UNIFORM_BUFFER, view_uniforms_binding, ubo, static_cast<GLintptr>(index * stride), sizeof(ViewUniforms)); }
+
+ private:
+  unsigned int ubo = 0;
+  size_t stride = 0, capacity = 0;
+  ResourceRegistry::Handle record = 0;
+};
+
+#pragma region draw queue
+// one model placement of the frame; state groups draws that share a shader so a replay switches once per group
+struct DrawItem {
+  uint32_t state;
+  Model *model;
+  int node;
+  glm::mat4 world;
+};
+// built per scene pass in the frame arena
+using DrawQueue = frame_vector<DrawItem>;
+
+// by state, then by model so consecutive draws reuse textures and vertex arrays; the node breaks ties, so the
+// order is total and std::sort (unlike stable_sort's buffer) does not allocate
+inline void sort_draw_queue(DrawQueue &queue) {
+  std::sort(queue.begin(), queue.end(), [](const DrawItem &a, const DrawItem &b) {
+    if (a.state != b.state) return a.state < b.state;
+    if (a.model != b.model) return std::less<const Model *>()(a.model, b.model);
+    return a.node < b.node;
+  });
+}
+#pragma endregion
+
+#endif
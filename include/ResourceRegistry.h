@@ -0,0 +1,159 @@
+#pragma once
+#ifndef RESOURCE_REGISTRY_H
+#define RESOURCE_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Where the memory goes: every GL buffer, texture and renderbuffer the renderer allocates, and the CPU copies
+// kept next to them (mesh geometry, the font atlas pixels), is recorded with its size, format, owner and time of
+// creation. Owners register on allocation, update on reallocation and remove on delete; the registry itself
+// never touches GL. Crossing the GPU or CPU budget prints a warning once, re-armed when usage falls back under
+// 90% of it. GL thread only.
+
+enum resource_kind {
+  k_resource_buffer,      // vertex/index/uniform buffers
+  k_resource_texture,
+  k_resource_renderbuffer,
+  k_resource_cpu          // host memory kept alongside GPU resources
+};
+
+inline const char *resource_kind_name(const resource_kind kind) {
+  switch (kind) {
+    case k_resource_buffer: return "buffer";
+    case k_resource_texture: return "texture";
+    case k_resource_renderbuffer: return "renderbuffer";
+    default: return "cpu";
+  }
+}
+
+struct ResourceRecord {
+  resource_kind kind;
+  GLuint name;       // GL object, 0 for CPU memory
+  size_t bytes;
+  std::string format;// e.g. "RGBA8 2048x2048 mips", "31k vertices"
+  std::string owner; // e.g. "backpack.obj mesh 3", "render graph"
+  double created;    // seconds since the registry started
+  bool live;
+};
+
+struct ResourceTotals {
+  size_t gpu_bytes, cpu_bytes;
+  size_t bytes[4];// per resource_kind
+  size_t count[4];
+};
+
+class ResourceRegistry {
+ public:
+  using Handle = uint32_t;// 0 is no resource
+
+  ResourceRegistry() : start(std::chrono::steady_clock::now()) {}
+  ResourceRegistry(const ResourceRegistry &) = delete;
+  ResourceRegistry &operator=(const ResourceRegistry &) = delete;
+
+  Handle add(const resource_kind kind, const GLuint name, const size_t bytes, std::string format, std::string owner) {
+    ResourceRecord record{kind, name, bytes, std::move(format), std::move(owner), seconds(), true};
+    Handle handle;
+    if (!free_slots.empty()) {
+      handle = free_slots.back();
+      free_slots.pop_back();
+      slots[handle - 1] = std::move(record);
+    } else {
+      slots.push_back(std::move(record));
+      handle = static_cast<Handle>(slots.size());
+    }
+    account(slots[handle - 1], 1);
+    ++version_;
+    return handle;
+  }
+  // the resource was reallocated at a new size; the age restarts
+  void update(const Handle handle, const size_t bytes, std::string format) {
+    if (!valid(handle)) return;
+    ResourceRecord &record = slots[handle - 1];
+    account(record, -1);
+    record.bytes = bytes;
+    record.format = std::move(format);
+    record.created = seconds();
+    account(record, 1);
+    ++version_;
+  }
+  void remove(const Handle handle) {
+    if (!valid(handle)) return;
+    ResourceRecord &record = slots[handle - 1];
+    account(record, -1);
+    record.live = false;
+    free_slots.push_back(handle);
+    ++version_;
+  }
+
+  // bytes 0 disables that side's budget
+  void set_budget(const size_t gpu_bytes, const size_t cpu_bytes) {
+    gpu_budget = gpu_bytes;
+    cpu_budget = cpu_bytes;
+    check_budget();
+  }
+  bool over_gpu_budget() const { return gpu_budget > 0 && totals_.gpu_bytes > gpu_budget; }
+  bool over_cpu_budget() const { return cpu_budget > 0 && totals_.cpu_bytes > cpu_budget; }
+  size_t gpu_budget_bytes() const { return gpu_budget; }
+  size_t cpu_budget_bytes() const { return cpu_budget; }
+
+  const ResourceTotals &totals() const { return totals_; }
+  // live and dead slots; skip records that are not live
+  const std::vector<ResourceRecord> &records() const { return slots; }
+  double now() const { return seconds(); }
+  // bumps on every add, update and remove, e.g. to know when a sorted view of the records is stale
+  uint64_t version() const { return version_; }
+
+ private:
+  std::chrono::steady_clock::time_point start;
+  std::vector<ResourceRecord> slots;
+  std::vector<Handle> free_slots;
+  ResourceTotals totals_{};
+  size_t gpu_budget = 0, cpu_budget = 0;
+  bool gpu_warned = false, cpu_warned = false;
+  uint64_t version_ = 0;
+
+  bool valid(const Handle handle) const { return handle > 0 && handle <= slots.size() && slots[handle - 1].live; }
+  double seconds() const { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); }
+
+  void account(const ResourceRecord &record, const int sign) {
+    const size_t kind = record.kind;
+    const auto apply = [sign, &record](size_t &total) { total = sign > 0 ? total + record.bytes : total - record.bytes; };
+    apply(totals_.bytes[kind]);
+    apply(record.kind == k_resource_cpu ? totals_.cpu_bytes : totals_.gpu_bytes);
+    totals_.count[kind] = sign > 0 ? totals_.count[kind] + 1 : totals_.count[kind] - 1;
+    check_budget();
+  }
+  void check_budget() {
+    warn(totals_.gpu_bytes, gpu_budget, gpu_warned, "GPU");
+    warn(totals_.cpu_bytes, cpu_budget, cpu_warned, "CPU");
+  }
+  static void warn(const size_t used, const size_t budget, bool &warned, const char *side) {
+    if (budget == 0) return;
+    if (!warned && used > budget) {
+      std::cout << "WARNING::RESOURCES:: " << side << " memory " << used / (1024 * 1024) << " MB over the budget of " << budget / (1024 * 1024) << " MB" << std::endl;
+      warned = true;
+    } else if (warned && used < budget / 10 * 9) {
+      warned = false;
+    }
+  }
+};
+
+inline ResourceRegistry &resources() {
+  static ResourceRegistry instance;
+  return instance;
+}
+
+// bytes of a texture's level 0 and, with mips, the whole chain (about a third more)
+inline size_t texture_bytes(const int width, const int height, const int bytes_per_pixel, const bool mips) {
+  const size_t base = static_cast<size_t>(width) * static_cast<size_t>(height) * static_cast<size_t>(bytes_per_pixel);
+  return mips ? base + base / 3 : base;
+}
+
+#endif
@@ -0,0 +1,90 @@
+#pragma once
+#ifndef SDF_BENCH_H
+#define SDF_BENCH_H
+
+#include <CollisionBench.h>
+#include <SparseSdf.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Headless benchmark for SparseSdf.h (run with --bench-sdf [voxel size]). Bakes the two vertebrae (or a synthetic
+// mesh), then cuts rongeur bites and ablation balls at random surface points on 1, 2, 4 and 8 threads and reports
+// the cost of the edit and of the re-mesh, which together have to fit well inside a frame.
+inline int run_sdf_benchmark(const float voxel_size = 0.04f, const int bites = 400) {
+  using clock = std::chrono::steady_clock;
+  const auto millis = [](const clock::time_point a, const clock::time_point b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+  const auto percentile = [](std::vector<double> v, const double q) {
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    return v[static_cast<size_t>(q * static_cast<double>(v.size() - 1))];
+  };
+
+  // same placement as the scene: both vertebrae moved down by 10
+  std::vector<std::vector<glm::vec3>> positions(2);
+  std::vector<std::vector<unsigned int>> indices(2);
+  const char *paths[2] = {"./resources/objects/backpack/lower.obj", "./resources/objects/backpack/upper.obj"};
+  for (int m = 0; m < 2; ++m) {
+    if (!load_collision_mesh(paths[m], positions[m], indices[m])) {
+      std::printf("%s: not loadable, using synthetic mesh\n", paths[m]);
+      positions.resize(1);
+      indices.resize(1);
+      positions[0].clear();
+      indices[0].clear();
+      make_benchmark_mesh(200, positions[0], indices[0]);
+      for (glm::vec3 &p : positions[0]) p *= 0.3f;// about the size of a vertebra
+      break;
+    }
+    for (glm::vec3 &p : positions[m]) p.y -= 10.0f;
+  }
+  std::vector<TriangleBvh> bvhs;
+  bvhs.reserve(positions.size());
+  std::vector<SdfSource> sources;
+  for (size_t m = 0; m < positions.size(); ++m) {
+    bvhs.emplace_back(positions[m], indices[m]);
+    sources.push_back({bvhs[m], positions[m], indices[m]});
+  }
+
+  JobSystem jobs(8);
+  SparseSdfConfig config;
+  config.voxel_size = voxel_size;
+  std::printf("hardware threads %u  voxel %.3f\n", std::max(1u, std::thread::hardware_concurrency()), voxel_size);
+  std::printf("%8s %10s %8s %8s %10s | %-20s %-20s %-20s\n", "threads", "bake ms", "bricks", "MB", "tris", "edit p50/p99 ms", "remesh p50/p99 ms", "bite p50/p99 ms");
+  for (const int threads : {1, 2, 4, 8}) {
+    jobs.set_active_threads(threads);
+    SparseSdf sdf(jobs, config);
+    auto t0 = clock::now();
+    sdf.bake(sources);
+    const double bake_ms = millis(t0, clock::now());
+    const size_t baked_bricks = sdf.brick_count(), baked_bytes = sdf.memory_bytes(), baked_triangles = sdf.triangle_count();
+
+    uint32_t state = 12345u;
+    const auto rnd = [&state]() {
+      state = state * 1664525u + 1013904223u;
+      return static_cast<float>(state >> 8) * (1.0f / 16777216.0f);
+    };
+    std::vector<double> edit, remesh, bite;
+    for (int b = 0; b < bites; ++b) {
+      const TriangleBvh &bvh = bvhs[b % bvhs.size()];
+      const Aabb box = bvh.bounds();
+      const glm::vec3 p = bvh.closest_point(box.min + (box.max - box.min) * glm::vec3(rnd(), rnd(), rnd())).point_on_mesh;
+      const glm::vec3 dir = glm::normalize(glm::vec3(rnd() - 0.5f, rnd() - 0.5f, rnd() - 0.5f) + glm::vec3(1e-4f));
+      t0 = clock::now();
+      // alternately a rongeur jaw and an ablation ball
+      const SdfEditStats e = b % 2 ? sdf.subtract_sphere(p, 0.2f) : sdf.subtract_capsule({p, p + dir * 0.6f, 0.15f});
+      const SdfMeshStats m = sdf.remesh();
+      bite.push_back(millis(t0, clock::now()));
+      edit.push_back(e.edit_ms);
+      remesh.push_back(m.mesh_ms);
+    }
+    std::printf("%8d %10.1f %8zu %8.2f %10zu | %8.3f / %-9.3f %8.3f / %-9.3f %8.3f / %-9.3f\n", threads, bake_ms, baked_bricks, static_cast<double>(baked_bytes) / (1024.0 * 1024.0), baked_triangles, percentile(edit, 0.5), percentile(edit, 0.99),
+                percentile(remesh, 0.5), percentile(remesh, 0.99), percentile(bite, 0.5), percentile(bite, 0.99));
+  }
+  return 0;
+}
+
+#endif
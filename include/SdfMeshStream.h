@@ -0,0 +1,304 @@
+#pragma once
+#ifndef SDF_MESH_STREAM_H
+#define SDF_MESH_STREAM_H
+
+#include <ResourceRegistry.h>
+#include <SparseSdf.h>
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// GPU side of SparseSdf: one vertex buffer shared by all bricks, each brick owning a range of it. A re-meshed
+// brick is written in place when it still fits its range (ranges keep some slack, bites mostly shrink or grow a
+// mesh a little), otherwise it moves to the first free range that fits. The buffer only grows, by copying on the
+// GPU, and the whole surface is one glMultiDrawArrays. Each brick also keeps its unique edges in an index buffer laid
+// out like the vertex buffer (two entries per vertex slot), for the edge wireframe. Needs a current GL context
+// (3.3, for glCopyBufferSubData).
+class SdfMeshStream {
+ public:
+  SdfMeshStream() {
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ebo);
+    allocate_buffer(64 * 1024);
+  }
+  ~SdfMeshStream() {
+    resources().remove(record);
+    resources().remove(edge_record);
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &ebo);
+    glDeleteVertexArrays(1, &vao);
+  }
+  SdfMeshStream(const SdfMeshStream &) = delete;
+  SdfMeshStream &operator=(const SdfMeshStream &) = delete;
+
+  // uploads every brick, e.g. right after a bake
+  void rebuild(const SparseSdf &sdf) {
+    ranges.clear();
+    free_ranges.clear();
+    first.clear();
+    count.clear();
+    edge_offset.clear();
+    edge_count.clear();
+    draw_brick.clear();
+    end = 0;
+    size_t total = 0;
+    for (uint32_t linear = 0; linear < sdf.grid_size(); ++linear) total += slack(sdf.mesh(linear).size());
+    if (total > capacity) allocate_buffer(total);
+    uploaded_bytes = 0;
+    for (uint32_t linear = 0; linear < sdf.grid_size(); ++linear) upload(linear, sdf.mesh(linear));
+  }
+
+  // uploads the bricks re-meshed by the last SparseSdf::remesh()
+  void update(const SparseSdf &sdf) {
+    uploaded_bytes = 0;
+    for (const uint32_t linear : sdf.changed_bricks()) upload(linear, sdf.mesh(linear));
+  }
+
+  void draw() const {
+    if (first.empty()) return;
+    glBindVertexArray(vao);
+    glMultiDrawArrays(GL_TRIANGLES, first.data(), count.data(), static_cast<GLsizei>(first.size()));
+    glBindVertexArray(0);
+  }
+
+  // only the bricks with brick_visible[brick] set, e.g. by occlusion culling
+  void draw(const std::vector<uint8_t> &brick_visible) {
+    visible_first.clear();
+    visible_count.clear();
+    for (size_t d = 0; d < first.size(); ++d)
+      if (brick_visible[draw_brick[d]]) {
+        visible_first.push_back(first[d]);
+        visible_count.push_back(count[d]);
+      }
+    if (visible_first.empty()) return;
+    glBindVertexArray(vao);
+    glMultiDrawArrays(GL_TRIANGLES, visible_first.data(), visible_count.data(), static_cast<GLsizei>(visible_first.size()));
+    glBindVertexArray(0);
+  }
+
+  // the unique edges as GL_LINES, e.g. over WireframePass's underlay; same brick selection as draw()
+  void draw_edges() {
+    edge_lines = edge_vertices = 0;
+    if (edge_offset.empty()) return;
+    for (size_t d = 0; d < first.size(); ++d) edge_lines += edge_count[d] / 2, edge_vertices += count[d];
+    glBindVertexArray(vao);
+    glMultiDrawElements(GL_LINES, edge_count.data(), GL_UNSIGNED_INT, edge_offset.data(), static_cast<GLsizei>(edge_offset.size()));
+    glBindVertexArray(0);
+  }
+  void draw_edges(const std::vector<uint8_t> &brick_visible) {
+    edge_lines = edge_vertices = 0;
+    visible_offset.clear();
+    visible_count.clear();
+    for (size_t d = 0; d < first.size(); ++d)
+      if (brick_visible[draw_brick[d]]) {
+        visible_offset.push_back(edge_offset[d]);
+        visible_count.push_back(edge_count[d]);
+        edge_lines += edge_count[d] / 2, edge_vertices += count[d];
+      }
+    if (visible_offset.empty()) return;
+    glBindVertexArray(vao);
+    glMultiDrawElements(GL_LINES, visible_count.data(), GL_UNSIGNED_INT, visible_offset.data(), static_cast<GLsizei>(visible_offset.size()));
+    glBindVertexArray(0);
+  }
+  // segments of the last draw_edges() and the triangle outlines polygon mode would have drawn for the same bricks
+  size_t last_edge_lines() const { return edge_lines; }
+  size_t last_triangle_edges() const { return edge_vertices; }
+
+  // bricks with a mesh on the GPU
+  const std::vector<uint32_t> &drawn_bricks() const { return draw_brick; }
+
+  size_t buffer_bytes() const { return capacity * (sizeof(SdfVertex) + 2 * sizeof(uint32_t)); }
+  size_t last_upload_bytes() const { return uploaded_bytes; }
+  size_t draw_ranges() const { return first.size(); }
+
+ private:
+  struct Range {
+    size_t first;
+    size_t capacity;
+    size_t draw;// index into first/count
+  };
+
+  unsigned int vao = 0, vbo = 0, ebo = 0;
+  size_t capacity = 0;// vertices
+  size_t end = 0;     // high-water mark of allocated ranges
+  size_t uploaded_bytes = 0;
+  size_t edge_lines = 0, edge_vertices = 0;
+  ResourceRegistry::Handle record = 0, edge_record = 0;
+  std::unordered_map<uint32_t, Range> ranges;// by brick
+  std::vector<Range> free_ranges;            // sorted by first, neighbours merged
+  std::vector<GLint> first;
+  std::vector<GLsizei> count;
+  std::vector<const void *> edge_offset;// byte offsets into ebo, parallel to first/count
+  std::vector<GLsizei> edge_count;
+  std::vector<uint32_t> draw_brick;
+  std::vector<GLint> visible_first;// scratch for the culled draws
+  std::vector<GLsizei> visible_count;
+  std::vector<const void *> visible_offset;
+  // scratch for brick_edges()
+  std::vector<uint32_t> weld;
+  std::vector<uint32_t> canonical;
+  std::vector<std::pair<uint64_t, uint64_t>> edge_keys;
+  std::vector<uint32_t> lines;
+
+  // a quarter more than needed, rounded up to 64 vertices
+  static size_t slack(const size_t vertices) { return vertices == 0 ? 0 : (vertices + vertices / 4 + 63) / 64 * 64; }
+
+  // unique edges of a brick's triangle soup as indices into the shared buffer, the mesh starting at `at`. Marching
+  // cubes computes a vertex shared by neighbouring cells from the same two samples, so welding by exact position
+  // finds it; sorting instead of hashing keeps the scratch reusable.
+  void brick_edges(const std::vector<SdfVertex> &mesh, const size_t at) {
+    const auto less = [&](const uint32_t a, const uint32_t b) {
+      const glm::vec3 &p = mesh[a].position, &q = mesh[b].position;
+      return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+    };
+    weld.resize(mesh.size());
+    for (uint32_t v = 0; v < mesh.size(); ++v) weld[v] = v;
+    std::sort(weld.begin(), weld.end(), less);
+    canonical.resize(mesh.size());
+    for (size_t i = 0, id = 0; i < weld.size(); ++i) {
+      if (i > 0 && less(weld[i - 1], weld[i])) ++id;
+      canonical[weld[i]] = static_cast<uint32_t>(id);
+    }
+
+    // (welded pair, vertex pair) per triangle edge; the first of each welded pair is drawn
+    edge_keys.clear();
+    for (uint32_t t = 0; t + 2 < mesh.size(); t += 3)
+      for (uint32_t e = 0; e < 3; ++e) {
+        const uint32_t a = t + e, b = t + (e + 1) % 3;
+        const uint32_t ca = canonical[a], cb = canonical[b];
+        if (ca == cb) continue;
+        edge_keys.emplace_back(static_cast<uint64_t>(std::min(ca, cb)) << 32 | std::max(ca, cb), static_cast<uint64_t>(a) << 32 | b);
+      }
+    std::sort(edge_keys.begin(), edge_keys.end());
+    lines.clear();
+    for (size_t i = 0; i < edge_keys.size(); ++i) {
+      if (i > 0 && edge_keys[i].first == edge_keys[i - 1].first) continue;
+      lines.push_back(static_cast<uint32_t>(at + (edge_keys[i].second >> 32)));
+      lines.push_back(static_cast<uint32_t>(at + (edge_keys[i].second & 0xffffffffu)));
+    }
+  }
+
+  void upload(const uint32_t linear, const std::vector<SdfVertex> &mesh) {
+    auto it = ranges.find(linear);
+    if (it != ranges.end() && (mesh.empty() || mesh.size() > it->second.capacity)) {
+      release(it->second);
+      ranges.erase(it);
+      it = ranges.end();
+    }
+    if (mesh.empty()) return;
+    if (it == ranges.end()) {
+      Range range{reserve(slack(mesh.size())), slack(mesh.size()), first.size()};
+      first.push_back(static_cast<GLint>(range.first));
+      count.push_back(0);
+      edge_offset.push_back(reinterpret_cast<const void *>(2 * range.first * sizeof(uint32_t)));
+      edge_count.push_back(0);
+      draw_brick.push_back(linear);
+      it = ranges.emplace(linear, range).first;
+    }
+    const Range &range = it->second;
+    count[range.draw] = static_cast<GLsizei>(mesh.size());
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(range.first * sizeof(SdfVertex)), static_cast<GLsizeiptr>(mesh.size() * sizeof(SdfVertex)), mesh.data());
+    uploaded_bytes += mesh.size() * sizeof(SdfVertex);
+
+    // at most one edge per triangle corner, so the lines fit the range's two index slots per vertex
+    brick_edges(mesh, range.first);
+    edge_count[range.draw] = static_cast<GLsizei>(lines.size());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(2 * range.first * sizeof(uint32_t)), static_cast<GLsizeiptr>(lines.size() * sizeof(uint32_t)), lines.data());
+    uploaded_bytes += lines.size() * sizeof(uint32_t);
+  }
+
+  // first fit from the free list, else from the end of the buffer (growing it)
+  size_t reserve(const size_t vertices) {
+    for (size_t i = 0; i < free_ranges.size(); ++i) {
+      Range &free = free_ranges[i];
+      if (free.capacity < vertices) continue;
+      const size_t at = free.first;
+      free.first += vertices;
+      free.capacity -= vertices;
+      if (free.capacity == 0) free_ranges.erase(free_ranges.begin() + static_cast<std::ptrdiff_t>(i));
+      return at;
+    }
+    if (end + vertices > capacity) allocate_buffer(std::max(2 * capacity, end + vertices));
+    const size_t at = end;
+    end += vertices;
+    return at;
+  }
+
+  void release(const Range &range) {
+    // drop the draw entry, the last one takes its place
+    const size_t last = first.size() - 1;
+    if (range.draw != last) {
+      first[range.draw] = first[last];
+      count[range.draw] = count[last];
+      edge_offset[range.draw] = edge_offset[last];
+      edge_count[range.draw] = edge_count[last];
+      draw_brick[range.draw] = draw_brick[last];
+      ranges[draw_brick[range.draw]].draw = range.draw;
+    }
+    first.pop_back();
+    count.pop_back();
+    edge_offset.pop_back();
+    edge_count.pop_back();
+    draw_brick.pop_back();
+
+    auto at = std::lower_bound(free_ranges.begin(), free_ranges.end(), range.first, [](const Range &r, const size_t f) { return r.first < f; });
+    at = free_ranges.insert(at, Range{range.first, range.capacity, 0});
+    if (at + 1 != free_ranges.end() && at->first + at->capacity == (at + 1)->first) {
+      at->capacity += (at + 1)->capacity;
+      free_ranges.erase(at + 1);
+    }
+    if (at != free_ranges.begin() && (at - 1)->first + (at - 1)->capacity == at->first) {
+      (at - 1)->capacity += at->capacity;
+      at = free_ranges.erase(at) - 1;
+    }
+    if (at->first + at->capacity == end) {
+      end = at->first;
+      free_ranges.erase(at);
+    }
+  }
+
+  // a bigger copy of `buffer` holding its first `used` bytes
+  void grow(unsigned int &buffer, const size_t bytes, const size_t used) {
+    unsigned int grown;
+    glGenBuffers(1, &grown);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+    glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(bytes), nullptr, GL_DYNAMIC_DRAW);
+    if (used > 0) {
+      glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(used));
+    }
+    glDeleteBuffers(1, &buffer);
+    buffer = grown;
+  }
+
+  void allocate_buffer(const size_t vertices) {
+    grow(vbo, vertices * sizeof(SdfVertex), end * sizeof(SdfVertex));
+    grow(ebo, 2 * vertices * sizeof(uint32_t), 2 * end * sizeof(uint32_t));
+    capacity = vertices;
+    // new buffer names, so new records rather than updates
+    resources().remove(record);
+    resources().remove(edge_record);
+    record = resources().add(k_resource_buffer, vbo, vertices * sizeof(SdfVertex), std::to_string(vertices) + " vertices", "bone mesh");
+    edge_record = resources().add(k_resource_buffer, ebo, 2 * vertices * sizeof(uint32_t), std::to_string(2 * vertices) + " edge indices", "bone mesh");
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SdfVertex), (void *) offsetof(SdfVertex, position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SdfVertex), (void *) offsetof(SdfVertex, normal));
+    glBindVertexArray(0);
+  }
+};
+
+#endif
@@ -1,6 +1,8 @@
 ﻿#ifndef SHADER_H
 #define SHADER_H
 
+#include <Trace.h>
+
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
@@ -17,6 +19,7 @@ public:
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath)
     {
+        TRACE_ZONE("compile shader");
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
         std::string fragmentCode;
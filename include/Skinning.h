@@ -0,0 +1,136 @@
+#pragma once
+#ifndef SKINNING_H
+#define SKINNING_H
+
+#include <Animation.h>
+#include <DynamicMesh.h>
+#include <JobSystem.h>
+#include <Model.h>
+#include <ResourceRegistry.h>
+#include <Shader.h>
+
+#include <glad/glad.h>
+
+#include <memory>
+#include <vector>
+
+// GL side of Animation.h. GPU skinning draws the model's own meshes with shader/skinned.vs and the palette in a
+// uniform buffer; the CPU fallback (no skinning shader, or morph targets, which the shader does not blend)
+// skins into DynamicMesh streams instead.
+
+constexpr unsigned int bone_palette_binding = 0;
+
+class BonePaletteBuffer {
+ public:
+  BonePaletteBuffer() {
+    glGenBuffers(1, &ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferData(GL_UNIFORM_BUFFER, max_bones * sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    record = resources().add(k_resource_buffer, ubo, max_bones * sizeof(glm::mat4), std::to_string(max_bones) + " bones", "bone palette");
+  }
+  ~BonePaletteBuffer() {
+    resources().remove(record);
+    glDeleteBuffers(1, &ubo);
+  }
+  BonePaletteBuffer(const BonePaletteBuffer &) = delete;
+  BonePaletteBuffer &operator=(const BonePaletteBuffer &) = delete;
+
+  // std140 lays out a mat4 array like glm does, so the palette goes in as is
+  void upload(const AnimationPose &pose) {
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, static_cast<GLsizeiptr>(pose.bone_count * sizeof(glm::mat4)), pose.bones);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+
+  void bind(const Shader &shader) const {
+    const unsigned int block = glGetUniformBlockIndex(shader.ID, "BonePalette");
+    if (block != GL_INVALID_INDEX) glUniformBlockBinding(shader.ID, block, bone_palette_binding);
+    glBindBufferBase(GL_UNIFORM_BUFFER, bone_palette_binding, ubo);
+  }
+
+ private:
+  unsigned int ubo = 0;
+  ResourceRegistry::Handle record = 0;
+};
+
+// one Mesh skinned on the CPU into a streamed copy
+class CpuSkinnedMesh {
+ public:
+  explicit CpuSkinnedMesh(const Mesh &mesh) : mesh(mesh), stream(mesh.vertices, mesh.indices, mesh.textures, GL_TRIANGLES, k_stream_orphan, 1, mesh.owner + " skinned") {
+    for (const Vertex &v : mesh.vertices) {
+      rest_positions.push_back(v.Position);
+      rest_normals.push_back(v.Normal);
+      bone_ids.emplace_back(v.m_BoneIDs[0], v.m_BoneIDs[1], v.m_BoneIDs[2], v.m_BoneIDs[3]);
+      bone_weights.emplace_back(v.m_Weights[0], v.m_Weights[1], v.m_Weights[2], v.m_Weights[3]);
+    }
+  }
+
+  void update(const AnimationPose &pose, JobSystem &jobs) {
+    const size_t n = rest_positions.size();
+    glm::vec3 *positions = stream.edit_positions(0, n);
+    glm::vec3 *normals = stream.edit_normals(0, n);
+    jobs.parallel_for(0, n, 2048, [&](size_t b, size_t e) { skin_vertices(rest_positions.data(), rest_normals.data(), bone_ids.data(), bone_weights.data(), mesh.morph_deltas, pose, b, e, positions, normals); });
+    stream.upload();
+  }
+
+  void Draw(Shader &shader) { stream.Draw(shader); }
+
+ private:
+  const Mesh &mesh;
+  DynamicMesh stream;
+  std::vector<glm::vec3> rest_positions, rest_normals;
+  std::vector<glm::ivec4> bone_ids;
+  std::vector<glm::vec4> bone_weights;
+};
+
+// a skinned Model with its player thread and whichever skinning path it uses
+class AnimatedModel {
+ public:
+  AnimatedModel(Model &model, const bool gpu_skinning) : model(model), player(model.skeleton, model.animations) {
+    bool morphs = false;
+    for (const Mesh &mesh : model.meshes) morphs |= !mesh.morph_deltas.empty();
+    gpu = gpu_skinning && !morphs;
+    if (!gpu)
+      for (const Mesh &mesh : model.meshes) cpu_meshes.push_back(std::make_unique<CpuSkinnedMesh>(mesh));
+    player.start();
+  }
+
+  Model &model;
+  AnimationPlayer player;
+
+  bool gpu_skinned() const { return gpu; }
+  int clip_count() const { return static_cast<int>(model.animations.size()); }
+
+  // hands the control to the player and skins / uploads its latest pose
+  void update(const AnimationControl &control, JobSystem &jobs) {
+    player.control.store(control);
+    player.pose.load(pose);
+    if (gpu) palette.upload(pose);
+    else
+      for (const auto &mesh : cpu_meshes) mesh->update(pose, jobs);
+  }
+
+  // view/projection have to be set on both shaders; leaves `shader` in use
+  void Draw(Shader &shader, Shader &skinned_shader, const glm::mat4 &world) {
+    if (gpu) {
+      skinned_shader.use();
+      palette.bind(skinned_shader);
+      model.Draw(skinned_shader, world);
+      shader.use();
+    } else {
+      for (size_t i = 0; i < cpu_meshes.size(); ++i) {
+        shader.setMat4("model", world * model.mesh_transforms[i]);
+        cpu_meshes[i]->Draw(shader);
+      }
+    }
+  }
+
+ private:
+  bool gpu = true;
+  BonePaletteBuffer palette;
+  std::vector<std::unique_ptr<CpuSkinnedMesh>> cpu_meshes;
+  AnimationPose pose{};
+};
+
+#endif
@@ -0,0 +1,652 @@
+#pragma once
+#ifndef SOFT_TISSUE_H
+#define SOFT_TISSUE_H
+
+#include <Collision.h>
+#include <JobSystem.h>
+
+#include <fusion.pb.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SOFT_TISSUE_SSE2 1
+#else
+#define SOFT_TISSUE_SSE2 0
+#endif
+
+// XPBD soft tissue for the structures listed in the Tissue message.
+//
+// Every structure is a proxy: a sheet (cloth), a tetrahedral block or a strand, pinned where it attaches to bone.
+// The solver follows "small steps" XPBD (Macklin et al. 2019): many substeps with one constraint iteration each,
+// so the Lagrange multipliers start at zero every substep and need no storage.
+//  - particles and constraints are SoA,
+//  - constraints are graph colored (no two constraints of a color share a particle) and sorted by color, so each
+//    color is one lock-free parallel loop on the JobSystem and four neighbouring constraints form one SSE batch,
+//  - the step runs as many substeps as fit into the time budget; the substep count adapts frame to frame and a
+//    step that still overruns folds its remaining time into one last substep.
+// Distance constraints tear past a strain limit; the share of intact constraints is what goes out in the Tissue
+// fields (1 = intact), and the nerve root's displacement from rest drives nerve_root_dance.
+
+#pragma region tissue proxies
+enum tissue_kind {
+  k_liga_flavum,
+  k_disc_yellow_space,
+  k_veutro_vessel,
+  k_fat,
+  k_fibrous_rings,
+  k_nucleus_pulposus,
+  k_p_longitudinal_liga,
+  k_dura_mater,
+  k_nerve_root,
+  k_tissue_kind_count
+};
+
+inline const char *tissue_name(const int kind) {
+  static const char *names[k_tissue_kind_count] = {"liga_flavum", "disc_yellow_space", "veutro_vessel", "fat", "fibrous_rings", "nucleus_pulposus", "p_longitudinal_liga", "dura_mater", "nerve_root"};
+  return kind >= 0 && kind < k_tissue_kind_count ? names[kind] : "?";
+}
+
+enum tissue_proxy_shape {
+  k_proxy_sheet, // grid in the x/z plane, pinned along both z edges
+  k_proxy_block, // 5 tets per cell, pinned on the bottom face
+  k_proxy_strand,// particle chain along x, pinned at both ends
+};
+
+struct TissueProxySpec {
+  tissue_kind tissue;
+  tissue_proxy_shape shape;
+  glm::vec3 origin;     // min corner
+  glm::vec3 extent;     // size of the box the proxy spans
+  glm::ivec3 resolution;// cells per axis (sheets ignore y, strands use x)
+  float mass;           // total, spread over the particles
+  float compliance;     // distance constraints, inverse stiffness
+  float volume_compliance;// exactly 0 fights the distance constraints on thin cells, ~1e-6 is incompressible enough
+  float tear_strain;// relative stretch at which a distance constraint breaks, <= 0 never
+};
+
+// proxies laid out relative to the anatomy bounds; `density` scales the resolution (constraints grow ~density^2..3)
+inline std::vector<TissueProxySpec> default_tissue_proxies(const Aabb &anatomy, const float density = 1.0f) {
+  const glm::vec3 size = anatomy.max - anatomy.min;
+  const auto spec = [&](tissue_kind kind, tissue_proxy_shape shape, glm::vec3 rel_origin, glm::vec3 rel_extent, glm::ivec3 res, float mass, float compliance, float volume_compliance, float tear) {
+    const glm::ivec3 scaled = glm::max(glm::ivec3(glm::vec3(res) * density + 0.5f), glm::ivec3(1));
+    return TissueProxySpec{kind, shape, anatomy.min + rel_origin * size, rel_extent * size, scaled, mass, compliance, volume_compliance, tear};
+  };
+  return {
+      spec(k_liga_flavum, k_proxy_sheet, {0.10f, 0.75f, 0.10f}, {0.80f, 0.00f, 0.30f}, {40, 1, 24}, 0.2f, 1e-5f, 0.0f, 0.35f),
+      spec(k_disc_yellow_space, k_proxy_block, {0.30f, 0.45f, 0.45f}, {0.40f, 0.10f, 0.10f}, {12, 4, 4}, 0.1f, 1e-4f, 1e-6f, 0.0f),
+      spec(k_veutro_vessel, k_proxy_strand, {0.05f, 0.30f, 0.80f}, {0.90f, 0.00f, 0.00f}, {60, 1, 1}, 0.05f, 1e-4f, 0.0f, 0.6f),
+      spec(k_fat, k_proxy_block, {0.05f, 0.80f, 0.50f}, {0.90f, 0.15f, 0.30f}, {24, 5, 10}, 0.5f, 1e-3f, 1e-4f, 0.5f),
+      spec(k_fibrous_rings, k_proxy_block, {0.20f, 0.35f, 0.20f}, {0.60f, 0.08f, 0.60f}, {16, 4, 16}, 0.4f, 1e-6f, 1e-6f, 0.0f),
+      spec(k_nucleus_pulposus, k_proxy_block, {0.35f, 0.36f, 0.35f}, {0.30f, 0.06f, 0.30f}, {8, 4, 8}, 0.2f, 1e-4f, 1e-6f, 0.0f),
+      spec(k_p_longitudinal_liga, k_proxy_sheet, {0.40f, 0.20f, 0.00f}, {0.20f, 0.00f, 1.00f}, {12, 1, 48}, 0.1f, 1e-5f, 0.0f, 0.35f),
+      spec(k_dura_mater, k_proxy_sheet, {0.15f, 0.60f, 0.05f}, {0.70f, 0.00f, 0.90f}, {40, 1, 40}, 0.3f, 1e-5f, 0.0f, 0.4f),
+      spec(k_nerve_root, k_proxy_strand, {0.10f, 0.55f, 0.60f}, {0.80f, 0.00f, 0.00f}, {80, 1, 1}, 0.05f, 1e-4f, 0.0f, 0.8f),
+  };
+}
+#pragma endregion
+
+#pragma region simd lanes
+// four constraints at a time; with SSE2 one register, otherwise plain arrays the compiler can still vectorize
+struct TissueLanes {
+#if SOFT_TISSUE_SSE2
+  __m128 v;
+  static TissueLanes set1(const float a) { return {_mm_set1_ps(a)}; }
+  static TissueLanes gather(const float *base, const uint32_t *index) { return {_mm_set_ps(base[index[3]], base[index[2]], base[index[1]], base[index[0]])}; }
+  static TissueLanes load(const float *p) { return {_mm_loadu_ps(p)}; }
+  void store(float *p) const { _mm_storeu_ps(p, v); }
+  friend TissueLanes operator+(const TissueLanes a, const TissueLanes b) { return {_mm_add_ps(a.v, b.v)}; }
+  friend TissueLanes operator-(const TissueLanes a, const TissueLanes b) { return {_mm_sub_ps(a.v, b.v)}; }
+  friend TissueLanes operator*(const TissueLanes a, const TissueLanes b) { return {_mm_mul_ps(a.v, b.v)}; }
+  friend TissueLanes operator/(const TissueLanes a, const TissueLanes b) { return {_mm_div_ps(a.v, b.v)}; }
+  friend TissueLanes max(const TissueLanes a, const TissueLanes b) { return {_mm_max_ps(a.v, b.v)}; }
+  friend TissueLanes sqrt(const TissueLanes a) { return {_mm_sqrt_ps(a.v)}; }
+  // a where mask > threshold, else 0
+  friend TissueLanes keep_if_greater(const TissueLanes a, const TissueLanes mask, const TissueLanes threshold) { return {_mm_and_ps(a.v, _mm_cmpgt_ps(mask.v, threshold.v))}; }
+#else
+  float v[4];
+  static TissueLanes set1(const float a) { return {{a, a, a, a}}; }
+  static TissueLanes gather(const float *base, const uint32_t *index) { return {{base[index[0]], base[index[1]], base[index[2]], base[index[3]]}}; }
+  static TissueLanes load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+  void store(float *p) const {
+    for (int i = 0; i < 4; ++i) p[i] = v[i];
+  }
+  template <typename Op>
+  static TissueLanes map(const TissueLanes a, const TissueLanes b, Op op) {
+    TissueLanes r;
+    for (int i = 0; i < 4; ++i) r.v[i] = op(a.v[i], b.v[i]);
+    return r;
+  }
+  friend TissueLanes operator+(const TissueLanes a, const TissueLanes b) { return map(a, b, [](float x, float y) { return x + y; }); }
+  friend TissueLanes operator-(const TissueLanes a, const TissueLanes b) { return map(a, b, [](float x, float y) { return x - y; }); }
+  friend TissueLanes operator*(const TissueLanes a, const TissueLanes b) { return map(a, b, [](float x, float y) { return x * y; }); }
+  friend TissueLanes operator/(const TissueLanes a, const TissueLanes b) { return map(a, b, [](float x, float y) { return x / y; }); }
+  friend TissueLanes max(const TissueLanes a, const TissueLanes b) { return map(a, b, [](float x, float y) { return x > y ? x : y; }); }
+  friend TissueLanes sqrt(const TissueLanes a) { return map(a, a, [](float x, float) { return std::sqrt(x); }); }
+  friend TissueLanes keep_if_greater(const TissueLanes a, const TissueLanes mask, const TissueLanes threshold) {
+    TissueLanes r;
+    for (int i = 0; i < 4; ++i) r.v[i] = mask.v[i] > threshold.v[i] ? a.v[i] : 0.0f;
+    return r;
+  }
+#endif
+  void scatter(float *base, const uint32_t *index) const {
+    alignas(16) float lanes[4];
+    store(lanes);
+    for (int i = 0; i < 4; ++i) base[index[i]] = lanes[i];
+  }
+};
+#pragma endregion
+
+#pragma region solver
+struct TissueSolverConfig {
+  float dt = 1.0f / 60.0f;// simulated time per step()
+  int substeps = 8;       // starting point, adapted to the budget
+  int min_substeps = 2;
+  int max_substeps = 40;
+  double budget_ms = 2.0;// wall time per step(); <= 0 runs exactly `substeps`
+  glm::vec3 gravity{0.0f, -9.81f, 0.0f};
+  float damping = 2.0f;      // velocity damping per second
+  float contact_margin = 0.02f;
+  size_t grain = 512;        // constraints per chunk handed to a thread
+  float nerve_dance_displacement = 0.15f;// nerve root displacement (scene units) that counts as disturbed
+};
+
+struct TissueState {
+  float integrity[k_tissue_kind_count];   // share of intact tearable constraints, 1 = untouched
+  float max_strain[k_tissue_kind_count];  // largest relative stretch of an intact constraint
+  float max_displacement[k_tissue_kind_count];
+  bool nerve_root_disturbed;
+};
+
+struct TissueSolverStats {
+  double step_ms;
+  double substep_ms;
+  int substeps;       // run in the last step
+  int budget_overruns;// steps that had to fold their remaining time into one substep
+  size_t particles;
+  size_t distance_constraints;
+  size_t volume_constraints;
+  size_t distance_colors;
+  size_t volume_colors;
+  int threads;
+};
+
+class TissueSolver {
+ public:
+  explicit TissueSolver(JobSystem &jobs, TissueSolverConfig config = TissueSolverConfig()) : config(config), jobs(jobs), substeps(config.substeps) {}
+
+  TissueSolverConfig config;
+
+  void build(const std::vector<TissueProxySpec> &specs) {
+    clear();
+    for (const TissueProxySpec &spec : specs) add_proxy(spec);
+    color_and_sort();
+    // one partial per measure() chunk, so steps do not allocate
+    partial.reserve((d_a.size() + measure_grain() - 1) / measure_grain());
+    for (size_t i = 0; i < d_a.size(); ++i)
+      if (d_tear[i] > 0.0f) ++tearable[d_tissue[i]];
+    state = TissueState{};
+    for (float &v : state.integrity) v = 1.0f;
+  }
+
+  // instrument shapes that push tissue aside, in world space; replaced every frame
+  void set_colliders(const std::vector<Capsule> &capsules) { colliders = capsules; }
+
+  // advances config.dt
+  void step() {
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    const int planned = std::min(std::max(substeps, config.min_substeps), config.max_substeps);
+    const float h = config.dt / static_cast<float>(planned);
+    int done = 0;
+    bool overrun = false;
+    while (done < planned) {
+      float sub = h;
+      // over budget with substeps left: fold the rest into one substep instead of running late
+      const double elapsed_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+      if (config.budget_ms > 0.0 && done > 0 && done + 1 < planned && elapsed_ms > config.budget_ms) {
+        sub = h * static_cast<float>(planned - done);
+        overrun = true;
+      }
+      substep(sub);
+      done = sub > h ? planned : done + 1;
+    }
+    measure();
+
+    const double step_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    stat.step_ms = step_ms;
+    stat.substeps = done;
+    stat.substep_ms = step_ms / done;
+    if (overrun) ++stat.budget_overruns;
+    if (config.budget_ms > 0.0) {
+      // aim a little below the budget so jitter does not trip the fold-in
+      const int fit = static_cast<int>(0.9 * config.budget_ms / std::max(stat.substep_ms, 1e-6));
+      substeps = std::min(std::max(fit, config.min_substeps), config.max_substeps);
+    }
+  }
+
+  const TissueState &tissue_state() const { return state; }
+
+  TissueSolverStats stats() const {
+    TissueSolverStats s = stat;
+    s.particles = x.size();
+    s.distance_constraints = d_a.size();
+    s.volume_constraints = t_rest.size();
+    s.distance_colors = d_colors.size() - 1;
+    s.volume_colors = t_colors.size() - 1;
+    s.threads = jobs.active_threads();
+    return s;
+  }
+
+  // rendering: particle positions and the intact distance constraints as line pairs
+  size_t particle_count() const { return x.size(); }
+  void write_positions(std::vector<glm::vec3> &out) const {
+    out.resize(x.size());
+    for (size_t i = 0; i < x.size(); ++i) out[i] = glm::vec3(x[i], y[i], z[i]);
+  }
+  void write_line_indices(std::vector<unsigned int> &out) const {
+    out.clear();
+    for (size_t i = 0; i < d_a.size(); ++i)
+      if (d_alpha[i] < torn_alpha) out.insert(out.end(), {d_a[i], d_b[i]});
+  }
+  // bumps whenever a constraint tears, i.e. when the line indices need rebuilding
+  uint32_t topology_version() const { return topology; }
+
+  void reset() {
+    x = rx;
+    y = ry;
+    z = rz;
+    std::fill(vx.begin(), vx.end(), 0.0f);
+    std::fill(vy.begin(), vy.end(), 0.0f);
+    std::fill(vz.begin(), vz.end(), 0.0f);
+    for (size_t i = 0; i < d_a.size(); ++i) d_alpha[i] = d_compliance[i];
+    ++topology;
+    measure();
+  }
+
+ private:
+  JobSystem &jobs;
+  int substeps;
+  TissueSolverStats stat{};
+  TissueState state{};
+  std::vector<Capsule> colliders;
+  uint32_t topology = 0;
+  int tearable[k_tissue_kind_count] = {};
+  static constexpr float torn_alpha = 1e20f;
+
+  // particles
+  std::vector<float> x, y, z, px, py, pz, vx, vy, vz, w, rx, ry, rz;
+  std::vector<uint8_t> p_tissue;
+
+  // distance constraints, sorted by color; d_colors[c]..d_colors[c + 1] is color c
+  std::vector<uint32_t> d_a, d_b;
+  std::vector<float> d_rest, d_alpha, d_compliance, d_tear;
+  std::vector<uint8_t> d_tissue;
+  std::vector<size_t> d_colors;
+
+  // tetrahedral volume constraints, same layout
+  std::vector<uint32_t> t_0, t_1, t_2, t_3;
+  std::vector<float> t_rest, t_alpha;
+  std::vector<size_t> t_colors;
+
+  // measure() reductions, one per chunk
+  struct Partial {
+    int torn[k_tissue_kind_count];
+    int newly_torn;
+    float strain[k_tissue_kind_count];
+  };
+  std::vector<Partial> partial;
+
+  void clear() {
+    substeps = config.substeps;
+    stat = TissueSolverStats{};
+    ++topology;
+    std::fill(std::begin(tearable), std::end(tearable), 0);
+    for (auto *v : {&x, &y, &z, &px, &py, &pz, &vx, &vy, &vz, &w, &rx, &ry, &rz, &d_rest, &d_alpha, &d_compliance, &d_tear, &t_rest, &t_alpha}) v->clear();
+    for (auto *v : {&d_a, &d_b, &t_0, &t_1, &t_2, &t_3}) v->clear();
+    p_tissue.clear();
+    d_tissue.clear();
+    d_colors.clear();
+    t_colors.clear();
+  }
+
+  uint32_t add_particle(const glm::vec3 &p, const float inv_mass, const tissue_kind kind) {
+    for (auto *v : {&px, &vx, &vy, &vz}) v->push_back(0.0f);
+    x.push_back(p.x), y.push_back(p.y), z.push_back(p.z);
+    rx.push_back(p.x), ry.push_back(p.y), rz.push_back(p.z);
+    py.push_back(0.0f), pz.push_back(0.0f);
+    w.push_back(inv_mass);
+    p_tissue.push_back(static_cast<uint8_t>(kind));
+    return static_cast<uint32_t>(x.size() - 1);
+  }
+
+  glm::vec3 rest(const uint32_t i) const { return {rx[i], ry[i], rz[i]}; }
+
+  void add_distance(const uint32_t a, const uint32_t b, const TissueProxySpec &spec) {
+    d_a.push_back(a);
+    d_b.push_back(b);
+    d_rest.push_back(glm::length(rest(a) - rest(b)));
+    d_alpha.push_back(spec.compliance);
+    d_compliance.push_back(spec.compliance);
+    d_tear.push_back(spec.tear_strain);
+    d_tissue.push_back(static_cast<uint8_t>(spec.tissue));
+  }
+
+  void add_tet(const uint32_t a, const uint32_t b, const uint32_t c, const uint32_t d, const TissueProxySpec &spec) {
+    t_0.push_back(a), t_1.push_back(b), t_2.push_back(c), t_3.push_back(d);
+    t_rest.push_back(glm::dot(glm::cross(rest(b) - rest(a), rest(c) - rest(a)), rest(d) - rest(a)) / 6.0f);
+    t_alpha.push_back(spec.volume_compliance);
+  }
+
+  void add_proxy(const TissueProxySpec &spec) {
+    const glm::ivec3 n = glm::max(spec.resolution, glm::ivec3(1));
+    const auto first = static_cast<uint32_t>(x.size());
+    if (spec.shape == k_proxy_sheet) {
+      const int count = (n.x + 1) * (n.z + 1);
+      const float inv_mass = static_cast<float>(count) / std::max(spec.mass, 1e-6f);
+      for (int j = 0; j <= n.z; ++j)
+        for (int i = 0; i <= n.x; ++i) {
+          const glm::vec3 p = spec.origin + spec.extent * glm::vec3(static_cast<float>(i) / n.x, 0.0f, static_cast<float>(j) / n.z);
+          add_particle(p, j == 0 || j == n.z ? 0.0f : inv_mass, spec.tissue);
+        }
+      const auto id = [&](int i, int j) { return first + static_cast<uint32_t>(j * (n.x + 1) + i); };
+      for (int j = 0; j <= n.z; ++j)
+        for (int i = 0; i <= n.x; ++i) {
+          if (i < n.x) add_distance(id(i, j), id(i + 1, j), spec);// structural
+          if (j < n.z) add_distance(id(i, j), id(i, j + 1), spec);
+          if (i < n.x && j < n.z) {// shear
+            add_distance(id(i, j), id(i + 1, j + 1), spec);
+            add_distance(id(i + 1, j), id(i, j + 1), spec);
+          }
+          if (i + 2 <= n.x) add_distance(id(i, j), id(i + 2, j), spec);// bending
+          if (j + 2 <= n.z) add_distance(id(i, j), id(i, j + 2), spec);
+        }
+    } else if (spec.shape == k_proxy_strand) {
+      const float inv_mass = static_cast<float>(n.x + 1) / std::max(spec.mass, 1e-6f);
+      for (int i = 0; i <= n.x; ++i) add_particle(spec.origin + spec.extent * (static_cast<float>(i) / n.x), i == 0 || i == n.x ? 0.0f : inv_mass, spec.tissue);
+      for (int i = 0; i < n.x; ++i) add_distance(first + i, first + i + 1, spec);
+      for (int i = 0; i + 2 <= n.x; ++i) add_distance(first + i, first + i + 2, spec);
+    } else {
+      const int count = (n.x + 1) * (n.y + 1) * (n.z + 1);
+      const float inv_mass = static_cast<float>(count) / std::max(spec.mass, 1e-6f);
+      const auto id = [&](int i, int j, int k) { return first + static_cast<uint32_t>((k * (n.y + 1) + j) * (n.x + 1) + i); };
+      for (int k = 0; k <= n.z; ++k)
+        for (int j = 0; j <= n.y; ++j)
+          for (int i = 0; i <= n.x; ++i)
+            add_particle(spec.origin + spec.extent * glm::vec3(glm::vec3(i, j, k) / glm::vec3(n)), j == 0 ? 0.0f : inv_mass, spec.tissue);
+      // 5 tets per cell, alternating orientation so neighbouring cells share face diagonals
+      static const int even[5][4] = {{1, 2, 4, 7}, {0, 1, 2, 4}, {3, 2, 1, 7}, {5, 1, 4, 7}, {6, 2, 7, 4}};
+      static const int odd[5][4] = {{0, 3, 5, 6}, {1, 0, 3, 5}, {2, 0, 3, 6}, {4, 0, 5, 6}, {7, 3, 5, 6}};
+      std::vector<uint64_t> edges;
+      for (int k = 0; k < n.z; ++k)
+        for (int j = 0; j < n.y; ++j)
+          for (int i = 0; i < n.x; ++i) {
+            uint32_t corner[8];
+            for (int c = 0; c < 8; ++c) corner[c] = id(i + (c & 1), j + ((c >> 1) & 1), k + ((c >> 2) & 1));
+            const int(*tets)[4] = (i + j + k) & 1 ? odd : even;
+            for (int t = 0; t < 5; ++t) {
+              const uint32_t v[4] = {corner[tets[t][0]], corner[tets[t][1]], corner[tets[t][2]], corner[tets[t][3]]};
+              add_tet(v[0], v[1], v[2], v[3], spec);
+              for (int a = 0; a < 4; ++a)
+                for (int b = a + 1; b < 4; ++b) edges.push_back(static_cast<uint64_t>(std::min(v[a], v[b])) << 32 | std::max(v[a], v[b]));
+            }
+          }
+      std::sort(edges.begin(), edges.end());
+      edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+      for (const uint64_t e : edges) add_distance(static_cast<uint32_t>(e >> 32), static_cast<uint32_t>(e), spec);
+    }
+  }
+
+  // greedy coloring with a 64-bit "colors in use" mask per particle; constraints that find no free color go
+  // into a last color that is solved on one thread
+  template <typename Particles>
+  static std::vector<uint32_t> color(const size_t count, const size_t particles, Particles particles_of, std::vector<size_t> &offsets) {
+    std::vector<uint64_t> used(particles, 0);
+    std::vector<uint8_t> color_of(count);
+    size_t histogram[65] = {};
+    for (size_t c = 0; c < count; ++c) {
+      uint32_t p[4];
+      const int arity = particles_of(c, p);
+      uint64_t mask = 0;
+      for (int k = 0; k < arity; ++k) mask |= used[p[k]];
+      int col = 64;
+      for (int b = 0; b < 64; ++b)
+        if (!(mask & (uint64_t(1) << b))) {
+          col = b;
+          break;
+        }
+      if (col < 64)
+        for (int k = 0; k < arity; ++k) used[p[k]] |= uint64_t(1) << col;
+      color_of[c] = static_cast<uint8_t>(col);
+      ++histogram[col];
+    }
+    int colors = 0;
+    for (int c = 0; c < 65; ++c)
+      if (histogram[c]) colors = c + 1;
+    offsets.assign(static_cast<size_t>(colors) + 1, 0);
+    for (int c = 0; c < colors; ++c) offsets[c + 1] = offsets[c] + histogram[c];
+    std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+    std::vector<uint32_t> order(count);
+    for (size_t c = 0; c < count; ++c) order[cursor[color_of[c]]++] = static_cast<uint32_t>(c);
+    return order;
+  }
+
+  template <typename T>
+  static void permute(std::vector<T> &v, const std::vector<uint32_t> &order) {
+    std::vector<T> sorted(v.size());
+    for (size_t i = 0; i < order.size(); ++i) sorted[i] = v[order[i]];
+    v.swap(sorted);
+  }
+
+  void color_and_sort() {
+    const auto d_order = color(d_a.size(), x.size(), [this](size_t c, uint32_t *p) { p[0] = d_a[c], p[1] = d_b[c]; return 2; }, d_colors);
+    permute(d_a, d_order), permute(d_b, d_order), permute(d_rest, d_order), permute(d_alpha, d_order);
+    permute(d_compliance, d_order), permute(d_tear, d_order), permute(d_tissue, d_order);
+    const auto t_order = color(t_rest.size(), x.size(), [this](size_t c, uint32_t *p) { p[0] = t_0[c], p[1] = t_1[c], p[2] = t_2[c], p[3] = t_3[c]; return 4; }, t_colors);
+    permute(t_0, t_order), permute(t_1, t_order), permute(t_2, t_order), permute(t_3, t_order), permute(t_rest, t_order), permute(t_alpha, t_order);
+    if (d_colors.empty()) d_colors.push_back(0);
+    if (t_colors.empty()) t_colors.push_back(0);
+  }
+
+  // the "no free color" bucket shares particles inside itself
+  static bool serial_color(const size_t c) { return c == 64; }
+
+  void substep(const float h) {
+    const float inv_h2 = 1.0f / (h * h);
+    const float damp = std::max(0.0f, 1.0f - config.damping * h);
+    const glm::vec3 g = config.gravity * h;
+
+    jobs.parallel_for(0, x.size(), config.grain, [&](size_t b, size_t e) {
+      for (size_t i = b; i < e; ++i) {
+        px[i] = x[i], py[i] = y[i], pz[i] = z[i];
+        if (w[i] == 0.0f) continue;
+        vx[i] = (vx[i] + g.x) * damp, vy[i] = (vy[i] + g.y) * damp, vz[i] = (vz[i] + g.z) * damp;
+        x[i] += vx[i] * h, y[i] += vy[i] * h, z[i] += vz[i] * h;
+      }
+    });
+
+    // the batched solvers assume the constraints of a batch touch different particles, which only holds
+    // inside a real color; the overflow bucket goes one constraint at a time
+    for (size_t c = 0; c + 1 < d_colors.size(); ++c) {
+      if (serial_color(c)) {
+        for (size_t k = d_colors[c]; k < d_colors[c + 1]; ++k) solve_distance_one(k, inv_h2);
+        continue;
+      }
+      jobs.parallel_for(d_colors[c], d_colors[c + 1], config.grain, [&](size_t b, size_t e) { solve_distance(b, e, inv_h2); });
+    }
+    for (size_t c = 0; c + 1 < t_colors.size(); ++c) {
+      if (serial_color(c)) {
+        for (size_t k = t_colors[c]; k < t_colors[c + 1]; ++k) solve_volume_one(k, inv_h2);
+        continue;
+      }
+      jobs.parallel_for(t_colors[c], t_colors[c + 1], config.grain, [&](size_t b, size_t e) { solve_volume(b, e, inv_h2); });
+    }
+
+    const float inv_h = 1.0f / h;
+    jobs.parallel_for(0, x.size(), config.grain, [&](size_t b, size_t e) {
+      for (size_t i = b; i < e; ++i) {
+        if (w[i] == 0.0f) continue;
+        glm::vec3 p(x[i], y[i], z[i]);
+        for (const Capsule &capsule : colliders) {
+          glm::vec3 on_axis;
+          const glm::vec3 ab = capsule.b - capsule.a;
+          const float t = glm::clamp(glm::dot(p - capsule.a, ab) / std::max(glm::dot(ab, ab), 1e-12f), 0.0f, 1.0f);
+          on_axis = capsule.a + ab * t;
+          const glm::vec3 d = p - on_axis;
+          const float r = capsule.radius + config.contact_margin;
+          const float d2 = glm::dot(d, d);
+          if (d2 < r * r && d2 > 1e-12f) p = on_axis + d * (r / std::sqrt(d2));
+        }
+        x[i] = p.x, y[i] = p.y, z[i] = p.z;
+        vx[i] = (x[i] - px[i]) * inv_h, vy[i] = (y[i] - py[i]) * inv_h, vz[i] = (z[i] - pz[i]) * inv_h;
+      }
+    });
+  }
+
+  void solve_distance_one(const size_t c, const float inv_h2) {
+    const uint32_t a = d_a[c], b = d_b[c];
+    const float dx = x[a] - x[b], dy = y[a] - y[b], dz = z[a] - z[b];
+    const float len = std::sqrt(dx * dx + dy * dy + dz * dz);
+    const float denom = std::max(w[a] + w[b] + d_alpha[c] * inv_h2, 1e-12f);
+    const float s = len > 1e-9f ? -(len - d_rest[c]) / denom / len : 0.0f;
+    x[a] += w[a] * s * dx, y[a] += w[a] * s * dy, z[a] += w[a] * s * dz;
+    x[b] -= w[b] * s * dx, y[b] -= w[b] * s * dy, z[b] -= w[b] * s * dz;
+  }
+
+  // C = |xa - xb| - rest, dlambda = -C / (wa + wb + alpha / h^2)
+  void solve_distance(size_t c, const size_t end, const float inv_h2) {
+    using L = TissueLanes;
+    const L eps = L::set1(1e-9f), tiny = L::set1(1e-12f), k = L::set1(inv_h2);
+    for (; c + 4 <= end; c += 4) {
+      const uint32_t *a = &d_a[c], *b = &d_b[c];
+      const L xa = L::gather(x.data(), a), ya = L::gather(y.data(), a), za = L::gather(z.data(), a);
+      const L xb = L::gather(x.data(), b), yb = L::gather(y.data(), b), zb = L::gather(z.data(), b);
+      const L wa = L::gather(w.data(), a), wb = L::gather(w.data(), b);
+      const L dx = xa - xb, dy = ya - yb, dz = za - zb;
+      const L len = sqrt(dx * dx + dy * dy + dz * dz);
+      const L denom = max(wa + wb + L::load(&d_alpha[c]) * k, tiny);
+      const L s = keep_if_greater((L::load(&d_rest[c]) - len) / (denom * max(len, eps)), len, eps);
+      (xa + wa * s * dx).scatter(x.data(), a), (ya + wa * s * dy).scatter(y.data(), a), (za + wa * s * dz).scatter(z.data(), a);
+      (xb - wb * s * dx).scatter(x.data(), b), (yb - wb * s * dy).scatter(y.data(), b), (zb - wb * s * dz).scatter(z.data(), b);
+    }
+    for (; c < end; ++c) solve_distance_one(c, inv_h2);
+  }
+
+  void solve_volume_one(const size_t c, const float inv_h2) {
+    const uint32_t v[4] = {t_0[c], t_1[c], t_2[c], t_3[c]};
+    const glm::vec3 p0(x[v[0]], y[v[0]], z[v[0]]);
+    const glm::vec3 e1 = glm::vec3(x[v[1]], y[v[1]], z[v[1]]) - p0, e2 = glm::vec3(x[v[2]], y[v[2]], z[v[2]]) - p0, e3 = glm::vec3(x[v[3]], y[v[3]], z[v[3]]) - p0;
+    glm::vec3 grad[4];
+    grad[1] = glm::cross(e2, e3) / 6.0f;
+    grad[2] = glm::cross(e3, e1) / 6.0f;
+    grad[3] = glm::cross(e1, e2) / 6.0f;
+    grad[0] = -(grad[1] + grad[2] + grad[3]);
+    float denom = t_alpha[c] * inv_h2;
+    for (int i = 0; i < 4; ++i) denom += w[v[i]] * glm::dot(grad[i], grad[i]);
+    if (denom < 1e-12f) return;
+    const float s = -(glm::dot(grad[3], e3) - t_rest[c]) / denom;
+    for (int i = 0; i < 4; ++i) {
+      x[v[i]] += s * w[v[i]] * grad[i].x, y[v[i]] += s * w[v[i]] * grad[i].y, z[v[i]] += s * w[v[i]] * grad[i].z;
+    }
+  }
+
+  // C = V - V_rest with V = (e1 x e2) . e3 / 6; gradients are the opposite face normals / 6
+  void solve_volume(size_t c, const size_t end, const float inv_h2) {
+    using L = TissueLanes;
+    const L sixth = L::set1(1.0f / 6.0f), tiny = L::set1(1e-12f), k = L::set1(inv_h2), zero = L::set1(0.0f);
+    for (; c + 4 <= end; c += 4) {
+      const uint32_t *id[4] = {&t_0[c], &t_1[c], &t_2[c], &t_3[c]};
+      L px_[4], py_[4], pz_[4], wv[4];
+      for (int i = 0; i < 4; ++i) {
+        px_[i] = L::gather(x.data(), id[i]), py_[i] = L::gather(y.data(), id[i]), pz_[i] = L::gather(z.data(), id[i]);
+        wv[i] = L::gather(w.data(), id[i]);
+      }
+      const L e1x = px_[1] - px_[0], e1y = py_[1] - py_[0], e1z = pz_[1] - pz_[0];
+      const L e2x = px_[2] - px_[0], e2y = py_[2] - py_[0], e2z = pz_[2] - pz_[0];
+      const L e3x = px_[3] - px_[0], e3y = py_[3] - py_[0], e3z = pz_[3] - pz_[0];
+      L gx[4], gy[4], gz[4];
+      gx[1] = (e2y * e3z - e2z * e3y) * sixth, gy[1] = (e2z * e3x - e2x * e3z) * sixth, gz[1] = (e2x * e3y - e2y * e3x) * sixth;
+      gx[2] = (e3y * e1z - e3z * e1y) * sixth, gy[2] = (e3z * e1x - e3x * e1z) * sixth, gz[2] = (e3x * e1y - e3y * e1x) * sixth;
+      gx[3] = (e1y * e2z - e1z * e2y) * sixth, gy[3] = (e1z * e2x - e1x * e2z) * sixth, gz[3] = (e1x * e2y - e1y * e2x) * sixth;
+      gx[0] = zero - (gx[1] + gx[2] + gx[3]), gy[0] = zero - (gy[1] + gy[2] + gy[3]), gz[0] = zero - (gz[1] + gz[2] + gz[3]);
+      L denom = L::load(&t_alpha[c]) * k;
+      for (int i = 0; i < 4; ++i) denom = denom + wv[i] * (gx[i] * gx[i] + gy[i] * gy[i] + gz[i] * gz[i]);
+      const L volume = gx[3] * e3x + gy[3] * e3y + gz[3] * e3z;
+      const L s = keep_if_greater((L::load(&t_rest[c]) - volume) / max(denom, tiny), denom, tiny);
+      for (int i = 0; i < 4; ++i) {
+        const L sw = s * wv[i];
+        (px_[i] + sw * gx[i]).scatter(x.data(), id[i]), (py_[i] + sw * gy[i]).scatter(y.data(), id[i]), (pz_[i] + sw * gz[i]).scatter(z.data(), id[i]);
+      }
+    }
+    for (; c < end; ++c) solve_volume_one(c, inv_h2);
+  }
+
+  // after a step: tear overstretched constraints and reduce the published per-tissue values
+  size_t measure_grain() const { return std::max<size_t>(config.grain, 1) * 8; }
+  void measure() {
+    const size_t grain = measure_grain();
+    partial.assign((d_a.size() + grain - 1) / grain, Partial{});
+    jobs.parallel_for(0, d_a.size(), grain, [&](size_t b, size_t e) {
+      Partial &out = partial[b / grain];
+      for (size_t c = b; c < e; ++c) {
+        const int kind = d_tissue[c];
+        if (d_alpha[c] >= torn_alpha) {
+          ++out.torn[kind];
+          continue;
+        }
+        const uint32_t a = d_a[c], o = d_b[c];
+        const float dx = x[a] - x[o], dy = y[a] - y[o], dz = z[a] - z[o];
+        const float strain = std::sqrt(dx * dx + dy * dy + dz * dz) / std::max(d_rest[c], 1e-9f) - 1.0f;
+        if (d_tear[c] > 0.0f && strain > d_tear[c]) {
+          d_alpha[c] = torn_alpha;
+          ++out.torn[kind];
+          ++out.newly_torn;
+        } else {
+          out.strain[kind] = std::max(out.strain[kind], strain);
+        }
+      }
+    });
+    TissueState s{};
+    int torn[k_tissue_kind_count] = {};
+    for (const Partial &p : partial) {
+      for (int k = 0; k < k_tissue_kind_count; ++k) {
+        torn[k] += p.torn[k];
+        s.max_strain[k] = std::max(s.max_strain[k], p.strain[k]);
+      }
+      if (p.newly_torn) ++topology;
+    }
+    for (int k = 0; k < k_tissue_kind_count; ++k) s.integrity[k] = tearable[k] ? 1.0f - static_cast<float>(torn[k]) / static_cast<float>(tearable[k]) : 1.0f;
+    for (size_t i = 0; i < x.size(); ++i) {
+      const float dx = x[i] - rx[i], dy = y[i] - ry[i], dz = z[i] - rz[i];
+      float &d = s.max_displacement[p_tissue[i]];
+      d = std::max(d, dx * dx + dy * dy + dz * dz);
+    }
+    for (float &d : s.max_displacement) d = std::sqrt(d);
+    s.nerve_root_disturbed = s.max_displacement[k_nerve_root] > config.nerve_dance_displacement;
+    state = s;
+  }
+};
+#pragma endregion
+
+// copies the solver state into the published fields
+inline void apply_tissue_state(const TissueState &state, pb::FusionData::FusionData &fusion) {
+  pb::Tissue::Tissue *tissue = fusion.mutable_soft_tissue();
+  tissue->set_liga_flavum(state.integrity[k_liga_flavum]);
+  tissue->set_disc_yellow_space(state.integrity[k_disc_yellow_space]);
+  tissue->set_veutro_vessel(state.integrity[k_veutro_vessel]);
+  tissue->set_fat(state.integrity[k_fat]);
+  tissue->set_fibrous_rings(state.integrity[k_fibrous_rings]);
+  tissue->set_nucleus_pulposus(state.integrity[k_nucleus_pulposus]);
+  tissue->set_p_longitudinal_liga(state.integrity[k_p_longitudinal_liga]);
+  tissue->set_dura_mater(state.integrity[k_dura_mater]);
+  tissue->set_nerve_root(state.integrity[k_nerve_root]);
+  fusion.set_nerve_root_dance(state.nerve_root_disturbed ? 1.0f : 0.0f);
+}
+
+#endif
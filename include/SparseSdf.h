@@ -0,0 +1,587 @@
+#pragma once
+#ifndef SPARSE_SDF_H
+#define SPARSE_SDF_H
+
+#include <Collision.h>
+#include <JobSystem.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Sparse signed distance volume for removing bone (ablation, rongeur bites).
+//
+// The domain is cut into bricks of 8^3 cells. Only bricks within `band` of the surface store samples (9^3, the
+// faces are shared with the neighbours so a brick can be meshed on its own); every other brick is just a flag,
+// outside or inside. Memory therefore follows the surface area, not the volume.
+// Distances are clamped to +-band, which commutes with the CSG used here: removing a tool is
+// d = max(d, -tool(p)), evaluated only for bricks the tool's box touches. An inside brick a tool reaches is
+// allocated on the spot, a brick that ends up entirely outside is freed again.
+// Changed bricks are re-meshed with marching cubes, in parallel on the JobSystem (one brick per task); normals come
+// from central differences of the samples, across brick borders where needed, so shading has no seams.
+
+constexpr int sdf_brick_cells = 8;
+constexpr int sdf_brick_side = sdf_brick_cells + 1;
+constexpr int sdf_brick_samples = sdf_brick_side * sdf_brick_side * sdf_brick_side;
+
+struct SparseSdfConfig {
+  float voxel_size = 0.04f;
+  int band_voxels = 3;  // narrow band half width in voxels
+  float padding = 0.25f;// domain margin around the baked mesh, room for tools to cut
+};
+
+// one closed mesh to bake; the referenced data only has to live through bake()
+struct SdfSource {
+  const TriangleBvh &bvh;
+  const std::vector<glm::vec3> &positions;
+  const std::vector<unsigned int> &indices;
+};
+
+struct SdfVertex {
+  glm::vec3 position;
+  glm::vec3 normal;
+};
+
+struct SdfEditStats {
+  int bricks_touched;
+  int bricks_allocated;
+  int bricks_freed;
+  float removed_volume;// scene units^3
+  double edit_ms;
+};
+
+struct SdfMeshStats {
+  int bricks_meshed;
+  size_t triangles;// in the meshed bricks
+  double mesh_ms;
+};
+
+#pragma region marching cubes tables
+// corner k of a cell sits at (k & 1, k >> 1 & 1, k >> 2 & 1); edges 0-3 run along x, 4-7 along y, 8-11 along z
+constexpr int sdf_cube_edges[12][2] = {{0, 1}, {2, 3}, {4, 5}, {6, 7}, {0, 2}, {1, 3}, {4, 6}, {5, 7}, {0, 4}, {1, 5}, {2, 6}, {3, 7}};
+
+inline glm::ivec3 sdf_corner(const int k) { return {k & 1, (k >> 1) & 1, (k >> 2) & 1}; }
+
+struct SdfCubeCase {
+  uint8_t triangles;
+  uint8_t edges[36];
+};
+
+// Marching cubes case table, derived instead of typed in: on every cube face the crossing edges are joined into
+// segments (a face with two inside corners on a diagonal keeps them apart, the same rule for both cells sharing
+// the face, so the surface stays closed), the segments are chained into loops around the cube and each loop is
+// fanned into triangles facing away from the inside corners.
+inline const SdfCubeCase *sdf_cube_cases() {
+  static const std::vector<SdfCubeCase> table = [] {
+    static const int faces[6][4] = {{0, 2, 6, 4}, {1, 3, 7, 5}, {0, 1, 5, 4}, {2, 3, 7, 6}, {0, 1, 3, 2}, {4, 5, 7, 6}};
+    static const glm::vec3 normals[6] = {{-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}};
+    const auto edge_of = [](const int a, const int b) {
+      for (int e = 0; e < 12; ++e)
+        if ((sdf_cube_edges[e][0] == a && sdf_cube_edges[e][1] == b) || (sdf_cube_edges[e][0] == b && sdf_cube_edges[e][1] == a)) return e;
+      return -1;
+    };
+    const auto midpoint = [](const int e) { return 0.5f * glm::vec3(sdf_corner(sdf_cube_edges[e][0]) + sdf_corner(sdf_cube_edges[e][1])); };
+    std::vector<SdfCubeCase> cases(256, SdfCubeCase{});
+    for (int mask = 1; mask < 255; ++mask) {
+      const auto inside = [mask](const int k) { return (mask >> k & 1) != 0; };
+      int next[12];
+      std::fill(std::begin(next), std::end(next), -1);
+      for (int f = 0; f < 6; ++f) {
+        const int *c = faces[f];
+        // one segment per inside corner whose neighbours on the face are outside, or per pair of crossings otherwise
+        int crossing[4], n = 0;
+        for (int i = 0; i < 4; ++i)
+          if (inside(c[i]) != inside(c[(i + 1) % 4])) crossing[n++] = i;
+        const auto add = [&](const int ea, const int eb, const int inside_corner) {
+          const glm::vec3 side = glm::cross(normals[f], midpoint(eb) - midpoint(ea));
+          if (glm::dot(side, glm::vec3(sdf_corner(inside_corner)) - midpoint(ea)) > 0.0f) next[ea] = eb;
+          else next[eb] = ea;
+        };
+        if (n == 2) {
+          const int ea = edge_of(c[crossing[0]], c[(crossing[0] + 1) % 4]), eb = edge_of(c[crossing[1]], c[(crossing[1] + 1) % 4]);
+          int in_corner = c[0];
+          for (int i = 0; i < 4; ++i)
+            if (inside(c[i])) in_corner = c[i];
+          add(ea, eb, in_corner);
+        } else if (n == 4) {
+          for (int i = 0; i < 4; ++i)
+            if (inside(c[i])) add(edge_of(c[(i + 3) % 4], c[i]), edge_of(c[i], c[(i + 1) % 4]), c[i]);
+        }
+      }
+      SdfCubeCase &cube = cases[mask];
+      bool used[12] = {};
+      for (int start = 0; start < 12; ++start) {
+        if (next[start] < 0 || used[start]) continue;
+        int loop[12], length = 0;
+        for (int e = start; e >= 0 && !used[e]; e = next[e]) {
+          used[e] = true;
+          loop[length++] = e;
+        }
+        for (int i = 1; i + 1 < length; ++i) {
+          uint8_t *tri = &cube.edges[3 * cube.triangles++];
+          tri[0] = static_cast<uint8_t>(loop[0]), tri[1] = static_cast<uint8_t>(loop[i]), tri[2] = static_cast<uint8_t>(loop[i + 1]);
+        }
+      }
+    }
+    // loops run with the inside on their left; flip the whole table if that makes triangles face inwards
+    const SdfCubeCase &probe = cases[1];
+    const glm::vec3 n = glm::cross(midpoint(probe.edges[1]) - midpoint(probe.edges[0]), midpoint(probe.edges[2]) - midpoint(probe.edges[0]));
+    if (glm::dot(n, glm::vec3(1.0f)) < 0.0f)
+      for (SdfCubeCase &cube : cases)
+        for (int t = 0; t < cube.triangles; ++t) std::swap(cube.edges[3 * t + 1], cube.edges[3 * t + 2]);
+    return cases;
+  }();
+  return table.data();
+}
+#pragma endregion
+
+class SparseSdf {
+ public:
+  explicit SparseSdf(JobSystem &jobs, const SparseSdfConfig config = SparseSdfConfig()) : config(config), jobs(&jobs) {}
+
+  const SparseSdfConfig config;
+
+  // samples the union of closed, outward facing meshes (shared vertices) into the narrow band. The meshes may
+  // overlap: each one gets its own signed distance and the union is their minimum.
+  void bake(const std::vector<SdfSource> &sources) {
+    bricks.clear();
+    free_slots.clear();
+    changed.clear();
+    band = config.band_voxels * config.voxel_size;
+    Aabb mesh_bounds;
+    std::vector<SignedMesh> meshes;
+    for (const SdfSource &source : sources) {
+      if (!source.bvh.bounds().valid()) continue;
+      mesh_bounds.grow(source.bvh.bounds().min);
+      mesh_bounds.grow(source.bvh.bounds().max);
+      meshes.emplace_back(source);
+    }
+    if (meshes.empty()) {
+      grid.clear();
+      return;
+    }
+    const float brick_extent = sdf_brick_cells * config.voxel_size;
+    origin = mesh_bounds.min - glm::vec3(config.padding);
+    dims = glm::max(glm::ivec3(glm::ceil((mesh_bounds.max - mesh_bounds.min + 2.0f * config.padding) / brick_extent)), glm::ivec3(1));
+    grid.assign(static_cast<size_t>(dims.x) * dims.y * dims.z, k_outside);
+
+    // classify bricks by the distance at their center; a brick is near when any mesh's surface may pass through it
+    const float half_diagonal = 0.5f * std::sqrt(3.0f) * brick_extent;
+    const float reach = half_diagonal + band;
+    std::vector<float> center_d(grid.size() * meshes.size());
+    std::vector<uint8_t> near(grid.size(), 0);
+    jobs->parallel_for(0, grid.size(), 64, [&](size_t b, size_t e) {
+      for (size_t i = b; i < e; ++i) {
+        const glm::vec3 center = brick_origin(brick_coord(i)) + glm::vec3(0.5f * brick_extent);
+        float d = FLT_MAX;
+        for (size_t m = 0; m < meshes.size(); ++m) {
+          center_d[i * meshes.size() + m] = meshes[m].signed_distance(center, FLT_MAX);
+          d = std::min(d, center_d[i * meshes.size() + m]);
+          near[i] |= std::abs(center_d[i * meshes.size() + m]) <= reach;
+        }
+        if (!near[i]) grid[i] = d < 0.0f ? k_inside : k_outside;
+      }
+    });
+    std::vector<uint32_t> near_bricks;
+    for (size_t i = 0; i < grid.size(); ++i)
+      if (near[i]) near_bricks.push_back(static_cast<uint32_t>(i));
+    bricks.resize(near_bricks.size());
+    jobs->parallel_for(0, near_bricks.size(), 1, [&](size_t b, size_t e) {
+      for (size_t n = b; n < e; ++n) {
+        Brick &brick = bricks[n];
+        brick.linear = near_bricks[n];
+        std::fill(std::begin(brick.d), std::end(brick.d), band);
+        const glm::vec3 base = brick_origin(brick_coord(brick.linear));
+        for (size_t m = 0; m < meshes.size(); ++m) {
+          const float center = center_d[brick.linear * meshes.size() + m];
+          if (std::abs(center) > reach) {
+            // this mesh's surface is farther than band from the whole brick, so it only contributes its sign
+            if (center < 0.0f) std::fill(std::begin(brick.d), std::end(brick.d), -band);
+            continue;
+          }
+          for (int s = 0; s < sdf_brick_samples; ++s) {
+            const glm::vec3 p = base + glm::vec3(sample_offset(s)) * config.voxel_size;
+            // the surface is within reach of the center, so twice that from any sample always finds a triangle
+            const float d = meshes[m].signed_distance(p, 2.0f * reach);
+            brick.d[s] = std::min(brick.d[s], glm::clamp(d, -band, band));
+          }
+        }
+        bool any_negative = false, any_positive = false;
+        for (const float d : brick.d) {
+          any_negative |= d < band;
+          any_positive |= d > -band;
+        }
+        brick.state = any_negative && any_positive ? k_keep : any_negative ? k_inside : k_outside;
+      }
+    });
+    // bricks that turned out to be far after all go back to flags
+    std::vector<Brick> kept;
+    kept.reserve(bricks.size());
+    for (Brick &brick : bricks) {
+      if (brick.state != k_keep) {
+        grid[brick.linear] = brick.state;
+        continue;
+      }
+      grid[brick.linear] = static_cast<int32_t>(kept.size());
+      brick.dirty = true;
+      kept.push_back(std::move(brick));
+    }
+    bricks.swap(kept);
+    for (const Brick &brick : bricks) changed.push_back(brick.linear);
+    remesh_changed();
+  }
+  // the same with the loops on `pool`, for a bake on another thread while the usual pool is busy elsewhere
+  void bake(const std::vector<SdfSource> &sources, JobSystem &pool) {
+    JobSystem *const usual = jobs;
+    jobs = &pool;
+    bake(sources);
+    jobs = usual;
+  }
+
+  // removes a ball; returns what was removed and how long it took
+  SdfEditStats subtract_sphere(const glm::vec3 &center, const float radius) {
+    Aabb box;
+    box.grow(center - glm::vec3(radius + band));
+    box.grow(center + glm::vec3(radius + band));
+    return subtract(box, [center, radius](const glm::vec3 &p) { return glm::length(p - center) - radius; });
+  }
+
+  // removes a capsule (a rongeur bite)
+  SdfEditStats subtract_capsule(const Capsule &capsule) {
+    Aabb box;
+    box.grow(glm::min(capsule.a, capsule.b) - glm::vec3(capsule.radius + band));
+    box.grow(glm::max(capsule.a, capsule.b) + glm::vec3(capsule.radius + band));
+    const glm::vec3 ab = capsule.b - capsule.a;
+    const float inv = 1.0f / std::max(glm::dot(ab, ab), 1e-12f);
+    return subtract(box, [capsule, ab, inv](const glm::vec3 &p) {
+      const float t = glm::clamp(glm::dot(p - capsule.a, ab) * inv, 0.0f, 1.0f);
+      return glm::length(p - (capsule.a + ab * t)) - capsule.radius;
+    });
+  }
+
+  // re-meshes every brick changed since the last call; the changed brick ids are then in changed_bricks()
+  SdfMeshStats remesh() {
+    changed.swap(pending);
+    pending.clear();
+    return remesh_changed();
+  }
+
+  // bricks (by grid index) whose mesh changed in the last remesh(); mesh() is empty for freed bricks
+  const std::vector<uint32_t> &changed_bricks() const { return changed; }
+  const std::vector<SdfVertex> &mesh(const uint32_t linear) const {
+    static const std::vector<SdfVertex> none;
+    return grid[linear] >= 0 ? bricks[grid[linear]].mesh : none;
+  }
+  size_t grid_size() const { return grid.size(); }
+  Aabb brick_bounds(const uint32_t linear) const {
+    const glm::vec3 o = brick_origin(brick_coord(linear));
+    Aabb box;
+    box.grow(o);
+    box.grow(o + glm::vec3(static_cast<float>(sdf_brick_cells) * config.voxel_size));
+    return box;
+  }
+
+  // band-clamped signed distance at p, trilinear
+  float distance(const glm::vec3 &p) const {
+    const glm::vec3 g = (p - origin) / config.voxel_size;
+    const glm::ivec3 i = glm::ivec3(glm::floor(g));
+    const glm::vec3 f = g - glm::vec3(i);
+    float c[8];
+    for (int k = 0; k < 8; ++k) c[k] = sample(i.x + (k & 1), i.y + ((k >> 1) & 1), i.z + ((k >> 2) & 1));
+    const float x0 = glm::mix(glm::mix(c[0], c[1], f.x), glm::mix(c[2], c[3], f.x), f.y);
+    const float x1 = glm::mix(glm::mix(c[4], c[5], f.x), glm::mix(c[6], c[7], f.x), f.y);
+    return glm::mix(x0, x1, f.z);
+  }
+
+  glm::vec3 gradient(const glm::vec3 &p) const {
+    const float h = 0.5f * config.voxel_size;
+    const glm::vec3 g(distance(p + glm::vec3(h, 0, 0)) - distance(p - glm::vec3(h, 0, 0)), distance(p + glm::vec3(0, h, 0)) - distance(p - glm::vec3(0, h, 0)),
+                      distance(p + glm::vec3(0, 0, h)) - distance(p - glm::vec3(0, 0, h)));
+    const float len = glm::length(g);
+    return len > 1e-12f ? g / len : glm::vec3(0.0f, 1.0f, 0.0f);
+  }
+
+  // deepest point of a capsule in the volume, sampled along the axis every voxel; depth saturates at radius + band
+  ContactResult capsule_contact(const Capsule &capsule) const {
+    ContactResult result;
+    const float length = glm::length(capsule.b - capsule.a);
+    const int steps = std::max(1, static_cast<int>(length / config.voxel_size));
+    for (int s = 0; s <= steps; ++s) {
+      const glm::vec3 p = glm::mix(capsule.a, capsule.b, static_cast<float>(s) / steps);
+      const float d = distance(p);
+      if (d - capsule.radius < 0.0f && capsule.radius - d > result.depth) {
+        result.hit = true;
+        result.depth = capsule.radius - d;
+        result.distance = d;
+        result.point_on_query = p;
+      }
+    }
+    if (result.hit) {
+      result.normal = gradient(result.point_on_query);
+      result.point_on_mesh = result.point_on_query - result.normal * result.distance;
+    }
+    return result;
+  }
+
+  size_t brick_count() const { return bricks.size(); }
+  size_t memory_bytes() const {
+    size_t bytes = grid.size() * sizeof(int32_t) + bricks.capacity() * sizeof(Brick);
+    for (const Brick &brick : bricks) bytes += brick.mesh.capacity() * sizeof(SdfVertex);
+    return bytes;
+  }
+  size_t triangle_count() const {
+    size_t n = 0;
+    for (const Brick &brick : bricks) n += brick.mesh.size() / 3;
+    return n;
+  }
+
+ private:
+  static constexpr int32_t k_outside = -1;
+  static constexpr int32_t k_inside = -2;
+  static constexpr int32_t k_keep = 0;
+
+  struct Brick {
+    float d[sdf_brick_samples];
+    uint32_t linear = 0;
+    int32_t state = k_keep;// scratch while baking / editing
+    bool dirty = false;
+    std::vector<SdfVertex> mesh;
+  };
+
+  // signed distance to one closed mesh; angle weighted pseudo normals give the right sign also when the closest
+  // point is on a sharp edge or vertex, where the face normal does not
+  struct SignedMesh {
+    const SdfSource &source;
+    std::vector<glm::vec3> vertex_normals;
+    std::unordered_map<uint64_t, glm::vec3> edge_normals;
+
+    static uint64_t edge_key(const unsigned int a, const unsigned int b) { return static_cast<uint64_t>(std::min(a, b)) << 32 | std::max(a, b); }
+
+    explicit SignedMesh(const SdfSource &source) : source(source), vertex_normals(source.positions.size(), glm::vec3(0.0f)) {
+      const std::vector<glm::vec3> &positions = source.positions;
+      for (size_t t = 0; t + 2 < source.indices.size(); t += 3) {
+        const unsigned int *v = &source.indices[t];
+        const glm::vec3 n = glm::cross(positions[v[1]] - positions[v[0]], positions[v[2]] - positions[v[0]]);
+        const float len = glm::length(n);
+        if (len <= 0.0f) continue;
+        for (int k = 0; k < 3; ++k) {
+          const glm::vec3 e0 = positions[v[(k + 1) % 3]] - positions[v[k]], e1 = positions[v[(k + 2) % 3]] - positions[v[k]];
+          const float angle = std::acos(glm::clamp(glm::dot(e0, e1) / std::max(glm::length(e0) * glm::length(e1), 1e-20f), -1.0f, 1.0f));
+          vertex_normals[v[k]] += angle * n / len;
+          edge_normals[edge_key(v[k], v[(k + 1) % 3])] += n / len;
+        }
+      }
+    }
+
+    // FLT_MAX when nothing is within max_distance
+    float signed_distance(const glm::vec3 &p, const float max_distance) const {
+      const ContactResult c = source.bvh.closest_point(p, max_distance);
+      if (!c.hit) return FLT_MAX;
+      const unsigned int *v = &source.indices[3 * c.triangle];
+      const glm::vec3 &a = source.positions[v[0]], &b = source.positions[v[1]], &d = source.positions[v[2]];
+      // which feature the closest point lies on, from its barycentric coordinates
+      const glm::vec3 n = glm::cross(b - a, d - a);
+      const float area = std::max(glm::dot(n, n), 1e-30f);
+      const glm::vec3 w(glm::dot(glm::cross(d - b, c.point_on_mesh - b), n) / area, glm::dot(glm::cross(a - d, c.point_on_mesh - d), n) / area, glm::dot(glm::cross(b - a, c.point_on_mesh - a), n) / area);
+      const float eps = 1e-4f;
+      glm::vec3 normal = n;
+      for (int k = 0; k < 3; ++k) {
+        if (w[k] > 1.0f - eps) {
+          normal = vertex_normals[v[k]];
+        } else if (w[k] < eps && w[(k + 1) % 3] >= eps && w[(k + 2) % 3] >= eps) {
+          const auto edge = edge_normals.find(edge_key(v[(k + 1) % 3], v[(k + 2) % 3]));
+          if (edge != edge_normals.end()) normal = edge->second;
+        }
+      }
+      return glm::dot(p - c.point_on_mesh, normal) < 0.0f ? -c.distance : c.distance;
+    }
+  };
+
+  JobSystem *jobs;// bake(sources, pool) swaps it for the bake
+  float band = 0.0f;
+  glm::vec3 origin{0.0f};
+  glm::ivec3 dims{0};
+  std::vector<int32_t> grid;// brick slot, or k_outside / k_inside
+  std::vector<Brick> bricks;
+  std::vector<uint32_t> free_slots;
+  std::vector<uint32_t> changed, pending;
+
+  glm::ivec3 brick_coord(const size_t linear) const {
+    const int i = static_cast<int>(linear);
+    return {i % dims.x, (i / dims.x) % dims.y, i / (dims.x * dims.y)};
+  }
+  size_t brick_linear(const glm::ivec3 &c) const { return (static_cast<size_t>(c.z) * dims.y + c.y) * dims.x + c.x; }
+  glm::vec3 brick_origin(const glm::ivec3 &c) const { return origin + glm::vec3(c * sdf_brick_cells) * config.voxel_size; }
+  static glm::ivec3 sample_offset(const int s) { return {s % sdf_brick_side, (s / sdf_brick_side) % sdf_brick_side, s / (sdf_brick_side * sdf_brick_side)}; }
+  static int sample_index(const int x, const int y, const int z) { return (z * sdf_brick_side + y) * sdf_brick_side + x; }
+
+  // sample at global voxel corner (x, y, z)
+  float sample(const int x, const int y, const int z) const {
+    if (x < 0 || y < 0 || z < 0 || x > dims.x * sdf_brick_cells || y > dims.y * sdf_brick_cells || z > dims.z * sdf_brick_cells) return band;
+    const glm::ivec3 c = glm::min(glm::ivec3(x, y, z) / sdf_brick_cells, dims - 1);
+    const int32_t slot = grid[brick_linear(c)];
+    if (slot == k_outside) return band;
+    if (slot == k_inside) return -band;
+    return bricks[slot].d[sample_index(x - c.x * sdf_brick_cells, y - c.y * sdf_brick_cells, z - c.z * sdf_brick_cells)];
+  }
+
+  uint32_t allocate_brick(const uint32_t linear, const float fill) {
+    uint32_t slot;
+    if (!free_slots.empty()) {
+      slot = free_slots.back();
+      free_slots.pop_back();
+    } else {
+      slot = static_cast<uint32_t>(bricks.size());
+      bricks.emplace_back();
+    }
+    Brick &brick = bricks[slot];
+    std::fill(std::begin(brick.d), std::end(brick.d), fill);
+    brick.linear = linear;
+    brick.mesh.clear();
+    grid[linear] = static_cast<int32_t>(slot);
+    return slot;
+  }
+
+  template <typename Tool>
+  SdfEditStats subtract(const Aabb &box, Tool tool) {
+    const auto start = std::chrono::steady_clock::now();
+    SdfEditStats stats{};
+    if (grid.empty()) return stats;
+    const float brick_extent = sdf_brick_cells * config.voxel_size;
+    // bricks hold their max faces too, so a sample on a face also belongs to the brick below it
+    const glm::ivec3 lo = glm::max(glm::ivec3(glm::ceil((box.min - origin) / brick_extent)) - 1, glm::ivec3(0));
+    const glm::ivec3 hi = glm::min(glm::ivec3(glm::floor((box.max - origin) / brick_extent)), dims - 1);
+
+    // touched bricks; inside flags become real bricks first (serial, it grows the pool)
+    std::vector<uint32_t> slots;
+    for (int z = lo.z; z <= hi.z; ++z)
+      for (int y = lo.y; y <= hi.y; ++y)
+        for (int x = lo.x; x <= hi.x; ++x) {
+          const size_t linear = brick_linear({x, y, z});
+          if (grid[linear] == k_outside) continue;
+          if (grid[linear] == k_inside) {
+            allocate_brick(static_cast<uint32_t>(linear), -band);
+            ++stats.bricks_allocated;
+          }
+          slots.push_back(static_cast<uint32_t>(grid[linear]));
+        }
+    stats.bricks_touched = static_cast<int>(slots.size());
+
+    std::atomic<int> removed{0};
+    jobs->parallel_for(0, slots.size(), 1, [&](size_t b, size_t e) {
+      for (size_t n = b; n < e; ++n) {
+        Brick &brick = bricks[slots[n]];
+        const glm::vec3 base = brick_origin(brick_coord(brick.linear));
+        int flipped = 0;
+        bool changed_any = false, all_outside = true;
+        for (int s = 0; s < sdf_brick_samples; ++s) {
+          const glm::ivec3 o = sample_offset(s);
+          const float before = brick.d[s];
+          const float after = std::min(std::max(before, -tool(base + glm::vec3(o) * config.voxel_size)), band);
+          if (after != before) {
+            brick.d[s] = after;
+            changed_any = true;
+            // shared face samples are counted by the brick that owns the lower corner only
+            if (before < 0.0f && after >= 0.0f && o.x < sdf_brick_cells && o.y < sdf_brick_cells && o.z < sdf_brick_cells) ++flipped;
+          }
+          all_outside &= after >= band;
+        }
+        brick.dirty = changed_any;
+        brick.state = all_outside ? k_outside : k_keep;
+        removed += flipped;
+      }
+    });
+
+    for (const uint32_t slot : slots) {
+      Brick &brick = bricks[slot];
+      if (!brick.dirty) continue;
+      pending.push_back(brick.linear);
+      if (brick.state == k_outside) {
+        grid[brick.linear] = k_outside;
+        brick.mesh.clear();
+        brick.mesh.shrink_to_fit();
+        free_slots.push_back(slot);
+        ++stats.bricks_freed;
+      }
+    }
+    stats.removed_volume = static_cast<float>(removed.load()) * config.voxel_size * config.voxel_size * config.voxel_size;
+    stats.edit_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+  }
+
+  SdfMeshStats remesh_changed() {
+    const auto start = std::chrono::steady_clock::now();
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    std::atomic<size_t> triangles{0};
+    jobs->parallel_for(0, changed.size(), 1, [&](size_t b, size_t e) {
+      for (size_t n = b; n < e; ++n) {
+        const int32_t slot = grid[changed[n]];
+        if (slot < 0) continue;
+        mesh_brick(bricks[slot]);
+        triangles += bricks[slot].mesh.size() / 3;
+      }
+    });
+    SdfMeshStats stats{};
+    stats.bricks_meshed = static_cast<int>(changed.size());
+    stats.triangles = triangles.load();
+    stats.mesh_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+  }
+
+  glm::vec3 corner_gradient(const Brick &brick, const glm::ivec3 &base, const glm::ivec3 &o) const {
+    const auto at = [&](const int x, const int y, const int z) {
+      if (x >= 0 && y >= 0 && z >= 0 && x < sdf_brick_side && y < sdf_brick_side && z < sdf_brick_side) return brick.d[sample_index(x, y, z)];
+      return sample(base.x + x, base.y + y, base.z + z);
+    };
+    return {at(o.x + 1, o.y, o.z) - at(o.x - 1, o.y, o.z), at(o.x, o.y + 1, o.z) - at(o.x, o.y - 1, o.z), at(o.x, o.y, o.z + 1) - at(o.x, o.y, o.z - 1)};
+  }
+
+  void mesh_brick(Brick &brick) {
+    brick.mesh.clear();
+    float lo = brick.d[0], hi = brick.d[0];
+    for (const float d : brick.d) lo = std::min(lo, d), hi = std::max(hi, d);
+    if (lo >= 0.0f || hi < 0.0f) return;
+
+    const SdfCubeCase *cases = sdf_cube_cases();
+    const glm::ivec3 base = brick_coord(brick.linear) * sdf_brick_cells;
+    const glm::vec3 world = origin + glm::vec3(base) * config.voxel_size;
+    for (int z = 0; z < sdf_brick_cells; ++z)
+      for (int y = 0; y < sdf_brick_cells; ++y)
+        for (int x = 0; x < sdf_brick_cells; ++x) {
+          float v[8];
+          int mask = 0;
+          for (int k = 0; k < 8; ++k) {
+            v[k] = brick.d[sample_index(x + (k & 1), y + ((k >> 1) & 1), z + ((k >> 2) & 1))];
+            mask |= (v[k] < 0.0f) << k;
+          }
+          if (mask == 0 || mask == 255) continue;
+          const SdfCubeCase &cube = cases[mask];
+          const glm::ivec3 cell(x, y, z);
+          SdfVertex vertices[12];
+          uint16_t have = 0;
+          for (int t = 0; t < 3 * cube.triangles; ++t) {
+            const int e = cube.edges[t];
+            if (!(have & (1u << e))) {
+              const int a = sdf_cube_edges[e][0], b = sdf_cube_edges[e][1];
+              const glm::ivec3 ca = cell + sdf_corner(a), cb = cell + sdf_corner(b);
+              const float f = v[a] / (v[a] - v[b]);
+              const glm::vec3 n = glm::mix(corner_gradient(brick, base, ca), corner_gradient(brick, base, cb), f);
+              const float len = glm::length(n);
+              vertices[e] = {world + glm::mix(glm::vec3(ca), glm::vec3(cb), f) * config.voxel_size, len > 1e-12f ? n / len : glm::vec3(0.0f, 1.0f, 0.0f)};
+              have |= static_cast<uint16_t>(1u << e);
+            }
+            brick.mesh.push_back(vertices[e]);
+          }
+        }
+  }
+};
+
+#endif
@@ -0,0 +1,107 @@
+#pragma once
+#ifndef STREAM_BENCH_H
+#define STREAM_BENCH_H
+
+#include <FrameStream.h>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Headless benchmark for the frame stream codec (run with --bench-stream [width height]). Encodes a synthetic
+// frame that looks like the scene (flat background, thin lines) and, when present, photographic textures from the
+// resources, checks that every frame decodes back exactly, and reports the single frame cost and the frame rate
+// that 1, 2 and 4 encoder workers reach together. The render thread side (readback, fences, mapping) needs a GL
+// context and is shown in the Frame stream window instead.
+inline int run_stream_benchmark(const int width = 1600, const int height = 900, const int repeats = 20) {
+  using clock = std::chrono::steady_clock;
+  const auto millis = [](const clock::time_point a, const clock::time_point b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+
+  struct Frame {
+    std::string name;
+    int width, height;
+    std::vector<uint8_t> rgba;
+  };
+  std::vector<Frame> frames;
+
+  // scene-like: the clear color with a few hundred lines
+  Frame scene{"synthetic scene", width, height, std::vector<uint8_t>(static_cast<size_t>(width) * height * 4)};
+  for (size_t i = 0; i < scene.rgba.size(); i += 4) {
+    scene.rgba[i] = 182;
+    scene.rgba[i + 1] = 187;
+    scene.rgba[i + 2] = 196;
+    scene.rgba[i + 3] = 255;
+  }
+  uint32_t state = 12345u;
+  const auto rnd = [&state](const int n) {
+    state = state * 1664525u + 1013904223u;
+    return static_cast<int>((state >> 8) % static_cast<uint32_t>(n));
+  };
+  for (int l = 0; l < 400; ++l) {
+    const int x0 = rnd(width), y0 = rnd(height), x1 = rnd(width), y1 = rnd(height);
+    const uint8_t shade = static_cast<uint8_t>(40 + rnd(120));
+    const int steps = std::max(std::abs(x1 - x0), std::abs(y1 - y0)) + 1;
+    for (int s = 0; s < steps; ++s) {
+      const int x = x0 + (x1 - x0) * s / steps, y = y0 + (y1 - y0) * s / steps;
+      uint8_t *p = &scene.rgba[(static_cast<size_t>(y) * width + x) * 4];
+      p[0] = shade;
+      p[1] = static_cast<uint8_t>(shade / 2);
+      p[2] = static_cast<uint8_t>(shade / 3);
+    }
+  }
+  frames.push_back(std::move(scene));
+
+  for (const char *path : {"./resources/objects/backpack/body_dif.png", "./resources/objects/backpack/helmet_diff.png"}) {
+    int w, h, n;
+    unsigned char *data = stbi_load(path, &w, &h, &n, 4);
+    if (!data) {
+      std::printf("%s: not loadable, skipped\n", path);
+      continue;
+    }
+    frames.push_back({path, w, h, std::vector<uint8_t>(data, data + static_cast<size_t>(w) * h * 4)});
+    stbi_image_free(data);
+  }
+
+  std::printf("hardware threads %u\n", std::max(1u, std::thread::hardware_concurrency()));
+  std::printf("%-44s %11s %8s %12s %12s %10s %7s\n", "frame", "size", "ratio", "encode ms", "decode ms", "MB/s", "exact");
+  bool all_exact = true;
+  std::vector<uint8_t> message, decoded;
+  for (const Frame &frame : frames) {
+    double encode = 1e30, decode = 1e30;
+    for (int r = 0; r < repeats; ++r) {
+      auto t0 = clock::now();
+      encode_frame(frame.rgba.data(), frame.width, frame.height, k_codec_lossless, 0, 0, message);
+      encode = std::min(encode, millis(t0, clock::now()));
+      t0 = clock::now();
+      decode_frame_lossless(message.data() + sizeof(FrameHeader), message.size() - sizeof(FrameHeader), frame.width, frame.height, decoded);
+      decode = std::min(decode, millis(t0, clock::now()));
+    }
+    bool exact = decoded.size() == static_cast<size_t>(frame.width) * frame.height * 3;
+    for (size_t i = 0; exact && i < static_cast<size_t>(frame.width) * frame.height; ++i) exact = std::equal(decoded.begin() + 3 * i, decoded.begin() + 3 * i + 3, frame.rgba.begin() + 4 * i);
+    all_exact &= exact;
+    const double raw = static_cast<double>(frame.width) * frame.height * 3;
+    std::printf("%-44s %5dx%-5d %8.2f %12.2f %12.2f %10.1f %7s\n", frame.name.c_str(), frame.width, frame.height, raw / static_cast<double>(message.size()), encode, decode, raw / (encode * 1e3), exact ? "yes" : "NO");
+  }
+
+  // workers encoding different frames at once, as FrameStreamer's pool does
+  const Frame &busy = frames.size() > 1 ? frames[1] : frames[0];
+  std::printf("%8s %12s  (%s)\n", "workers", "frames/s", busy.name.c_str());
+  for (const int workers : {1, 2, 4}) {
+    const auto t0 = clock::now();
+    std::vector<std::thread> threads;
+    for (int w = 0; w < workers; ++w)
+      threads.emplace_back([&busy, repeats] {
+        std::vector<uint8_t> out;
+        for (int r = 0; r < repeats; ++r) encode_frame(busy.rgba.data(), busy.width, busy.height, k_codec_lossless, 0, 0, out);
+      });
+    for (std::thread &t : threads) t.join();
+    std::printf("%8d %12.1f\n", workers, workers * repeats / (millis(t0, clock::now()) * 1e-3));
+  }
+  return all_exact ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,681 @@
+#pragma once
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <ResourceRegistry.h>
+#include <Trace.h>
+
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Process-wide texture cache shared by every Model. A texture is looked up by its canonical path first, then by
+// a hash of the file's bytes, so the same image under two names (or reached through two relative paths) is
+// decoded and uploaded once. Both lookups go through open-addressing tables; a hash hit is confirmed against the
+// stored path, or the file size for contents. acquire() and release() count references; an entry nobody
+// references stays cached until trim() evicts it, least recently released first.
+// Once started, loading does not block the GL thread: workers read and hash the file, then decode it into a
+// bounded staging pool, and update() uploads a budgeted number of rows per frame through a ring of pixel buffer
+// objects, building the mipmaps when the last row is up. Until then a handle's id() is a placeholder, so draws
+// bind through the cache rather than keeping the GL name. The public functions are for the GL thread only.
+
+// 64-bit hash of a byte range, eight bytes per step
+inline uint64_t hash_bytes(const void *data, const size_t size) {
+  const auto *bytes = static_cast<const unsigned char *>(data);
+  uint64_t hash = 0x9e3779b97f4a7c15ull ^ size;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, bytes + i, 8);
+    hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+    hash ^= hash >> 32;
+  }
+  for (; i < size; ++i) hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+  hash ^= hash >> 29;
+  return hash * 0xc4ceb9fe1a85ec53ull;
+}
+
+// key hash -> uint32 value, linear probing with tombstones; a hash match is only a candidate, the caller's
+// predicate confirms it
+class HashIndex {
+ public:
+  static constexpr uint32_t none = UINT32_MAX;
+
+  template <typename Match>
+  uint32_t find(const uint64_t hash, Match match) const {
+    if (slots.empty()) return none;
+    for (size_t i = hash & mask();; i = (i + 1) & mask()) {
+      const Slot &slot = slots[i];
+      if (slot.state == k_empty) return none;
+      if (slot.state == k_full && slot.hash == hash && match(slot.value)) return slot.value;
+    }
+  }
+  void insert(const uint64_t hash, const uint32_t value) {
+    if ((used + 1) * 10 > slots.size() * 7) rehash(count * 2 >= slots.size() / 2 ? std::max<size_t>(slots.size() * 2, 16) : slots.size());
+    size_t i = hash & mask();
+    while (slots[i].state == k_full) i = (i + 1) & mask();
+    if (slots[i].state == k_empty) ++used;
+    slots[i] = {hash, value, k_full};
+    ++count;
+  }
+  template <typename Match>
+  void erase(const uint64_t hash, Match match) {
+    if (slots.empty()) return;
+    for (size_t i = hash & mask();; i = (i + 1) & mask()) {
+      Slot &slot = slots[i];
+      if (slot.state == k_empty) return;
+      if (slot.state == k_full && slot.hash == hash && match(slot.value)) {
+        slot.state = k_tombstone;
+        --count;
+        return;
+      }
+    }
+  }
+  size_t size() const { return count; }
+
+ private:
+  enum slot_state : uint8_t { k_empty, k_full, k_tombstone };
+  struct Slot {
+    uint64_t hash;
+    uint32_t value;
+    slot_state state;
+  };
+  std::vector<Slot> slots;// power of two
+  size_t used = 0;        // full and tombstone slots
+  size_t count = 0;
+
+  size_t mask() const { return slots.size() - 1; }
+  // also run at the same size to drop tombstones
+  void rehash(const size_t capacity) {
+    std::vector<Slot> old(capacity, Slot{0, 0, k_empty});
+    old.swap(slots);
+    used = count = 0;
+    for (const Slot &slot : old)
+      if (slot.state == k_full) insert(slot.hash, slot.value);
+  }
+};
+
+// the path as the cache keys it: lexically normalised, forward slashes, and case folded on Windows
+inline std::string canonical_texture_path(const std::string &path) {
+  std::string canonical = std::filesystem::path(path).lexically_normal().generic_string();
+#ifdef _WIN32
+  std::transform(canonical.begin(), canonical.end(), canonical.begin(), [](const unsigned char c) { return static_cast<char>(std::tolower(c)); });
+#endif
+  return canonical;
+}
+
+struct TextureStreamConfig {
+  int workers = 2;                                    // decode threads; 0 loads synchronously in acquire()
+  size_t staging_bytes = size_t(96) << 20;            // decoded pixels waiting for upload, at most
+  size_t upload_bytes_per_frame = size_t(8) << 20;    // copied into pixel buffers per update()
+  int upload_buffers = 3;                             // pixel buffer objects in the upload ring
+};
+
+struct TextureCacheStats {
+  size_t entries, referenced, loading;
+  size_t gpu_bytes, unreferenced_bytes;
+  size_t staging_bytes; // held by the staging pool, in use or free
+  size_t uploaded_bytes;// by the last update()
+  size_t loads, path_hits, content_hits, evictions, failures;
+};
+
+// memory for decoded pixels on their way to the GPU. Blocks are reused, best fit first, and the pool holds at
+// most its limit (one image larger than the limit gets through when nothing else is held), so decoders wait for
+// room instead of piling up images faster than the uploads drain them.
+class StagingPool {
+ public:
+  struct Block {
+    std::unique_ptr<uint8_t[]> data;
+    size_t size = 0;
+  };
+
+  void set_limit(const size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    limit = bytes;
+  }
+  // waits for room; an empty block once stopped
+  Block acquire(const size_t bytes) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+      auto best = free.end();
+      for (auto it = free.begin(); it != free.end(); ++it)
+        if (it->size >= bytes && (best == free.end() || it->size < best->size)) best = it;
+      if (best != free.end()) {
+        Block block = std::move(*best);
+        free.erase(best);
+        in_use += block.size;
+        return block;
+      }
+      // every free block is too small; drop them, smallest first, to make room
+      while (!free.empty() && total + bytes > limit) {
+        const auto smallest = std::min_element(free.begin(), free.end(), [](const Block &a, const Block &b) { return a.size < b.size; });
+        total -= smallest->size;
+        free.erase(smallest);
+      }
+      if (total + bytes <= limit || in_use == 0) {
+        total += bytes;
+        in_use += bytes;
+        return {std::unique_ptr<uint8_t[]>(new uint8_t[bytes]), bytes};
+      }
+      room.wait(lock);
+    }
+    return {};
+  }
+  void release(Block block) {
+    if (!block.data) return;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      in_use -= block.size;
+      free.push_back(std::move(block));
+    }
+    room.notify_all();
+  }
+  // frees the idle blocks once loading went quiet; blocks still held by jobs stay with them
+  void drop_free() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (free.empty()) return;
+      for (const Block &block : free) total -= block.size;
+      free.clear();
+    }
+    room.notify_all();
+  }
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    room.notify_all();
+  }
+  size_t bytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return total;
+  }
+
+ private:
+  mutable std::mutex mutex;
+  std::condition_variable room;
+  std::vector<Block> free;
+  size_t limit = 0, total = 0, in_use = 0;
+  bool stopping = false;
+};
+
+class TextureCache {
+ public:
+  using Handle = uint32_t;// 0 is no texture
+
+  TextureCache() = default;
+  TextureCache(const TextureCache &) = delete;
+  TextureCache &operator=(const TextureCache &) = delete;
+  ~TextureCache() { stop_workers(); }
+
+  // GL thread, once GL is loaded and before the first acquire(): starts the decoders and the upload ring.
+  // Without it textures load synchronously.
+  void start(const TextureStreamConfig &stream_config) {
+    config = stream_config;
+    staging.set_limit(config.staging_bytes);
+    if (config.workers <= 0) return;
+    upload_buffers.resize(static_cast<size_t>(std::max(config.upload_buffers, 1)));
+    for (UploadBuffer &buffer : upload_buffers) glGenBuffers(1, &buffer.pbo);
+    running = true;
+    for (int i = 0; i < config.workers; ++i) workers.emplace_back([this] { run(); });
+  }
+  // GL thread, before the context goes: stops the decoders and deletes every GL object of the cache
+  void stop() {
+    stop_workers();
+    for (UploadBuffer &buffer : upload_buffers) {
+      if (buffer.fence) glDeleteSync(buffer.fence);
+      glDeleteBuffers(1, &buffer.pbo);
+      resources().remove(buffer.record);
+    }
+    upload_buffers.clear();
+    for (const LoadJob &job : uploads)
+      if (job.texture) glDeleteTextures(1, &job.texture);
+    uploads.clear();
+    for (Entry &entry : entries)
+      if (entry.live && owns_texture(entry)) glDeleteTextures(1, &entry.id);
+    if (placeholder) glDeleteTextures(1, &placeholder);
+    placeholder = 0;
+  }
+
+  // a reference to the texture at path. A new path is read and decoded on a worker and uploaded by update();
+  // until then, or if it cannot be loaded, the handle's id() is a grey placeholder
+  Handle acquire(const std::string &path) {
+    const std::string canonical = canonical_texture_path(path);
+    const uint64_t path_hash = hash_bytes(canonical.data(), canonical.size());
+    const uint32_t name = path_index.find(path_hash, [&](const uint32_t n) { return names[n].path == canonical; });
+    if (name != HashIndex::none) {
+      ++stats_.path_hits;
+      return reference(names[name].entry);
+    }
+
+    const uint32_t entry = new_entry();
+    add_name(canonical, path_hash, entry);
+    entries[entry].id = placeholder_texture();
+    LoadJob job;
+    job.entry = entry;
+    job.path = canonical;
+    if (workers.empty()) {
+      // synchronous: the same steps as the workers and update(), in one go
+      read(job);
+      if (job.ok && dedupe(job)) return reference(entry);
+      if (job.ok) decode(job);
+      if (!job.ok) {
+        fail(job);
+        return reference(entry);
+      }
+      allocate_storage(job);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, job.width, job.height, gl_format(job.channels), GL_UNSIGNED_BYTE, job.pixels.data.get());
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      complete(job);
+      return reference(entry);
+    }
+    entries[entry].state = k_texture_loading;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      requests.push_back(std::move(job));
+    }
+    wake.notify_one();
+    return reference(entry);
+  }
+
+  void release(const Handle handle) {
+    if (!valid(handle)) return;
+    Entry &entry = entries[handle - 1];
+    if (entry.refs == 0) return;
+    if (--entry.refs == 0) entry.released = ++release_clock;
+  }
+
+  // GL name to bind: the texture, the one with the same contents, or the placeholder while loading
+  GLuint id(const Handle handle) const {
+    if (!valid(handle)) return 0;
+    const Entry &entry = entries[handle - 1];
+    return entry.alias ? id(entry.alias) : entry.id;
+  }
+
+  // GL thread, every loop iteration: takes the workers' finished reads and decodes, then uploads rows of decoded
+  // images through the pixel buffer ring until upload_bytes_per_frame is spent (at least one row per call) or no
+  // buffer is free. Returns how many textures replaced their placeholder.
+  size_t update() {
+    uploaded = 0;
+    if (workers.empty()) return 0;
+    TRACE_ZONE("texture uploads");
+    bool idle;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      finished.swap(done);
+      idle = requests.empty();
+    }
+    size_t ready = 0;
+    for (LoadJob &job : finished) {
+      if (!job.ok) {
+        fail(job);
+      } else if (job.stage == k_stage_read) {
+        if (dedupe(job)) {
+          ++ready;
+          continue;
+        }
+        job.stage = k_stage_decode;
+        idle = false;
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          requests.push_back(std::move(job));
+        }
+        wake.notify_one();
+      } else {
+        uploads.push_back(std::move(job));
+      }
+    }
+    finished.clear();
+    while (!uploads.empty() && upload_rows(uploads.front())) {
+      if (uploads.front().uploaded_rows < uploads.front().height) continue;
+      complete(uploads.front());
+      uploads.pop_front();
+      ++ready;
+    }
+    // nothing left to decode or upload: the free staging blocks would otherwise sit there until the next load
+    if (idle && uploads.empty()) staging.drop_free();
+    return ready;
+  }
+
+  // deletes unreferenced textures, least recently released first, until those left take at most keep_bytes.
+  // Textures still loading stay.
+  void trim(const size_t keep_bytes) {
+    // aliases and failures hold no memory of their own; an alias going may leave its texture unreferenced
+    for (uint32_t e = 0; e < entries.size(); ++e)
+      if (evictable(entries[e]) && entries[e].gpu_bytes == 0) evict(e);
+    size_t unreferenced = 0;
+    for (const Entry &entry : entries)
+      if (evictable(entry)) unreferenced += entry.gpu_bytes;
+    while (unreferenced > keep_bytes) {
+      uint32_t oldest = HashIndex::none;
+      for (uint32_t e = 0; e < entries.size(); ++e)
+        if (evictable(entries[e]) && (oldest == HashIndex::none || entries[e].released < entries[oldest].released)) oldest = e;
+      if (oldest == HashIndex::none) break;
+      unreferenced -= entries[oldest].gpu_bytes;
+      evict(oldest);
+    }
+  }
+
+  TextureCacheStats stats() const {
+    TextureCacheStats stats = stats_;
+    for (const Entry &entry : entries) {
+      if (!entry.live) continue;
+      ++stats.entries;
+      stats.gpu_bytes += entry.gpu_bytes;
+      if (entry.state == k_texture_loading) ++stats.loading;
+      if (entry.refs > 0) ++stats.referenced;
+      else stats.unreferenced_bytes += entry.gpu_bytes;
+    }
+    stats.staging_bytes = staging.bytes();
+    stats.uploaded_bytes = uploaded;
+    return stats;
+  }
+
+ private:
+  enum texture_state { k_texture_ready, k_texture_loading, k_texture_failed };
+  enum load_stage { k_stage_read, k_stage_decode };
+  struct Entry {
+    GLuint id = 0;// the placeholder until loaded
+    texture_state state = k_texture_ready;
+    Handle alias = 0;// an entry with the same contents, which this one holds a reference on
+    uint64_t content_hash = 0;
+    size_t file_bytes = 0, gpu_bytes = 0;
+    uint32_t refs = 0;
+    uint64_t released = 0;// release_clock when refs last fell to 0
+    ResourceRegistry::Handle record = 0;
+    std::vector<uint32_t> names;// into names, every path that reached this entry
+    bool live = false;
+  };
+  struct Name {
+    std::string path;// canonical
+    uint64_t hash;
+    uint32_t entry;
+  };
+  // one texture on its way: read and hashed, then decoded into staging, then uploaded a few rows per frame
+  struct LoadJob {
+    uint32_t entry = 0;
+    load_stage stage = k_stage_read;
+    bool ok = false;
+    std::string path;
+    std::vector<unsigned char> file;
+    uint64_t content_hash = 0;
+    size_t file_bytes = 0;
+    StagingPool::Block pixels;
+    int width = 0, height = 0, channels = 0;
+    int uploaded_rows = 0;
+    GLuint texture = 0;// allocated once the first rows go up
+  };
+  struct UploadBuffer {
+    GLuint pbo = 0;
+    size_t capacity = 0;
+    GLsync fence = nullptr;
+    ResourceRegistry::Handle record = 0;
+  };
+
+  std::vector<Entry> entries;
+  std::vector<uint32_t> free_entries;
+  std::vector<Name> names;
+  std::vector<uint32_t> free_names;
+  HashIndex path_index, content_index;
+  uint64_t release_clock = 0;
+  TextureCacheStats stats_{};
+  TextureStreamConfig config;
+  GLuint placeholder = 0;
+
+  // workers
+  StagingPool staging;
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<LoadJob> requests, done;// guarded by mutex
+  bool running = false;
+
+  // GL thread only
+  std::deque<LoadJob> finished, uploads;
+  std::vector<UploadBuffer> upload_buffers;
+  size_t next_buffer = 0, uploaded = 0;
+
+  bool valid(const Handle handle) const { return handle > 0 && handle <= entries.size() && entries[handle - 1].live; }
+  static bool owns_texture(const Entry &entry) { return entry.state == k_texture_ready && entry.alias == 0; }
+  static bool evictable(const Entry &entry) { return entry.live && entry.refs == 0 && entry.state != k_texture_loading; }
+  static GLenum gl_format(const int channels) { return channels == 1 ? GL_RED : channels == 2 ? GL_RG : channels == 3 ? GL_RGB : GL_RGBA; }
+  Handle reference(const uint32_t entry) {
+    ++entries[entry].refs;
+    return entry + 1;
+  }
+
+  uint32_t new_entry() {
+    uint32_t entry;
+    if (free_entries.empty()) {
+      entry = static_cast<uint32_t>(entries.size());
+      entries.emplace_back();
+    } else {
+      entry = free_entries.back();
+      free_entries.pop_back();
+      entries[entry] = Entry();
+    }
+    entries[entry].live = true;
+    return entry;
+  }
+  void add_name(const std::string &canonical, const uint64_t hash, const uint32_t entry) {
+    uint32_t name;
+    if (free_names.empty()) {
+      name = static_cast<uint32_t>(names.size());
+      names.push_back({canonical, hash, entry});
+    } else {
+      name = free_names.back();
+      free_names.pop_back();
+      names[name] = {canonical, hash, entry};
+    }
+    path_index.insert(hash, name);
+    entries[entry].names.push_back(name);
+  }
+  void evict(const uint32_t entry) {
+    Entry &e = entries[entry];
+    for (const uint32_t name : e.names) {
+      path_index.erase(names[name].hash, [name](const uint32_t n) { return n == name; });
+      std::string().swap(names[name].path);
+      free_names.push_back(name);
+    }
+    content_index.erase(e.content_hash, [entry](const uint32_t other) { return other == entry; });
+    if (owns_texture(e)) glDeleteTextures(1, &e.id);
+    resources().remove(e.record);
+    const Handle alias = e.alias;
+    e = Entry();
+    free_entries.push_back(entry);
+    release(alias);
+    ++stats_.evictions;
+  }
+
+  GLuint placeholder_texture() {
+    if (placeholder == 0) {
+      const unsigned char grey[4] = {128, 128, 128, 255};
+      glGenTextures(1, &placeholder);
+      glBindTexture(GL_TEXTURE_2D, placeholder);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    return placeholder;
+  }
+
+  // worker: the file's bytes and their hash
+  static void read(LoadJob &job) {
+    TRACE_ZONE("read texture");
+    std::ifstream file(job.path, std::ios::binary);
+    if (file) job.file.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    job.file_bytes = job.file.size();
+    job.content_hash = hash_bytes(job.file.data(), job.file.size());
+    job.ok = !job.file.empty();
+  }
+  // worker: pixels into a staging block; waits while the pool is full
+  void decode(LoadJob &job) {
+    TRACE_ZONE("decode texture");
+    const int size = static_cast<int>(job.file.size());
+    job.ok = false;
+    if (!stbi_info_from_memory(job.file.data(), size, &job.width, &job.height, &job.channels)) return;
+    const size_t bytes = static_cast<size_t>(job.width) * static_cast<size_t>(job.height) * static_cast<size_t>(job.channels);
+    job.pixels = staging.acquire(bytes);
+    if (!job.pixels.data) return;
+    unsigned char *decoded = stbi_load_from_memory(job.file.data(), size, &job.width, &job.height, &job.channels, job.channels);
+    if (decoded) {
+      std::memcpy(job.pixels.data.get(), decoded, bytes);
+      stbi_image_free(decoded);
+      job.ok = true;
+    } else {
+      staging.release(std::move(job.pixels));
+    }
+    std::vector<unsigned char>().swap(job.file);
+  }
+  void run() {
+    TRACE_THREAD_NAME("texture decoder");
+    while (true) {
+      LoadJob job;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this] { return !running || !requests.empty(); });
+        if (!running) return;
+        job = std::move(requests.front());
+        requests.pop_front();
+      }
+      if (job.stage == k_stage_read) read(job);
+      else decode(job);
+      std::lock_guard<std::mutex> lock(mutex);
+      done.push_back(std::move(job));
+    }
+  }
+  void stop_workers() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      running = false;
+    }
+    wake.notify_all();
+    staging.stop();
+    for (std::thread &worker : workers) worker.join();
+    workers.clear();
+  }
+
+  // GL thread, after the read: true when the contents are already cached, the entry then stands for that one
+  bool dedupe(LoadJob &job) {
+    Entry &entry = entries[job.entry];
+    entry.content_hash = job.content_hash;
+    entry.file_bytes = job.file_bytes;
+    const uint32_t same = content_index.find(job.content_hash, [&](const uint32_t e) { return entries[e].file_bytes == job.file_bytes; });
+    if (same == HashIndex::none) {
+      content_index.insert(job.content_hash, job.entry);
+      return false;
+    }
+    entries[job.entry].alias = reference(same);
+    entries[job.entry].state = k_texture_ready;
+    ++stats_.content_hits;
+    return true;
+  }
+  void fail(LoadJob &job) {
+    std::cout << "Texture failed to load at path: " << job.path << std::endl;
+    if (job.texture) glDeleteTextures(1, &job.texture);
+    staging.release(std::move(job.pixels));
+    Entry &entry = entries[job.entry];
+    content_index.erase(entry.content_hash, [&job](const uint32_t other) { return other == job.entry; });
+    entry.state = k_texture_failed;
+    ++stats_.failures;
+  }
+
+  void allocate_storage(LoadJob &job) {
+    const GLenum format = gl_format(job.channels);
+    glGenTextures(1, &job.texture);
+    glBindTexture(GL_TEXTURE_2D, job.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(format), job.width, job.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  }
+  // a ring buffer whose last upload the GPU has consumed
+  UploadBuffer *free_upload_buffer() {
+    UploadBuffer &buffer = upload_buffers[next_buffer];
+    if (buffer.fence) {
+      const GLenum status = glClientWaitSync(buffer.fence, 0, 0);
+      if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return nullptr;
+      glDeleteSync(buffer.fence);
+      buffer.fence = nullptr;
+    }
+    next_buffer = (next_buffer + 1) % upload_buffers.size();
+    return &buffer;
+  }
+  // the next rows of job within the frame's budget; false when the budget is spent or no buffer is free
+  bool upload_rows(LoadJob &job) {
+    const size_t row_bytes = static_cast<size_t>(job.width) * static_cast<size_t>(job.channels);
+    if (uploaded > 0 && uploaded + row_bytes > config.upload_bytes_per_frame) return false;
+    UploadBuffer *buffer = free_upload_buffer();
+    if (!buffer) return false;
+    const size_t budget_rows = config.upload_bytes_per_frame > uploaded ? (config.upload_bytes_per_frame - uploaded) / row_bytes : 0;
+    const int rows = static_cast<int>(std::min<size_t>(std::max<size_t>(budget_rows, 1), static_cast<size_t>(job.height - job.uploaded_rows)));
+    const size_t bytes = static_cast<size_t>(rows) * row_bytes;
+    const unsigned char *source = job.pixels.data.get() + static_cast<size_t>(job.uploaded_rows) * row_bytes;
+    if (job.texture == 0) allocate_storage(job);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer->pbo);
+    if (bytes > buffer->capacity) {
+      buffer->capacity = bytes;
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(bytes), nullptr, GL_STREAM_DRAW);
+      if (buffer->record == 0) buffer->record = resources().add(k_resource_buffer, buffer->pbo, bytes, "texture upload", "texture cache");
+      else resources().update(buffer->record, bytes, "texture upload");
+    }
+    void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(bytes), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped) {
+      std::memcpy(mapped, source, bytes);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    } else {
+      // upload straight from the staging block instead
+      std::cout << "ERROR::TEXTURE_CACHE:: could not map the upload buffer" << std::endl;
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    glBindTexture(GL_TEXTURE_2D, job.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, job.uploaded_rows, job.width, rows, gl_format(job.channels), GL_UNSIGNED_BYTE, mapped ? nullptr : source);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    buffer->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    job.uploaded_rows += rows;
+    uploaded += bytes;
+    return true;
+  }
+  // every row is up: mipmaps, and the texture takes the placeholder's place
+  void complete(LoadJob &job) {
+    glBindTexture(GL_TEXTURE_2D, job.texture);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    Entry &entry = entries[job.entry];
+    entry.id = job.texture;
+    entry.state = k_texture_ready;
+    entry.gpu_bytes = texture_bytes(job.width, job.height, job.channels, true);
+    const char *format = job.channels == 1 ? "R8" : job.channels == 2 ? "RG8" : job.channels == 3 ? "RGB8" : "RGBA8";
+    entry.record = resources().add(k_resource_texture, job.texture, entry.gpu_bytes, std::string(format) + " " + std::to_string(job.width) + "x" + std::to_string(job.height) + " mips", job.path);
+    staging.release(std::move(job.pixels));
+    job.texture = 0;
+    ++stats_.loads;
+  }
+};
+
+inline TextureCache &textures() {
+  static TextureCache instance;
+  return instance;
+}
+
+#endif
@@ -0,0 +1,70 @@
+#pragma once
+#ifndef TISSUE_BENCH_H
+#define TISSUE_BENCH_H
+
+#include <SoftTissue.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Headless benchmark for SoftTissue.h (run with --bench-tissue [density]). Steps the default proxies with a
+// fixed substep count on 1, 2, 4 and 8 threads and reports time per step and the speedup over one thread,
+// then runs once more under the time budget to show how many substeps fit.
+inline int run_tissue_benchmark(const float density = 1.0f, const int steps = 120) {
+  using clock = std::chrono::steady_clock;
+  Aabb anatomy;
+  anatomy.grow(glm::vec3(-1.2f, -11.25f, -6.85f));
+  anatomy.grow(glm::vec3(1.2f, -8.75f, 3.0f));
+  const std::vector<TissueProxySpec> proxies = default_tissue_proxies(anatomy, density);
+
+  // the tube sweeping through the dura and fat, so tearing and contacts are part of the measurement
+  const auto drive = [&anatomy](TissueSolver &solver, const int frame) {
+    const float t = static_cast<float>(frame) / 60.0f;
+    const glm::vec3 size = anatomy.max - anatomy.min;
+    const glm::vec3 tip = anatomy.min + size * glm::vec3(0.5f + 0.4f * std::sin(t), 0.95f - 0.3f * std::min(t, 1.0f), 0.5f);
+    solver.set_colliders({Capsule{tip, tip + glm::vec3(0.0f, 3.0f, 0.0f), 0.05f * size.x}});
+  };
+
+  JobSystem jobs(8);
+  std::printf("hardware threads %u\n", std::max(1u, std::thread::hardware_concurrency()));
+  std::printf("%8s %10s %12s %10s %10s\n", "threads", "step ms", "substep ms", "speedup", "Mc/s");
+  double single_ms = 0.0;
+  for (const int threads : {1, 2, 4, 8}) {
+    jobs.set_active_threads(threads);
+    TissueSolverConfig config;
+    config.budget_ms = 0.0;
+    TissueSolver solver(jobs, config);
+    solver.build(proxies);
+    for (int f = 0; f < 10; ++f) solver.step();// warm up
+    const auto start = clock::now();
+    for (int f = 0; f < steps; ++f) {
+      drive(solver, f);
+      solver.step();
+    }
+    const double step_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count() / steps;
+    if (threads == 1) single_ms = step_ms;
+    const TissueSolverStats s = solver.stats();
+    const double constraints = static_cast<double>(s.distance_constraints + s.volume_constraints) * s.substeps;
+    if (threads == 1)
+      std::printf("particles %zu  distance %zu (%zu colors)  volume %zu (%zu colors)  substeps %d\n", s.particles, s.distance_constraints, s.distance_colors, s.volume_constraints, s.volume_colors, s.substeps);
+    std::printf("%8d %10.3f %12.3f %10.2f %10.1f\n", threads, step_ms, step_ms / s.substeps, single_ms / step_ms, constraints / step_ms / 1000.0);
+  }
+
+  jobs.set_active_threads(jobs.thread_count());
+  TissueSolver budgeted(jobs);
+  budgeted.build(proxies);
+  double worst = 0.0;
+  for (int f = 0; f < steps; ++f) {
+    drive(budgeted, f);
+    budgeted.step();
+    if (f >= 10) worst = std::max(worst, budgeted.stats().step_ms);
+  }
+  const TissueSolverStats s = budgeted.stats();
+  std::printf("budget %.1f ms: substeps %d  last step %.3f ms  worst %.3f ms  overruns %d\n", budgeted.config.budget_ms, s.substeps, s.step_ms, worst, s.budget_overruns);
+  return 0;
+}
+
+#endif
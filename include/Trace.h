@@ -0,0 +1,199 @@
+#pragma once
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Timeline recorder for every thread, written as Chrome Trace Event JSON (chrome://tracing, ui.perfetto.dev).
+// Each thread appends begin/end/counter events with nanosecond timestamps to its own ring: one writer, no locks,
+// and no allocation after the thread's first event. Rings are found through a lock-free list and outlive their
+// thread, so write_trace() also covers workers that already ended. A ring keeps the last trace_ring_events events
+// of its thread; a dump copies each ring while it is written and keeps only the part the writer cannot have
+// overwritten during the copy. Event names are stored as pointers and must be string literals.
+// Building with TRACE_ENABLED=0 compiles the TRACE_ macros to nothing.
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+constexpr size_t trace_ring_events = size_t(1) << 15;
+
+struct TraceEvent {
+  const char *name;
+  int64_t ns;  // since trace_origin()
+  double value;// counters
+  char phase;  // 'B', 'E' or 'C'
+};
+
+struct TraceRing {
+  std::atomic<const char *> thread_name{nullptr};
+  uint32_t tid = 0;
+  std::atomic<uint64_t> head{0};// events ever written
+  std::vector<TraceEvent> events = std::vector<TraceEvent>(trace_ring_events);
+  TraceRing *next = nullptr;
+};
+
+struct TraceStats {
+  size_t threads;
+  uint64_t events;     // recorded since start
+  uint64_t overwritten;// lost to ring wraparound
+};
+
+namespace trace_detail {
+inline std::atomic<TraceRing *> &rings() {
+  static std::atomic<TraceRing *> head{nullptr};
+  return head;
+}
+// the calling thread's ring, registered on first use; never freed
+inline TraceRing &this_thread_ring() {
+  thread_local TraceRing *ring = nullptr;
+  if (!ring) {
+    static std::atomic<uint32_t> next_tid{1};
+    ring = new TraceRing();
+    ring->tid = next_tid.fetch_add(1, std::memory_order_relaxed);
+    ring->next = rings().load(std::memory_order_relaxed);
+    while (!rings().compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed)) {}
+  }
+  return *ring;
+}
+// innermost TRACE_ZONE and the name of the calling thread; plain thread_locals, readable from an allocator hook
+inline const char *&current_zone() {
+  thread_local const char *zone = nullptr;
+  return zone;
+}
+inline const char *&thread_label() {
+  thread_local const char *label = nullptr;
+  return label;
+}
+inline void json_string(FILE *file, const char *text) {
+  std::fputc('"', file);
+  for (const char *c = text; *c; ++c) {
+    if (*c == '"' || *c == '\\') std::fputc('\\', file);
+    if (static_cast<unsigned char>(*c) >= 0x20) std::fputc(*c, file);
+  }
+  std::fputc('"', file);
+}
+}// namespace trace_detail
+
+// time zero of the trace; the first call fixes it, so call it early in main
+inline std::chrono::steady_clock::time_point trace_origin() {
+  static const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+  return origin;
+}
+
+inline void trace_event(const char *name, const char phase, const double value = 0.0) {
+  TraceRing &ring = trace_detail::this_thread_ring();
+  const uint64_t head = ring.head.load(std::memory_order_relaxed);
+  const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - trace_origin()).count();
+  ring.events[head % trace_ring_events] = {name, ns, value, phase};
+  ring.head.store(head + 1, std::memory_order_release);
+}
+
+// names the calling thread in the trace; a string literal
+inline void trace_thread_name(const char *name) {
+  trace_detail::thread_label() = name;
+  trace_detail::this_thread_ring().thread_name.store(name, std::memory_order_relaxed);
+}
+
+inline TraceStats trace_stats() {
+  TraceStats stats{0, 0, 0};
+  for (TraceRing *ring = trace_detail::rings().load(std::memory_order_acquire); ring; ring = ring->next) {
+    const uint64_t head = ring->head.load(std::memory_order_acquire);
+    ++stats.threads;
+    stats.events += head;
+    if (head > trace_ring_events) stats.overwritten += head - trace_ring_events;
+  }
+  return stats;
+}
+
+// writes what the rings hold as Chrome trace JSON; returns the number of events written, -1 if the file cannot
+// be opened. Safe while other threads keep recording; their events after the copy are simply not in the file.
+inline long write_trace(const char *path) {
+  FILE *file = std::fopen(path, "w");
+  if (!file) {
+    std::printf("ERROR::TRACE::CANNOT_OPEN %s\n", path);
+    return -1;
+  }
+  std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+  std::fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"PhysicalSimulatedServer\"}}", file);
+  long written = 0;
+  std::vector<TraceEvent> copy;
+  for (TraceRing *ring = trace_detail::rings().load(std::memory_order_acquire); ring; ring = ring->next) {
+    // copy between two reads of head; slots the writer may have reused meanwhile are dropped
+    const uint64_t before = ring->head.load(std::memory_order_acquire);
+    const uint64_t first = before > trace_ring_events ? before - trace_ring_events : 0;
+    copy.clear();
+    for (uint64_t i = first; i < before; ++i) copy.push_back(ring->events[i % trace_ring_events]);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t after = ring->head.load(std::memory_order_relaxed);
+    // the writer may be filling slot `after` right now, which holds event after - trace_ring_events: drop it too
+    const uint64_t valid = after + 1 > trace_ring_events ? after + 1 - trace_ring_events : 0;
+    const size_t skip = valid > first ? static_cast<size_t>(std::min(valid - first, before - first)) : 0;
+
+    const char *name = ring->thread_name.load(std::memory_order_relaxed);
+    std::fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", ring->tid);
+    if (name) trace_detail::json_string(file, name);
+    else std::fprintf(file, "\"thread %u\"", ring->tid);
+    std::fputs("}}", file);
+    int depth = 0;
+    for (size_t i = skip; i < copy.size(); ++i) {
+      const TraceEvent &event = copy[i];
+      // a zone begun before the kept window has only its end left; viewers mis-nest those
+      if (event.phase == 'E' && depth == 0) continue;
+      depth += event.phase == 'B' ? 1 : event.phase == 'E' ? -1 : 0;
+      std::fputs(",\n{\"name\":", file);
+      trace_detail::json_string(file, event.name);
+      std::fprintf(file, ",\"ph\":\"%c\",\"ts\":%lld.%03lld,\"pid\":1,\"tid\":%u", event.phase, static_cast<long long>(event.ns / 1000), static_cast<long long>(event.ns % 1000), ring->tid);
+      if (event.phase == 'C') std::fprintf(file, ",\"args\":{\"value\":%.17g}", event.value);
+      std::fputc('}', file);
+      ++written;
+    }
+  }
+  std::fputs("\n]}\n", file);
+  std::fclose(file);
+  return written;
+}
+
+// scoped B/E pair, see TRACE_ZONE
+class TraceZone {
+ public:
+  explicit TraceZone(const char *name) : name(name), outer(trace_detail::current_zone()) {
+    trace_detail::current_zone() = name;
+    trace_event(name, 'B');
+  }
+  ~TraceZone() {
+    trace_event(name, 'E');
+    trace_detail::current_zone() = outer;
+  }
+  TraceZone(const TraceZone &) = delete;
+  TraceZone &operator=(const TraceZone &) = delete;
+
+ private:
+  const char *name, *outer;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#if TRACE_ENABLED
+// the enclosing scope as a slice on this thread's track
+#define TRACE_ZONE(name) const TraceZone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+// a value over time, drawn as its own track
+#define TRACE_COUNTER(name, value) trace_event(name, 'C', static_cast<double>(value))
+// an explicit B or E, for spans that are not one scope (startup); pair them on the same thread
+#define TRACE_BEGIN(name) trace_event(name, 'B')
+#define TRACE_END(name) trace_event(name, 'E')
+#define TRACE_THREAD_NAME(name) trace_thread_name(name)
+#else
+#define TRACE_ZONE(name) ((void) 0)
+#define TRACE_COUNTER(name, value) ((void) 0)
+#define TRACE_BEGIN(name) ((void) 0)
+#define TRACE_END(name) ((void) 0)
+#define TRACE_THREAD_NAME(name) ((void) 0)
+#endif
+
+#endif
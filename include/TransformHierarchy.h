@@ -0,0 +1,184 @@
+#pragma once
+#ifndef TRANSFORM_HIERARCHY_H
+#define TRANSFORM_HIERARCHY_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRANSFORM_SSE2 1
+#else
+#define TRANSFORM_SSE2 0
+#endif
+
+// Flat transform hierarchy: nodes live in arrays (structure of arrays), a parent always before its children,
+// so one forward pass updates every world matrix. Poses set through set_pose/set_euler are converted to
+// matrices in batches of four (one node per SSE lane) on update(), and only nodes whose local matrix changed,
+// or whose parent's world did, are multiplied again. Setting the pose a node already has is free.
+
+struct TransformStats {
+  size_t nodes;
+  size_t converted;  // poses turned into local matrices
+  size_t multiplied; // world matrices recomputed
+};
+
+// rotation of glm::rotate(y) * rotate(x) * rotate(z), angles in degrees, the order the fused euler angles use
+inline glm::quat quat_from_euler_yxz(const glm::vec3 &degrees) {
+  const glm::vec3 h = glm::radians(degrees) * 0.5f;
+  const glm::quat qy(std::cos(h.y), 0.0f, std::sin(h.y), 0.0f);
+  const glm::quat qx(std::cos(h.x), std::sin(h.x), 0.0f, 0.0f);
+  const glm::quat qz(std::cos(h.z), 0.0f, 0.0f, std::sin(h.z));
+  return qy * qx * qz;
+}
+
+class TransformHierarchy {
+ public:
+  // parent must already exist (-1 for a root)
+  int add(const int parent, const std::string &name, const glm::mat4 &local = glm::mat4(1.0f)) {
+    const int index = static_cast<int>(parents.size());
+    if (parent >= index) {
+      std::cout << "ERROR::TRANSFORM::PARENT_AFTER_CHILD " << name << std::endl;
+      return -1;
+    }
+    parents.push_back(parent);
+    names.push_back(name);
+    locals.push_back(local);
+    worlds.push_back(local);
+    translations.emplace_back(0.0f);
+    rotations.emplace_back(0.0f, 0.0f, 0.0f, 0.0f);// no pose set yet
+    local_dirty.push_back(1);
+    world_changed.push_back(0);
+    pose_pending.push_back(0);
+    return index;
+  }
+
+  size_t size() const { return parents.size(); }
+  int parent(const int node) const { return parents[node]; }
+  const std::string &name(const int node) const { return names[node]; }
+  const glm::mat4 &local(const int node) const { return locals[node]; }
+  const glm::mat4 &world(const int node) const { return worlds[node]; }
+  // nodes whose world matrix changed in the last update()
+  const std::vector<int> &changed() const { return changed_nodes; }
+  const TransformStats &stats() const { return last_stats; }
+
+  void set_local(const int node, const glm::mat4 &local) {
+    if (locals[node] == local) return;
+    locals[node] = local;
+    rotations[node] = glm::quat(0.0f, 0.0f, 0.0f, 0.0f);
+    pose_pending[node] = 0;
+    local_dirty[node] = 1;
+  }
+
+  // translation and unit rotation, turned into the local matrix on the next update()
+  void set_pose(const int node, const glm::vec3 &translation, const glm::quat &rotation) {
+    if (!pose_pending[node] && translations[node] == translation && rotations[node] == rotation) return;
+    translations[node] = translation;
+    rotations[node] = rotation;
+    if (!pose_pending[node]) pending.push_back(node);
+    pose_pending[node] = 1;
+  }
+  void set_euler(const int node, const glm::vec3 &translation, const glm::vec3 &euler_degrees) { set_pose(node, translation, quat_from_euler_yxz(euler_degrees)); }
+
+  void update() {
+    for (const int node : changed_nodes) world_changed[node] = 0;
+    changed_nodes.clear();
+    convert_pending();
+
+    for (size_t i = 0; i < parents.size(); ++i) {
+      const int p = parents[i];
+      if (!local_dirty[i] && (p < 0 || !world_changed[p])) continue;
+      if (p < 0) worlds[i] = locals[i];
+      else multiply(worlds[p], locals[i], worlds[i]);
+      local_dirty[i] = 0;
+      world_changed[i] = 1;
+      changed_nodes.push_back(static_cast<int>(i));
+    }
+    last_stats.nodes = size();
+    last_stats.multiplied = changed_nodes.size();
+  }
+
+ private:
+  std::vector<int> parents;
+  std::vector<std::string> names;
+  std::vector<glm::mat4> locals, worlds;
+  std::vector<glm::vec3> translations;
+  std::vector<glm::quat> rotations;
+  std::vector<uint8_t> local_dirty, world_changed, pose_pending;
+  std::vector<int> pending, changed_nodes;
+  TransformStats last_stats{};
+
+  // quaternion + translation -> matrix, four nodes at a time
+  void convert_pending() {
+    // set_local() after set_pose() wins
+    pending.erase(std::remove_if(pending.begin(), pending.end(), [this](const int node) { return !pose_pending[node]; }), pending.end());
+    size_t i = 0;
+#if TRANSFORM_SSE2
+    for (; i + 4 <= pending.size(); i += 4) {
+      alignas(16) float x[4], y[4], z[4], w[4];
+      for (int l = 0; l < 4; ++l) {
+        const glm::quat &q = rotations[pending[i + l]];
+        x[l] = q.x;
+        y[l] = q.y;
+        z[l] = q.z;
+        w[l] = q.w;
+      }
+      const __m128 qx = _mm_load_ps(x), qy = _mm_load_ps(y), qz = _mm_load_ps(z), qw = _mm_load_ps(w);
+      const __m128 two = _mm_set1_ps(2.0f), one = _mm_set1_ps(1.0f);
+      const __m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+      const __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+      const __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+      // m[column][row]
+      alignas(16) float m[9][4];
+      _mm_store_ps(m[0], _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))));
+      _mm_store_ps(m[1], _mm_mul_ps(two, _mm_add_ps(xy, wz)));
+      _mm_store_ps(m[2], _mm_mul_ps(two, _mm_sub_ps(xz, wy)));
+      _mm_store_ps(m[3], _mm_mul_ps(two, _mm_sub_ps(xy, wz)));
+      _mm_store_ps(m[4], _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))));
+      _mm_store_ps(m[5], _mm_mul_ps(two, _mm_add_ps(yz, wx)));
+      _mm_store_ps(m[6], _mm_mul_ps(two, _mm_add_ps(xz, wy)));
+      _mm_store_ps(m[7], _mm_mul_ps(two, _mm_sub_ps(yz, wx)));
+      _mm_store_ps(m[8], _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))));
+      for (int l = 0; l < 4; ++l) {
+        const int node = pending[i + l];
+        glm::mat4 &local = locals[node];
+        for (int c = 0; c < 3; ++c) local[c] = glm::vec4(m[3 * c][l], m[3 * c + 1][l], m[3 * c + 2][l], 0.0f);
+        local[3] = glm::vec4(translations[node], 1.0f);
+      }
+    }
+#endif
+    for (; i < pending.size(); ++i) {
+      const int node = pending[i];
+      locals[node] = glm::mat4_cast(rotations[node]);
+      locals[node][3] = glm::vec4(translations[node], 1.0f);
+    }
+    for (const int node : pending) {
+      pose_pending[node] = 0;
+      local_dirty[node] = 1;
+    }
+    last_stats.converted = pending.size();
+    pending.clear();
+  }
+
+  static void multiply(const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &out) {
+#if TRANSFORM_SSE2
+    const float *pa = &a[0][0];
+    const __m128 a0 = _mm_loadu_ps(pa), a1 = _mm_loadu_ps(pa + 4), a2 = _mm_loadu_ps(pa + 8), a3 = _mm_loadu_ps(pa + 12);
+    for (int c = 0; c < 4; ++c) {
+      const __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(b[c][0])), _mm_mul_ps(a1, _mm_set1_ps(b[c][1]))), _mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(b[c][2])), _mm_mul_ps(a3, _mm_set1_ps(b[c][3]))));
+      _mm_storeu_ps(&out[c][0], r);
+    }
+#else
+    out = a * b;
+#endif
+  }
+};
+
+#endif
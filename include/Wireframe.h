@@ -0,0 +1,148 @@
+#pragma once
+#ifndef WIREFRAME_H
+#define WIREFRAME_H
+
+#include <Model.h>
+#include <RenderViews.h>
+#include <Shader.h>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Wireframe from edge lists instead of glPolygonMode(GL_LINE): every edge is drawn once as a GL_LINES
+// segment (polygon mode outlines each triangle, so an edge shared by two triangles is rasterized twice), and a
+// depth-only solid underlay pushed back with polygon offset hides the lines behind surfaces.
+
+struct WireframeStats {
+  size_t lines;         // segments drawn from edge lists
+  size_t triangle_edges;// what polygon mode would outline for the same meshes
+};
+
+// Unique edges of a triangle list as GL_LINES indices. Vertices are welded by position first, so edges along
+// UV or normal seams (split vertices in the file) are not doubled. With crease_degrees > 0 only feature edges
+// are kept: boundary and non-manifold edges and those whose two faces meet at more than the crease angle.
+inline std::vector<unsigned int> extract_unique_edges(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, const float crease_degrees = 0.0f) {
+  struct PositionHash {
+    size_t operator()(const glm::vec3 &p) const {
+      const glm::vec3 q = p + glm::vec3(0.0f);// -0 and +0 compare equal, so they have to hash equal
+      uint32_t b[3];
+      std::memcpy(b, &q, sizeof(b));
+      return (b[0] * 73856093u) ^ (b[1] * 19349663u) ^ (b[2] * 83492791u);
+    }
+  };
+  struct Edge {
+    unsigned int a, b;// vertex indices of the first triangle that had it
+    glm::vec3 normal; // that triangle's normal
+    int faces;
+    bool feature;
+  };
+
+  std::unordered_map<glm::vec3, unsigned int, PositionHash> welded;
+  std::vector<unsigned int> canonical(vertices.size());
+  welded.reserve(vertices.size());
+  for (size_t v = 0; v < vertices.size(); ++v) canonical[v] = welded.emplace(vertices[v].Position, static_cast<unsigned int>(welded.size())).first->second;
+
+  const float cos_crease = std::cos(glm::radians(crease_degrees));
+  std::unordered_map<uint64_t, Edge> edges;
+  edges.reserve(indices.size());
+  std::vector<uint64_t> order;// first-seen order keeps the output deterministic
+  for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+    const unsigned int tri[3] = {indices[t], indices[t + 1], indices[t + 2]};
+    const glm::vec3 n = glm::cross(vertices[tri[1]].Position - vertices[tri[0]].Position, vertices[tri[2]].Position - vertices[tri[0]].Position);
+    const float length = glm::length(n);
+    const glm::vec3 normal = length > 0.0f ? n / length : glm::vec3(0.0f);
+    for (int e = 0; e < 3; ++e) {
+      const unsigned int a = tri[e], b = tri[(e + 1) % 3];
+      const unsigned int ca = canonical[a], cb = canonical[b];
+      if (ca == cb) continue;
+      const uint64_t key = static_cast<uint64_t>(std::min(ca, cb)) << 32 | std::max(ca, cb);
+      const auto found = edges.find(key);
+      if (found == edges.end()) {
+        edges.emplace(key, Edge{a, b, normal, 1, false});
+        order.push_back(key);
+        continue;
+      }
+      Edge &edge = found->second;
+      if (++edge.faces == 2) edge.feature = glm::dot(edge.normal, normal) < cos_crease;
+    }
+  }
+
+  std::vector<unsigned int> lines;
+  lines.reserve(order.size() * 2);
+  for (const uint64_t key : order) {
+    const Edge &edge = edges[key];
+    if (crease_degrees > 0.0f && edge.faces == 2 && !edge.feature) continue;
+    lines.push_back(edge.a);
+    lines.push_back(edge.b);
+  }
+  return lines;
+}
+
+inline void build_model_edges(Model &model, const float crease_degrees = 0.0f) {
+  for (Mesh &mesh : model.meshes) mesh.set_edges(extract_unique_edges(mesh.vertices, mesh.indices, crease_degrees));
+}
+
+class WireframePass {
+ public:
+  // shader/depth.vs + depth.fs: positions only, no color output
+  WireframePass() : depth_shader("./Shader/depth.vs", "./Shader/depth.fs") { attach_view_uniforms(depth_shader); }
+
+  // writes depth for solid geometry drawn until end_underlay(), pushed back so coplanar lines still pass; the
+  // view is the one bound to ViewUniforms
+  void begin_underlay() {
+    glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(1.0f, 1.0f);
+    depth_shader.use();
+    depth_shader.setMat4("model", glm::mat4(1.0f));
+    stats = {0, 0};
+  }
+  void underlay(Model &model, const glm::mat4 &world) {
+    for (size_t i = 0; i < model.meshes.size(); ++i) {
+      if (!model.mesh_visible.empty() && !model.mesh_visible[i]) continue;
+      depth_shader.setMat4("model", world * model.mesh_transforms[i]);
+      model.meshes[i].DrawGeometry();
+    }
+  }
+  // for other solid draws between begin/end
+  void set_model(const glm::mat4 &world) { depth_shader.setMat4("model", world); }
+  void end_underlay() {
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glPolygonMode(GL_FRONT_AND_BACK, polygon_mode[0]);
+  }
+
+  // edge lists of the model, with the caller's (textured) shader
+  void draw_edges(Model &model, Shader &shader, const glm::mat4 &world) {
+    for (size_t i = 0; i < model.meshes.size(); ++i) {
+      if (!model.mesh_visible.empty() && !model.mesh_visible[i]) continue;
+      shader.setMat4("model", world * model.mesh_transforms[i]);
+      model.meshes[i].DrawEdges(shader);
+      stats.lines += model.meshes[i].edge_count / 2;
+      stats.triangle_edges += model.meshes[i].index_count;
+    }
+  }
+
+  // edges drawn by something other than a Model, e.g. the bone stream
+  void count_edges(const size_t lines, const size_t triangle_edges) {
+    stats.lines += lines;
+    stats.triangle_edges += triangle_edges;
+  }
+
+  const WireframeStats &last_stats() const { return stats; }
+
+ private:
+  Shader depth_shader;
+  GLint polygon_mode[2] = {GL_FILL, GL_FILL};
+  WireframeStats stats{};
+};
+
+#endif
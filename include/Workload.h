@@ -0,0 +1,607 @@
+#pragma once
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <Trace.h>
+
+#include <ecal/ecal.h>
+#include <fusion.pb.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WORKLOAD_SSE2 1
+#else
+#define WORKLOAD_SSE2 0
+#endif
+
+// Synthetic FusionData workload: smooth instrument trajectories, tissue state changes and haptic events,
+// all derived from a declarative profile and a seed. Every sample is a pure function of (seed, sample index),
+// so runs are reproducible and batches can be generated out of order or on any thread.
+
+#pragma region counter based rng
+// Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3"), a counter-based generator:
+// no state to carry between draws, the counter *is* the position in the stream.
+constexpr uint32_t philox_m0 = 0xD2511F53u;
+constexpr uint32_t philox_m1 = 0xCD9E8D57u;
+constexpr uint32_t philox_w0 = 0x9E3779B9u;
+constexpr uint32_t philox_w1 = 0xBB67AE85u;
+
+inline void philox4x32(const uint32_t ctr[4], uint32_t k0, uint32_t k1, uint32_t out[4]) {
+  uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+  for (int round = 0; round < 10; ++round) {
+    const uint64_t p0 = static_cast<uint64_t>(philox_m0) * c0;
+    const uint64_t p1 = static_cast<uint64_t>(philox_m1) * c2;
+    const uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+    const uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+    c1 = static_cast<uint32_t>(p1);
+    c3 = static_cast<uint32_t>(p0);
+    c0 = n0;
+    c2 = n2;
+    k0 += philox_w0;
+    k1 += philox_w1;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+#if WORKLOAD_SSE2
+// four independent Philox blocks per call, one per SSE lane (SoA: c0 holds word 0 of all four counters, ...)
+inline void philox4x32_x4(__m128i &c0, __m128i &c1, __m128i &c2, __m128i &c3, uint32_t k0, uint32_t k1) {
+  const __m128i m0 = _mm_set1_epi32(static_cast<int>(philox_m0));
+  const __m128i m1 = _mm_set1_epi32(static_cast<int>(philox_m1));
+  // 32x32->64 multiply of all four lanes; SSE2 only multiplies lanes 0 and 2, so do the odd lanes separately
+  const auto mulhilo = [](const __m128i a, const __m128i m, __m128i &lo, __m128i &hi) {
+    const __m128i even = _mm_mul_epu32(a, m);
+    const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);
+    lo = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+    hi = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 3, 1)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 3, 1)));
+  };
+  for (int round = 0; round < 10; ++round) {
+    __m128i lo0, hi0, lo1, hi1;
+    mulhilo(c0, m0, lo0, hi0);
+    mulhilo(c2, m1, lo1, hi1);
+    const __m128i n0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), _mm_set1_epi32(static_cast<int>(k0)));
+    const __m128i n2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), _mm_set1_epi32(static_cast<int>(k1)));
+    c1 = lo1;
+    c3 = lo0;
+    c0 = n0;
+    c2 = n2;
+    k0 += philox_w0;
+    k1 += philox_w1;
+  }
+}
+#endif
+
+// maps the top 24 bits of a random word to a float in [0, 1)
+inline float u32_to_unit(const uint32_t x) { return static_cast<float>(x >> 8) * (1.0f / 16777216.0f); }
+
+// four uniforms in [0, 1) for one (stream, counter) pair
+inline void philox_uniform4(const uint64_t seed, const uint64_t stream, const uint64_t counter, float out[4]) {
+  const uint32_t ctr[4] = {static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32), static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32)};
+  uint32_t r[4];
+  philox4x32(ctr, static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32), r);
+  for (int i = 0; i < 4; ++i) out[i] = u32_to_unit(r[i]);
+}
+
+// fills out[0..n) with uniforms in [0, 1) taken from counters first_counter, first_counter + 1, ... of one stream.
+// Same result with or without SSE2; the vector path just runs four counters per iteration.
+inline void philox_fill_uniform(const uint64_t seed, const uint64_t stream, const uint64_t first_counter, float *out, const size_t n) {
+  const auto k0 = static_cast<uint32_t>(seed);
+  const auto k1 = static_cast<uint32_t>(seed >> 32);
+  size_t i = 0;
+  uint64_t counter = first_counter;
+#if WORKLOAD_SSE2
+  // each block of 16 outputs consumes four consecutive counters
+  const __m128i s_lo = _mm_set1_epi32(static_cast<int>(static_cast<uint32_t>(stream)));
+  const __m128i s_hi = _mm_set1_epi32(static_cast<int>(static_cast<uint32_t>(stream >> 32)));
+  const __m128 scale = _mm_set1_ps(1.0f / 16777216.0f);
+  for (; i + 16 <= n; i += 16, counter += 4) {
+    alignas(16) uint32_t lo[4], hi[4];
+    for (int l = 0; l < 4; ++l) {
+      lo[l] = static_cast<uint32_t>(counter + l);
+      hi[l] = static_cast<uint32_t>((counter + l) >> 32);
+    }
+    __m128i c0 = _mm_load_si128(reinterpret_cast<const __m128i *>(lo));
+    __m128i c1 = _mm_load_si128(reinterpret_cast<const __m128i *>(hi));
+    __m128i c2 = s_lo;
+    __m128i c3 = s_hi;
+    philox4x32_x4(c0, c1, c2, c3, k0, k1);
+    // transpose so that out[] matches the scalar order (counter-major, word-minor)
+    const __m128i t0 = _mm_unpacklo_epi32(c0, c1);
+    const __m128i t1 = _mm_unpacklo_epi32(c2, c3);
+    const __m128i t2 = _mm_unpackhi_epi32(c0, c1);
+    const __m128i t3 = _mm_unpackhi_epi32(c2, c3);
+    const __m128i r[4] = {_mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1), _mm_unpacklo_epi64(t2, t3), _mm_unpackhi_epi64(t2, t3)};
+    for (int l = 0; l < 4; ++l) _mm_storeu_ps(out + i + 4 * l, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(r[l], 8)), scale));
+  }
+#endif
+  for (; i < n; i += 4, ++counter) {
+    float r[4];
+    philox_uniform4(seed, stream, counter, r);
+    for (size_t l = 0; l < 4 && i + l < n; ++l) out[i + l] = r[l];
+  }
+}
+#pragma endregion
+
+#pragma region profile
+// every generated field of FusionData gets a channel; smooth channels come first
+enum workload_channel {
+  k_endoscope_pos_x,
+  k_endoscope_pos_y,
+  k_endoscope_pos_z,
+  k_endoscope_euler_x,
+  k_endoscope_euler_y,
+  k_endoscope_euler_z,
+  k_tube_pos_x,
+  k_tube_pos_y,
+  k_tube_pos_z,
+  k_tube_euler_x,
+  k_tube_euler_y,
+  k_tube_euler_z,
+  k_rongeur_pos_x,
+  k_rongeur_pos_y,
+  k_rongeur_pos_z,
+  k_rongeur_rot_x,
+  k_rongeur_rot_y,
+  k_rongeur_rot_z,
+  k_animation_value,
+  k_smooth_channel_count,
+  k_tissue_first = k_smooth_channel_count,
+  k_tissue_last = k_tissue_first + 8,
+  k_haptic_state,
+  k_haptic_offset,
+  k_haptic_force,
+  k_ablation_count,
+  k_hemostasis_count,
+  k_hemostasis_index,
+  k_nerve_root_dance,
+  k_channel_count
+};
+
+constexpr int tissue_count = k_tissue_last - k_tissue_first + 1;
+
+inline const char *workload_channel_name(const int channel) {
+  static const char *names[k_smooth_channel_count] = {
+      "endoscope_pos.x", "endoscope_pos.y", "endoscope_pos.z", "endoscope_euler.x", "endoscope_euler.y", "endoscope_euler.z",
+      "tube_pos.x", "tube_pos.y", "tube_pos.z", "tube_euler.x", "tube_euler.y", "tube_euler.z",
+      "rongeur_pos.x", "rongeur_pos.y", "rongeur_pos.z", "rongeur_rot.x", "rongeur_rot.y", "rongeur_rot.z",
+      "animation_value"};
+  return channel >= 0 && channel < k_smooth_channel_count ? names[channel] : "";
+}
+
+// a smooth channel wanders inside [min, max], passing through a new random knot every `period` seconds
+struct TrajectoryProfile {
+  float min = 0.0f;
+  float max = 1.0f;
+  float period = 2.0f;
+  float jitter = 0.0f;// white noise amplitude added on top of the smooth path
+};
+
+struct WorkloadProfile {
+  uint64_t seed = 0x5EED;
+  float sample_rate = 1000.0f;// samples per simulated second; sample k sits at t = k / sample_rate
+
+  TrajectoryProfile trajectory[k_smooth_channel_count];
+
+  // tissue: the time line is cut into slots, each slot may flip a structure to a random level
+  float tissue_slot = 1.0f;
+  float tissue_change_probability = 0.05f;
+  int tissue_levels = 3;
+
+  // haptic: a slot with an event renders a half-sine force pulse of peak `haptic_peak_force`
+  float haptic_slot = 0.5f;
+  float haptic_event_probability = 0.2f;
+  float haptic_idle_state = 0.0f;
+  float haptic_event_state = 3.0f;
+  float haptic_offset = -1.0f;
+  float haptic_peak_force = 2.0f;
+
+  float ablation_rate = 0.0f;  // ablations per second
+  float hemostasis_rate = 0.0f;// hemostasis events per second
+  int hemostasis_sites = 1;
+
+  // load driver (off unless the profile turns it on)
+  bool load_enabled = false;
+  std::string load_topic = "fusion_load";
+  float load_rate = 1000.0f;// messages per second on every topic
+  int load_fan_out = 1;     // number of topics the same stream is published on
+  int load_batch = 256;     // samples generated per refill
+
+  WorkloadProfile() {
+    // defaults reproduce the ranges of the old hard-wired uniform distributions
+    for (int c : {k_endoscope_pos_x, k_endoscope_pos_y, k_endoscope_pos_z, k_tube_pos_x, k_tube_pos_y, k_tube_pos_z, k_rongeur_pos_x, k_rongeur_pos_y, k_rongeur_pos_z}) trajectory[c] = {0.0f, 10.0f, 2.0f, 0.0f};
+    for (int c : {k_endoscope_euler_x, k_tube_euler_x, k_rongeur_rot_x}) trajectory[c] = {330.0f, 360.0f, 3.0f, 0.0f};
+    for (int c : {k_endoscope_euler_y, k_endoscope_euler_z, k_tube_euler_y, k_tube_euler_z, k_rongeur_rot_y, k_rongeur_rot_z}) trajectory[c] = {10.0f, 15.0f, 3.0f, 0.0f};
+    trajectory[k_animation_value] = {0.0f, 1.0f, 1.0f, 0.0f};
+  }
+};
+
+// applies one `key = value` assignment; group keys such as "tube_pos.min" fan out to .x/.y/.z.
+// returns false for unknown keys so the loader can report them.
+inline bool apply_workload_setting(WorkloadProfile &profile, const std::string &key, const std::string &value) {
+  const auto as_float = [&value]() { return std::stof(value); };
+  const auto as_int = [&value]() { return std::stoi(value); };
+
+  const size_t dot = key.find_last_of('.');
+  if (dot != std::string::npos) {
+    const std::string target = key.substr(0, dot);
+    const std::string field = key.substr(dot + 1);
+    bool matched = false;
+    for (int c = 0; c < k_smooth_channel_count; ++c) {
+      const std::string name = workload_channel_name(c);
+      if (name != target && name.compare(0, target.size() + 1, target + ".") != 0) continue;
+      TrajectoryProfile &t = profile.trajectory[c];
+      if (field == "min") t.min = as_float();
+      else if (field == "max") t.max = as_float();
+      else if (field == "period") t.period = as_float();
+      else if (field == "jitter") t.jitter = as_float();
+      else return false;
+      matched = true;
+    }
+    if (matched) return true;
+  }
+
+  if (key == "seed") profile.seed = std::stoull(value, nullptr, 0);
+  else if (key == "sample_rate") profile.sample_rate = as_float();
+  else if (key == "tissue.slot") profile.tissue_slot = as_float();
+  else if (key == "tissue.change_probability") profile.tissue_change_probability = as_float();
+  else if (key == "tissue.levels") profile.tissue_levels = as_int();
+  else if (key == "haptic.slot") profile.haptic_slot = as_float();
+  else if (key == "haptic.event_probability") profile.haptic_event_probability = as_float();
+  else if (key == "haptic.idle_state") profile.haptic_idle_state = as_float();
+  else if (key == "haptic.event_state") profile.haptic_event_state = as_float();
+  else if (key == "haptic.offset") profile.haptic_offset = as_float();
+  else if (key == "haptic.peak_force") profile.haptic_peak_force = as_float();
+  else if (key == "ablation.rate") profile.ablation_rate = as_float();
+  else if (key == "hemostasis.rate") profile.hemostasis_rate = as_float();
+  else if (key == "hemostasis.sites") profile.hemostasis_sites = as_int();
+  else if (key == "load.enabled") profile.load_enabled = as_int() != 0;
+  else if (key == "load.topic") profile.load_topic = value;
+  else if (key == "load.rate") profile.load_rate = as_float();
+  else if (key == "load.fan_out") profile.load_fan_out = as_int();
+  else if (key == "load.batch") profile.load_batch = as_int();
+  else return false;
+  return true;
+}
+
+// reads a profile file made of `key = value` lines ('#' starts a comment). Missing keys keep their defaults,
+// a missing file leaves the whole profile at its defaults.
+inline bool load_workload_profile(const std::string &path, WorkloadProfile &profile) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    std::cout << "WARNING::WORKLOAD:: profile not found, using defaults: " << path << std::endl;
+    return false;
+  }
+  const auto trim = [](std::string s) {
+    const size_t b = s.find_first_not_of(" \t\r");
+    const size_t e = s.find_last_not_of(" \t\r");
+    return b == std::string::npos ? std::string() : s.substr(b, e - b + 1);
+  };
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line)) {
+    ++line_number;
+    line = trim(line.substr(0, line.find('#')));
+    if (line.empty()) continue;
+    const size_t eq = line.find('=');
+    if (eq == std::string::npos) {
+      std::cout << "ERROR::WORKLOAD:: " << path << ":" << line_number << " expected key = value" << std::endl;
+      continue;
+    }
+    const std::string key = trim(line.substr(0, eq));
+    const std::string value = trim(line.substr(eq + 1));
+    try {
+      if (!apply_workload_setting(profile, key, value)) std::cout << "ERROR::WORKLOAD:: " << path << ":" << line_number << " unknown key " << key << std::endl;
+    } catch (const std::exception &) {
+      std::cout << "ERROR::WORKLOAD:: " << path << ":" << line_number << " bad value for " << key << std::endl;
+    }
+  }
+  profile.load_fan_out = std::max(profile.load_fan_out, 1);
+  profile.load_batch = std::max(profile.load_batch, 1);
+  profile.tissue_levels = std::max(profile.tissue_levels, 2);
+  profile.hemostasis_sites = std::max(profile.hemostasis_sites, 1);
+  // the generator divides by these; the minimum goes first so a nan from the file falls back to it as well
+  profile.sample_rate = std::max(1.0f, profile.sample_rate);
+  profile.tissue_slot = std::max(1e-3f, profile.tissue_slot);
+  profile.haptic_slot = std::max(1e-3f, profile.haptic_slot);
+  return true;
+}
+#pragma endregion
+
+#pragma region generator
+// SoA block of generated samples: channel[c][i] is channel c of sample first + i
+struct WorkloadBatch {
+  uint64_t first = 0;
+  size_t count = 0;
+  std::vector<float> channel[k_channel_count];
+  std::vector<float> scratch;
+
+  void resize(const size_t n) {
+    count = n;
+    for (auto &c : channel) c.resize(n);
+  }
+};
+
+class WorkloadGenerator {
+ public:
+  explicit WorkloadGenerator(const WorkloadProfile &profile = WorkloadProfile()) : profile(profile) {}
+
+  const WorkloadProfile profile;
+
+  // generates n samples into batch, sample i being stream index first + floor(i * stride). A stride above one
+  // thins the stream out (the load driver uses it to cover real time at low publish rates). The batch's storage
+  // is reused, so a warmed up batch does not allocate.
+  void generate(const uint64_t first, const size_t n, WorkloadBatch &batch, const double stride = 1.0) const {
+    batch.first = first;
+    batch.resize(n);
+    if (n == 0) return;
+    const double dt = 1.0 / profile.sample_rate;
+    const auto index = [first, stride](const size_t i) { return first + static_cast<uint64_t>(static_cast<double>(i) * stride); };
+
+    // smooth channels: Catmull-Rom through random knots. Channel-major so the four knots are only redrawn when a
+    // sample crosses into the next knot interval, which at typical rates is once every few thousand samples.
+    for (int c = 0; c < k_smooth_channel_count; ++c) {
+      const TrajectoryProfile &tp = profile.trajectory[c];
+      float *out = batch.channel[c].data();
+      const double inv_period = 1.0 / std::max(tp.period, 1e-3f);
+      int64_t cached_knot = std::numeric_limits<int64_t>::min();
+      float p0 = 0, p1 = 0, p2 = 0, p3 = 0;
+      for (size_t i = 0; i < n; ++i) {
+        const double x = static_cast<double>(index(i)) * dt * inv_period;
+        const auto knot = static_cast<int64_t>(std::floor(x));
+        if (knot != cached_knot) {
+          p0 = knot_value(c, knot - 1);
+          p1 = knot_value(c, knot);
+          p2 = knot_value(c, knot + 1);
+          p3 = knot_value(c, knot + 2);
+          cached_knot = knot;
+        }
+        out[i] = catmull_rom(p0, p1, p2, p3, static_cast<float>(x - static_cast<double>(knot)));
+      }
+      if (tp.jitter > 0.0f) {
+        // one uniform per stream index: float j of the stream is word j % 4 of counter j / 4
+        std::vector<float> &noise = batch.scratch;
+        if (stride == 1.0) {
+          const size_t skew = first & 3;
+          noise.resize(n + skew);
+          philox_fill_uniform(profile.seed, stream_jitter + c, first / 4, noise.data(), n + skew);
+          for (size_t i = 0; i < n; ++i) out[i] += tp.jitter * (2.0f * noise[i + skew] - 1.0f);
+        } else {
+          for (size_t i = 0; i < n; ++i) {
+            float r[4];
+            philox_uniform4(profile.seed, stream_jitter + c, index(i) / 4, r);
+            out[i] += tp.jitter * (2.0f * r[index(i) & 3] - 1.0f);
+          }
+        }
+      }
+      for (size_t i = 0; i < n; ++i) out[i] = std::min(std::max(out[i], tp.min), tp.max);
+    }
+
+    // discrete channels are piecewise constant per slot; the slot draws are cached like the knots above
+    constexpr int tissue_blocks = (tissue_count + 3) / 4;
+    float tissue_event[4 * tissue_blocks], tissue_level[4 * tissue_blocks], haptic_r[4];
+    uint64_t cached_tissue_slot = std::numeric_limits<uint64_t>::max();
+    uint64_t cached_haptic_slot = std::numeric_limits<uint64_t>::max();
+    for (size_t i = 0; i < n; ++i) {
+      const double t = static_cast<double>(index(i)) * dt;
+
+      const auto tissue_slot = static_cast<uint64_t>(t / profile.tissue_slot);
+      if (tissue_slot != cached_tissue_slot) {
+        for (int b = 0; b < tissue_blocks; ++b) {
+          philox_uniform4(profile.seed, stream_tissue_event + b, tissue_slot, tissue_event + 4 * b);
+          philox_uniform4(profile.seed, stream_tissue_level + b, tissue_slot, tissue_level + 4 * b);
+        }
+        cached_tissue_slot = tissue_slot;
+      }
+      for (int k = 0; k < tissue_count; ++k) {
+        float value = 1.0f;
+        if (tissue_event[k] < profile.tissue_change_probability) {
+          const int level = std::min(static_cast<int>(tissue_level[k] * static_cast<float>(profile.tissue_levels)), profile.tissue_levels - 1);
+          value = static_cast<float>(level) / static_cast<float>(profile.tissue_levels - 1);
+        }
+        batch.channel[k_tissue_first + k][i] = value;
+      }
+
+      const double haptic_x = t / profile.haptic_slot;
+      const auto haptic_slot = static_cast<uint64_t>(haptic_x);
+      if (haptic_slot != cached_haptic_slot) {
+        philox_uniform4(profile.seed, stream_haptic, haptic_slot, haptic_r);
+        cached_haptic_slot = haptic_slot;
+      }
+      const bool event = haptic_r[0] < profile.haptic_event_probability;
+      const auto phase = static_cast<float>(haptic_x - static_cast<double>(haptic_slot));
+      batch.channel[k_haptic_state][i] = event ? profile.haptic_event_state : profile.haptic_idle_state;
+      batch.channel[k_haptic_offset][i] = profile.haptic_offset;
+      batch.channel[k_haptic_force][i] = event ? profile.haptic_peak_force * (0.5f + 0.5f * haptic_r[1]) * std::sin(3.14159265f * phase) : 0.0f;
+
+      const double hemostasis = std::floor(t * profile.hemostasis_rate);
+      batch.channel[k_ablation_count][i] = static_cast<float>(std::floor(t * profile.ablation_rate));
+      batch.channel[k_hemostasis_count][i] = static_cast<float>(hemostasis);
+      batch.channel[k_hemostasis_index][i] = static_cast<float>(std::fmod(hemostasis, static_cast<double>(profile.hemostasis_sites)));
+      // the nerve root twitches while it is being worked on
+      batch.channel[k_nerve_root_dance][i] = batch.channel[k_tissue_last][i] < 1.0f && event ? 1.0f : 0.0f;
+    }
+  }
+
+  // sample index for a point in time, for callers that pace themselves (e.g. the render loop)
+  uint64_t sample_index(const double seconds) const { return static_cast<uint64_t>(std::max(seconds, 0.0) * profile.sample_rate); }
+
+ private:
+  // Philox streams; smooth channels use stream_knot + channel and stream_jitter + channel
+  static constexpr uint64_t stream_knot = 0x100;
+  static constexpr uint64_t stream_jitter = 0x200;
+  static constexpr uint64_t stream_tissue_event = 0x300;
+  static constexpr uint64_t stream_tissue_level = 0x380;
+  static constexpr uint64_t stream_haptic = 0x400;
+
+  float knot_value(const int channel, const int64_t knot) const {
+    float r[4];
+    philox_uniform4(profile.seed, stream_knot + channel, static_cast<uint64_t>(knot), r);
+    const TrajectoryProfile &tp = profile.trajectory[channel];
+    return tp.min + (tp.max - tp.min) * r[0];
+  }
+
+  static float catmull_rom(const float p0, const float p1, const float p2, const float p3, const float t) {
+    const float t2 = t * t;
+    const float t3 = t2 * t;
+    return 0.5f * (2.0f * p1 + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+  }
+};
+
+// copies sample i of a batch into the dynamic fields of a FusionData; configuration fields are left untouched
+inline void apply_workload_sample(const WorkloadBatch &batch, const size_t i, pb::FusionData::FusionData &fusion) {
+  const auto ch = [&batch, i](const int c) { return batch.channel[c][i]; };
+
+  fusion.mutable_endoscope_pos()->set_x(ch(k_endoscope_pos_x));
+  fusion.mutable_endoscope_pos()->set_y(ch(k_endoscope_pos_y));
+  fusion.mutable_endoscope_pos()->set_z(ch(k_endoscope_pos_z));
+  fusion.mutable_endoscope_euler()->set_x(ch(k_endoscope_euler_x));
+  fusion.mutable_endoscope_euler()->set_y(ch(k_endoscope_euler_y));
+  fusion.mutable_endoscope_euler()->set_z(ch(k_endoscope_euler_z));
+
+  fusion.mutable_tube_pos()->set_x(ch(k_tube_pos_x));
+  fusion.mutable_tube_pos()->set_y(ch(k_tube_pos_y));
+  fusion.mutable_tube_pos()->set_z(ch(k_tube_pos_z));
+  fusion.mutable_tube_euler()->set_x(ch(k_tube_euler_x));
+  fusion.mutable_tube_euler()->set_y(ch(k_tube_euler_y));
+  fusion.mutable_tube_euler()->set_z(ch(k_tube_euler_z));
+
+  fusion.mutable_rongeur_pos()->set_x(ch(k_rongeur_pos_x));
+  fusion.mutable_rongeur_pos()->set_y(ch(k_rongeur_pos_y));
+  fusion.mutable_rongeur_pos()->set_z(ch(k_rongeur_pos_z));
+  fusion.mutable_rongeur_rot()->set_x(ch(k_rongeur_rot_x));
+  fusion.mutable_rongeur_rot()->set_y(ch(k_rongeur_rot_y));
+  fusion.mutable_rongeur_rot()->set_z(ch(k_rongeur_rot_z));
+
+  fusion.mutable_offset()->set_animation_value(ch(k_animation_value));
+
+  fusion.mutable_haptic()->set_haptic_state(ch(k_haptic_state));
+  fusion.mutable_haptic()->set_haptic_offset(ch(k_haptic_offset));
+  fusion.mutable_haptic()->set_haptic_force(ch(k_haptic_force));
+
+  pb::Tissue::Tissue *tissue = fusion.mutable_soft_tissue();
+  tissue->set_liga_flavum(ch(k_tissue_first + 0));
+  tissue->set_disc_yellow_space(ch(k_tissue_first + 1));
+  tissue->set_veutro_vessel(ch(k_tissue_first + 2));
+  tissue->set_fat(ch(k_tissue_first + 3));
+  tissue->set_fibrous_rings(ch(k_tissue_first + 4));
+  tissue->set_nucleus_pulposus(ch(k_tissue_first + 5));
+  tissue->set_p_longitudinal_liga(ch(k_tissue_first + 6));
+  tissue->set_dura_mater(ch(k_tissue_first + 7));
+  tissue->set_nerve_root(ch(k_tissue_first + 8));
+
+  fusion.set_ablation_count(ch(k_ablation_count));
+  fusion.set_hemostasis_count(ch(k_hemostasis_count));
+  fusion.set_hemostasis_index(ch(k_hemostasis_index));
+  fusion.set_nerve_root_dance(ch(k_nerve_root_dance));
+}
+#pragma endregion
+
+#pragma region load driver
+// Publishes the generated stream on `load_fan_out` topics at `load_rate` messages per second from its own thread.
+// Every message is serialized once and sent to all topics. Pacing is by due count rather than by sleeping per
+// message, so rates above the OS timer resolution still average out correctly.
+class WorkloadDriver {
+ public:
+  explicit WorkloadDriver(const WorkloadProfile &profile) : generator(profile) {
+    const int fan_out = std::max(profile.load_fan_out, 1);
+    for (int i = 0; i < fan_out; ++i) {
+      const std::string topic = fan_out == 1 ? profile.load_topic : profile.load_topic + "_" + std::to_string(i);
+      publishers.push_back(std::make_unique<eCAL::CPublisher>(topic));
+    }
+  }
+  ~WorkloadDriver() { stop(); }
+  WorkloadDriver(const WorkloadDriver &) = delete;
+  WorkloadDriver &operator=(const WorkloadDriver &) = delete;
+
+  void start() {
+    if (running.exchange(true)) return;
+    worker = std::thread([this] { run(); });
+  }
+
+  void stop() {
+    running = false;
+    if (worker.joinable()) worker.join();
+  }
+
+  // counters, readable from any thread
+  std::atomic<uint64_t> samples_sent{0};
+  std::atomic<uint64_t> bytes_sent{0};
+  std::atomic<uint64_t> send_failures{0};
+
+ private:
+  WorkloadGenerator generator;
+  std::vector<std::unique_ptr<eCAL::CPublisher>> publishers;
+  std::atomic<bool> running{false};
+  std::thread worker;
+
+  void run() {
+    using clock = std::chrono::steady_clock;
+    const WorkloadProfile &profile = generator.profile;
+    const auto batch_size = static_cast<size_t>(profile.load_batch);
+    const double rate = std::max(profile.load_rate, 1.0f);
+    // the generator's time axis runs at sample_rate; stride through it so the published stream covers real time
+    const double stride = profile.sample_rate / rate;
+
+    WorkloadBatch batch;
+    pb::FusionData::FusionData message;
+    std::vector<uint8_t> buffer;
+    uint64_t next = 0;
+    size_t cursor = batch_size;
+    const clock::time_point start = clock::now();
+    TRACE_THREAD_NAME("workload driver");
+
+    while (running) {
+      const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+      const auto due = static_cast<uint64_t>(elapsed * rate);
+      if (next >= due) {
+        std::this_thread::sleep_for(std::chrono::microseconds(std::max(1, static_cast<int>(1e6 / rate / 2))));
+        continue;
+      }
+      // when we fall more than a batch behind (debugger, overloaded host) skip ahead instead of bursting
+      if (due - next > batch_size) {
+        next = due - batch_size;
+        cursor = batch_size;
+      }
+      TRACE_ZONE("workload publish");
+      TRACE_COUNTER("workload backlog", due - next);
+      for (; next < due && running; ++next) {
+        if (cursor >= batch.count) {
+          // one generator sample per published message, stride apart on the generator's time axis
+          generator.generate(static_cast<uint64_t>(static_cast<double>(next) * stride), batch_size, batch, stride);
+          cursor = 0;
+        }
+        apply_workload_sample(batch, cursor++, message);
+        const size_t size = message.ByteSizeLong();
+        if (buffer.size() < size) buffer.resize(size * 2);
+        message.SerializePartialToArray(buffer.data(), static_cast<int>(size));
+        for (const auto &publisher : publishers) {
+          if (publisher->Send(buffer.data(), size) != size) send_failures.fetch_add(1, std::memory_order_relaxed);
+        }
+        samples_sent.fetch_add(1, std::memory_order_relaxed);
+        bytes_sent.fetch_add(size * publishers.size(), std::memory_order_relaxed);
+      }
+    }
+  }
+
+};
+#pragma endregion
+
+#endif
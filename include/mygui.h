@@ -1,6 +1,24 @@
 ﻿#pragma once
 #include "imgui.h"
 
+#include <AllocTracker.h>
+#include <FrameArena.h>
+#include <FrameScheduler.h>
+#include <FrameStream.h>
+#include <HapticServo.h>
+#include <OcclusionCuller.h>
+#include <Profiler.h>
+#include <RenderGraph.h>
+#include <RenderViews.h>
+#include <ResourceRegistry.h>
+#include <SoftTissue.h>
+#include <SparseSdf.h>
+#include <TextureCache.h>
+#include <Trace.h>
+#include <Wireframe.h>
+
+#include <algorithm>
+#include <functional>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -12,12 +30,12 @@ inline void draw_gui() {
   ImGui::Begin(u8"Debug Window");// u8 for chinese,but do not make sense
 
   for (size_t i = 0; i < 5; ++i) {
-    ImGui::Button(std::to_string(i).c_str());
+    ImGui::Button(frame_format("%zu", i));
     if (i < 5) {
       ImGui::SameLine();
     }
     if (ImGui::BeginDragDropSource()) {
-      ImGui::Text(std::string("Darg: ").append(std::to_string(i).c_str()).c_str());
+      ImGui::Text("Darg: %zu", i);
       ImGui::SetDragDropPayload("DragIndexButton", &i, sizeof(int));
       ImGui::EndDragDropSource();
     }
@@ -40,7 +58,7 @@ inline void draw_gui() {
   for (size_t i = 0; i < drag_list.size(); ++i) {
     //ImGui::Button(std::to_string(drag_list.at(i)).c_str());
 
-    if (ImGui::Button(std::to_string(drag_list.at(i)).c_str())) {
+    if (ImGui::Button(frame_format("%d", drag_list.at(i)))) {
       drag_list.erase(drag_list.begin() + i);
     }
 
@@ -51,3 +69,288 @@ inline void draw_gui() {
 
   ImGui::End();
 }
+
+// servo timing: tick count, deadline misses and the lateness histogram
+inline void draw_haptic_servo_stats(const HapticServoStats &stats) {
+  ImGui::Begin("Haptic Servo");
+  ImGui::Text("ticks %llu  misses %llu  skipped %llu", static_cast<unsigned long long>(stats.ticks), static_cast<unsigned long long>(stats.deadline_misses), static_cast<unsigned long long>(stats.skipped_ticks));
+  ImGui::Text("lateness mean %.1f us  max %.1f us", stats.mean_lateness_us, stats.max_lateness_us);
+  ImGui::Text("step max %.1f us", stats.max_step_us);
+  ImGui::Text("affinity %s  rt priority %s", stats.affinity_applied ? "yes" : "no", stats.priority_applied ? "yes" : "no");
+  float histogram[haptic_latency_buckets];
+  float total = 0.0f;
+  for (const uint64_t count : stats.latency_histogram) total += static_cast<float>(count);
+  for (int i = 0; i < haptic_latency_buckets; ++i) histogram[i] = total > 0.0f ? static_cast<float>(stats.latency_histogram[i]) / total : 0.0f;
+  ImGui::PlotHistogram("lateness", histogram, haptic_latency_buckets, 0, "<10 <50 <100 <250 <500 <1000 >1000 us", 0.0f, 1.0f, ImVec2(0, 80));
+  ImGui::End();
+}
+
+inline void draw_tissue_stats(const TissueSolverStats &stats, const TissueState &state) {
+  ImGui::Begin("Soft Tissue");
+  ImGui::Text("step %.3f ms  substeps %d (%.3f ms each)  threads %d", stats.step_ms, stats.substeps, stats.substep_ms, stats.threads);
+  ImGui::Text("particles %zu  distance %zu / %zu colors  volume %zu / %zu colors", stats.particles, stats.distance_constraints, stats.distance_colors, stats.volume_constraints, stats.volume_colors);
+  ImGui::Text("budget overruns %d  nerve root %s", stats.budget_overruns, state.nerve_root_disturbed ? "disturbed" : "calm");
+  for (int k = 0; k < k_tissue_kind_count; ++k) {
+    ImGui::ProgressBar(state.integrity[k], ImVec2(120, 0));
+    ImGui::SameLine();
+    ImGui::Text("%-20s strain %.2f  moved %.2f", tissue_name(k), state.max_strain[k], state.max_displacement[k]);
+  }
+  ImGui::End();
+}
+
+inline void draw_bone_removal_stats(const SdfEditStats &edit, const SdfMeshStats &mesh, const size_t bricks, const size_t cpu_bytes, const size_t gpu_bytes) {
+  ImGui::Begin("Bone Removal");
+  ImGui::Text("last cut %.3f ms  bricks touched %d (+%d -%d)  removed %.4f", edit.edit_ms, edit.bricks_touched, edit.bricks_allocated, edit.bricks_freed, edit.removed_volume);
+  ImGui::Text("remesh %.3f ms  bricks %d  triangles %zu", mesh.mesh_ms, mesh.bricks_meshed, mesh.triangles);
+  ImGui::Text("surface bricks %zu  memory %.1f MB  vertex buffer %.1f MB", bricks, static_cast<double>(cpu_bytes) / (1024.0 * 1024.0), static_cast<double>(gpu_bytes) / (1024.0 * 1024.0));
+  ImGui::End();
+}
+
+inline void draw_occlusion_stats(const OcclusionStats &stats) {
+  ImGui::Begin("Occlusion");
+  ImGui::Text("occluder triangles %zu  raster %.3f ms", stats.occluder_triangles, stats.raster_ms);
+  ImGui::Text("culled %zu of %zu boxes", stats.culled, stats.tested);
+  ImGui::End();
+}
+
+inline void draw_frame_scheduler_stats(const FrameSchedulerStats &stats) {
+  ImGui::Begin("Frames");
+  ImGui::Text("loop %zu  3D passes %zu  UI frames %zu  idle waits %zu", stats.iterations, stats.scene_passes, stats.ui_frames, stats.idle_waits);
+  ImGui::End();
+}
+
+inline void draw_frame_stream_stats(const FrameStreamStats &stats) {
+  ImGui::Begin("Frame stream");
+  ImGui::Text("captured %llu  sent %llu  ring full %llu  send failures %llu", static_cast<unsigned long long>(stats.captured), static_cast<unsigned long long>(stats.sent), static_cast<unsigned long long>(stats.ring_full), static_cast<unsigned long long>(stats.send_failures));
+  ImGui::Text("%.1f fps  encode %.2f ms  ratio %.1f  render thread %.3f ms", stats.fps, stats.encode_ms, stats.compression, stats.render_thread_ms);
+  ImGui::End();
+}
+
+inline void draw_resolution_stats(const int panel_width, const int panel_height, const int render_width, const int render_height, const float gpu_ms, const size_t allocations) {
+  ImGui::Begin("Resolution");
+  ImGui::Text("panel %dx%d  3D pass %dx%d (%.0f%%)", panel_width, panel_height, render_width, render_height, 100.0f * static_cast<float>(render_width) / static_cast<float>(panel_width));
+  ImGui::Text("3D pass %.2f ms on the GPU  target allocations %zu", gpu_ms, allocations);
+  ImGui::End();
+}
+
+inline void draw_render_graph_stats(const RenderGraphStats &stats) {
+  ImGui::Begin("Render graph");
+  ImGui::Text("passes %zu (%zu culled)  images %zu on %zu allocations", stats.passes, stats.culled_passes, stats.images, stats.physical_images);
+  ImGui::Text("%.1f MB, %.1f MB without aliasing  GL allocations %zu", static_cast<double>(stats.allocated_bytes) / 1e6, static_cast<double>(stats.unaliased_bytes) / 1e6, stats.allocations);
+  ImGui::End();
+}
+
+inline void draw_render_view_stats(const std::vector<RenderView> &views, const size_t queue_items) {
+  ImGui::Begin("Views");
+  ImGui::Text("draw queue %zu items, built once for %zu views", queue_items, views.size());
+  for (const RenderView &view : views) {
+    if (view.active) ImGui::Text("%-10s %dx%d  %zu draws", view.name.c_str(), view.width, view.height, view.draws);
+    else ImGui::Text("%-10s not shown", view.name.c_str());
+  }
+  ImGui::End();
+}
+
+inline void draw_meshlet_stats(const size_t drawn, const size_t total) {
+  ImGui::Begin("Meshlets");
+  ImGui::Text("drawn %zu of %zu meshlets", drawn, total);
+  ImGui::End();
+}
+
+inline void draw_wireframe_stats(const WireframeStats &stats) {
+  ImGui::Begin("Wireframe");
+  ImGui::Text("edge lines %zu  (polygon mode would outline %zu)", stats.lines, stats.triangle_edges);
+  ImGui::End();
+}
+
+// the last frame's heap traffic by thread and by site (innermost zone), most allocating sites first
+inline void draw_alloc_stats(const AllocTracker &tracker) {
+  ImGui::Begin("Allocations");
+  const AllocCount &frame = tracker.last_frame();
+  ImGui::Text("last frame %llu allocations, %llu frees, %.1f KB", static_cast<unsigned long long>(frame.allocations), static_cast<unsigned long long>(frame.frees), static_cast<double>(frame.bytes) / 1024.0);
+  ImGui::Text("frames allocating %zu of %zu  peak %llu allocations", tracker.allocating_frames(), tracker.frame_count(), static_cast<unsigned long long>(tracker.peak_frame_allocations()));
+  for (const AllocThreadStats &thread : tracker.last_frame_threads()) {
+    if (thread.name) ImGui::Text("%-22s %6llu allocs %6llu frees", thread.name, static_cast<unsigned long long>(thread.count.allocations), static_cast<unsigned long long>(thread.count.frees));
+    else ImGui::Text("thread %-15u %6llu allocs %6llu frees", thread.id, static_cast<unsigned long long>(thread.count.allocations), static_cast<unsigned long long>(thread.count.frees));
+  }
+  if (ImGui::BeginTable("sites", 3, ImGuiTableFlags_RowBg)) {
+    ImGui::TableSetupColumn("site");
+    ImGui::TableSetupColumn("allocs");
+    ImGui::TableSetupColumn("bytes");
+    ImGui::TableHeadersRow();
+    for (const AllocSiteStats &site : tracker.last_frame_sites()) {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(site.site);
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu", static_cast<unsigned long long>(site.count.allocations));
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu", static_cast<unsigned long long>(site.count.bytes));
+    }
+    ImGui::EndTable();
+  }
+  ImGui::End();
+}
+
+inline void draw_frame_arena_stats(const FrameArenaStats &stats) {
+  ImGui::Begin("Frame arena");
+  ImGui::Text("last frame %.1f KB on %zu threads  high water %.1f KB", static_cast<double>(stats.last_frame_bytes) / 1024.0, stats.threads, static_cast<double>(stats.high_water_bytes) / 1024.0);
+  ImGui::Text("capacity %.1f KB  overflow blocks %zu", static_cast<double>(stats.capacity_bytes) / 1024.0, stats.overflows);
+  ImGui::End();
+}
+
+// GPU and CPU memory by kind against the budgets, then every live resource; click a header to sort (largest first
+// by default)
+inline void draw_memory_browser(const ResourceRegistry &registry) {
+  ImGui::Begin("Memory");
+  const ResourceTotals &totals = registry.totals();
+  const double mb = 1024.0 * 1024.0;
+  const auto side = [mb](const char *label, const size_t used, const size_t budget, const bool over) {
+    if (budget > 0) ImGui::TextColored(over ? ImVec4(0.8f, 0.1f, 0.1f, 1.0f) : ImGui::GetStyleColorVec4(ImGuiCol_Text), "%s %.1f MB of %.0f MB", label, static_cast<double>(used) / mb, static_cast<double>(budget) / mb);
+    else ImGui::Text("%s %.1f MB", label, static_cast<double>(used) / mb);
+  };
+  side("GPU", totals.gpu_bytes, registry.gpu_budget_bytes(), registry.over_gpu_budget());
+  ImGui::SameLine();
+  side("  CPU", totals.cpu_bytes, registry.cpu_budget_bytes(), registry.over_cpu_budget());
+  for (const resource_kind kind : {k_resource_buffer, k_resource_texture, k_resource_renderbuffer, k_resource_cpu})
+    ImGui::Text("%-13s %5zu  %9.2f MB", resource_kind_name(kind), totals.count[kind], static_cast<double>(totals.bytes[kind]) / mb);
+
+  const std::vector<ResourceRecord> &records = registry.records();
+  // the row order persists; it is rebuilt only when the sort specs or the records change
+  static std::vector<size_t> rows;
+  static uint64_t rows_version = ~uint64_t(0);
+  const ImGuiTableFlags flags = ImGuiTableFlags_RowBg | ImGuiTableFlags_Sortable | ImGuiTableFlags_ScrollY | ImGuiTableFlags_SizingStretchProp;
+  if (ImGui::BeginTable("resources", 5, flags)) {
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("kind");
+    ImGui::TableSetupColumn("owner");
+    ImGui::TableSetupColumn("format");
+    ImGui::TableSetupColumn("KB", ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_PreferSortDescending);
+    ImGui::TableSetupColumn("age s");
+    ImGui::TableHeadersRow();
+    ImGuiTableSortSpecs *specs = ImGui::TableGetSortSpecs();
+    if (rows_version != registry.version() || (specs && specs->SpecsDirty)) {
+      rows.clear();
+      for (size_t i = 0; i < records.size(); ++i)
+        if (records[i].live) rows.push_back(i);
+      if (specs && specs->SpecsCount > 0) {
+        const int column = specs->Specs[0].ColumnIndex;
+        const bool descending = specs->Specs[0].SortDirection == ImGuiSortDirection_Descending;
+        // ties go by record index, so std::sort gives a stable order without stable_sort's buffer
+        std::sort(rows.begin(), rows.end(), [&](const size_t a, const size_t b) {
+          const ResourceRecord &x = records[a], &y = records[b];
+          int order;
+          switch (column) {
+            case 0: order = (x.kind > y.kind) - (x.kind < y.kind); break;
+            case 1: order = x.owner.compare(y.owner); break;
+            case 2: order = x.format.compare(y.format); break;
+            case 3: order = (x.bytes > y.bytes) - (x.bytes < y.bytes); break;
+            default: order = (x.created < y.created) - (x.created > y.created);// age: newest first when ascending
+          }
+          if (descending) order = -order;
+          return order != 0 ? order < 0 : a < b;
+        });
+      }
+      if (specs) specs->SpecsDirty = false;
+      rows_version = registry.version();
+    }
+    const double now = registry.now();
+    for (const size_t i : rows) {
+      const ResourceRecord &record = records[i];
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(resource_kind_name(record.kind));
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(record.owner.c_str());
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(record.format.c_str());
+      ImGui::TableNextColumn();
+      ImGui::Text("%.1f", static_cast<double>(record.bytes) / 1024.0);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.0f", now - record.created);
+    }
+    ImGui::EndTable();
+  }
+  ImGui::End();
+}
+
+// shared textures: how many are referenced or still loading, what the unreferenced ones still hold, the
+// streaming memory, and how lookups were served
+inline void draw_texture_cache_stats(const TextureCacheStats &stats) {
+  ImGui::Begin("Texture cache");
+  ImGui::Text("%zu textures, %zu referenced  %.1f MB, %.1f MB unreferenced", stats.entries, stats.referenced, static_cast<double>(stats.gpu_bytes) / (1024.0 * 1024.0), static_cast<double>(stats.unreferenced_bytes) / (1024.0 * 1024.0));
+  ImGui::Text("loading %zu  staging %.1f MB  uploaded last frame %.1f KB", stats.loading, static_cast<double>(stats.staging_bytes) / (1024.0 * 1024.0), static_cast<double>(stats.uploaded_bytes) / 1024.0);
+  ImGui::Text("loads %zu  path hits %zu  same content %zu  evicted %zu  failed %zu", stats.loads, stats.path_hits, stats.content_hits, stats.evictions, stats.failures);
+  ImGui::End();
+}
+
+// ring fill per thread and the last dump; returns true when "Write trace" was pressed
+inline bool draw_trace_controls(const TraceStats &stats, const char *last_path, const long last_events) {
+  ImGui::Begin("Trace");
+  ImGui::Text("%zu threads  %llu events recorded, %llu overwritten", stats.threads, static_cast<unsigned long long>(stats.events), static_cast<unsigned long long>(stats.overwritten));
+  const bool pressed = ImGui::Button("Write trace");
+  if (last_events >= 0) ImGui::Text("last: %ld events to %s", last_events, last_path);
+  ImGui::End();
+  return pressed;
+}
+
+#if PROFILE_ENABLED
+// the last frame's zones as a timeline, CPU rows above GPU rows (one row per nesting level), then each zone's
+// rolling percentiles; hover a bar for its name and time
+inline void draw_profiler(const Profiler &profiler) {
+  ImGui::Begin("Profiler");
+  const ProfileSummary frame = profiler.frame_summary();
+  ImGui::Text("frame %.2f ms  p50 %.2f  p95 %.2f  p99 %.2f  max %.2f", frame.last_ms, frame.p50_ms, frame.p95_ms, frame.p99_ms, frame.max_ms);
+  ImGui::Text("GPU frames dropped (queries not ready in time) %zu", profiler.gpu_frames_dropped());
+
+  const std::vector<ProfileZone> &cpu = profiler.last_cpu_frame(), &gpu = profiler.last_gpu_frame();
+  int cpu_rows = 0, gpu_rows = 0;
+  double span = frame.last_ms;
+  for (const ProfileZone &zone : cpu) cpu_rows = std::max(cpu_rows, zone.depth + 1);
+  for (const ProfileZone &zone : gpu) {
+    gpu_rows = std::max(gpu_rows, zone.depth + 1);
+    span = std::max(span, zone.end_ms);
+  }
+  ImDrawList *draw_list = ImGui::GetWindowDrawList();
+  const ImVec2 origin = ImGui::GetCursorScreenPos();
+  const float width = std::max(ImGui::GetContentRegionAvail().x, 1.0f), row = ImGui::GetTextLineHeightWithSpacing();
+  const float scale = span > 0.0 ? width / static_cast<float>(span) : 0.0f;
+  const auto bars = [&](const std::vector<ProfileZone> &zones, const float top) {
+    for (const ProfileZone &zone : zones) {
+      const ImVec2 a(origin.x + static_cast<float>(zone.begin_ms) * scale, top + static_cast<float>(zone.depth) * row);
+      const ImVec2 b(std::max(a.x + 1.0f, origin.x + static_cast<float>(zone.end_ms) * scale), a.y + row - 1.0f);
+      // hue from the literal's address (stable per zone, no string to build), scrambled so neighbours differ
+      const auto key = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(zone.name) * 2654435761u);
+      const float hue = static_cast<float>((key >> 16) % 360) / 360.0f;
+      draw_list->AddRectFilled(a, b, ImColor::HSV(hue, 0.35f, 0.9f));
+      draw_list->PushClipRect(a, b, true);
+      draw_list->AddText(ImVec2(a.x + 2.0f, a.y), IM_COL32(0, 0, 0, 255), zone.name);
+      draw_list->PopClipRect();
+      if (ImGui::IsMouseHoveringRect(a, b)) ImGui::SetTooltip("%s %.3f ms", zone.name, zone.end_ms - zone.begin_ms);
+    }
+  };
+  bars(cpu, origin.y);
+  const float gpu_top = origin.y + static_cast<float>(cpu_rows) * row + row * 0.5f;
+  bars(gpu, gpu_top);
+  ImGui::Dummy(ImVec2(width, gpu_top - origin.y + static_cast<float>(gpu_rows) * row));
+
+  if (ImGui::BeginTable("zones", 6, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp)) {
+    for (const char *header : {"zone ms", "last", "p50", "p95", "p99", "max"}) ImGui::TableSetupColumn(header);
+    ImGui::TableHeadersRow();
+    const auto rows = [](const std::vector<ProfileSummary> &summaries, const char *prefix) {
+      for (const ProfileSummary &s : summaries) {
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::Text("%s%s", prefix, s.name.c_str());
+        for (const double value : {s.last_ms, s.p50_ms, s.p95_ms, s.p99_ms, s.max_ms}) {
+          ImGui::TableNextColumn();
+          ImGui::Text("%.3f", value);
+        }
+      }
+    };
+    rows(profiler.cpu_summaries(), "");
+    rows(profiler.gpu_summaries(), "gpu ");
+    ImGui::EndTable();
+  }
+  ImGui::End();
+}
+#endif
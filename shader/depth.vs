@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 model;
+
+// per view, from RenderViews.h
+layout (std140) uniform ViewUniforms
+{
+    mat4 projection;
+    mat4 view;
+    vec4 eye;
+};
+
+void main()
+{
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
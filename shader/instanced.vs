@@ -0,0 +1,27 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 7) in mat4 aInstanceWorld;
+layout (location = 11) in vec4 aInstanceTint;
+
+out vec2 TexCoords;
+out vec4 Tint;
+
+// model is the mesh transform inside the model, the instance world places the copy
+uniform mat4 model;
+
+// per view, from RenderViews.h
+layout (std140) uniform ViewUniforms
+{
+    mat4 projection;
+    mat4 view;
+    vec4 eye;
+};
+
+void main()
+{
+    TexCoords = aTexCoords;
+    Tint = aInstanceTint;
+    gl_Position = projection * view * aInstanceWorld * model * vec4(aPos, 1.0);
+}
@@ -6,8 +6,14 @@ layout (location = 2) in vec2 aTexCoords;
 out vec2 TexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// per view, from RenderViews.h
+layout (std140) uniform ViewUniforms
+{
+    mat4 projection;
+    mat4 view;
+    vec4 eye;
+};
 
 void main()
 {
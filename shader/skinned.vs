@@ -0,0 +1,44 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in ivec4 aBoneIds;
+layout (location = 6) in vec4 aWeights;
+
+const int MAX_BONES = 100;
+const int MAX_BONE_INFLUENCE = 4;
+
+// palette written by Skinning.h, one mat4 per bone
+layout (std140) uniform BonePalette
+{
+    mat4 bones[MAX_BONES];
+};
+
+out vec2 TexCoords;
+
+uniform mat4 model;
+
+// per view, from RenderViews.h
+layout (std140) uniform ViewUniforms
+{
+    mat4 projection;
+    mat4 view;
+    vec4 eye;
+};
+
+void main()
+{
+    mat4 skin = mat4(0.0);
+    float total = 0.0;
+    for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+    {
+        if (aBoneIds[i] < 0 || aBoneIds[i] >= MAX_BONES)
+            continue;
+        skin += bones[aBoneIds[i]] * aWeights[i];
+        total += aWeights[i];
+    }
+    // vertices without bones keep their rest position
+    vec4 position = total > 0.0 ? (skin / total) * vec4(aPos, 1.0) : vec4(aPos, 1.0);
+    TexCoords = aTexCoords;
+    gl_Position = projection * view * model * position;
+}
@@ -0,0 +1,27 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// reduced render in the lower left corner of its texture
+uniform sampler2D source;
+uniform vec2 uv_extent;
+// one source texel in texture coordinates
+uniform vec2 texel;
+// 0 plain bilinear, 1 strong
+uniform float sharpness;
+
+void main()
+{
+    vec2 uv = TexCoords * uv_extent;
+    vec3 c = texture(source, uv).rgb;
+    vec3 n = texture(source, uv + vec2(0.0, texel.y)).rgb;
+    vec3 s = texture(source, uv - vec2(0.0, texel.y)).rgb;
+    vec3 e = texture(source, uv + vec2(texel.x, 0.0)).rgb;
+    vec3 w = texture(source, uv - vec2(texel.x, 0.0)).rgb;
+    // unsharp mask against the cross, clamped to the neighbourhood so edges do not ring
+    vec3 sharpened = c + sharpness * (4.0 * c - n - s - e - w) * 0.25;
+    vec3 lo = min(c, min(min(n, s), min(e, w)));
+    vec3 hi = max(c, max(max(n, s), max(e, w)));
+    FragColor = vec4(clamp(sharpened, lo, hi), 1.0);
+}
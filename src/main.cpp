@@ -9,6 +9,7 @@
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
+#include "imgui_internal.h"
 
 #include <Camera.h>
 #include <Model.h>
@@ -16,15 +17,42 @@
 #include <iostream>
 #include <mygui.h>
 
+#include <AllocTracker.h>
+
+#include <Collision.h>
+#include <CollisionBench.h>
+#include <DynamicMesh.h>
 #include <ecal/ecal.h>
+#include <FrameScheduler.h>
+#include <FrameStream.h>
+#include <FusionTopics.h>
+#include <HapticServo.h>
+#include <Instancing.h>
+#include <JobSystem.h>
+#include <OcclusionCuller.h>
+#include <Profiler.h>
+#include <RenderGraph.h>
+#include <RenderTarget.h>
+#include <RenderViews.h>
+#include <ResourceRegistry.h>
+#include <SdfBench.h>
+#include <SdfMeshStream.h>
+#include <Skinning.h>
+#include <SoftTissue.h>
+#include <TextureCache.h>
+#include <StreamBench.h>
+#include <TissueBench.h>
+#include <TransformHierarchy.h>
+#include <Wireframe.h>
+#include <Workload.h>
 #include <ecal/msg/protobuf/publisher.h>
 #include <fusion.pb.h>
-#include <random>
 
 #pragma region inline function
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void mouse_callback(GLFWwindow *window, double x_pos_in, double y_pos_in);
 void scroll_callback(GLFWwindow *window, double x_offset, double y_offset);
+void window_refresh_callback(GLFWwindow *window);
 void process_input(GLFWwindow *window);
 #pragma endregion
 
@@ -42,6 +70,104 @@ bool first_mouse = true;
 // timing
 float delta_time = 0.0f;
 float last_frame = 0.0f;
+// set by resize/expose callbacks, the UI has to be presented again
+bool window_damaged = true;
+
+// topics: split the fusion stream into a per-frame pose topic and a change-triggered state topic
+constexpr bool split_fusion_topics = false;
+constexpr bool keep_legacy_fusion_topic = true;
+
+// haptic servo
+constexpr double haptic_rate = 1000.0;
+constexpr int haptic_cpu = -1;
+// SCHED_FIFO priority for the servo thread; 0 keeps normal priority, real-time scheduling is opt-in
+constexpr int haptic_fifo_priority = 0;
+
+// collision: tissue stiffness scale handed to the servo for bone contacts
+constexpr float bone_stiffness = 1.0f;
+
+// soft tissue: wall time per simulation step, the solver runs as many substeps as fit
+constexpr bool simulate_tissue = true;
+constexpr double tissue_budget_ms = 2.0;
+
+// bone removal: the vertebrae become a sparse distance volume that ablation and rongeur bites cut into
+constexpr bool remove_bone = true;
+constexpr float bone_voxel_size = 0.04f;
+constexpr float ablation_radius = 0.2f;
+constexpr float rongeur_jaw_length = 0.6f;
+constexpr float rongeur_jaw_radius = 0.15f;
+
+// wireframe: models draw their unique edges over a depth-only underlay instead of polygon outlines;
+// a crease angle > 0 keeps only feature edges
+constexpr bool edge_wireframe = true;
+constexpr float wireframe_crease_degrees = 0.0f;
+
+// occlusion culling: the vertebrae, or the cut bone surface, are rasterized on the CPU into a small depth buffer
+// and meshes and bone bricks behind them are skipped; occluders are simplified to this cell size
+constexpr bool occlusion_culling = true;
+constexpr float occluder_cell = 0.12f;
+
+// meshlet culling: triangle clusters outside the view, or facing away from it when faces are filled, are not drawn
+constexpr bool meshlet_culling = true;
+
+// instancing: repeated implants (screws, rods, clips) listed in this plan, placed relative to the anatomy
+constexpr const char *implant_plan = "./resources/profiles/implants.plan";
+
+// animation: models imported with bones are skinned in skinned.vs, or on the CPU when off or when a mesh has morph targets
+constexpr bool gpu_skinning = true;
+
+// scene resolution: the 3D pass follows the Scene panel's size; dynamic resolution scales it down (to at least
+// the min scale) to keep its GPU time near the target, and below full scale the upscale to the panel is sharpened
+constexpr bool dynamic_resolution = true;
+constexpr float resolution_target_ms = 8.0f;
+constexpr float resolution_min_scale = 0.5f;
+constexpr float resolution_sharpness = 0.5f;
+
+// demand-driven frames: the 3D pass only runs when the visible scene changed, the UI only on input (plus a slow
+// stats refresh), and an idle loop sleeps until the next publish; publish_hz is the idle publish rate
+constexpr bool render_on_demand = true;
+constexpr double publish_hz = 60.0;
+
+// frame streaming: while someone subscribes to stream_topic the Scene image is read back asynchronously,
+// compressed losslessly on a worker and published there, at up to stream_max_fps
+constexpr bool stream_frames = true;
+constexpr const char *stream_topic = "scene_frames";
+constexpr double stream_max_fps = 30.0;
+
+// endoscope view: a second view from the endoscope tip (down the node's -z) in its own panel; it shares the
+// frame's culling, draw queue and matrix upload with the Scene view
+constexpr bool endoscope_view = true;
+constexpr float endoscope_fov_degrees = 70.0f;
+constexpr float endoscope_near = 0.05f;
+
+// tracing: every thread records a timeline; startup and the first trace_startup_frames loop iterations are
+// written to trace_startup_path (0 to skip), the Trace window writes the recent timeline to trace_dump_path.
+// Open either in chrome://tracing or ui.perfetto.dev
+constexpr size_t trace_startup_frames = 300;
+constexpr const char *trace_startup_path = "./startup.trace.json";
+constexpr const char *trace_dump_path = "./frame.trace.json";
+
+// allocation tracking (builds with ALLOC_TRACKING=1): once alloc_steady_frames iterations have run, every
+// iteration that still allocates is reported, up to alloc_reports times
+constexpr size_t alloc_steady_frames = 600;
+constexpr size_t alloc_reports = 20;
+
+// memory accounting: every GL buffer, texture and renderbuffer and the CPU copies kept next to them are listed in
+// the Memory window; crossing a budget warns once (0 for no budget). With release_cpu_copies the meshes' vertex
+// and index copies and the font atlas pixels are freed once the GPU has them and everything built from them exists
+constexpr size_t memory_budget_gpu_mb = 512;
+constexpr size_t memory_budget_cpu_mb = 256;
+constexpr bool release_cpu_copies = true;
+
+// shared texture cache: textures no model references any more stay loaded up to texture_cache_keep_mb, least
+// recently released evicted first
+constexpr size_t texture_cache_keep_mb = 64;
+// texture streaming: texture_decode_workers threads read and decode images into at most texture_staging_mb of
+// staging memory, and each loop iteration uploads up to texture_upload_kb of them; a grey placeholder is drawn
+// until a texture is in. 0 workers loads every texture synchronously at model load
+constexpr int texture_decode_workers = 2;
+constexpr size_t texture_staging_mb = 96;
+constexpr size_t texture_upload_kb = 8192;
 #pragma endregion
 
 
@@ -49,8 +175,24 @@ int count{0};
 std::vector<float> data;
 pb::FusionData::FusionData fusion_data;
 
-int main() {
+int main(int argc, char **argv) {
+  // headless collision benchmark: --bench-collision [mesh ...]
+  if (argc > 1 && std::string(argv[1]) == "--bench-collision") {
+    std::vector<std::string> meshes(argv + 2, argv + argc);
+    if (meshes.empty()) meshes = {"./resources/objects/backpack/lower.obj", "./resources/objects/backpack/upper.obj", "<synthetic>"};
+    return run_collision_benchmark(meshes);
+  }
+  // headless soft tissue benchmark: --bench-tissue [density]
+  if (argc > 1 && std::string(argv[1]) == "--bench-tissue") return run_tissue_benchmark(argc > 2 ? std::stof(argv[2]) : 1.0f);
+  // headless bone removal benchmark: --bench-sdf [voxel size]
+  if (argc > 1 && std::string(argv[1]) == "--bench-sdf") return run_sdf_benchmark(argc > 2 ? std::stof(argv[2]) : bone_voxel_size);
+  // headless frame stream codec benchmark: --bench-stream [width height]
+  if (argc > 1 && std::string(argv[1]) == "--bench-stream") return argc > 3 ? run_stream_benchmark(std::stoi(argv[2]), std::stoi(argv[3])) : run_stream_benchmark();
+
+  TRACE_THREAD_NAME("main");
+  TRACE_BEGIN("startup");
 #pragma region glfw init
+  TRACE_BEGIN("create window");
   glfwInit();
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -63,256 +205,797 @@ int main() {
   glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
   glfwSetCursorPosCallback(window, mouse_callback);
   glfwSetScrollCallback(window, scroll_callback);
+  glfwSetWindowRefreshCallback(window, window_refresh_callback);
+  TRACE_END("create window");
 
   // tell GLFW to capture our mouse
   // glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
   // glad: load all OpenGL function pointers
+  TRACE_BEGIN("load gl functions");
   if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress)))// NOLINT(clang-diagnostic-cast-function-type-strict)
   {
     std::cout << "Failed to initialize GLAD" << std::endl;
     return -1;
   }
+  TRACE_END("load gl functions");
 #pragma endregion
 
 #pragma region shader and model
   // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
   stbi_set_flip_vertically_on_load(true);
-  // configure global opengl state
-  glEnable(GL_DEPTH_TEST);
-  // build and compile shaders
-  Shader our_shader("./Shader/shader.vs", "./Shader/shader.fs");
-  // load models
-  Model our_model("./resources/objects/backpack/backpack.obj");
-  Model endoscope_model("./resources/objects/backpack/endoscope.obj");
-  Model tube_model("./resources/objects/backpack/tubeC.obj");
-  Model lower_model("./resources/objects/backpack/lower.obj");
-  Model upper_model("./resources/objects/backpack/upper.obj");
-  // draw in wireframe
-  glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+  TextureStreamConfig texture_stream;
+  texture_stream.workers = texture_decode_workers;
+  texture_stream.staging_bytes = texture_staging_mb << 20;
+  texture_stream.upload_bytes_per_frame = texture_upload_kb << 10;
+  textures().start(texture_stream);
+  // everything owning GL objects lives in this scope, so it is deleted while the context still exists
+  {
+    // configure global opengl state
+    glEnable(GL_DEPTH_TEST);
+    TRACE_BEGIN("shaders and models");
+    resources().set_budget(memory_budget_gpu_mb << 20, memory_budget_cpu_mb << 20);
+    // build and compile shaders
+    Shader our_shader("./Shader/shader.vs", "./Shader/shader.fs");
+    Shader skinned_shader("./Shader/skinned.vs", "./Shader/shader.fs");
+    Shader instanced_shader("./Shader/instanced.vs", "./Shader/instanced.fs");
+    for (const Shader *shader : {&our_shader, &skinned_shader, &instanced_shader}) attach_view_uniforms(*shader);
+    // load models
+    Model our_model("./resources/objects/backpack/backpack.obj");
+    Model endoscope_model("./resources/objects/backpack/endoscope.obj");
+    Model tube_model("./resources/objects/backpack/tubeC.obj");
+    Model lower_model("./resources/objects/backpack/lower.obj");
+    Model upper_model("./resources/objects/backpack/upper.obj");
+    // draw in wireframe; with edge_wireframe only what has no edge list (skinned, instanced) is outlined, in
+    // polygon line mode set around just those draws
+    WireframePass wireframe;
+    if (edge_wireframe)
+      for (Model *m : {&our_model, &endoscope_model, &tube_model, &lower_model, &upper_model}) build_model_edges(*m, wireframe_crease_degrees);
+    TRACE_END("shaders and models");
 #pragma endregion
 
 #pragma region texture
-  GLuint FBO, texture;
-  glGenFramebuffers(1, &FBO);
-  glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-
-  glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, scr_width, scr_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
-
-  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // the frame's images come from the render graph; scene_image and endoscope_image are the exported ones the
+    // panels and the stream read, valid until the next scene pass declares a new frame
+    RenderGraph graph;
+    RenderGraph::Resource scene_image = -1, endoscope_image = -1;
+    DynamicResolution resolution(resolution_target_ms, resolution_min_scale);
+    UpscalePass upscale;
+    // the Scene panel's content region in pixels, from the previous frame's ImGui pass
+    int panel_width = static_cast<int>(scr_width), panel_height = static_cast<int>(scr_height);
+    bool scene_panel_visible = true;
+    // the endoscope view renders at its panel's size, without dynamic resolution
+    int endoscope_width = static_cast<int>(scr_width) / 2, endoscope_height = static_cast<int>(scr_height) / 2;
+    bool endoscope_panel_visible = endoscope_view;
+    FrameScheduler scheduler(FrameSchedulerConfig{publish_hz});
 #pragma endregion
 
 #pragma region imgui init
-  IMGUI_CHECKVERSION();
-  ImGui::CreateContext(nullptr);
-  ImGuiIO &io = ImGui::GetIO();
-  (void) io;
-  io.Fonts->AddFontFromFileTTF("JetBrainsMono-Regular.ttf", 36, nullptr, io.Fonts->GetGlyphRangesChineseFull());
-
-  io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;
-  io.ConfigFlags |= ImGuiViewportFlags_NoDecoration;
-  io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable;
-  io.ConfigFlags |= ImGuiCol_DockingEmptyBg;
-  // ImGui::StyleColorsDark();
-  ImGui::StyleColorsLight();
-  ImGuiStyle &style = ImGui::GetStyle();
-  style.WindowRounding = 12;
-  style.ChildRounding = 12;
-  style.FrameRounding = 12;
-  style.PopupRounding = 6;
-  style.ScrollbarRounding = 8;
-  style.GrabRounding = 12;
-  style.TabRounding = 8;
-
-  ImVec4 *colors = style.Colors;
-  colors[ImGuiCol_BorderShadow] = ImVec4(0.66f, 0.66f, 0.66f, 0.00f);
-  colors[ImGuiCol_FrameBgHovered] = ImVec4(0.47f, 0.47f, 0.47f, 0.40f);
-  colors[ImGuiCol_FrameBgActive] = ImVec4(0.79f, 0.79f, 0.79f, 0.67f);
-  colors[ImGuiCol_TitleBgActive] = ImVec4(0.40f, 0.40f, 0.40f, 1.00f);
-  colors[ImGuiCol_CheckMark] = ImVec4(0.26f, 0.26f, 0.26f, 1.00f);
-  colors[ImGuiCol_SliderGrab] = ImVec4(0.55f, 0.55f, 0.55f, 1.00f);
-  colors[ImGuiCol_SliderGrabActive] = ImVec4(0.61f, 0.61f, 0.61f, 1.00f);
-  colors[ImGuiCol_Button] = ImVec4(0.65f, 0.65f, 0.65f, 0.40f);
-  colors[ImGuiCol_ButtonHovered] = ImVec4(0.66f, 0.66f, 0.66f, 1.00f);
-  colors[ImGuiCol_ButtonActive] = ImVec4(0.85f, 0.85f, 0.85f, 1.00f);
-  colors[ImGuiCol_HeaderHovered] = ImVec4(0.70f, 0.70f, 0.70f, 0.80f);
-  colors[ImGuiCol_HeaderActive] = ImVec4(0.85f, 0.85f, 0.85f, 1.00f);
-  colors[ImGuiCol_SeparatorHovered] = ImVec4(0.60f, 0.60f, 0.60f, 0.78f);
-  colors[ImGuiCol_SeparatorActive] = ImVec4(0.75f, 0.75f, 0.75f, 1.00f);
-  colors[ImGuiCol_ResizeGrip] = ImVec4(0.25f, 0.25f, 0.25f, 0.20f);
-  colors[ImGuiCol_ResizeGripHovered] = ImVec4(0.36f, 0.36f, 0.36f, 0.67f);
-  colors[ImGuiCol_ResizeGripActive] = ImVec4(0.74f, 0.74f, 0.74f, 0.95f);
-  colors[ImGuiCol_Tab] = ImVec4(0.64f, 0.64f, 0.64f, 0.86f);
-  colors[ImGuiCol_TabHovered] = ImVec4(0.24f, 0.24f, 0.24f, 0.80f);
-  colors[ImGuiCol_TabActive] = ImVec4(0.81f, 0.81f, 0.81f, 1.00f);
-  colors[ImGuiCol_TabUnfocusedActive] = ImVec4(0.66f, 0.66f, 0.66f, 1.00f);
-  colors[ImGuiCol_DockingPreview] = ImVec4(0.49f, 0.49f, 0.49f, 0.70f);
-  colors[ImGuiCol_TextSelectedBg] = ImVec4(0.71f, 0.71f, 0.71f, 0.35f);
-  colors[ImGuiCol_NavHighlight] = ImVec4(0.52f, 0.52f, 0.52f, 1.00f);
-  colors[ImGuiCol_FrameBg] = ImVec4(0.52f, 0.52f, 0.52f, 0.54f);
-  colors[ImGuiCol_Header] = ImVec4(0.67f, 0.67f, 0.67f, 0.31f);
-  colors[ImGuiCol_TableHeaderBg] = ImVec4(0.38f, 0.38f, 0.38f, 1.00f);
-  colors[ImGuiCol_DragDropTarget] = ImVec4(0.64f, 1.00f, 0.85f, 0.95f);
-
-  ImGui_ImplGlfw_InitForOpenGL(window, true);
-  ImGui_ImplOpenGL3_Init("#version 330");
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext(nullptr);
+    ImGuiIO &io = ImGui::GetIO();
+    (void) io;
+    {
+      // the full CJK range makes a large atlas; built here rather than inside the first frame so it shows in the trace
+      TRACE_ZONE("font atlas");
+      io.Fonts->AddFontFromFileTTF("JetBrainsMono-Regular.ttf", 36, nullptr, io.Fonts->GetGlyphRangesChineseFull());
+      io.Fonts->Build();
+    }
+
+    io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;
+    io.ConfigFlags |= ImGuiViewportFlags_NoDecoration;
+    io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable;
+    io.ConfigFlags |= ImGuiCol_DockingEmptyBg;
+    // ImGui::StyleColorsDark();
+    ImGui::StyleColorsLight();
+    ImGuiStyle &style = ImGui::GetStyle();
+    style.WindowRounding = 12;
+    style.ChildRounding = 12;
+    style.FrameRounding = 12;
+    style.PopupRounding = 6;
+    style.ScrollbarRounding = 8;
+    style.GrabRounding = 12;
+    style.TabRounding = 8;
+
+    ImVec4 *colors = style.Colors;
+    colors[ImGuiCol_BorderShadow] = ImVec4(0.66f, 0.66f, 0.66f, 0.00f);
+    colors[ImGuiCol_FrameBgHovered] = ImVec4(0.47f, 0.47f, 0.47f, 0.40f);
+    colors[ImGuiCol_FrameBgActive] = ImVec4(0.79f, 0.79f, 0.79f, 0.67f);
+    colors[ImGuiCol_TitleBgActive] = ImVec4(0.40f, 0.40f, 0.40f, 1.00f);
+    colors[ImGuiCol_CheckMark] = ImVec4(0.26f, 0.26f, 0.26f, 1.00f);
+    colors[ImGuiCol_SliderGrab] = ImVec4(0.55f, 0.55f, 0.55f, 1.00f);
+    colors[ImGuiCol_SliderGrabActive] = ImVec4(0.61f, 0.61f, 0.61f, 1.00f);
+    colors[ImGuiCol_Button] = ImVec4(0.65f, 0.65f, 0.65f, 0.40f);
+    colors[ImGuiCol_ButtonHovered] = ImVec4(0.66f, 0.66f, 0.66f, 1.00f);
+    colors[ImGuiCol_ButtonActive] = ImVec4(0.85f, 0.85f, 0.85f, 1.00f);
+    colors[ImGuiCol_HeaderHovered] = ImVec4(0.70f, 0.70f, 0.70f, 0.80f);
+    colors[ImGuiCol_HeaderActive] = ImVec4(0.85f, 0.85f, 0.85f, 1.00f);
+    colors[ImGuiCol_SeparatorHovered] = ImVec4(0.60f, 0.60f, 0.60f, 0.78f);
+    colors[ImGuiCol_SeparatorActive] = ImVec4(0.75f, 0.75f, 0.75f, 1.00f);
+    colors[ImGuiCol_ResizeGrip] = ImVec4(0.25f, 0.25f, 0.25f, 0.20f);
+    colors[ImGuiCol_ResizeGripHovered] = ImVec4(0.36f, 0.36f, 0.36f, 0.67f);
+    colors[ImGuiCol_ResizeGripActive] = ImVec4(0.74f, 0.74f, 0.74f, 0.95f);
+    colors[ImGuiCol_Tab] = ImVec4(0.64f, 0.64f, 0.64f, 0.86f);
+    colors[ImGuiCol_TabHovered] = ImVec4(0.24f, 0.24f, 0.24f, 0.80f);
+    colors[ImGuiCol_TabActive] = ImVec4(0.81f, 0.81f, 0.81f, 1.00f);
+    colors[ImGuiCol_TabUnfocusedActive] = ImVec4(0.66f, 0.66f, 0.66f, 1.00f);
+    colors[ImGuiCol_DockingPreview] = ImVec4(0.49f, 0.49f, 0.49f, 0.70f);
+    colors[ImGuiCol_TextSelectedBg] = ImVec4(0.71f, 0.71f, 0.71f, 0.35f);
+    colors[ImGuiCol_NavHighlight] = ImVec4(0.52f, 0.52f, 0.52f, 1.00f);
+    colors[ImGuiCol_FrameBg] = ImVec4(0.52f, 0.52f, 0.52f, 0.54f);
+    colors[ImGuiCol_Header] = ImVec4(0.67f, 0.67f, 0.67f, 0.31f);
+    colors[ImGuiCol_TableHeaderBg] = ImVec4(0.38f, 0.38f, 0.38f, 1.00f);
+    colors[ImGuiCol_DragDropTarget] = ImVec4(0.64f, 1.00f, 0.85f, 0.95f);
+
+    ImGui_ImplGlfw_InitForOpenGL(window, true);
+    ImGui_ImplOpenGL3_Init("#version 330");
+    // the font texture is made here rather than in the first NewFrame, so it is recorded and its pixels can go
+    ImGui_ImplOpenGL3_CreateDeviceObjects();
+    const int atlas_width = io.Fonts->TexWidth, atlas_height = io.Fonts->TexHeight;
+    const std::string atlas_size = std::to_string(atlas_width) + "x" + std::to_string(atlas_height);
+    resources().add(k_resource_texture, static_cast<GLuint>(reinterpret_cast<intptr_t>(io.Fonts->TexID)), texture_bytes(atlas_width, atlas_height, 4, false), "RGBA8 " + atlas_size, "imgui font atlas");
+    if (release_cpu_copies) io.Fonts->ClearTexData();
+    else resources().add(k_resource_cpu, 0, texture_bytes(atlas_width, atlas_height, 5, false), "A8 + RGBA8 " + atlas_size, "imgui font atlas");
 #pragma endregion
 
 #pragma region eCAL
-  eCAL::Initialize(1, nullptr, "Fusion Publisher");
-  eCAL::Process::SetState(proc_sev_healthy, proc_sev_level1, "healthy");
-  const eCAL::CPublisher publisher("fusion");
+    {
+      TRACE_ZONE("ecal init");
+      eCAL::Initialize(1, nullptr, "Fusion Publisher");
+    }
+    eCAL::Process::SetState(proc_sev_healthy, proc_sev_level1, "healthy");
+    FusionTopicConfig topic_config;
+    topic_config.split = split_fusion_topics;
+    topic_config.legacy = keep_legacy_fusion_topic;
+    FusionPublisher publisher(topic_config);
+    std::unique_ptr<FrameStreamer> frame_streamer;
+    if (stream_frames) {
+      FrameStreamConfig stream_config;
+      stream_config.topic = stream_topic;
+      stream_config.max_fps = stream_max_fps;
+      frame_streamer = std::make_unique<FrameStreamer>(stream_config);
+    }
 
 #pragma endregion
 
-#pragma region Random
-  std::random_device rd;
-  std::mt19937 gen(rd());
-  std::uniform_real_distribution<float> dis_0_10(0.0, 10.0);
-  std::uniform_real_distribution<float> dis_330_360(330.0, 360.0);
-  std::uniform_real_distribution<float> dis_10_15(10.0, 15.0);
-  uniform_real_distribution<float> dis_0_1(0.0, 1.0);
-#pragma endregion
-  while (!glfwWindowShouldClose(window)) {
-#pragma region init
-    const auto current_frame = static_cast<float>(glfwGetTime());
-    delta_time = current_frame - last_frame;
-    last_frame = current_frame;
-    process_input(window);
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-    glClearColor(0.7137f, 0.7333f, 0.7686f, 1.0f);// rgb(182, 187, 196)
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+#pragma region haptic
+    HapticServoConfig haptic_config;
+    haptic_config.rate = haptic_rate;
+    haptic_config.cpu = haptic_cpu;
+    haptic_config.fifo_priority = haptic_fifo_priority;
+    HapticServo haptic_servo(haptic_config);
+    haptic_servo.start();
 #pragma endregion
 
-#pragma region model do MVP
-    our_shader.use();
-
-    // view/projection transformations
-    glm::mat4 projection = glm::perspective(glm::radians(camera.cam_zoom), static_cast<float>(scr_width) / static_cast<float>(scr_height), 0.1f, 100.0f);
-    glm::mat4 view = camera.get_view_matrix();
-    our_shader.setMat4("projection", projection);
-    our_shader.setMat4("view", view);
-
-    // render the loaded model
-    auto model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(0.0f, -10.0f, 0.0f));// translate it down so it's at the center of the scene
-    model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));      // it's a bit too big for our scene, so scale it down
-    our_shader.setMat4("model", model);
-    our_model.Draw(our_shader);
-    endoscope_model.Draw(our_shader);
-    tube_model.Draw((our_shader));
-    lower_model.Draw((our_shader));
-    upper_model.Draw(our_shader);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+#pragma region collision
+    // vertebrae are static: build once, place them with the same model matrix they are drawn with
+    const glm::mat4 anatomy_world = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -10.0f, 0.0f));
+    const TriangleBvh lower_bvh(lower_model.collision_positions, lower_model.collision_indices);
+    const TriangleBvh upper_bvh(upper_model.collision_positions, upper_model.collision_indices);
+    BvhInstance anatomy[2] = {{&lower_bvh}, {&upper_bvh}};
+    for (BvhInstance &instance : anatomy) instance.set_transform(anatomy_world);
+    // instrument shafts as capsules in their own frames, moved by the fused poses every frame: tube and endoscope
+    // around their meshes' long axes, the rongeur (no mesh of its own) along its jaw
+    const auto shaft_of = [](const Model &model) {
+      Aabb bounds;
+      for (const glm::vec3 &p : model.collision_positions) bounds.grow(p);
+      return bounds.valid() ? capsule_from_bounds(bounds) : Capsule{glm::vec3(0.0f), glm::vec3(0.0f), 0.0f};
+    };
+    const Capsule instrument_shafts[3] = {shaft_of(tube_model), shaft_of(endoscope_model), {glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -rongeur_jaw_length), rongeur_jaw_radius}};
+    Capsule last_instrument_capsules[3] = {instrument_shafts[0], instrument_shafts[1], instrument_shafts[2]};
+    bool have_last_instrument_capsules = false;
+    std::vector<Capsule> instrument_capsules;
 #pragma endregion
 
-#pragma region ImGui
-    ImGui_ImplOpenGL3_NewFrame();
-    ImGui_ImplGlfw_NewFrame();
-    ImGui::NewFrame();
-    ImGui::DockSpaceOverViewport();
-
-    draw_gui();
-
-    ImGui::Begin("Scene");
-    ImGui::Image(reinterpret_cast<void *>(static_cast<intptr_t>(texture)), ImVec2{scr_width, scr_height}, ImVec2{0, 1}, ImVec2{1, 0});// NOLINT(performance-no-int-to-ptr)
-    ImGui::End();
-
-    ImGui::ShowDemoWindow();
-
-    ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+#pragma region scene graph
+    // anatomy is static; the instruments follow the fused poses, bound every frame
+    TransformHierarchy scene;
+    const int anatomy_node = scene.add(-1, "anatomy", anatomy_world);
+    const int backpack_node = scene.add(anatomy_node, "backpack");
+    const int lower_node = scene.add(anatomy_node, "lower");
+    const int upper_node = scene.add(anatomy_node, "upper");
+    const int endoscope_node = scene.add(-1, "endoscope");
+    const int tube_node = scene.add(-1, "tube");
+    const int rongeur_node = scene.add(-1, "rongeur");
+    scene.update();
+#pragma endregion
 
+#pragma region views
+    // views[0] is the Scene panel's free camera, views[1] the endoscope tip
+    std::vector<RenderView> views(endoscope_view ? 2 : 1);
+    views[0].name = "scene";
+    if (endoscope_view) {
+      views[1].name = "endoscope";
+      views[1].hidden_node = endoscope_node;
+    }
+    ViewUniformBuffer view_uniforms;
+    size_t queued_draws = 0;// items in the last scene pass's draw queue
 #pragma endregion
 
+#pragma region implants
+    // one Model per distinct implant, one instanced draw per mesh however many copies are placed
+    std::vector<InstancePlan> implant_plans;
+    load_instance_plan(implant_plan, implant_plans);
+    std::vector<std::unique_ptr<Model>> implant_models;
+    std::vector<std::unique_ptr<InstancedModel>> implants;
+    for (const InstancePlan &plan : implant_plans) {
+      implant_models.push_back(std::make_unique<Model>(plan.model_path));
+      implants.push_back(std::make_unique<InstancedModel>(*implant_models.back()));
+      implants.back()->instances = plan.instances;
+    }
+#pragma endregion
 
-    #pragma region mutable_ set_
-    fusion_data.mutable_endoscope_pos()->set_x(dis_0_10(gen));
-    fusion_data.mutable_endoscope_pos()->set_y(dis_0_10(gen));
-    fusion_data.mutable_endoscope_pos()->set_z(dis_0_10(gen));
+#pragma region soft tissue
+    JobSystem jobs;
+    TissueSolverConfig tissue_config;
+    tissue_config.budget_ms = tissue_budget_ms;
+    TissueSolver tissue_solver(jobs, tissue_config);
+    Aabb anatomy_bounds;
+    for (const Model *vertebra : {&lower_model, &upper_model})
+      for (const glm::vec3 &p : vertebra->collision_positions) anatomy_bounds.grow(glm::vec3(anatomy_world * glm::vec4(p, 1.0f)));
+    if (simulate_tissue && anatomy_bounds.valid()) tissue_solver.build(default_tissue_proxies(anatomy_bounds));
+    // proxies drawn as lines; positions are world space, only particles that moved are re-uploaded after a step
+    std::vector<glm::vec3> tissue_positions;
+    std::vector<unsigned int> tissue_lines;
+    tissue_solver.write_positions(tissue_positions);
+    tissue_solver.write_line_indices(tissue_lines);
+    uint32_t tissue_topology = tissue_solver.topology_version();
+    std::vector<Vertex> tissue_vertices(tissue_positions.size(), Vertex{});
+    for (size_t i = 0; i < tissue_positions.size(); ++i) tissue_vertices[i].Position = tissue_positions[i];
+    DynamicMesh tissue_mesh(tissue_vertices, tissue_lines, {}, GL_LINES, k_stream_ring, 3, "soft tissue");
+#pragma endregion
 
-    fusion_data.mutable_endoscope_euler()->set_x(dis_330_360(gen));
-    fusion_data.mutable_endoscope_euler()->set_y(dis_10_15(gen));
-    fusion_data.mutable_endoscope_euler()->set_z(dis_10_15(gen));
+#pragma region bone removal
+    // baked in world space, so cuts, contacts and drawing need no transform. The bake takes over a second, so it
+    // runs on a thread with a job pool of its own (`jobs` serves the frame loop meanwhile); until it is done the
+    // original vertebra meshes are drawn, culled and collided with, and the frame loop does not touch bone_sdf
+    SparseSdfConfig bone_config;
+    bone_config.voxel_size = bone_voxel_size;
+    SparseSdf bone_sdf(jobs, bone_config);
+    SdfMeshStream bone_stream;
+    std::atomic<bool> bone_baked{false};
+    bool bone_ready = false;// baked and uploaded
+    std::thread bone_bake;
+    if (remove_bone) {
+      const int bake_threads = std::max(1, jobs.thread_count() - 1);
+      bone_bake = std::thread([&, bake_threads] {
+        TRACE_THREAD_NAME("bone bake");
+        std::vector<glm::vec3> lower_world, upper_world;
+        for (const glm::vec3 &p : lower_model.collision_positions) lower_world.emplace_back(anatomy_world * glm::vec4(p, 1.0f));
+        for (const glm::vec3 &p : upper_model.collision_positions) upper_world.emplace_back(anatomy_world * glm::vec4(p, 1.0f));
+        const TriangleBvh lower_world_bvh(lower_world, lower_model.collision_indices);
+        const TriangleBvh upper_world_bvh(upper_world, upper_model.collision_indices);
+        JobSystem bake_jobs(bake_threads);
+        bone_sdf.bake({{lower_world_bvh, lower_world, lower_model.collision_indices}, {upper_world_bvh, upper_world, upper_model.collision_indices}}, bake_jobs);
+        bone_baked.store(true, std::memory_order_release);
+      });
+    }
+    float last_ablation_count = 0.0f;
+    bool rongeur_in_bone = false;
+    SdfEditStats bone_edit{};
+    SdfMeshStats bone_mesh{};
+#pragma endregion
 
-    fusion_data.mutable_tube_pos()->set_x(dis_0_10(gen));
-    fusion_data.mutable_tube_pos()->set_y(dis_0_10(gen));
-    fusion_data.mutable_tube_pos()->set_z(dis_0_10(gen));
+#pragma region animation
+    // animation_value scrubs the first clip, a dancing nerve root plays the second one in real time
+    std::vector<std::unique_ptr<AnimatedModel>> animated_models;
+    for (Model *m : {&our_model, &endoscope_model, &tube_model, &lower_model, &upper_model})
+      if (m->animated()) animated_models.push_back(std::make_unique<AnimatedModel>(*m, gpu_skinning));
+    const auto find_animated = [&](const Model &m) -> AnimatedModel * {
+      for (const auto &animated : animated_models)
+        if (&animated->model == &m) return animated.get();
+      return nullptr;
+    };
+    const auto draw_item = [&](const DrawItem &item) {
+      if (AnimatedModel *animated = find_animated(*item.model)) {
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        animated->Draw(our_shader, skinned_shader, item.world);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+      } else if (edge_wireframe) {
+        wireframe.draw_edges(*item.model, our_shader, item.world);
+      } else {
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        item.model->Draw(our_shader, item.world);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+      }
+    };
+#pragma endregion
 
-    fusion_data.mutable_tube_euler()->set_x(dis_330_360(gen));
-    fusion_data.mutable_tube_euler()->set_y(dis_10_15(gen));
-    fusion_data.mutable_tube_euler()->set_x(dis_10_15(gen));
+#pragma region occlusion
+    OcclusionCuller occlusion(jobs);
+    SdfOccluders bone_occluders(occluder_cell);
+    // the vertebrae occlude until the bone volume is baked, then its bricks take over
+    const Occluder lower_occluder = simplify_occluder(lower_model.collision_positions, lower_model.collision_indices, occluder_cell);
+    const Occluder upper_occluder = simplify_occluder(upper_model.collision_positions, upper_model.collision_indices, occluder_cell);
+    struct CulledModel {
+      Model *model;
+      int node;
+      std::vector<Aabb> bounds;
+    };
+    std::vector<CulledModel> culled_models;
+    for (const auto &entry : {std::make_pair(&our_model, backpack_node), std::make_pair(&endoscope_model, endoscope_node), std::make_pair(&tube_model, tube_node), std::make_pair(&lower_model, lower_node), std::make_pair(&upper_model, upper_node)})
+      culled_models.push_back({entry.first, entry.second, model_mesh_bounds(*entry.first)});
+    std::vector<uint8_t> brick_visible;// sized once the bone is baked
+#pragma endregion
 
+#pragma region workload
+    // synthetic poses/tissue/haptic values; the optional load driver publishes the same stream on its own topics
+    WorkloadProfile workload_profile;
+    load_workload_profile("./resources/profiles/default.workload", workload_profile);
+    const WorkloadGenerator workload(workload_profile);
+    WorkloadBatch workload_sample;
+    // the instrument offsets and the pivot are fixed for the receivers; nothing overwrites them, so set them once
     fusion_data.mutable_offset()->set_endoscope_offset(-1);
     fusion_data.mutable_offset()->set_tube_offset(-3);
     fusion_data.mutable_offset()->set_instrument_switch(60);
-    fusion_data.mutable_offset()->set_animation_value(dis_0_1(gen));
     fusion_data.mutable_offset()->set_pivot_offset(2);
-
     fusion_data.mutable_rot_coord()->set_x(0);
     fusion_data.mutable_rot_coord()->set_y(0.7071068f);
     fusion_data.mutable_rot_coord()->set_z(0);
     fusion_data.mutable_rot_coord()->set_w(0.7071068f);
-
     fusion_data.mutable_pivot_pos()->set_x(-10);
     fusion_data.mutable_pivot_pos()->set_y(4.9f);
     fusion_data.mutable_pivot_pos()->set_z(-0.9f);
+    std::unique_ptr<WorkloadDriver> workload_driver;
+    if (workload_profile.load_enabled) {
+      workload_driver = std::make_unique<WorkloadDriver>(workload_profile);
+      workload_driver->start();
+    }
+#pragma endregion
+#if TRACE_ENABLED
+    const char *trace_written_path = trace_dump_path;
+    long trace_written = -1;
+    size_t trace_frame = 0;
+#endif
+#if ALLOC_TRACKING
+    size_t alloc_reported = 0;
+#endif
+    // edges, meshlets, bounds, occluders, collision and skinning streams are built by now
+    if (release_cpu_copies) {
+      for (Model *m : {&our_model, &endoscope_model, &tube_model, &lower_model, &upper_model}) m->release_cpu_geometry();
+      for (const std::unique_ptr<Model> &m : implant_models) m->release_cpu_geometry();
+    }
+    TRACE_END("startup");
+    while (!glfwWindowShouldClose(window)) {
+      TRACE_ZONE("frame");
+#pragma region init
+      const double loop_time = glfwGetTime();
+      const auto current_frame = static_cast<float>(loop_time);
+      delta_time = current_frame - last_frame;
+      last_frame = current_frame;
+      process_input(window);
+      const float render_scale = dynamic_resolution ? resolution.scale() : 1.0f;
+      const int render_width = std::max(1, static_cast<int>(static_cast<float>(panel_width) * render_scale + 0.5f));
+      const int render_height = std::max(1, static_cast<int>(static_cast<float>(panel_height) * render_scale + 0.5f));
+
+      // view/projection transformations
+      glm::mat4 projection = glm::perspective(glm::radians(camera.cam_zoom), static_cast<float>(panel_width) / static_cast<float>(panel_height), 0.1f, 100.0f);
+      glm::mat4 view = camera.get_view_matrix();
+
+      // textures that finished loading replace their placeholders in the scene
+      if (textures().update() > 0) scheduler.mark_scene_changed();
+
+      // the Scene image is wanted by its panel (unless collapsed, hidden or minimized) or by stream subscribers, the
+      // endoscope image by its panel; skip the pass when the last images are still current. A view coming back
+      // (or going) makes the pass due, as its last image may be stale.
+      const bool iconified = glfwGetWindowAttrib(window, GLFW_ICONIFIED);
+      const bool scene_wanted = (scene_panel_visible && !iconified) || (frame_streamer && frame_streamer->subscribed());
+      const bool endoscope_wanted = endoscope_view && endoscope_panel_visible && !iconified;
+      if (views[0].active != scene_wanted || (endoscope_view && views[1].active != endoscope_wanted)) scheduler.mark_scene_changed();
+      views[0].active = scene_wanted;
+      if (endoscope_view) views[1].active = endoscope_wanted;
+      const bool scene_pass = render_on_demand ? scheduler.need_scene_pass(view, projection, render_width, render_height, scene_wanted || endoscope_wanted) : true;
+#pragma endregion
 
-    fusion_data.set_ablation_count(0);
+#pragma region model do MVP
+      if (scene_pass) {
+        PROFILE_ZONE("scene pass");
+        // shared by all views: their matrices, culling for the union of what they see, the sorted draw queue
+        views[0].set(view, projection);
+        if (endoscope_view) views[1].set(node_view_matrix(scene.world(endoscope_node)), glm::perspective(glm::radians(endoscope_fov_degrees), static_cast<float>(endoscope_width) / static_cast<float>(endoscope_height), endoscope_near, 100.0f));
+        const CullViews cull_views = active_cull_views(views);
+        view_uniforms.upload(views);
+
+        if (occlusion_culling) {
+          PROFILE_ZONE("occlusion culling");
+          // occluders are rasterized from the Scene view; the other views keep whatever is in their frustum
+          const auto in_other_view = [&](const Aabb &box, const glm::mat4 &world) {
+            for (size_t v = 1; v < views.size(); ++v)
+              if (views[v].active && views[v].cull.frustum.intersects_box(box, world)) return true;
+            return false;
+          };
+          if (views[0].active) {
+            occlusion.begin(projection * view);
+            if (bone_ready) {
+              bone_occluders.submit(occlusion);
+            } else {
+              occlusion.add_occluder(lower_occluder, scene.world(lower_node));
+              occlusion.add_occluder(upper_occluder, scene.world(upper_node));
+            }
+            occlusion.rasterize();
+          }
+          for (CulledModel &culled : culled_models) {
+            culled.model->mesh_visible.resize(culled.bounds.size());
+            for (size_t i = 0; i < culled.bounds.size(); ++i) culled.model->mesh_visible[i] = (views[0].active && occlusion.visible(culled.bounds[i], scene.world(culled.node))) || in_other_view(culled.bounds[i], scene.world(culled.node));
+          }
+          if (bone_ready)
+            for (const uint32_t brick : bone_stream.drawn_bricks()) brick_visible[brick] = (views[0].active && occlusion.visible(bone_sdf.brick_bounds(brick))) || in_other_view(bone_sdf.brick_bounds(brick), glm::mat4(1.0f));
+        }
+        // back faces only go when the triangles are filled (the edge wireframe's underlay); polygon mode outlines them
+        if (meshlet_culling) {
+          PROFILE_ZONE("meshlet culling");
+          for (CulledModel &culled : culled_models) culled.model->cull_meshlets(scene.world(culled.node), cull_views, edge_wireframe);
+        }
 
-    fusion_data.mutable_haptic()->set_haptic_state(3);
-    fusion_data.mutable_haptic()->set_haptic_offset(-1);
-    fusion_data.mutable_haptic()->set_haptic_force(2);
+        // render the loaded models, placed by the scene graph
+        if (!animated_models.empty()) {
+          PROFILE_ZONE("animation");
+          for (const auto &animated : animated_models) {
+            AnimationControl control{0, 1.0f, std::clamp(fusion_data.offset().animation_value(), 0.0f, 1.0f)};
+            if (fusion_data.nerve_root_dance() > 0.0f && animated->clip_count() > 1) control = {1, 1.0f, -1.0f};
+            animated->update(control, jobs);
+          }
+        }
+        // one queue replayed by every view, skinned models last as they switch shaders
+        DrawQueue draw_queue;
+        draw_queue.reserve(culled_models.size());
+        for (const CulledModel &culled : culled_models) {
+          if (bone_ready && (culled.node == lower_node || culled.node == upper_node)) continue;// drawn from the bone volume
+          draw_queue.push_back({find_animated(*culled.model) ? 1u : 0u, culled.model, culled.node, scene.world(culled.node)});
+        }
+        sort_draw_queue(draw_queue);
+        queued_draws = draw_queue.size();
+        for (const auto &implant : implants) implant->update(scene.world(anatomy_node), cull_views);
 
-    fusion_data.set_hemostasis_count(0);
-    fusion_data.set_hemostasis_index(0);
+        // one view into the bound framebuffer
+        const auto draw_view = [&](const size_t v) {
+          RenderView &render_view = views[v];
+          glClearColor(0.7137f, 0.7333f, 0.7686f, 1.0f);// rgb(182, 187, 196)
+          glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+          view_uniforms.use(v);
+          render_view.draws = 0;
+          if (edge_wireframe) {
+            wireframe.begin_underlay();
+            for (const DrawItem &item : draw_queue)
+              if (item.node != render_view.hidden_node) wireframe.underlay(*item.model, item.world);
+            if (bone_ready) {
+              wireframe.set_model(glm::mat4(1.0f));
+              if (occlusion_culling) bone_stream.draw(brick_visible);
+              else bone_stream.draw();
+            }
+            wireframe.end_underlay();
+          }
+          our_shader.use();
+          for (const DrawItem &item : draw_queue) {
+            if (item.node == render_view.hidden_node) continue;
+            draw_item(item);
+            ++render_view.draws;
+          }
+          if (bone_ready) {
+            our_shader.setMat4("model", glm::mat4(1.0f));
+            if (edge_wireframe) {
+              if (occlusion_culling) bone_stream.draw_edges(brick_visible);
+              else bone_stream.draw_edges();
+              wireframe.count_edges(bone_stream.last_edge_lines(), bone_stream.last_triangle_edges());
+            } else {
+              glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+              if (occlusion_culling) bone_stream.draw(brick_visible);
+              else bone_stream.draw();
+              glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+            }
+          }
+          if (!tissue_lines.empty()) {
+            our_shader.setMat4("model", glm::mat4(1.0f));
+            tissue_mesh.Draw(our_shader);
+          }
+          if (!implants.empty()) {
+            instanced_shader.use();
+            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+            for (const auto &implant : implants) implant->Draw(instanced_shader);
+            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+            our_shader.use();
+          }
+        };
 
-    fusion_data.mutable_soft_tissue()->set_liga_flavum(1);
-    fusion_data.mutable_soft_tissue()->set_disc_yellow_space(1);
-    fusion_data.mutable_soft_tissue()->set_veutro_vessel(1);
-    fusion_data.mutable_soft_tissue()->set_fat(1);
-    fusion_data.mutable_soft_tissue()->set_fibrous_rings(1);
-    fusion_data.mutable_soft_tissue()->set_nucleus_pulposus(1);
-    fusion_data.mutable_soft_tissue()->set_p_longitudinal_liga(1);
-    fusion_data.mutable_soft_tissue()->set_dura_mater(1);
-    fusion_data.mutable_soft_tissue()->set_nerve_root(1);
+        // the frame's passes; a view nobody looks at is not exported, so the graph drops its pass
+        graph.begin_frame();
+        const RenderGraph::Resource scene_color = graph.create("scene color", k_format_color, render_width, render_height);
+        const RenderGraph::Resource scene_depth = graph.create("scene depth", k_format_depth, render_width, render_height);
+        graph.add_pass("scene view", {}, {scene_color, scene_depth}, [&] {
+          PROFILE_ZONE("scene view");
+          PROFILE_GPU_ZONE("scene view");
+          if (dynamic_resolution) resolution.begin_pass();
+          draw_view(0);
+          if (dynamic_resolution) resolution.end_pass();
+        });
+        views[0].width = render_width;
+        views[0].height = render_height;
+        scene_image = scene_color;
+        if (render_width < panel_width || render_height < panel_height) {
+          scene_image = graph.create("scene upscaled", k_format_color, panel_width, panel_height);
+          graph.add_pass("upscale", {scene_color}, {scene_image}, [&, scene_color] {
+            PROFILE_GPU_ZONE("upscale");
+            upscale.draw(graph.image(scene_color), resolution_sharpness);
+          });
+        }
+        if (views[0].active) graph.export_image(scene_image);
+        if (endoscope_view) {
+          endoscope_image = graph.create("endoscope color", k_format_color, endoscope_width, endoscope_height);
+          const RenderGraph::Resource endoscope_depth = graph.create("endoscope depth", k_format_depth, endoscope_width, endoscope_height);
+          graph.add_pass("endoscope view", {}, {endoscope_image, endoscope_depth}, [&] {
+            PROFILE_ZONE("endoscope view");
+            PROFILE_GPU_ZONE("endoscope view");
+            draw_view(1);
+          });
+          views[1].width = endoscope_width;
+          views[1].height = endoscope_height;
+          if (views[1].active) graph.export_image(endoscope_image);
+        }
+        graph.execute();
+        if (graph.layout_changed()) std::cout << graph.report();
+      }
+      if (frame_streamer) {
+        PROFILE_ZONE("frame stream");
+        if (graph.produced(scene_image)) {
+          const RenderImage streamed = graph.image(scene_image);
+          frame_streamer->capture(graph.framebuffer(scene_image), streamed.width, streamed.height, scene_pass, loop_time);
+        }
+        frame_streamer->poll();
+      }
+#pragma endregion
+
+#pragma region ImGui
+      // input queued by the GLFW backend (any viewport) or a damaged window means the UI has to react
+      if (window_damaged || ImGui::GetCurrentContext()->InputEventsQueue.Size > 0) scheduler.mark_input(loop_time);
+      window_damaged = false;
+      const bool ui_frame = render_on_demand ? scheduler.need_ui_frame(loop_time, scene_pass) : true;
+      if (ui_frame) {
+        PROFILE_ZONE("imgui");
+        ImGui_ImplOpenGL3_NewFrame();
+        ImGui_ImplGlfw_NewFrame();
+        ImGui::NewFrame();
+        ImGui::DockSpaceOverViewport();
 
-    fusion_data.set_nerve_root_dance(0);
+        draw_gui();
+        draw_haptic_servo_stats(haptic_servo.stats());
+        if (simulate_tissue) draw_tissue_stats(tissue_solver.stats(), tissue_solver.tissue_state());
+        if (occlusion_culling) draw_occlusion_stats(occlusion.stats());
+        if (edge_wireframe) draw_wireframe_stats(wireframe.last_stats());
+        if (meshlet_culling) {
+          size_t drawn = 0, total = 0;
+          for (const CulledModel &culled : culled_models) {
+            drawn += culled.model->meshlets_drawn();
+            total += culled.model->meshlet_count();
+          }
+          draw_meshlet_stats(drawn, total);
+        }
+        if (bone_ready) draw_bone_removal_stats(bone_edit, bone_mesh, bone_sdf.brick_count(), bone_sdf.memory_bytes(), bone_stream.buffer_bytes());
 
-    fusion_data.mutable_rongeur_pos()->set_x(dis_0_10(gen));
-    fusion_data.mutable_rongeur_pos()->set_y(dis_0_10(gen));
-    fusion_data.mutable_rongeur_pos()->set_z(dis_0_10(gen));
+        if (render_on_demand) draw_frame_scheduler_stats(scheduler.stats());
+        if (frame_streamer) draw_frame_stream_stats(frame_streamer->stats());
+        if (endoscope_view) draw_render_view_stats(views, queued_draws);
+        if (dynamic_resolution) draw_resolution_stats(panel_width, panel_height, render_width, render_height, resolution.gpu_ms(), graph.stats().allocations);
+        draw_render_graph_stats(graph.stats());
+        draw_frame_arena_stats(frame_arena().stats());
+        draw_memory_browser(resources());
+        draw_texture_cache_stats(textures().stats());
+#if PROFILE_ENABLED
+        draw_profiler(profiler());
+#endif
+#if ALLOC_TRACKING
+        draw_alloc_stats(alloc_tracker());
+#endif
+#if TRACE_ENABLED
+        if (draw_trace_controls(trace_stats(), trace_written_path, trace_written)) {
+          trace_written_path = trace_dump_path;
+          trace_written = write_trace(trace_dump_path);
+        }
+#endif
+
+        scene_panel_visible = ImGui::Begin("Scene");
+        // the shown target's used corner, stretched over the content region; its size drives the next frame
+        const RenderImage shown = graph.image(scene_image);
+        const ImVec2 region = ImGui::GetContentRegionAvail();
+        ImGui::Image(reinterpret_cast<void *>(static_cast<intptr_t>(shown.texture)), region, ImVec2{0, shown.uv_extent.y}, ImVec2{shown.uv_extent.x, 0});// NOLINT(performance-no-int-to-ptr)
+        if (scene_panel_visible) {
+          panel_width = std::max(1, static_cast<int>(region.x * io.DisplayFramebufferScale.x));
+          panel_height = std::max(1, static_cast<int>(region.y * io.DisplayFramebufferScale.y));
+        }
+        ImGui::End();
+
+        if (endoscope_view) {
+          endoscope_panel_visible = ImGui::Begin("Endoscope");
+          const RenderImage endoscope = graph.image(endoscope_image);
+          const ImVec2 endoscope_region = ImGui::GetContentRegionAvail();
+          ImGui::Image(reinterpret_cast<void *>(static_cast<intptr_t>(endoscope.texture)), endoscope_region, ImVec2{0, endoscope.uv_extent.y}, ImVec2{endoscope.uv_extent.x, 0});// NOLINT(performance-no-int-to-ptr)
+          if (endoscope_panel_visible) {
+            const int width = std::max(1, static_cast<int>(endoscope_region.x * io.DisplayFramebufferScale.x));
+            const int height = std::max(1, static_cast<int>(endoscope_region.y * io.DisplayFramebufferScale.y));
+            // the scheduler only watches the Scene view's size
+            if (width != endoscope_width || height != endoscope_height) scheduler.mark_scene_changed();
+            endoscope_width = width;
+            endoscope_height = height;
+          }
+          ImGui::End();
+        }
+
+        ImGui::Render();
+        PROFILE_GPU_ZONE("imgui");
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+      }
 
-    fusion_data.mutable_rongeur_rot()->set_x(dis_330_360(gen));
-    fusion_data.mutable_rongeur_rot()->set_y(dis_10_15(gen));
-    fusion_data.mutable_rongeur_rot()->set_z(dis_10_15(gen));
 #pragma endregion
-    const int data_size = fusion_data.ByteSizeLong();  // NOLINT(clang-diagnostic-shorten-64-to-32, bugprone-narrowing-conversions, cppcoreguidelines-narrowing-conversions)
-    auto data = std::make_unique<uint8_t[]>(data_size);// NOLINT(clang-diagnostic-shadow)
-    fusion_data.SerializePartialToArray(data.get(), data_size);
 
-    const int code = publisher.Send(data.get(), data_size);// NOLINT(clang-diagnostic-shorten-64-to-32, bugprone-narrowing-conversions, cppcoreguidelines-narrowing-conversions)
-    if (code != data_size) { std::cout << "failure\n"; }
+
+      #pragma region mutable_ set_
+      workload.generate(workload.sample_index(current_frame), 1, workload_sample);
+      apply_workload_sample(workload_sample, 0, fusion_data);
+
+      // hand the poses to the scene graph; nodes whose pose did not change keep their matrices
+      const auto to_vec3 = [](const auto &v) { return glm::vec3(v.x(), v.y(), v.z()); };
+      scene.set_euler(endoscope_node, to_vec3(fusion_data.endoscope_pos()), to_vec3(fusion_data.endoscope_euler()));
+      scene.set_euler(tube_node, to_vec3(fusion_data.tube_pos()), to_vec3(fusion_data.tube_euler()));
+      scene.set_euler(rongeur_node, to_vec3(fusion_data.rongeur_pos()), to_vec3(fusion_data.rongeur_rot()));
+      scene.update();
+      // animated models pose themselves in the 3D pass, so they always need one
+      if (!scene.changed().empty() || !animated_models.empty()) scheduler.mark_scene_changed();
+
+      // instruments vs vertebrae: deepest capsule contact per shaft; if a shaft moved through bone since the last
+      // frame the sweep catches it and the untraveled part of the motion becomes the depth. The servo renders the
+      // deepest contact over all shafts
+      instrument_capsules.clear();
+      {
+        PROFILE_ZONE("instrument contact");
+        const int instrument_nodes[3] = {tube_node, endoscope_node, rongeur_node};
+        HapticContact contact{0.0f, glm::vec3(0.0f, 1.0f, 0.0f), bone_stiffness, HapticServo::now_seconds()};
+        const auto deepen = [&contact](const float depth, const glm::vec3 &normal) {
+          if (depth <= contact.depth) return;
+          contact.depth = depth;
+          contact.normal = normal;
+        };
+        for (int i = 0; i < 3; ++i) {
+          const Capsule &shaft = instrument_shafts[i];
+          if (shaft.radius <= 0.0f) continue;
+          const glm::mat4 &world = scene.world(instrument_nodes[i]);
+          const Capsule capsule{glm::vec3(world * glm::vec4(shaft.a, 1.0f)), glm::vec3(world * glm::vec4(shaft.b, 1.0f)), shaft.radius};
+          instrument_capsules.push_back(capsule);
+          if (bone_ready) {
+            // the cut bone, not the original meshes
+            const ContactResult hit = bone_sdf.capsule_contact(capsule);
+            if (hit.hit) deepen(hit.depth, hit.normal);
+          } else {
+            // this shaft's own depth decides whether it needs the sweep, not another shaft's
+            float depth = 0.0f;
+            for (const BvhInstance &instance : anatomy) {
+              const ContactResult hit = instance.capsule(capsule);
+              if (hit.hit && hit.depth > depth) {
+                depth = hit.depth;
+                deepen(depth, hit.normal);
+              }
+              if (depth > 0.0f || !have_last_instrument_capsules) continue;
+              const glm::vec3 motion = capsule.a - last_instrument_capsules[i].a;
+              const ContactResult swept = instance.sweep(last_instrument_capsules[i], motion);
+              if (swept.hit && swept.time < 1.0f) deepen((1.0f - swept.time) * glm::length(motion), swept.normal);
+            }
+          }
+          last_instrument_capsules[i] = capsule;
+        }
+        have_last_instrument_capsules = true;
+        haptic_servo.contact.store(contact);
+
+        // every new ablation burns a ball at the tube end nearer the bone
+        if (bone_ready && instrument_shafts[0].radius > 0.0f && fusion_data.ablation_count() > last_ablation_count) {
+          const Capsule &tube_capsule = last_instrument_capsules[0];
+          const glm::vec3 tip = bone_sdf.distance(tube_capsule.a) < bone_sdf.distance(tube_capsule.b) ? tube_capsule.a : tube_capsule.b;
+          bone_edit = bone_sdf.subtract_sphere(tip, ablation_radius);
+        }
+      }
+      last_ablation_count = fusion_data.ablation_count();
+
+      // the bake finished: upload the bone and switch drawing, culling and contacts over to it
+      if (remove_bone && !bone_ready && bone_baked.load(std::memory_order_acquire)) {
+        bone_bake.join();
+        bone_stream.rebuild(bone_sdf);
+        bone_occluders.rebuild(bone_sdf);
+        brick_visible.assign(bone_sdf.grid_size(), 1);
+        bone_ready = true;
+        scheduler.mark_scene_changed();
+      }
+      // the rongeur bites once each time its tip enters bone: a jaw sized capsule along its local -z
+      if (bone_ready) {
+        PROFILE_ZONE("bone removal");
+        const glm::mat4 &rongeur_world = scene.world(rongeur_node);
+        const glm::vec3 rongeur_tip = glm::vec3(rongeur_world[3]);
+        const glm::vec3 jaw = -glm::vec3(rongeur_world[2]);
+        const bool in_bone = bone_sdf.distance(rongeur_tip) < 0.0f;
+        if (in_bone && !rongeur_in_bone) bone_edit = bone_sdf.subtract_capsule({rongeur_tip, rongeur_tip + jaw * rongeur_jaw_length, rongeur_jaw_radius});
+        rongeur_in_bone = in_bone;
+        // only the bricks the cuts touched are meshed and uploaded
+        bone_mesh = bone_sdf.remesh();
+        bone_stream.update(bone_sdf);
+        if (occlusion_culling) bone_occluders.update(bone_sdf);
+        if (!bone_sdf.changed_bricks().empty()) scheduler.mark_scene_changed();
+      }
+
+      // soft tissue pushed by the instruments; its state replaces the workload's tissue values
+      if (simulate_tissue && tissue_solver.particle_count() > 0) {
+        PROFILE_ZONE("soft tissue");
+        tissue_solver.set_colliders(instrument_capsules);
+        tissue_solver.step();
+        apply_tissue_state(tissue_solver.tissue_state(), fusion_data);
+        tissue_solver.write_positions(tissue_positions);
+        tissue_mesh.update_positions(tissue_positions, 1e-5f);
+        if (tissue_solver.topology_version() != tissue_topology) {
+          tissue_solver.write_line_indices(tissue_lines);
+          tissue_mesh.set_indices(tissue_lines);
+          tissue_topology = tissue_solver.topology_version();
+          scheduler.mark_scene_changed();
+        }
+        tissue_mesh.recompute_normals(jobs);
+        tissue_mesh.upload();
+        if (tissue_mesh.stats().dirty_vertices > 0) scheduler.mark_scene_changed();
+      }
+      HapticOutput haptic_output;
+      if (haptic_servo.output.load(haptic_output)) {
+        fusion_data.mutable_haptic()->set_haptic_state(haptic_output.state);
+        fusion_data.mutable_haptic()->set_haptic_offset(haptic_output.offset);
+        fusion_data.mutable_haptic()->set_haptic_force(haptic_output.force);
+      }
+#pragma endregion
+      {
+        PROFILE_ZONE("publish");
+        if (!publisher.publish(fusion_data)) { std::cout << "failure\n"; }
+      }
+      scheduler.published(loop_time);
 
 #pragma region end
-    if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable) {
-      GLFWwindow *backup_current_context = glfwGetCurrentContext();
-      ImGui::UpdatePlatformWindows();
-      ImGui::RenderPlatformWindowsDefault();
-      glfwMakeContextCurrent(backup_current_context);
-    }
+      if (ui_frame) {
+        if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable) {
+          PROFILE_ZONE("platform windows");
+          GLFWwindow *backup_current_context = glfwGetCurrentContext();
+          ImGui::UpdatePlatformWindows();
+          ImGui::RenderPlatformWindowsDefault();
+          glfwMakeContextCurrent(backup_current_context);
+        }
 
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+        {
+          PROFILE_ZONE("swap");
+          glfwSwapBuffers(window);
+        }
+        PROFILE_ZONE("poll events");
+        glfwPollEvents();
+      } else {
+        // nothing presented, so no vsync to pace the loop: sleep until an event or the next publish is due
+        PROFILE_ZONE("idle wait");
+        glfwWaitEventsTimeout(scheduler.idle_timeout(glfwGetTime()));
+      }
+      PROFILE_END_FRAME();
+      frame_arena().reset();
+      textures().trim(texture_cache_keep_mb << 20);
+#if TRACE_ENABLED
+      if (++trace_frame == trace_startup_frames) {
+        trace_written_path = trace_startup_path;
+        trace_written = write_trace(trace_startup_path);
+      }
+#endif
+#if ALLOC_TRACKING
+      alloc_tracker().end_frame();
+      const AllocCount &allocated = alloc_tracker().last_frame();
+      if (alloc_tracker().frame_count() > alloc_steady_frames && allocated.allocations && alloc_reported++ < alloc_reports) {
+        const std::vector<AllocSiteStats> &sites = alloc_tracker().last_frame_sites();
+        std::cout << "ERROR::ALLOC::FRAME_ALLOCATED frame " << alloc_tracker().frame_count() << ": " << allocated.allocations << " allocations, " << allocated.bytes << " bytes, most in " << (sites.empty() ? "?" : sites.front().site) << std::endl;
+      }
+#endif
 #pragma endregion
+    }
+    workload_driver.reset();
+    frame_streamer.reset();
+    haptic_servo.stop();
+    // a bake still running writes into bone_sdf
+    if (bone_bake.joinable()) bone_bake.join();
   }
+  textures().stop();
+  PROFILE_RELEASE_GPU();
   glfwTerminate();
   eCAL::Finalize();
   return 0;
@@ -334,6 +1017,7 @@ void framebuffer_size_callback(GLFWwindow *window, const int width, const int he
   // make sure the viewport matches the new window dimensions; note that width and
   // height will be significantly larger than specified on retina displays.
   glViewport(0, 0, width, height);
+  window_damaged = true;
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -359,4 +1043,7 @@ void mouse_callback(GLFWwindow *window, const double x_pos_in, const double y_po
 
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
 void scroll_callback(GLFWwindow *window, double x_offset, const double y_offset) { camera.process_mouse_scroll(static_cast<float>(y_offset)); }
+
+// glfw: the window's contents were damaged (uncovered, restored) and have to be presented again
+void window_refresh_callback(GLFWwindow *window) { window_damaged = true; }
 #pragma endregion